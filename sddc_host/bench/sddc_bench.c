@@ -0,0 +1,3435 @@
+/*
+ * Copyright (c) 2015-2021 ACOINFO Co., Ltd.
+ * All rights reserved.
+ *
+ * Detailed license information can be found in the LICENSE file.
+ *
+ * File: sddc_bench.c SDDC host packet-rate benchmark.
+ *
+ * Author: agent <agent@local>
+ *
+ */
+
+#define _GNU_SOURCE                     /* RTLD_NEXT, recvmmsg/sendmmsg */
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <semaphore.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sched.h>
+#include "sddc.h"
+
+#if SDDC_CFG_SECURITY_EN > 0
+#include <mbedtls/md.h>
+#include <mbedtls/cipher.h>
+#endif
+
+#ifndef BENCH_OPENSSL_EN
+#define BENCH_OPENSSL_EN        0
+#endif
+
+#if BENCH_OPENSSL_EN > 0
+#include "sddc_crypto_openssl.h"
+#endif
+
+#ifndef BENCH_CJSON_EN
+#define BENCH_CJSON_EN          0
+#endif
+
+#if BENCH_CJSON_EN > 0
+#include "cJSON.h"
+#endif
+
+/* Bench defaults */
+#define BENCH_DEF_COUNT         20000U
+#define BENCH_ENGINE_PORT       (SDDC_CFG_PORT + 1)
+#define BENCH_TOKEN             "1234567890"
+#define BENCH_MESSAGE           "{\"cmd\":\"unlock\",\"timeout\":5000}"
+#define BENCH_BROADCAST_COUNT   100U
+#define BENCH_RECOVER_COUNT     20U
+#define BENCH_BURST             32U
+#define BENCH_WINDOW_COUNT      2000U
+#define BENCH_WINDOW_RETRIES    8U
+#define BENCH_SLOW_COUNT        2000U
+#define BENCH_SLOW_CB_US        1000U
+#define BENCH_FRAG_LEN          8192U
+#define BENCH_FRAG_COUNT        2000U
+#define BENCH_CONN_PORT         (SDDC_CFG_PORT + 2)
+#define BENCH_CONN_NUM          4U
+#define BENCH_CONN_SIZE         (128U * 1024U)
+#define BENCH_CONN_CHUNK        (SDDC_CFG_SEND_BUF_SIZE - 16)
+#define BENCH_CONN_CHUNKS       ((BENCH_CONN_SIZE + BENCH_CONN_CHUNK - 1) / BENCH_CONN_CHUNK)
+#define BENCH_CONN_BIG_SIZE     (1024U * 1024U)     /* One put */
+#define BENCH_CONN_SMALL_NUM    64U                 /* Doorbell snapshots */
+#define BENCH_CONN_SMALL_SIZE   (16U * 1024U)
+#define BENCH_SINK_MAX          BENCH_CONN_SMALL_NUM
+
+/* Header copy of sddc.c (wire format) */
+#define BENCH_MAGIC_VER         (0x5 | (0x1 << 4))
+
+#define BENCH_TYPE_DISCOVER     0x00
+#define BENCH_TYPE_REPORT       0x01
+#define BENCH_TYPE_UPDATE       0x02
+#define BENCH_TYPE_INVITE       0x03
+#define BENCH_TYPE_PING         0x04
+#define BENCH_TYPE_MESSAGE      0x05
+
+#define BENCH_FLAG_ACK          0x80
+#define BENCH_FLAG_REQ          0x40
+
+#define BENCH_SEC_FLAG_SUPPORT  0x80
+#define BENCH_SEC_FLAG_CRYPTO   0x40
+#define BENCH_SEC_FLAG_GCM_SUPPORT 0x02
+#define BENCH_SEC_FLAG_GCM      0x01
+
+/* AES-GCM payload of sddc.c: counter, ciphertext, tag */
+#if (SDDC_CFG_SECURITY_EN > 0) && (SDDC_CFG_GCM_EN > 0) && (SDDC_RANDOM_ENTROPY > 0)
+#define BENCH_GCM_EN            1
+#define BENCH_GCM_CTR_LEN       4
+#define BENCH_GCM_OVERHEAD      (BENCH_GCM_CTR_LEN + SDDC_CFG_GCM_TAG_LEN)
+#define BENCH_GCM_TAMPER_COUNT  16U
+#else
+#define BENCH_GCM_EN            0
+#endif
+
+/* AES micro benchmark modes */
+#define BENCH_AES_CBC_SETUP     0   /* Full cipher setup per packet, as __sddc_encrypt did */
+#define BENCH_AES_CBC           1   /* Persistent key schedule, fixed IV */
+#define BENCH_AES_GCM_SEAL      2   /* Persistent key schedule, per-packet nonce and tag */
+#define BENCH_AES_GCM_OPEN      3
+
+/* Crypto backend comparison, plaintext sizes */
+#define BENCH_BACKEND_SIZE_MAX  1400U
+
+typedef struct {
+    uint8_t             magic_ver;
+    uint8_t             flags_type;
+    uint16_t            seqno;
+    uint8_t             uid[SDDC_UID_LEN];
+    uint8_t             security;
+    uint8_t             reserved;
+    uint16_t            length;
+} bench_header_t;
+
+/* Simulated EdgerOS */
+typedef struct {
+    int                 fd;
+    struct sockaddr_in  engine_addr;
+    uint8_t             uid[SDDC_UID_LEN];
+    uint16_t            seqno;
+    sddc_bool_t         security_en;
+    sddc_bool_t         gcm;                /* Advertise GCM_SUPPORT, seal MESSAGE with GCM */
+#if BENCH_GCM_EN > 0
+    mbedtls_cipher_context_t gcm_seal_ctx;
+    mbedtls_cipher_context_t gcm_open_ctx;
+    uint32_t            gcm_counter;
+    uint32_t            gcm_opened;         /* Engine MESSAGE payloads authenticated */
+    uint32_t            gcm_bad;            /* Engine MESSAGE payloads failing the tag */
+#endif
+    volatile uint32_t   invites;            /* INVITE acks seen by the peer thread */
+    sddc_bool_t         drop_first;
+    uint16_t            drop_seqno;
+    uint32_t            loss_percent;       /* Each way, requests and acks */
+    unsigned int        loss_seed;
+    uint8_t             message[SDDC_CFG_SEND_BUF_SIZE];
+    size_t              message_len;
+    uint8_t             buf[SDDC_CFG_RECV_BUF_SIZE];
+} bench_peer_t;
+
+/* One result row */
+typedef struct {
+    const char         *name;
+    sddc_bool_t         security_en;
+    uint32_t            count;
+    double              seconds;
+    uint32_t           *lat_ns;
+    uint64_t            alloc_bytes;
+    uint64_t            alloc_calls;
+    uint64_t            sys_calls;
+    uint64_t            copy_bytes;
+} bench_result_t;
+
+static sddc_t          *bench_sddc;
+static pthread_t        bench_engine_tid;
+static bench_peer_t     bench_peer;
+static sem_t            bench_ack_sem;
+static volatile int     bench_peer_quit;
+
+/* Pipelined scenario, completion of each seqno by ack or lost */
+static sem_t            bench_ready_sem;
+static sem_t            bench_done_sem;
+static volatile int     bench_window_on;
+static volatile int     bench_slow_on;
+static int              bench_poll_loop;    /* Engine driven by sddc_process_* in place of sddc_run */
+static uint32_t         bench_rx_delivered;
+static volatile int     bench_rx_reject;    /* on_message rejects the MESSAGE */
+static uint32_t         bench_rx_updates;
+static uint8_t          bench_window_done[65536];
+static uint32_t         bench_window_completed;
+static uint32_t         bench_window_lost;
+static uint32_t         bench_window_total;
+
+/*
+ * Allocation accounting, interposed on the libc allocator so mbedtls is counted too
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+static volatile int     bench_alloc_on;
+static uint64_t         bench_alloc_bytes;
+static uint64_t         bench_alloc_calls;
+
+static inline void bench_alloc_account(size_t size)
+{
+    if (bench_alloc_on) {
+        __atomic_fetch_add(&bench_alloc_bytes, size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&bench_alloc_calls, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void *malloc(size_t size)
+{
+    bench_alloc_account(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    bench_alloc_account(nmemb * size);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    bench_alloc_account(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+/*
+ * Syscall accounting of the engine socket I/O, the simulated EdgerOS socket is not counted
+ */
+static uint64_t         bench_sys_calls;
+
+#define BENCH_SYS_REAL(name)    \
+        static __typeof__(name) *real; if (real == NULL) { real = dlsym(RTLD_NEXT, #name); }
+
+static inline void bench_sys_account(int fd)
+{
+    if (bench_alloc_on && (fd != bench_peer.fd)) {
+        __atomic_fetch_add(&bench_sys_calls, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    BENCH_SYS_REAL(select);
+    bench_sys_account(-1);
+    return real(nfds, readfds, writefds, exceptfds, timeout);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+    BENCH_SYS_REAL(recv);
+    bench_sys_account(fd);
+    return real(fd, buf, len, flags);
+}
+
+ssize_t recvfrom(int fd, void *buf, size_t len, int flags, __SOCKADDR_ARG addr, socklen_t *addrlen)
+{
+    BENCH_SYS_REAL(recvfrom);
+    bench_sys_account(fd);
+    return real(fd, buf, len, flags, addr, addrlen);
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+    BENCH_SYS_REAL(send);
+    bench_sys_account(fd);
+    return real(fd, buf, len, flags);
+}
+
+ssize_t sendto(int fd, const void *buf, size_t len, int flags, __CONST_SOCKADDR_ARG addr, socklen_t addrlen)
+{
+    BENCH_SYS_REAL(sendto);
+    bench_sys_account(fd);
+    return real(fd, buf, len, flags, addr, addrlen);
+}
+
+int recvmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout)
+{
+    BENCH_SYS_REAL(recvmmsg);
+    bench_sys_account(fd);
+    return real(fd, msgvec, vlen, flags, timeout);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr *msg, int flags)
+{
+    BENCH_SYS_REAL(sendmsg);
+    bench_sys_account(fd);
+    return real(fd, msg, flags);
+}
+
+int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+    BENCH_SYS_REAL(sendmmsg);
+    bench_sys_account(fd);
+    return real(fd, msgvec, vlen, flags);
+}
+
+int connect(int fd, __CONST_SOCKADDR_ARG addr, socklen_t addrlen)
+{
+    BENCH_SYS_REAL(connect);
+    bench_sys_account(fd);
+    return real(fd, addr, addrlen);
+}
+
+#if SDDC_CFG_SECURITY_EN > 0
+/*
+ * Token key derivation accounting: MD5 passes and AES key expansions
+ */
+static uint64_t         bench_md_calls;
+static uint64_t         bench_setkey_calls;
+
+int mbedtls_md_starts(mbedtls_md_context_t *ctx)
+{
+    BENCH_SYS_REAL(mbedtls_md_starts);
+    if (bench_alloc_on) {
+        __atomic_fetch_add(&bench_md_calls, 1, __ATOMIC_RELAXED);
+    }
+    return real(ctx);
+}
+
+int mbedtls_cipher_setkey(mbedtls_cipher_context_t *ctx, const unsigned char *key, int key_bitlen,
+                          const mbedtls_operation_t operation)
+{
+    BENCH_SYS_REAL(mbedtls_cipher_setkey);
+    if (bench_alloc_on) {
+        __atomic_fetch_add(&bench_setkey_calls, 1, __ATOMIC_RELAXED);
+    }
+    return real(ctx, key, key_bitlen, operation);
+}
+#endif
+
+/*
+ * Payload bytes copied by the engine transmit path (sddc_get_stats)
+ */
+static uint32_t         bench_copy_bytes;
+
+static void bench_count_start(void)
+{
+#if SDDC_CFG_STATS_EN > 0
+    sddc_stats_t stats;
+
+    bench_copy_bytes = 0;
+    if ((bench_sddc != NULL) && (sddc_get_stats(bench_sddc, &stats, NULL, 0) == 0)) {
+        bench_copy_bytes = stats.tx_copy_bytes;
+    }
+#endif
+
+    bench_alloc_bytes = 0;
+    bench_alloc_calls = 0;
+    bench_sys_calls   = 0;
+#if SDDC_CFG_SECURITY_EN > 0
+    bench_md_calls     = 0;
+    bench_setkey_calls = 0;
+#endif
+    __atomic_store_n(&bench_alloc_on, 1, __ATOMIC_SEQ_CST);
+}
+
+static void bench_count_stop(bench_result_t *result)
+{
+#if SDDC_CFG_STATS_EN > 0
+    sddc_stats_t stats;
+#endif
+
+    __atomic_store_n(&bench_alloc_on, 0, __ATOMIC_SEQ_CST);
+    result->alloc_bytes = bench_alloc_bytes;
+    result->alloc_calls = bench_alloc_calls;
+    result->sys_calls   = bench_sys_calls;
+
+    result->copy_bytes = 0;
+#if SDDC_CFG_STATS_EN > 0
+    if ((bench_sddc != NULL) && (sddc_get_stats(bench_sddc, &stats, NULL, 0) == 0)) {
+        result->copy_bytes = (uint32_t)(stats.tx_copy_bytes - bench_copy_bytes);
+    }
+#endif
+}
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* CPU cycles where the counter is readable from user space, else nanoseconds */
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_CYCLES_UNIT       "cycles"
+#define bench_cycles()          __builtin_ia32_rdtsc()
+#else
+#define BENCH_CYCLES_UNIT       "ns"
+#define bench_cycles()          bench_now_ns()
+#endif
+
+#if SDDC_CFG_SECURITY_EN > 0
+/*
+ * EdgerOS side of the token key, same derivation as __sddc_gen_key
+ */
+static void bench_gen_key(uint8_t *key, uint8_t *iv)
+{
+    mbedtls_md_context_t      md;
+    size_t                    token_len = strlen(BENCH_TOKEN);
+
+    mbedtls_md_init(&md);
+    mbedtls_md_setup(&md, mbedtls_md_info_from_string("MD5"), 0);
+    mbedtls_md_starts(&md);
+    mbedtls_md_update(&md, (const uint8_t *)BENCH_TOKEN, token_len);
+    mbedtls_md_finish(&md, key);
+    mbedtls_md_starts(&md);
+    mbedtls_md_update(&md, key, 16);
+    mbedtls_md_update(&md, (const uint8_t *)BENCH_TOKEN, token_len);
+    mbedtls_md_finish(&md, iv);
+    mbedtls_md_free(&md);
+}
+
+/*
+ * EdgerOS side of the token crypto, AES-128-CBC with the fixed IV
+ */
+static int bench_encrypt(const void *data, size_t len, uint8_t *output, size_t *olen)
+{
+    mbedtls_cipher_context_t  cipher;
+    uint8_t                   key[16];
+    uint8_t                   iv[16];
+    int                       ret;
+
+    bench_gen_key(key, iv);
+
+    mbedtls_cipher_init(&cipher);
+    mbedtls_cipher_setup(&cipher, mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CBC));
+    mbedtls_cipher_setkey(&cipher, key, 128, MBEDTLS_ENCRYPT);
+    ret = mbedtls_cipher_crypt(&cipher, iv, sizeof(iv), data, len, output, olen);
+    mbedtls_cipher_free(&cipher);
+
+    return ret;
+}
+
+#if BENCH_GCM_EN > 0
+/*
+ * EdgerOS side of the AES-GCM payload, same layout as __sddc_seal
+ */
+static int bench_gcm_setup(mbedtls_cipher_context_t *ctx)
+{
+    uint8_t key[16];
+    uint8_t iv[16];
+
+    bench_gen_key(key, iv);
+
+    mbedtls_cipher_init(ctx);
+    if ((mbedtls_cipher_setup(ctx, mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_GCM)) != 0) ||
+        (mbedtls_cipher_setkey(ctx, key, 128, MBEDTLS_ENCRYPT) != 0)) {
+        mbedtls_cipher_free(ctx);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void bench_gcm_iv(uint8_t *nonce, uint8_t *aad, const uint8_t *uid, const uint8_t *counter,
+                         uint8_t type, uint8_t frag, uint16_t seqno)
+{
+    memcpy(nonce, uid, SDDC_UID_LEN);
+    memcpy(nonce + SDDC_UID_LEN, counter, BENCH_GCM_CTR_LEN);
+
+    aad[0] = type;
+    aad[1] = frag;
+    aad[2] = seqno >> 8;
+    aad[3] = seqno;
+}
+
+static int bench_seal(mbedtls_cipher_context_t *ctx, const uint8_t *uid, uint32_t counter,
+                      uint8_t type, uint8_t frag, uint16_t seqno,
+                      const void *data, size_t len, uint8_t *output, size_t *olen)
+{
+    uint8_t nonce[SDDC_UID_LEN + BENCH_GCM_CTR_LEN];
+    uint8_t aad[4];
+    int     ret;
+
+    output[0] = counter >> 24;
+    output[1] = counter >> 16;
+    output[2] = counter >> 8;
+    output[3] = counter;
+
+    bench_gcm_iv(nonce, aad, uid, output, type, frag, seqno);
+
+    ret = mbedtls_cipher_auth_encrypt(ctx, nonce, sizeof(nonce), aad, sizeof(aad), data, len,
+                                      output + BENCH_GCM_CTR_LEN, olen,
+                                      output + BENCH_GCM_CTR_LEN + len, SDDC_CFG_GCM_TAG_LEN);
+    *olen += BENCH_GCM_OVERHEAD;
+
+    return ret;
+}
+
+/*
+ * Open the payload of a received packet, the header is in network byte order
+ */
+static int bench_open(mbedtls_cipher_context_t *ctx, const bench_header_t *header,
+                      const uint8_t *data, size_t len, uint8_t *output, size_t *olen)
+{
+    uint8_t nonce[SDDC_UID_LEN + BENCH_GCM_CTR_LEN];
+    uint8_t aad[4];
+
+    if (len < BENCH_GCM_OVERHEAD) {
+        return -1;
+    }
+    len -= BENCH_GCM_OVERHEAD;
+
+    bench_gcm_iv(nonce, aad, header->uid, data, header->flags_type & 0x0f, header->reserved, ntohs(header->seqno));
+
+    return mbedtls_cipher_auth_decrypt(ctx, nonce, sizeof(nonce), aad, sizeof(aad),
+                                       data + BENCH_GCM_CTR_LEN, len, output, olen,
+                                       data + BENCH_GCM_CTR_LEN + len, SDDC_CFG_GCM_TAG_LEN);
+}
+#endif
+
+/*
+ * Per-packet AES cost of BENCH_MESSAGE, mode: BENCH_AES_*. cycles: total CPU cycles
+ */
+static int bench_crypto(bench_result_t *result, int mode, uint64_t *cycles)
+{
+    mbedtls_cipher_context_t  cipher;
+    const mbedtls_cipher_info_t *info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CBC);
+    static const uint8_t      key[16] = { 0 };
+    static const uint8_t      iv[16]  = { 0 };
+    uint8_t                   output[sizeof(BENCH_MESSAGE) + 16];
+    size_t                    olen;
+    uint64_t                  begin, start, cycle;
+    uint32_t                  i;
+    int                       ret = 0;
+#if BENCH_GCM_EN > 0
+    static const uint8_t      uid[SDDC_UID_LEN] = { 0 };
+    uint8_t                   sealed[sizeof(BENCH_MESSAGE) + BENCH_GCM_OVERHEAD];
+    size_t                    sealed_len;
+    bench_header_t            header;
+#endif
+
+    if (mode == BENCH_AES_CBC) {
+        mbedtls_cipher_init(&cipher);
+        mbedtls_cipher_setup(&cipher, info);
+        mbedtls_cipher_setkey(&cipher, key, 128, MBEDTLS_ENCRYPT);
+    }
+
+#if BENCH_GCM_EN > 0
+    if ((mode == BENCH_AES_GCM_SEAL) || (mode == BENCH_AES_GCM_OPEN)) {
+        sddc_return_value_if_fail(bench_gcm_setup(&cipher) == 0, -1);
+    }
+
+    if (mode == BENCH_AES_GCM_OPEN) {
+        memset(&header, 0, sizeof(header));
+        header.flags_type = BENCH_TYPE_MESSAGE;
+        bench_seal(&cipher, uid, 0, BENCH_TYPE_MESSAGE, 0, 0,
+                   BENCH_MESSAGE, sizeof(BENCH_MESSAGE) - 1, sealed, &sealed_len);
+    }
+#endif
+
+    *cycles = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        cycle = bench_cycles();
+
+        switch (mode) {
+
+        case BENCH_AES_CBC_SETUP:
+            mbedtls_cipher_init(&cipher);
+            mbedtls_cipher_setup(&cipher, info);
+            mbedtls_cipher_setkey(&cipher, key, 128, MBEDTLS_ENCRYPT);
+            ret |= mbedtls_cipher_crypt(&cipher, iv, sizeof(iv), BENCH_MESSAGE, sizeof(BENCH_MESSAGE) - 1,
+                                        output, &olen);
+            mbedtls_cipher_free(&cipher);
+            break;
+
+        case BENCH_AES_CBC:
+            ret |= mbedtls_cipher_crypt(&cipher, iv, sizeof(iv), BENCH_MESSAGE, sizeof(BENCH_MESSAGE) - 1,
+                                        output, &olen);
+            break;
+
+#if BENCH_GCM_EN > 0
+        case BENCH_AES_GCM_SEAL:
+            ret |= bench_seal(&cipher, uid, i, BENCH_TYPE_MESSAGE, 0, (uint16_t)i,
+                              BENCH_MESSAGE, sizeof(BENCH_MESSAGE) - 1, sealed, &sealed_len);
+            break;
+
+        case BENCH_AES_GCM_OPEN:
+            ret |= bench_open(&cipher, &header, sealed, sealed_len, output, &olen);
+            break;
+#endif
+        }
+
+        *cycles += bench_cycles() - cycle;
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    if (mode != BENCH_AES_CBC_SETUP) {
+        mbedtls_cipher_free(&cipher);
+    }
+
+    return ret;
+}
+
+/*
+ * Bytes on the wire of one encrypted datagram (header and payload) for a plaintext length
+ */
+static size_t bench_wire_cbc(size_t len)
+{
+    return sizeof(bench_header_t) + (len / 16 + 1) * 16;
+}
+
+#if BENCH_GCM_EN > 0
+static size_t bench_wire_gcm(size_t len)
+{
+    return sizeof(bench_header_t) + len + BENCH_GCM_OVERHEAD;
+}
+#endif
+#endif
+
+static size_t bench_build(bench_peer_t *peer, uint8_t *packet, uint8_t type, uint8_t flags, uint8_t security,
+                          uint16_t seqno, const void *payload, size_t payload_len)
+{
+    bench_header_t *header = (bench_header_t *)packet;
+
+    memset(header, 0, sizeof(bench_header_t));
+    header->magic_ver  = BENCH_MAGIC_VER;
+    header->flags_type = type | flags;
+    header->seqno      = htons(seqno);
+    header->security   = security | (peer->gcm ? BENCH_SEC_FLAG_GCM_SUPPORT : 0);
+    header->length     = htons(payload_len);
+    memcpy(header->uid, peer->uid, SDDC_UID_LEN);
+
+    if (payload_len > 0) {
+        memcpy(packet + sizeof(bench_header_t), payload, payload_len);
+    }
+
+    return sizeof(bench_header_t) + payload_len;
+}
+
+/*
+ * Prebuild the MESSAGE payload (ciphertext is fixed: fixed IV, fixed plaintext)
+ */
+static int bench_peer_payload(bench_peer_t *peer, const char *message)
+{
+    size_t len = strlen(message);
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (peer->security_en) {
+        return bench_encrypt(message, len, peer->message, &peer->message_len);
+    }
+#endif
+
+    memcpy(peer->message, message, len);
+    peer->message_len = len;
+
+    return 0;
+}
+
+/*
+ * Several simulated EdgerOS share the peer socket, only the UID differs
+ */
+static void bench_peer_set_uid(bench_peer_t *peer, uint32_t index)
+{
+    peer->uid[0] = 0x11;
+    peer->uid[1] = 0x22;
+    peer->uid[2] = 0x33;
+    peer->uid[3] = 0x44;
+    peer->uid[4] = index >> 24;
+    peer->uid[5] = index >> 16;
+    peer->uid[6] = index >> 8;
+    peer->uid[7] = index;
+}
+
+static int bench_peer_open(bench_peer_t *peer, sddc_bool_t security_en)
+{
+    struct sockaddr_in addr;
+    struct timeval     timeout = { 1, 0 };
+    int                reuse   = 1;
+
+    memset(peer, 0, sizeof(bench_peer_t));
+    bench_peer_set_uid(peer, 0);
+    peer->security_en = security_en;
+
+    peer->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sddc_return_value_if_fail(peer->fd >= 0, -1);
+
+    setsockopt(peer->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    setsockopt(peer->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(SDDC_CFG_PORT);
+
+    if (bind(peer->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        SDDC_LOG_ERR("Failed to bind peer port %u!\n", (unsigned)SDDC_CFG_PORT);
+        close(peer->fd);
+        return -1;
+    }
+
+    peer->engine_addr            = addr;
+    peer->engine_addr.sin_port   = htons(BENCH_ENGINE_PORT);
+
+    return bench_peer_payload(peer, BENCH_MESSAGE);
+}
+
+static int bench_peer_send(bench_peer_t *peer, const uint8_t *packet, size_t len)
+{
+    return sendto(peer->fd, packet, len, 0,
+                  (const struct sockaddr *)&peer->engine_addr, sizeof(peer->engine_addr)) == len ? 0 : -1;
+}
+
+/*
+ * Wait a packet with the specified type and flags
+ */
+static int bench_peer_wait(bench_peer_t *peer, uint8_t type, uint8_t flags, uint16_t *seqno)
+{
+    bench_header_t *header = (bench_header_t *)peer->buf;
+    ssize_t         len;
+
+    while (1) {
+        len = recv(peer->fd, peer->buf, sizeof(peer->buf), 0);
+        if (len < 0) {
+            return -1;
+        }
+
+        if ((len >= sizeof(bench_header_t)) &&
+            ((header->flags_type & 0x0f) == type) &&
+            ((header->flags_type & flags) == flags)) {
+            if (seqno != NULL) {
+                *seqno = ntohs(header->seqno);
+            }
+            return 0;
+        }
+    }
+}
+
+/*
+ * INVITE request, the engine takes the GCM mode of the session from it
+ */
+static int bench_peer_invite(bench_peer_t *peer)
+{
+    uint8_t packet[SDDC_CFG_SEND_BUF_SIZE];
+    size_t  len;
+
+    len = bench_build(peer, packet, BENCH_TYPE_INVITE, BENCH_FLAG_REQ,
+                      peer->security_en ? BENCH_SEC_FLAG_CRYPTO : 0,
+                      peer->seqno++, peer->message, peer->message_len);
+
+    return bench_peer_send(peer, packet, len);
+}
+
+static int bench_peer_join(bench_peer_t *peer)
+{
+    sddc_return_value_if_fail(bench_peer_invite(peer) == 0, -1);
+
+    return bench_peer_wait(peer, BENCH_TYPE_INVITE, BENCH_FLAG_ACK, NULL);
+}
+
+#if BENCH_GCM_EN > 0
+/*
+ * Join again while bench_peer_thread reads the peer socket
+ */
+static int bench_peer_rejoin(bench_peer_t *peer)
+{
+    uint32_t invites = peer->invites;
+    int      i;
+
+    sddc_return_value_if_fail(bench_peer_invite(peer) == 0, -1);
+
+    for (i = 0; (i < 1000) && (peer->invites == invites); i++) {
+        usleep(1000);
+    }
+
+    return (peer->invites != invites) ? 0 : -1;
+}
+#endif
+
+/*
+ * EdgerOS side for the transmit scenarios: count arrivals and ack requests
+ */
+static void *bench_peer_thread(void *arg)
+{
+    bench_peer_t   *peer   = arg;
+    bench_header_t *header = (bench_header_t *)peer->buf;
+    uint8_t         packet[sizeof(bench_header_t)];
+    ssize_t         len;
+
+    while (!bench_peer_quit) {
+        len = recv(peer->fd, peer->buf, sizeof(peer->buf), 0);
+        if (len < (ssize_t)sizeof(bench_header_t)) {
+            continue;
+        }
+
+        if ((header->flags_type & 0x0f) != BENCH_TYPE_MESSAGE) {
+            if (((header->flags_type & 0x0f) == BENCH_TYPE_INVITE) && (header->flags_type & BENCH_FLAG_ACK)) {
+                peer->invites++;
+            }
+            continue;
+        }
+
+#if BENCH_GCM_EN > 0
+        if (header->security & BENCH_SEC_FLAG_GCM) {
+            uint8_t plain[SDDC_CFG_RECV_BUF_SIZE];
+            size_t  plain_len;
+
+            if ((bench_open(&peer->gcm_open_ctx, header, peer->buf + sizeof(bench_header_t),
+                            len - sizeof(bench_header_t), plain, &plain_len) == 0) &&
+                (plain_len == sizeof(BENCH_MESSAGE) - 1) && (memcmp(plain, BENCH_MESSAGE, plain_len) == 0)) {
+                peer->gcm_opened++;
+            } else {
+                peer->gcm_bad++;
+            }
+        }
+#endif
+
+        if (header->flags_type & BENCH_FLAG_REQ) {
+            /*
+             * Lose the first transmission of every request
+             */
+            if (peer->drop_first && (peer->drop_seqno != ntohs(header->seqno))) {
+                peer->drop_seqno = ntohs(header->seqno);
+                continue;
+            }
+
+            /*
+             * Random loss of the request, then of the ack
+             */
+            if ((peer->loss_percent > 0) && ((uint32_t)(rand_r(&peer->loss_seed) % 100) < peer->loss_percent)) {
+                continue;
+            }
+
+            len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, 0,
+                              ntohs(header->seqno), NULL, 0);
+            ((bench_header_t *)packet)->reserved = header->reserved;    /* Fragment byte echo */
+
+            if ((peer->loss_percent > 0) && ((uint32_t)(rand_r(&peer->loss_seed) % 100) < peer->loss_percent)) {
+                continue;
+            }
+
+            bench_peer_send(peer, packet, len);
+        } else {
+            sem_post(&bench_ack_sem);
+        }
+    }
+
+    return NULL;
+}
+
+static sddc_bool_t bench_on_invite(sddc_t *sddc, const uint8_t *uid, const char *invite_data, size_t len)
+{
+    return SDDC_TRUE;
+}
+
+static sddc_bool_t bench_on_update(sddc_t *sddc, const uint8_t *uid, const char *update_data, size_t len)
+{
+    bench_rx_updates++;
+
+    return SDDC_TRUE;
+}
+
+static sddc_bool_t bench_on_message(sddc_t *sddc, const uint8_t *uid, const char *message, size_t len)
+{
+    if (bench_rx_reject) {
+        return SDDC_FALSE;
+    }
+
+    bench_rx_delivered++;
+
+    if (bench_slow_on) {
+        usleep(BENCH_SLOW_CB_US);
+    }
+
+    return SDDC_TRUE;
+}
+
+/*
+ * First ack or loss of a pipelined message, duplicate acks of retransmissions are ignored
+ */
+static void bench_window_complete(uint16_t seqno, sddc_bool_t lost)
+{
+    if (bench_window_done[seqno]) {
+        return;
+    }
+
+    bench_window_done[seqno] = 1;
+    bench_window_completed++;
+    if (lost) {
+        bench_window_lost++;
+    }
+
+    if (bench_window_completed == bench_window_total) {
+        sem_post(&bench_done_sem);
+    }
+}
+
+static void bench_on_message_ack(sddc_t *sddc, const uint8_t *uid, uint16_t seqno)
+{
+    if (bench_window_on) {
+        bench_window_complete(seqno, SDDC_FALSE);
+    } else {
+        sem_post(&bench_ack_sem);
+    }
+}
+
+static void bench_on_message_lost(sddc_t *sddc, const uint8_t *uid, uint16_t seqno)
+{
+    if (bench_window_on) {
+        bench_window_complete(seqno, SDDC_TRUE);
+    }
+}
+
+static void bench_on_message_ready(sddc_t *sddc, const uint8_t *uid)
+{
+    sem_post(&bench_ready_sem);
+}
+
+/*
+ * Application event loop on the SDDC socket
+ */
+static void bench_engine_poll(sddc_t *sddc)
+{
+    int fd = sddc_get_fd(sddc);
+
+    while (1) {
+        uint32_t       timeout = sddc_next_deadline_ms(sddc);
+        struct timeval tv      = { timeout / 1000, (timeout % 1000) * 1000 };
+        fd_set         rfds;
+
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
+
+        if (select(fd + 1, &rfds, NULL, NULL, &tv) > 0) {
+            sddc_process_readable(sddc);
+        }
+
+        sddc_process_timers(sddc);
+    }
+}
+
+static void *bench_engine_thread(void *arg)
+{
+    if (bench_poll_loop) {
+        bench_engine_poll(arg);
+    } else {
+        sddc_run(arg);
+    }
+
+    return NULL;
+}
+
+static int bench_engine_start(sddc_bool_t security_en)
+{
+    static const uint8_t mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    static const char    report[] = "{\"report\":{\"name\":\"bench\",\"type\":\"device\",\"excl\":false,"
+                                    "\"desc\":\"host bench\",\"model\":\"1\",\"vendor\":\"ACOINFO\"}}";
+
+    bench_sddc = sddc_create(BENCH_ENGINE_PORT);
+    sddc_return_value_if_fail(bench_sddc, -1);
+
+    sddc_set_on_invite(bench_sddc, bench_on_invite);
+    sddc_set_on_update(bench_sddc, bench_on_update);
+    sddc_set_on_message(bench_sddc, bench_on_message);
+    sddc_set_on_message_ack(bench_sddc, bench_on_message_ack);
+    sddc_set_on_message_lost(bench_sddc, bench_on_message_lost);
+    sddc_set_on_message_ready(bench_sddc, bench_on_message_ready);
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (security_en) {
+        sddc_set_token(bench_sddc, BENCH_TOKEN);
+    }
+#endif
+
+    sddc_set_uid(bench_sddc, mac);
+    sddc_set_report_data(bench_sddc, report, strlen(report));
+    sddc_set_invite_data(bench_sddc, report, strlen(report));
+
+    return pthread_create(&bench_engine_tid, NULL, bench_engine_thread, bench_sddc);
+}
+
+static void bench_engine_stop(void)
+{
+    struct timespec ts = { 0, 20 * 1000 * 1000 };
+
+    /*
+     * Let the engine go back to select() before cancel it
+     */
+    nanosleep(&ts, NULL);
+
+    pthread_cancel(bench_engine_tid);
+    pthread_join(bench_engine_tid, NULL);
+
+    sddc_destroy(bench_sddc);
+    bench_sddc = NULL;
+}
+
+/*
+ * Join EdgerOS 0 ~ npeers - 1
+ */
+static int bench_peer_join_many(bench_peer_t *peer, uint32_t npeers)
+{
+    uint32_t i;
+
+    for (i = 0; i < npeers; i++) {
+        bench_peer_set_uid(peer, i);
+        sddc_return_value_if_fail(bench_peer_join(peer) == 0, -1);
+    }
+
+    return 0;
+}
+
+/*
+ * MESSAGE request with the prebuilt payload, sealed for the seqno in GCM mode
+ */
+static size_t bench_peer_message(bench_peer_t *peer, uint8_t *packet)
+{
+#if BENCH_GCM_EN > 0
+    if (peer->gcm) {
+        uint8_t sealed[sizeof(BENCH_MESSAGE) + BENCH_GCM_OVERHEAD];
+        size_t  sealed_len;
+
+        bench_seal(&peer->gcm_seal_ctx, peer->uid, peer->gcm_counter++, BENCH_TYPE_MESSAGE, 0, peer->seqno,
+                   BENCH_MESSAGE, sizeof(BENCH_MESSAGE) - 1, sealed, &sealed_len);
+
+        return bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                           BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO | BENCH_SEC_FLAG_GCM,
+                           peer->seqno, sealed, sealed_len);
+    }
+#endif
+
+    return bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                       peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                       peer->seqno, peer->message, peer->message_len);
+}
+
+/*
+ * EdgerOS -> device MESSAGE request, round trip until MESSAGE ACK (__sddc_read_handle),
+ * the sender is picked at random from npeers joined EdgerOS
+ */
+static int bench_rx_message(bench_peer_t *peer, bench_result_t *result, uint32_t npeers)
+{
+    uint8_t  packet[SDDC_CFG_SEND_BUF_SIZE];
+    uint64_t begin, start;
+    uint32_t i;
+    uint32_t rand = 2463534242U;
+    size_t   len;
+    uint16_t seqno;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        if (npeers > 1) {
+            rand ^= rand << 13;
+            rand ^= rand >> 17;
+            rand ^= rand << 5;
+            bench_peer_set_uid(peer, rand % npeers);
+        }
+
+        len = bench_peer_message(peer, packet);
+
+        start = bench_now_ns();
+        sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        do {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &seqno) == 0);
+        } while (seqno != peer->seqno);
+        result->lat_ns[i] = bench_now_ns() - start;
+
+        peer->seqno++;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/*
+ * EdgerOS -> device PING request, round trip until PING ACK (prebuilt respond header)
+ */
+static int bench_rx_ping(bench_peer_t *peer, bench_result_t *result)
+{
+    uint8_t  packet[sizeof(bench_header_t)];
+    uint64_t begin, start;
+    uint32_t i;
+    size_t   len;
+    uint16_t seqno;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        len = bench_build(peer, packet, BENCH_TYPE_PING, BENCH_FLAG_REQ,
+                          peer->security_en ? BENCH_SEC_FLAG_SUPPORT : 0,
+                          peer->seqno, NULL, 0);
+
+        start = bench_now_ns();
+        sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        do {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_PING, BENCH_FLAG_ACK, &seqno) == 0);
+        } while (seqno != peer->seqno);
+        result->lat_ns[i] = bench_now_ns() - start;
+
+        peer->seqno++;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/*
+ * One PING round trip: the engine has handled what was sent before, and learns the peer
+ * security flags
+ */
+static int bench_peer_ping(bench_peer_t *peer)
+{
+    uint8_t  packet[sizeof(bench_header_t)];
+    size_t   len;
+    uint16_t seqno;
+
+    len = bench_build(peer, packet, BENCH_TYPE_PING, BENCH_FLAG_REQ, BENCH_SEC_FLAG_SUPPORT, peer->seqno, NULL, 0);
+    sddc_return_value_if_fail(bench_peer_send(peer, packet, len) == 0, -1);
+    do {
+        sddc_return_value_if_fail(bench_peer_wait(peer, BENCH_TYPE_PING, BENCH_FLAG_ACK, &seqno) == 0, -1);
+    } while (seqno != peer->seqno);
+    peer->seqno++;
+
+    return 0;
+}
+
+#if BENCH_GCM_EN > 0
+/*
+ * GCM MESSAGE requests with one ciphertext or tag byte flipped (strip: sent as CBC or plain
+ * with the GCM flags cleared), each followed by a PING round trip and the genuine request of
+ * the same seqno. delivered: how many tampered ones reached on_message (must be none),
+ * genuine: how many genuine ones (must be all)
+ */
+static int bench_rx_gcm_tamper(bench_peer_t *peer, sddc_bool_t strip, uint32_t *delivered, uint32_t *genuine)
+{
+    uint8_t  packet[SDDC_CFG_SEND_BUF_SIZE];
+    size_t   len;
+    uint32_t i;
+    uint16_t seqno, next, ack;
+
+    bench_rx_delivered = 0;
+    *delivered         = 0;
+    *genuine           = 0;
+
+    for (i = 0; i < BENCH_GCM_TAMPER_COUNT; i++) {
+        seqno = peer->seqno;
+        if (strip) {
+            if (i & 1) {
+                len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ, 0,
+                                  peer->seqno, BENCH_MESSAGE, sizeof(BENCH_MESSAGE) - 1);
+            } else {
+                len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                                  BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO,
+                                  peer->seqno, peer->message, peer->message_len);
+            }
+            if (i & 2) {
+                ((bench_header_t *)packet)->security &= ~BENCH_SEC_FLAG_GCM_SUPPORT;
+            }
+        } else {
+            len = bench_peer_message(peer, packet);
+            packet[sizeof(bench_header_t) + BENCH_GCM_CTR_LEN +
+                   i % (len - sizeof(bench_header_t) - BENCH_GCM_CTR_LEN)] ^= 0x01;
+        }
+        sddc_return_value_if_fail(bench_peer_send(peer, packet, len) == 0, -1);
+        peer->seqno++;
+
+        sddc_return_value_if_fail(bench_peer_ping(peer) == 0, -1);
+        *delivered += bench_rx_delivered;
+
+        /*
+         * The tampered request must not have taken the seqno
+         */
+        next        = peer->seqno;
+        peer->seqno = seqno;
+        len         = bench_peer_message(peer, packet);
+        peer->seqno = next;
+
+        bench_rx_delivered = 0;
+        sddc_return_value_if_fail(bench_peer_send(peer, packet, len) == 0, -1);
+        do {
+            sddc_return_value_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &ack) == 0, -1);
+        } while (ack != seqno);
+        *genuine          += bench_rx_delivered;
+        bench_rx_delivered = 0;
+    }
+
+    return 0;
+}
+#endif
+
+/*
+ * EdgerOS -> device MESSAGE requests in bursts of BENCH_BURST back to back datagrams,
+ * latency is from the burst start to the ack of each message
+ */
+static int bench_rx_burst(bench_peer_t *peer, bench_result_t *result)
+{
+    uint8_t  packet[SDDC_CFG_SEND_BUF_SIZE];
+    uint64_t begin, start;
+    uint32_t i, j, n, acked;
+    size_t   len;
+    uint16_t seqno;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i += n) {
+        n = (result->count - i < BENCH_BURST) ? result->count - i : BENCH_BURST;
+
+        start = bench_now_ns();
+        for (j = 0; j < n; j++) {
+            len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                              peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                              peer->seqno + j, peer->message, peer->message_len);
+            sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        }
+
+        for (acked = 0; acked < n; ) {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &seqno) == 0);
+            if ((uint16_t)(seqno - peer->seqno) < n) {
+                result->lat_ns[i + acked++] = bench_now_ns() - start;
+            }
+        }
+
+        peer->seqno += n;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/*
+ * EdgerOS -> device UPDATE request whose ack is lost once: the request is sent again
+ * after its ack. Latency is the retransmission round trip, on_update must run once.
+ */
+static int bench_rx_update_retrans(bench_peer_t *peer, bench_result_t *result)
+{
+    uint8_t  packet[SDDC_CFG_SEND_BUF_SIZE];
+    uint64_t begin, start;
+    uint32_t i;
+    size_t   len;
+    uint16_t seqno;
+
+    bench_rx_updates = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        len = bench_build(peer, packet, BENCH_TYPE_UPDATE, BENCH_FLAG_REQ,
+                          peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                          peer->seqno, peer->message, peer->message_len);
+
+        sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        do {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_UPDATE, BENCH_FLAG_ACK, &seqno) == 0);
+        } while (seqno != peer->seqno);
+
+        start = bench_now_ns();
+        sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        do {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_UPDATE, BENCH_FLAG_ACK, &seqno) == 0);
+        } while (seqno != peer->seqno);
+        result->lat_ns[i] = bench_now_ns() - start;
+
+        peer->seqno++;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    if (bench_rx_updates != result->count) {
+        SDDC_LOG_ERR("on_update called %u times for %u requests!\n", bench_rx_updates, result->count);
+        return -1;
+    }
+
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+#if SDDC_CFG_FRAG_MAX > 0
+/*
+ * EdgerOS -> device MESSAGE of BENCH_FRAG_LEN bytes in fragments of SDDC_CFG_FRAG_SIZE
+ * sent back to back, latency is from the first fragment to the ack of every fragment
+ */
+static int bench_rx_frag(bench_peer_t *peer, bench_result_t *result)
+{
+    static uint8_t data[BENCH_FRAG_LEN];
+    static uint8_t frag[16][SDDC_CFG_FRAG_SIZE + 16];
+    size_t         frag_len[16];
+    uint8_t        packet[SDDC_CFG_SEND_BUF_SIZE];
+    uint32_t       count = (BENCH_FRAG_LEN + SDDC_CFG_FRAG_SIZE - 1) / SDDC_CFG_FRAG_SIZE;
+    uint32_t       acked;
+    uint64_t       begin, start;
+    uint32_t       i, j;
+    size_t         len;
+    uint16_t       seqno, base;
+
+    memset(data, 'x', sizeof(data));
+
+    for (j = 0; j < count; j++) {
+        len = (j < count - 1) ? SDDC_CFG_FRAG_SIZE : (BENCH_FRAG_LEN - j * SDDC_CFG_FRAG_SIZE);
+#if SDDC_CFG_SECURITY_EN > 0
+        if (peer->security_en) {
+            sddc_return_value_if_fail(bench_encrypt(data + j * SDDC_CFG_FRAG_SIZE, len, frag[j], &frag_len[j]) == 0, -1);
+            continue;
+        }
+#endif
+        memcpy(frag[j], data + j * SDDC_CFG_FRAG_SIZE, len);
+        frag_len[j] = len;
+    }
+
+    bench_rx_delivered = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+
+        for (j = 0; j < count; j++) {
+            len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                              peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                              peer->seqno + j, frag[j], frag_len[j]);
+            ((bench_header_t *)packet)->reserved = (j << 4) | (count - 1);
+            sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        }
+
+        acked = 0;
+        while (acked != (1U << count) - 1) {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &seqno) == 0);
+            if ((uint16_t)(seqno - peer->seqno) < count) {
+                acked |= 1U << (uint16_t)(seqno - peer->seqno);
+            }
+        }
+        result->lat_ns[i] = bench_now_ns() - start;
+
+        peer->seqno += count;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    if (bench_rx_delivered != result->count) {
+        SDDC_LOG_ERR("on_message called %u times for %u fragmented messages!\n", bench_rx_delivered, result->count);
+        return -1;
+    }
+
+    /*
+     * on_message rejects one more message: every fragment but the last one is acked, and the
+     * message must be delivered when only its last fragment is sent again
+     */
+    base = peer->seqno;
+    bench_rx_reject = 1;
+
+    for (j = 0; j < count; j++) {
+        len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                          peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                          base + j, frag[j], frag_len[j]);
+        ((bench_header_t *)packet)->reserved = (j << 4) | (count - 1);
+        sddc_return_value_if_fail(bench_peer_send(peer, packet, len) == 0, -1);
+    }
+
+    for (acked = 0; acked != (1U << (count - 1)) - 1; ) {
+        sddc_return_value_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &seqno) == 0, -1);
+        if ((uint16_t)(seqno - base) < count) {
+            acked |= 1U << (uint16_t)(seqno - base);
+        }
+    }
+    sddc_return_value_if_fail(bench_peer_ping(peer) == 0, -1);
+    bench_rx_reject = 0;
+
+    sddc_return_value_if_fail(bench_peer_send(peer, packet, len) == 0, -1);
+    do {
+        sddc_return_value_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &seqno) == 0, -1);
+    } while (seqno != (uint16_t)(base + count - 1));
+    peer->seqno = base + count;
+
+    if (bench_rx_delivered != result->count + 1) {
+        SDDC_LOG_ERR("Fragmented message lost after on_message rejected it!\n");
+        return -1;
+    }
+
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+#endif
+
+/*
+ * Shuffle seq number offsets 0..n-1 (xorshift, fixed seed: same trace every run)
+ */
+static void bench_shuffle(uint16_t *order, uint32_t n, uint32_t *rand)
+{
+    uint32_t i, j;
+    uint16_t tmp;
+
+    for (i = 0; i < n; i++) {
+        order[i] = i;
+    }
+
+    for (i = n - 1; i > 0; i--) {
+        *rand ^= *rand << 13;
+        *rand ^= *rand >> 17;
+        *rand ^= *rand << 5;
+        j = *rand % (i + 1);
+        tmp      = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+/*
+ * EdgerOS -> device MESSAGE requests reordered in blocks of BENCH_BURST, every block
+ * sent again (retransmissions landing after newer messages): on_message must see each
+ * message once and every request is acked. Latency is from the block start to the acks.
+ */
+static int bench_rx_replay(bench_peer_t *peer, bench_result_t *result)
+{
+    uint8_t  packet[SDDC_CFG_SEND_BUF_SIZE];
+    uint16_t order[BENCH_BURST];
+    uint64_t begin, start;
+    uint32_t i, j, k, n, acked;
+    uint32_t rand = 88675123U;
+    size_t   len;
+    uint16_t seqno;
+
+    bench_rx_delivered = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i += n) {
+        n = (result->count - i < BENCH_BURST) ? result->count - i : BENCH_BURST;
+
+        start = bench_now_ns();
+        for (k = 0; k < 2; k++) {
+            bench_shuffle(order, n, &rand);
+
+            for (j = 0; j < n; j++) {
+                len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                                  peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                                  peer->seqno + order[j], peer->message, peer->message_len);
+                sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+            }
+        }
+
+        for (acked = 0; acked < n * 2; ) {
+            sddc_goto_error_if_fail(bench_peer_wait(peer, BENCH_TYPE_MESSAGE, BENCH_FLAG_ACK, &seqno) == 0);
+            if ((uint16_t)(seqno - peer->seqno) < n) {
+                if (acked < n) {
+                    result->lat_ns[i + acked] = bench_now_ns() - start;
+                }
+                acked++;
+            }
+        }
+
+        peer->seqno += n;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    if (bench_rx_delivered != result->count) {
+        SDDC_LOG_ERR("Replay window delivered %u of %u messages!\n", bench_rx_delivered, result->count);
+        return -1;
+    }
+
+    /*
+     * A captured request just behind the window is dropped, not acked
+     */
+    len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, BENCH_FLAG_REQ,
+                      peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                      peer->seqno - 1 - SDDC_CFG_REPLAY_WINDOW, peer->message, peer->message_len);
+    sddc_return_value_if_fail(bench_peer_send(peer, packet, len) == 0, -1);
+    sddc_return_value_if_fail(bench_peer_ping(peer) == 0, -1);
+
+    if (bench_rx_delivered != result->count) {
+        SDDC_LOG_ERR("Replay window delivered a message behind it!\n");
+        return -1;
+    }
+
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/*
+ * Device -> EdgerOS MESSAGE (__sddc_send_message), retries == 0 is the direct path,
+ * retries > 0 with urgent goes through the retransmit queue and waits for the ack
+ */
+static int bench_tx_message(bench_peer_t *peer, bench_result_t *result, uint8_t retries)
+{
+    struct timespec deadline;
+    uint64_t begin, start;
+    uint32_t i;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        sddc_goto_error_if_fail(sddc_send_message(bench_sddc, peer->uid,
+                                                  BENCH_MESSAGE, strlen(BENCH_MESSAGE),
+                                                  retries, SDDC_TRUE, NULL) == 0);
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        sddc_goto_error_if_fail(sem_timedwait(&bench_ack_sem, &deadline) == 0);
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+#if SDDC_CFG_FRAG_MAX > 0
+/*
+ * Device -> EdgerOS reliable MESSAGE of BENCH_FRAG_LEN bytes, sent in fragments through
+ * the send window, latency is until on_message_ack of the whole message
+ */
+static int bench_tx_frag(bench_peer_t *peer, bench_result_t *result)
+{
+    static uint8_t  data[BENCH_FRAG_LEN];
+    struct timespec deadline;
+    uint64_t        begin, start;
+    uint32_t        i;
+
+    memset(data, 'x', sizeof(data));
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        sddc_goto_error_if_fail(sddc_send_message(bench_sddc, peer->uid, data, sizeof(data),
+                                                  3, SDDC_FALSE, NULL) == 0);
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        sddc_goto_error_if_fail(sem_timedwait(&bench_ack_sem, &deadline) == 0);
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+#endif
+
+/*
+ * Device -> EdgerOS MESSAGE through the send window (not urgent), as fast as the
+ * message queue takes them: a full queue blocks the sender until on_message_ready.
+ * Latency is per sddc_send_message call including the backpressure wait, the rate
+ * is until every message is acked (or lost).
+ */
+static int bench_tx_window(bench_peer_t *peer, bench_result_t *result)
+{
+    struct timespec deadline;
+    uint64_t begin, start;
+    uint32_t i;
+
+    memset(bench_window_done, 0, sizeof(bench_window_done));
+    bench_window_completed = 0;
+    bench_window_lost      = 0;
+    bench_window_total     = result->count;
+    bench_window_on        = 1;
+
+    while (sem_trywait(&bench_ready_sem) == 0) {
+    }
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        while (sddc_send_message(bench_sddc, peer->uid,
+                                 BENCH_MESSAGE, strlen(BENCH_MESSAGE),
+                                 BENCH_WINDOW_RETRIES, SDDC_FALSE, NULL) != 0) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 5;
+            sddc_goto_error_if_fail(sem_timedwait(&bench_ready_sem, &deadline) == 0);
+        }
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 30;
+    sddc_goto_error_if_fail(sem_timedwait(&bench_done_sem, &deadline) == 0);
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    bench_window_on = 0;
+    return 0;
+
+error:
+    bench_count_stop(result);
+    bench_window_on = 0;
+    return -1;
+}
+
+/*
+ * EdgerOS pushing MESSAGE (no ack) the application handles slowly, sddc_run is in
+ * on_message half of the time
+ */
+static void *bench_slow_thread(void *arg)
+{
+    bench_peer_t *peer = arg;
+    uint8_t       packet[SDDC_CFG_SEND_BUF_SIZE];
+    size_t        len;
+
+    while (bench_slow_on) {
+        len = bench_build(peer, packet, BENCH_TYPE_MESSAGE, 0,
+                          peer->security_en ? (BENCH_SEC_FLAG_SUPPORT | BENCH_SEC_FLAG_CRYPTO) : 0,
+                          peer->seqno++, peer->message, peer->message_len);
+        bench_peer_send(peer, packet, len);
+        usleep(BENCH_SLOW_CB_US * 2);
+    }
+
+    return NULL;
+}
+
+/*
+ * Device -> EdgerOS MESSAGE while on_message callbacks are slow, latency is the
+ * sddc_send_message call only: what an application task waits for the engine
+ */
+static int bench_tx_slow_callback(bench_peer_t *peer, bench_result_t *result)
+{
+    struct timespec deadline;
+    pthread_t tid;
+    uint64_t begin, start;
+    uint32_t i;
+    int ret = -1;
+
+    bench_slow_on = 1;
+    if (pthread_create(&tid, NULL, bench_slow_thread, peer) != 0) {
+        bench_slow_on = 0;
+        return -1;
+    }
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        sddc_goto_error_if_fail(sddc_send_message(bench_sddc, peer->uid,
+                                                  BENCH_MESSAGE, strlen(BENCH_MESSAGE),
+                                                  0, SDDC_FALSE, NULL) == 0);
+        result->lat_ns[i] = bench_now_ns() - start;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        sddc_goto_error_if_fail(sem_timedwait(&bench_ack_sem, &deadline) == 0);
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    ret = 0;
+
+error:
+    bench_count_stop(result);
+    bench_slow_on = 0;
+    pthread_join(tid, NULL);
+    return ret;
+}
+
+/*
+ * sddc_broadcast_message to every joined EdgerOS, latency per call (queued for sddc_run,
+ * a full send queue waits for on_message_ready)
+ */
+static int bench_tx_broadcast(bench_result_t *result)
+{
+    struct timespec deadline;
+    uint64_t begin, start;
+    uint32_t i;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        while (sddc_broadcast_message(bench_sddc, BENCH_MESSAGE, strlen(BENCH_MESSAGE), 0, SDDC_FALSE, NULL) != 0) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 5;
+            if (sem_timedwait(&bench_ready_sem, &deadline) != 0) {
+                bench_count_stop(result);
+                return -1;
+            }
+        }
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    return 0;
+}
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench_report(bench_result_t *result)
+{
+    qsort(result->lat_ns, result->count, sizeof(uint32_t), bench_cmp_u32);
+
+    printf("%-20s %-4s %8u %12.0f %10.1f %10.1f %12.1f %10.2f %8.2f %11.1f\n",
+           result->name,
+           result->security_en ? "on" : "off",
+           result->count,
+           result->count / result->seconds,
+           result->lat_ns[result->count / 2] / 1000.0,
+           result->lat_ns[(uint64_t)result->count * 99 / 100] / 1000.0,
+           (double)result->alloc_bytes / result->count,
+           (double)result->alloc_calls / result->count,
+           (double)result->sys_calls / result->count,
+           (double)result->copy_bytes / result->count);
+}
+
+#if SDDC_CFG_STATS_EN > 0
+static void bench_report_mpool(void)
+{
+    sddc_stats_t stats;
+    int          i;
+
+    sddc_return_if_fail(sddc_get_stats(bench_sddc, &stats, NULL, 0) == 0);
+
+    printf("%-20s", "  mpool high water");
+    for (i = 0; i < SDDC_MPOOL_CLASS_NR; i++) {
+        printf(" %uB:%u/%u", stats.mpool[i].size, stats.mpool[i].high_water, stats.mpool[i].total);
+    }
+    printf(" heap:%u fail:%u\n", stats.mpool_heap_high_water, (unsigned)stats.mpool_alloc_fail);
+}
+
+static void bench_report_reply(void)
+{
+    sddc_stats_t stats;
+
+    sddc_return_if_fail(sddc_get_stats(bench_sddc, &stats, NULL, 0) == 0);
+
+    printf("%-20s hits:%u/%u (%.1f%%)\n", "  reply cache", (unsigned)stats.total.reply_hits,
+           (unsigned)stats.total.reply_requests,
+           stats.total.reply_requests ? 100.0 * stats.total.reply_hits / stats.total.reply_requests : 0.0);
+}
+
+/*
+ * Engine statistics (sddc_get_stats) since base, and the ack RTT histogram buckets hit
+ */
+static void bench_report_stats(const sddc_stats_t *base)
+{
+    sddc_stats_t                  stats;
+    const sddc_stats_counters_t *now = &stats.total;
+    const sddc_stats_counters_t *was = &base->total;
+    int                           i, hits;
+
+    sddc_return_if_fail(sddc_get_stats(bench_sddc, &stats, NULL, 0) == 0);
+
+    printf("%-20s retx:%u lost:%u dup:%u decrypt-fail:%u mqueue-hw:%u\n", "  stats",
+           now->retransmits - was->retransmits, now->lost - was->lost, now->duplicates - was->duplicates,
+           now->decrypt_fail - was->decrypt_fail, now->mqueue_high_water);
+
+    printf("%-20s", "  ack rtt ms");
+    for (i = 0, hits = 0; i < SDDC_STATS_RTT_NR; i++) {
+        if (now->rtt_hist[i] == was->rtt_hist[i]) {
+            continue;
+        }
+        hits++;
+        if (i <= 1) {
+            printf(" %d:%u", i, now->rtt_hist[i] - was->rtt_hist[i]);
+        } else if (i == SDDC_STATS_RTT_NR - 1) {
+            printf(" %u+:%u", 1U << (i - 1), now->rtt_hist[i] - was->rtt_hist[i]);
+        } else {
+            printf(" %u-%u:%u", 1U << (i - 1), (1U << i) - 1, now->rtt_hist[i] - was->rtt_hist[i]);
+        }
+    }
+    printf("%s\n", hits ? "" : " none (retransmitted requests are not sampled)");
+}
+
+/*
+ * Whole run: packets by type, lock waits and callback time, and the per-EdgerOS view of the peer
+ */
+static int bench_report_stats_total(void)
+{
+    static const char    *types[] = { "discover", "report", "update", "invite", "ping", "message", "timestamp" };
+    sddc_stats_t          stats;
+    sddc_edgeros_stats_t  edgeros;
+    int                   i;
+
+    sddc_return_value_if_fail(sddc_get_stats(bench_sddc, &stats, &edgeros, 1) == 0, -1);
+
+    printf("%-20s", "  stats rx/tx");
+    for (i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i++) {
+        if (stats.total.rx_packets[i] || stats.total.tx_packets[i]) {
+            printf(" %s:%u/%u", types[i], stats.total.rx_packets[i], stats.total.tx_packets[i]);
+        }
+    }
+    printf(" dup:%u decrypt-fail:%u\n", stats.total.duplicates, stats.total.decrypt_fail);
+
+    printf("%-20s lock:%u wait:%.2fus/lock callback:%u %.2fus/call\n", "  stats lock",
+           stats.lock_count, stats.lock_count ? (double)stats.lock_wait_us / stats.lock_count : 0.0,
+           stats.callback_count, stats.callback_count ? (double)stats.callback_us / stats.callback_count : 0.0);
+
+    /*
+     * One EdgerOS: its counters are the total ones but for the packets before it joined
+     */
+    sddc_return_value_if_fail(stats.edgeros_count == 1, -1);
+    sddc_return_value_if_fail(memcmp(edgeros.uid, bench_peer.uid, SDDC_UID_LEN) == 0, -1);
+    sddc_return_value_if_fail(edgeros.counters.retransmits == stats.total.retransmits, -1);
+    sddc_return_value_if_fail(edgeros.counters.tx_packets[BENCH_TYPE_MESSAGE] ==
+                              stats.total.tx_packets[BENCH_TYPE_MESSAGE], -1);
+
+    return 0;
+}
+#endif
+
+#if SDDC_CFG_TRACE_EN > 0
+/*
+ * Dump the trace of the row to a file for sddc_trace
+ */
+static int bench_report_trace(sddc_bool_t security_en)
+{
+    sddc_trace_header_t header;
+    const char         *path = security_en ? "sddc_trace_on.bin" : "sddc_trace_off.bin";
+    size_t              size = sizeof(sddc_trace_header_t) + SDDC_CFG_TRACE_SIZE * sizeof(sddc_trace_t);
+    void               *buf  = malloc(size);
+    ssize_t             len;
+    FILE               *fp;
+
+    sddc_return_value_if_fail(buf, -1);
+
+    len = sddc_trace_dump(bench_sddc, buf, size);
+    if (len < (ssize_t)sizeof(sddc_trace_header_t)) {
+        free(buf);
+        return -1;
+    }
+    memcpy(&header, buf, sizeof(header));
+
+    fp = fopen(path, "wb");
+    if ((fp == NULL) || (fwrite(buf, len, 1, fp) != 1)) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        free(buf);
+        return -1;
+    }
+    fclose(fp);
+    free(buf);
+
+    printf("%-20s records:%u lost:%u -> %s\n", "  trace", header.count, header.lost, path);
+
+    return (header.count > 0) ? 0 : -1;
+}
+#endif
+
+static int bench_run(sddc_bool_t security_en, uint32_t count)
+{
+    bench_result_t result;
+    pthread_t      peer_tid;
+    int            ret = -1;
+#if SDDC_CFG_STATS_EN > 0
+    sddc_stats_t   stats;
+#endif
+
+    memset(&result, 0, sizeof(result));
+    result.security_en = security_en;
+    result.count       = count;
+    result.lat_ns      = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    sddc_goto_error_if_fail(bench_peer_open(&bench_peer, security_en) == 0);
+#if BENCH_GCM_EN > 0
+    if (security_en) {
+        sddc_goto_error_if_fail(bench_gcm_setup(&bench_peer.gcm_seal_ctx) == 0);
+        sddc_goto_error_if_fail(bench_gcm_setup(&bench_peer.gcm_open_ctx) == 0);
+    }
+#endif
+    sddc_goto_error_if_fail(bench_engine_start(security_en) == 0);
+    sddc_goto_error_if_fail(bench_peer_join(&bench_peer) == 0);
+
+#if SDDC_CFG_TRACE_EN > 0
+    sddc_trace_dump(bench_sddc, NULL, 0);
+#endif
+
+    result.name = "rx message+ack";
+    sddc_goto_error_if_fail(bench_rx_message(&bench_peer, &result, 1) == 0);
+    bench_report(&result);
+#if SDDC_CFG_TRACE_EN > 0
+    sddc_goto_error_if_fail(bench_report_trace(security_en) == 0);
+#endif
+
+    result.name = "rx ping";
+    sddc_goto_error_if_fail(bench_rx_ping(&bench_peer, &result) == 0);
+    bench_report(&result);
+
+    result.name = "rx burst";
+    sddc_goto_error_if_fail(bench_rx_burst(&bench_peer, &result) == 0);
+    bench_report(&result);
+
+    result.name = "rx reorder+dup";
+    sddc_goto_error_if_fail(bench_rx_replay(&bench_peer, &result) == 0);
+    bench_report(&result);
+    printf("%-20s window:%u delivered:%u/%u\n", "  replay window", SDDC_CFG_REPLAY_WINDOW,
+           bench_rx_delivered, result.count);
+
+    result.name = "rx update retrans";
+    sddc_goto_error_if_fail(bench_rx_update_retrans(&bench_peer, &result) == 0);
+    bench_report(&result);
+#if SDDC_CFG_STATS_EN > 0
+    bench_report_reply();
+#endif
+
+#if SDDC_CFG_FRAG_MAX > 0
+    {
+        uint32_t count = result.count;
+
+        result.name  = "rx fragmented 8K";
+        result.count = (count < BENCH_FRAG_COUNT) ? count : BENCH_FRAG_COUNT;
+        sddc_goto_error_if_fail(bench_rx_frag(&bench_peer, &result) == 0);
+        bench_report(&result);
+        result.count = count;
+    }
+#endif
+
+#if BENCH_GCM_EN > 0
+    if (security_en) {
+        uint32_t delivered, genuine;
+
+        bench_peer.gcm = SDDC_TRUE;
+        sddc_goto_error_if_fail(bench_peer_join(&bench_peer) == 0);
+
+        result.name = "rx message gcm";
+        sddc_goto_error_if_fail(bench_rx_message(&bench_peer, &result, 1) == 0);
+        bench_report(&result);
+
+        sddc_goto_error_if_fail(bench_rx_gcm_tamper(&bench_peer, SDDC_FALSE, &delivered, &genuine) == 0);
+        printf("%-20s delivered:%u/%u genuine:%u/%u\n", "  gcm tampered", delivered, BENCH_GCM_TAMPER_COUNT,
+               genuine, BENCH_GCM_TAMPER_COUNT);
+        sddc_goto_error_if_fail((delivered == 0) && (genuine == BENCH_GCM_TAMPER_COUNT));
+
+        sddc_goto_error_if_fail(bench_rx_gcm_tamper(&bench_peer, SDDC_TRUE, &delivered, &genuine) == 0);
+        printf("%-20s delivered:%u/%u genuine:%u/%u\n", "  gcm stripped", delivered, BENCH_GCM_TAMPER_COUNT,
+               genuine, BENCH_GCM_TAMPER_COUNT);
+        sddc_goto_error_if_fail((delivered == 0) && (genuine == BENCH_GCM_TAMPER_COUNT));
+
+        bench_peer.gcm = SDDC_FALSE;
+        sddc_goto_error_if_fail(bench_peer_join(&bench_peer) == 0);
+    }
+#endif
+
+    bench_peer_quit = 0;
+    sddc_goto_error_if_fail(pthread_create(&peer_tid, NULL, bench_peer_thread, &bench_peer) == 0);
+
+    result.name = "tx message";
+    ret = bench_tx_message(&bench_peer, &result, 0);
+    if (ret == 0) {
+        bench_report(&result);
+
+        result.name = "tx message reliable";
+        ret = bench_tx_message(&bench_peer, &result, 1);
+        if (ret == 0) {
+            bench_report(&result);
+#if SDDC_CFG_STATS_EN > 0
+            bench_report_mpool();
+#endif
+        }
+    }
+
+#if BENCH_GCM_EN > 0
+    if ((ret == 0) && security_en) {
+        bench_peer.gcm = SDDC_TRUE;
+        ret = bench_peer_rejoin(&bench_peer);
+
+        bench_peer.gcm_opened = 0;
+        bench_peer.gcm_bad    = 0;
+
+        if (ret == 0) {
+            result.name = "tx reliable gcm";
+            ret = bench_tx_message(&bench_peer, &result, 1);
+        }
+        if (ret == 0) {
+            bench_report(&result);
+            printf("%-20s opened:%u/%u bad:%u\n", "  gcm tags", bench_peer.gcm_opened, result.count,
+                   bench_peer.gcm_bad);
+            if ((bench_peer.gcm_opened != result.count) || (bench_peer.gcm_bad != 0)) {
+                SDDC_LOG_ERR("EdgerOS side failed to open %u GCM payloads!\n", result.count - bench_peer.gcm_opened);
+                ret = -1;
+            }
+        }
+
+        bench_peer.gcm = SDDC_FALSE;
+        if (ret == 0) {
+            ret = bench_peer_rejoin(&bench_peer);
+        }
+    }
+#endif
+
+#if SDDC_CFG_FRAG_MAX > 0
+    if (ret == 0) {
+        uint32_t count = result.count;
+
+        result.name  = "tx fragmented 8K";
+        result.count = (count < BENCH_FRAG_COUNT) ? count : BENCH_FRAG_COUNT;
+        ret = bench_tx_frag(&bench_peer, &result);
+        if (ret == 0) {
+            bench_report(&result);
+        }
+
+        result.count = count;
+    }
+#endif
+
+    if (ret == 0) {
+        uint32_t count = result.count;
+
+        /*
+         * Every first transmission lost, latency is the retransmission timeout
+         */
+        bench_peer.drop_first = SDDC_TRUE;
+        bench_peer.drop_seqno = 0xffff;
+
+        result.name  = "tx reliable 1st lost";
+        result.count = (count < BENCH_RECOVER_COUNT) ? count : BENCH_RECOVER_COUNT;
+#if SDDC_CFG_STATS_EN > 0
+        sddc_get_stats(bench_sddc, &stats, NULL, 0);
+#endif
+        ret = bench_tx_message(&bench_peer, &result, 3);
+        if (ret == 0) {
+            bench_report(&result);
+#if SDDC_CFG_STATS_EN > 0
+            bench_report_stats(&stats);
+#endif
+        }
+
+        bench_peer.drop_first = SDDC_FALSE;
+        result.count = count;
+    }
+
+    if (ret == 0) {
+        static const uint32_t loss[] = { 0, 1, 10 };
+        static char           names[3][32];
+        uint32_t              count = result.count;
+        unsigned int          i;
+
+        result.count = (count < BENCH_WINDOW_COUNT) ? count : BENCH_WINDOW_COUNT;
+
+        for (i = 0; (i < sizeof(loss) / sizeof(loss[0])) && (ret == 0); i++) {
+            snprintf(names[i], sizeof(names[i]), "tx window loss %u%%", loss[i]);
+            result.name = names[i];
+
+            bench_peer.loss_percent = loss[i];
+            bench_peer.loss_seed    = 1 + i;
+#if SDDC_CFG_STATS_EN > 0
+            sddc_get_stats(bench_sddc, &stats, NULL, 0);
+#endif
+            ret = bench_tx_window(&bench_peer, &result);
+            if (ret == 0) {
+                bench_report(&result);
+                printf("%-20s window:%u lost:%u\n", "  send window", SDDC_CFG_SEND_WINDOW, bench_window_lost);
+#if SDDC_CFG_STATS_EN > 0
+                bench_report_stats(&stats);
+#endif
+            }
+        }
+
+        bench_peer.loss_percent = 0;
+        result.count = count;
+    }
+
+    if (ret == 0) {
+        uint32_t count = result.count;
+
+        result.name  = "tx slow callback";
+        result.count = (count < BENCH_SLOW_COUNT) ? count : BENCH_SLOW_COUNT;
+        ret = bench_tx_slow_callback(&bench_peer, &result);
+        if (ret == 0) {
+            bench_report(&result);
+        }
+
+        result.count = count;
+    }
+
+    bench_peer_quit = 1;
+    pthread_join(peer_tid, NULL);
+
+#if SDDC_CFG_STATS_EN > 0
+    if ((ret == 0) && (bench_report_stats_total() != 0)) {
+        SDDC_LOG_ERR("EdgerOS statistics do not match the engine ones!\n");
+        ret = -1;
+    }
+#endif
+
+error:
+    if (bench_sddc != NULL) {
+        bench_engine_stop();
+    }
+    if (bench_peer.fd > 0) {
+        close(bench_peer.fd);
+    }
+#if BENCH_GCM_EN > 0
+    if (security_en) {
+        mbedtls_cipher_free(&bench_peer.gcm_seal_ctx);
+        mbedtls_cipher_free(&bench_peer.gcm_open_ctx);
+    }
+#endif
+    free(result.lat_ns);
+
+    return ret;
+}
+
+#if SDDC_CFG_STATS_EN > 0
+/*
+ * DISCOVER storm from a not joined EdgerOS in bursts of BENCH_BURST, latency is from the burst start
+ * to the engine counting each DISCOVER. The REPORT got back are counted in reports
+ */
+static int bench_rx_discover(bench_peer_t *peer, bench_result_t *result, uint32_t *reports)
+{
+    uint8_t              packet[sizeof(bench_header_t)];
+    bench_header_t      *header = (bench_header_t *)peer->buf;
+    sddc_stats_t         stats;
+    struct timespec      ts = { 0, (SDDC_CFG_DISCOVER_JITTER + 50) * 1000 * 1000 };
+    uint64_t             begin, start;
+    uint32_t             i, j, n, done;
+    size_t               len;
+    ssize_t              ret;
+
+    *reports = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i += n) {
+        n = (result->count - i < BENCH_BURST) ? result->count - i : BENCH_BURST;
+
+        start = bench_now_ns();
+        for (j = 0; j < n; j++) {
+            len = bench_build(peer, packet, BENCH_TYPE_DISCOVER, 0, BENCH_SEC_FLAG_SUPPORT,
+                              peer->seqno++, NULL, 0);
+            sddc_goto_error_if_fail(bench_peer_send(peer, packet, len) == 0);
+        }
+
+        for (done = i; done < i + n; ) {
+            sddc_goto_error_if_fail(sddc_get_stats(bench_sddc, &stats, NULL, 0) == 0);
+            while ((done < stats.discovers) && (done < i + n)) {
+                result->lat_ns[done++] = bench_now_ns() - start;
+            }
+            sddc_goto_error_if_fail(bench_now_ns() - start < 1000000000ULL);
+            sched_yield();
+        }
+
+        while ((ret = recv(peer->fd, peer->buf, sizeof(peer->buf), MSG_DONTWAIT)) >= (ssize_t)sizeof(bench_header_t)) {
+            *reports += ((header->flags_type & 0x0f) == BENCH_TYPE_REPORT);
+        }
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    /*
+     * REPORT still pending are sent within the jitter
+     */
+    nanosleep(&ts, NULL);
+    while ((ret = recv(peer->fd, peer->buf, sizeof(peer->buf), MSG_DONTWAIT)) >= (ssize_t)sizeof(bench_header_t)) {
+        *reports += ((header->flags_type & 0x0f) == BENCH_TYPE_REPORT);
+    }
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+static int bench_run_discover(uint32_t count)
+{
+    bench_result_t       result;
+    sddc_stats_t         stats;
+    uint32_t             reports;
+    int                  ret = -1;
+
+    memset(&result, 0, sizeof(result));
+    result.count  = count;
+    result.lat_ns = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    sddc_goto_error_if_fail(bench_peer_open(&bench_peer, SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_engine_start(SDDC_FALSE) == 0);
+
+    result.name = "rx discover storm";
+    ret = bench_rx_discover(&bench_peer, &result, &reports);
+    if (ret == 0) {
+        bench_report(&result);
+
+        sddc_get_stats(bench_sddc, &stats, NULL, 0);
+        printf("%-20s reports:%u/%u coalesced:%u limited:%u got:%u\n", "  discover",
+               (unsigned)stats.discover_reports, (unsigned)stats.discovers, (unsigned)stats.discover_coalesced,
+               (unsigned)stats.discover_limited, reports);
+    }
+
+error:
+    if (bench_sddc != NULL) {
+        bench_engine_stop();
+    }
+    if (bench_peer.fd > 0) {
+        close(bench_peer.fd);
+    }
+    free(result.lat_ns);
+
+    return ret;
+}
+#endif
+
+/*
+ * EdgerOS table scaling with npeers joined EdgerOS (security off)
+ */
+static int bench_run_scaling(uint32_t npeers, uint32_t count)
+{
+    static char    names[2][32];
+    bench_result_t result;
+    int            ret = -1;
+
+    memset(&result, 0, sizeof(result));
+    result.count  = count;
+    result.lat_ns = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    sddc_goto_error_if_fail(bench_peer_open(&bench_peer, SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_engine_start(SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_peer_join_many(&bench_peer, npeers) == 0);
+
+    snprintf(names[0], sizeof(names[0]), "rx lookup x%u", npeers);
+    result.name = names[0];
+    sddc_goto_error_if_fail(bench_rx_message(&bench_peer, &result, npeers) == 0);
+    bench_report(&result);
+
+    snprintf(names[1], sizeof(names[1]), "broadcast x%u", npeers);
+    result.name  = names[1];
+    result.count = BENCH_BROADCAST_COUNT;
+    ret = bench_tx_broadcast(&result);
+    bench_report(&result);
+
+error:
+    if (bench_sddc != NULL) {
+        bench_engine_stop();
+    }
+    if (bench_peer.fd > 0) {
+        close(bench_peer.fd);
+    }
+    free(result.lat_ns);
+
+    return ret;
+}
+
+/*
+ * EdgerOS connector server: read the connections until bench_sink_conns are closed, or
+ * until bench_sink_frames transfers ended by an empty frame if it reads framed transfers
+ */
+static int      bench_sink_fd = -1;
+static uint64_t bench_sink_bytes;
+static uint32_t bench_sink_conns;
+static uint32_t bench_sink_frames;
+static uint32_t bench_sink_ended;
+
+/* Framed transfer parse state of a sink connection */
+typedef struct {
+    int             fd;
+    uint8_t         hdr[4];
+    uint32_t        hdr_len;
+    uint32_t        rest;               /* Bytes left of the current frame */
+} bench_sink_conn_t;
+
+static void bench_sink_parse(bench_sink_conn_t *sc, const uint8_t *buf, size_t len)
+{
+    size_t n;
+
+    while (len > 0) {
+        if (sc->rest > 0) {
+            n = (len < sc->rest) ? len : sc->rest;
+            sc->rest -= n;
+        } else {
+            sc->hdr[sc->hdr_len++] = *buf;
+            n = 1;
+            if (sc->hdr_len == sizeof(sc->hdr)) {
+                sc->rest    = ((uint32_t)sc->hdr[0] << 24) | ((uint32_t)sc->hdr[1] << 16) |
+                              ((uint32_t)sc->hdr[2] << 8) | sc->hdr[3];
+                sc->hdr_len = 0;
+                bench_sink_ended += (sc->rest == 0);
+            }
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void *bench_sink_thread(void *arg)
+{
+    static uint8_t    buf[65536];
+    bench_sink_conn_t conns[BENCH_SINK_MAX];
+    uint32_t          accepted = 0, closed = 0, i;
+    fd_set            rfds;
+    int               max_fd;
+    ssize_t           len;
+
+    memset(conns, 0, sizeof(conns));
+
+    while ((bench_sink_frames > 0) ? (bench_sink_ended < bench_sink_frames) : (closed < bench_sink_conns)) {
+        FD_ZERO(&rfds);
+        max_fd = -1;
+        if (accepted < BENCH_SINK_MAX) {
+            FD_SET(bench_sink_fd, &rfds);
+            max_fd = bench_sink_fd;
+        }
+        for (i = 0; i < accepted; i++) {
+            if (conns[i].fd >= 0) {
+                FD_SET(conns[i].fd, &rfds);
+                max_fd = (conns[i].fd > max_fd) ? conns[i].fd : max_fd;
+            }
+        }
+
+        if (select(max_fd + 1, &rfds, NULL, NULL, NULL) <= 0) {
+            break;
+        }
+
+        if ((accepted < BENCH_SINK_MAX) && FD_ISSET(bench_sink_fd, &rfds)) {
+            conns[accepted++].fd = accept(bench_sink_fd, NULL, NULL);
+        }
+
+        for (i = 0; i < accepted; i++) {
+            if ((conns[i].fd >= 0) && FD_ISSET(conns[i].fd, &rfds)) {
+                len = read(conns[i].fd, buf, sizeof(buf));  /* Not counted as engine syscall */
+                if (len > 0) {
+                    bench_sink_bytes += len;
+                    if (bench_sink_frames > 0) {
+                        bench_sink_parse(&conns[i], buf, len);
+                    }
+                } else {
+                    close(conns[i].fd);
+                    conns[i].fd = -1;
+                    closed++;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < accepted; i++) {
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Start the sink for conns connections, or for frames framed transfers if frames > 0
+ */
+static int bench_sink_start(pthread_t *tid, uint32_t conns, uint32_t frames)
+{
+    struct sockaddr_in addr;
+    int                reuse = 1;
+
+    bench_sink_bytes  = 0;
+    bench_sink_conns  = conns;
+    bench_sink_frames = frames;
+    bench_sink_ended  = 0;
+
+    bench_sink_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sddc_return_value_if_fail(bench_sink_fd >= 0, -1);
+
+    setsockopt(bench_sink_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(BENCH_CONN_PORT);
+
+    if ((bind(bench_sink_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(bench_sink_fd, BENCH_SINK_MAX) < 0) ||
+        (pthread_create(tid, NULL, bench_sink_thread, NULL) != 0)) {
+        close(bench_sink_fd);
+        bench_sink_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void bench_sink_stop(pthread_t tid)
+{
+    pthread_join(tid, NULL);
+    close(bench_sink_fd);
+    bench_sink_fd = -1;
+}
+
+/*
+ * BENCH_CONN_NUM transfers of BENCH_CONN_SIZE one after the other by blocking sddc_connector_put,
+ * latency is per chunk put
+ */
+static int bench_connector_put(bench_peer_t *peer, bench_result_t *result, const uint8_t *data, const char *token)
+{
+    sddc_connector_t *conn;
+    uint64_t          begin, start;
+    uint32_t          i, n = 0;
+    size_t            off, len;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < BENCH_CONN_NUM; i++) {
+        conn = sddc_connector_create(bench_sddc, peer->uid, BENCH_CONN_PORT, token, SDDC_FALSE);
+        sddc_goto_error_if_fail(conn);
+
+        for (off = 0; off < BENCH_CONN_SIZE; off += len) {
+            len = (BENCH_CONN_SIZE - off < BENCH_CONN_CHUNK) ? BENCH_CONN_SIZE - off : BENCH_CONN_CHUNK;
+
+            start = bench_now_ns();
+            if (sddc_connector_put(conn, data + off, len, (off + len) == BENCH_CONN_SIZE) < 0) {
+                sddc_connector_destroy(conn);
+                goto error;
+            }
+            result->lat_ns[n++] = bench_now_ns() - start;
+        }
+
+        sddc_connector_destroy(conn);
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/*
+ * BENCH_CONN_NUM transfers of BENCH_CONN_BIG_SIZE one after the other, each by one sddc_connector_put
+ * or by one sddc_connector_putv of a length prefix and the data, latency is per transfer
+ */
+static int bench_connector_put_big(bench_peer_t *peer, bench_result_t *result, const uint8_t *data, const char *token,
+                                   sddc_bool_t vec)
+{
+    sddc_connector_t *conn;
+    struct iovec      iov[2];
+    uint32_t          prefix = htonl(BENCH_CONN_BIG_SIZE);
+    uint64_t          begin, start;
+    uint32_t          i;
+    int               ret;
+
+    iov[0].iov_base = &prefix;
+    iov[0].iov_len  = sizeof(prefix);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len  = BENCH_CONN_BIG_SIZE;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < BENCH_CONN_NUM; i++) {
+        conn = sddc_connector_create(bench_sddc, peer->uid, BENCH_CONN_PORT, token, SDDC_FALSE);
+        sddc_goto_error_if_fail(conn);
+
+        start = bench_now_ns();
+        ret = vec ? sddc_connector_putv(conn, iov, 2, SDDC_TRUE) :
+                    sddc_connector_put(conn, data, BENCH_CONN_BIG_SIZE, SDDC_TRUE);
+        result->lat_ns[i] = bench_now_ns() - start;
+
+        sddc_connector_destroy(conn);
+        sddc_goto_error_if_fail(ret == 0);
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/*
+ * BENCH_CONN_SMALL_NUM transfers of BENCH_CONN_SMALL_SIZE one after the other, each by one
+ * sddc_connector_put on a new connector or on a pooled one, latency is per transfer with the connect
+ */
+static int bench_connector_small(bench_peer_t *peer, bench_result_t *result, const uint8_t *data, const char *token,
+                                 sddc_bool_t pooled)
+{
+    sddc_connector_t *conn;
+    uint64_t          begin, start;
+    uint32_t          i;
+    int               ret;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < BENCH_CONN_SMALL_NUM; i++) {
+        start = bench_now_ns();
+
+        conn = pooled ? sddc_connector_create_pooled(bench_sddc, peer->uid, BENCH_CONN_PORT, token, NULL, NULL) :
+                        sddc_connector_create(bench_sddc, peer->uid, BENCH_CONN_PORT, token, SDDC_FALSE);
+        sddc_goto_error_if_fail(conn);
+
+        ret = sddc_connector_put(conn, data, BENCH_CONN_SMALL_SIZE, SDDC_TRUE);
+        sddc_connector_destroy(conn);
+        sddc_goto_error_if_fail(ret == 0);
+
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+    return 0;
+
+error:
+    bench_count_stop(result);
+    return -1;
+}
+
+/* Non-blocking transfer */
+typedef struct {
+    sddc_connector_t   *conn;
+    const uint8_t      *data;
+    size_t              off;
+    uint64_t            start;              /* Current chunk */
+    bench_result_t     *result;
+    int                 event;              /* Last event */
+} bench_conn_t;
+
+static uint32_t         bench_conn_chunks;
+
+/*
+ * Write chunks until the socket is full
+ */
+static void bench_conn_write(bench_conn_t *bc)
+{
+    size_t  len;
+    ssize_t ret;
+
+    while (bc->off < BENCH_CONN_SIZE) {
+        len = (BENCH_CONN_SIZE - bc->off < BENCH_CONN_CHUNK) ? BENCH_CONN_SIZE - bc->off : BENCH_CONN_CHUNK;
+
+        if (bc->start == 0) {
+            bc->start = bench_now_ns();
+        }
+
+        ret = sddc_connector_write(bc->conn, bc->data + bc->off, len, (bc->off + len) == BENCH_CONN_SIZE);
+        if (ret <= 0) {
+            bc->event = (ret < 0) ? SDDC_CONNECTOR_EV_ERROR : bc->event;
+            return;
+        }
+
+        bc->off += ret;
+        if ((size_t)ret == len) {
+            bc->result->lat_ns[bench_conn_chunks++] = bench_now_ns() - bc->start;
+            bc->start = 0;
+        }
+    }
+}
+
+static void bench_on_connector(sddc_connector_t *conn, int event, void *arg)
+{
+    bench_conn_t *bc = arg;
+
+    bc->event = event;
+
+    if ((event == SDDC_CONNECTOR_EV_CONNECTED) || (event == SDDC_CONNECTOR_EV_WRITABLE)) {
+        bench_conn_write(bc);
+    }
+}
+
+/*
+ * BENCH_CONN_NUM transfers of BENCH_CONN_SIZE at the same time by non-blocking connectors
+ * from one select loop, latency is per chunk from the first write try until it is taken
+ */
+static int bench_connector_async(bench_peer_t *peer, bench_result_t *result, const uint8_t *data, const char *token)
+{
+    bench_conn_t bc[BENCH_CONN_NUM];
+    uint64_t     begin;
+    uint32_t     i, done = 0;
+    fd_set       wfds;
+    int          fd, max_fd;
+    int          ret = -1;
+
+    memset(bc, 0, sizeof(bc));
+    bench_conn_chunks = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < BENCH_CONN_NUM; i++) {
+        bc[i].data   = data;
+        bc[i].result = result;
+        bc[i].event  = -1;
+        bc[i].conn   = sddc_connector_create_async(bench_sddc, peer->uid, BENCH_CONN_PORT, token,
+                                                   bench_on_connector, &bc[i]);
+        sddc_goto_error_if_fail(bc[i].conn);
+    }
+
+    while (done < BENCH_CONN_NUM) {
+        FD_ZERO(&wfds);
+        max_fd = -1;
+
+        for (i = 0; i < BENCH_CONN_NUM; i++) {
+            if (sddc_connector_want_write(bc[i].conn)) {
+                fd = sddc_connector_fd(bc[i].conn);
+                FD_SET(fd, &wfds);
+                max_fd = (fd > max_fd) ? fd : max_fd;
+            }
+        }
+        sddc_goto_error_if_fail(max_fd >= 0);
+        sddc_goto_error_if_fail(select(max_fd + 1, NULL, &wfds, NULL, NULL) > 0);
+
+        for (i = 0; i < BENCH_CONN_NUM; i++) {
+            fd = sddc_connector_fd(bc[i].conn);
+            if ((fd >= 0) && FD_ISSET(fd, &wfds)) {
+                sddc_connector_process(bc[i].conn);
+
+                sddc_goto_error_if_fail(bc[i].event != SDDC_CONNECTOR_EV_ERROR);
+                done += (bc[i].event == SDDC_CONNECTOR_EV_DONE);
+            }
+        }
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    ret = (bench_conn_chunks == result->count) ? 0 : -1;
+
+error:
+    bench_count_stop(result);
+    for (i = 0; i < BENCH_CONN_NUM; i++) {
+        if (bc[i].conn != NULL) {
+            sddc_connector_destroy(bc[i].conn);
+        }
+    }
+    return ret;
+}
+
+/*
+ * Connector transfers to the joined EdgerOS, plain and encrypted (engine security off)
+ */
+static int bench_run_connector(void)
+{
+    static const char *modes[] = { "put", "async", "put", "putv", "new", "pooled" };
+    static char     names[12][32];
+    bench_result_t  result;
+    pthread_t       sink_tid;
+    uint8_t        *data;
+    uint32_t        i, num, size;
+    int             mode;
+    int             ret = -1;
+
+    memset(&result, 0, sizeof(result));
+    result.lat_ns = malloc(BENCH_CONN_NUM * BENCH_CONN_CHUNKS * sizeof(uint32_t));
+    data          = malloc(BENCH_CONN_BIG_SIZE);
+    sddc_goto_error_if_fail(result.lat_ns && data);
+
+    for (i = 0; i < BENCH_CONN_BIG_SIZE; i++) {
+        data[i] = (uint8_t)(i * 31);
+    }
+
+    sddc_goto_error_if_fail(bench_peer_open(&bench_peer, SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_engine_start(SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_peer_join(&bench_peer) == 0);
+
+    for (i = 0; i < 12; i++) {
+        const char *token = NULL;
+
+        mode = i % 6;
+
+#if SDDC_CFG_SECURITY_EN > 0
+        token = (i >= 6) ? BENCH_TOKEN : NULL;
+#else
+        if (i >= 6) {
+            break;
+        }
+#endif
+        result.security_en = (token != NULL);
+
+        if (mode < 2) {
+            num          = BENCH_CONN_NUM;
+            size         = BENCH_CONN_SIZE;
+            result.count = BENCH_CONN_NUM * BENCH_CONN_CHUNKS;
+            snprintf(names[i], sizeof(names[i]), "connector %s x%u", modes[mode], num);
+        } else if (mode < 4) {
+            num          = BENCH_CONN_NUM;
+            size         = BENCH_CONN_BIG_SIZE;
+            result.count = BENCH_CONN_NUM;
+            snprintf(names[i], sizeof(names[i]), "connector %s 1MB", modes[mode]);
+        } else {
+            num          = BENCH_CONN_SMALL_NUM;
+            size         = BENCH_CONN_SMALL_SIZE;
+            result.count = BENCH_CONN_SMALL_NUM;
+            snprintf(names[i], sizeof(names[i]), "connector %s x%u", modes[mode], num);
+        }
+        result.name = names[i];
+
+        sddc_goto_error_if_fail(bench_sink_start(&sink_tid, num, (mode == 5) ? num : 0) == 0);
+        switch (mode) {
+        case 0:
+            ret = bench_connector_put(&bench_peer, &result, data, token);
+            break;
+        case 1:
+            ret = bench_connector_async(&bench_peer, &result, data, token);
+            break;
+        case 2:
+        case 3:
+            ret = bench_connector_put_big(&bench_peer, &result, data, token, mode == 3);
+            break;
+        default:
+            ret = bench_connector_small(&bench_peer, &result, data, token, mode == 5);
+            break;
+        }
+        bench_sink_stop(sink_tid);
+        sddc_goto_error_if_fail(ret == 0);
+        sddc_goto_error_if_fail(bench_sink_bytes >= (uint64_t)num * size);
+
+        bench_report(&result);
+        printf("%-20s %u x %uKB %.1f MB/s\n", "  transfer", num, size / 1024,
+               (double)num * size / result.seconds / 1e6);
+#if SDDC_CFG_SECURITY_EN > 0
+        if ((token != NULL) && (mode >= 4)) {
+            printf("%-20s md5/conn:%.2f setkey/conn:%.2f\n", "  key derivation",
+                   (double)bench_md_calls / num, (double)bench_setkey_calls / num);
+        }
+#endif
+    }
+
+error:
+    if (bench_sddc != NULL) {
+        bench_engine_stop();
+    }
+    if (bench_peer.fd > 0) {
+        close(bench_peer.fd);
+    }
+    free(result.lat_ns);
+    free(data);
+
+    return ret;
+}
+
+/*
+ * rx and tx through an application event loop (sddc_get_fd, sddc_process_readable,
+ * sddc_process_timers, sddc_next_deadline_ms), security off
+ */
+static int bench_run_poll(uint32_t count)
+{
+    bench_result_t result;
+    pthread_t      peer_tid;
+    int            ret = -1;
+
+    memset(&result, 0, sizeof(result));
+    result.count  = count;
+    result.lat_ns = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    bench_poll_loop = 1;
+
+    sddc_goto_error_if_fail(bench_peer_open(&bench_peer, SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_engine_start(SDDC_FALSE) == 0);
+    sddc_goto_error_if_fail(bench_peer_join(&bench_peer) == 0);
+
+    result.name = "poll rx message+ack";
+    sddc_goto_error_if_fail(bench_rx_message(&bench_peer, &result, 1) == 0);
+    bench_report(&result);
+
+    bench_peer_quit = 0;
+    sddc_goto_error_if_fail(pthread_create(&peer_tid, NULL, bench_peer_thread, &bench_peer) == 0);
+
+    result.name = "poll tx reliable";
+    ret = bench_tx_message(&bench_peer, &result, 1);
+    if (ret == 0) {
+        bench_report(&result);
+    }
+
+    bench_peer_quit = 1;
+    pthread_join(peer_tid, NULL);
+
+error:
+    if (bench_sddc != NULL) {
+        bench_engine_stop();
+    }
+    if (bench_peer.fd > 0) {
+        close(bench_peer.fd);
+    }
+    free(result.lat_ns);
+
+    bench_poll_loop = 0;
+
+    return ret;
+}
+
+#if SDDC_CFG_SECURITY_EN > 0
+/*
+ * Per-packet cost of a crypto backend, mode: SDDC_CRYPTO_AES_128_*. cycles: total CPU cycles
+ */
+static int bench_backend(bench_result_t *result, const sddc_crypto_ops_t *crypto, int mode, size_t len,
+                         uint64_t *cycles)
+{
+    static uint8_t  input[BENCH_BACKEND_SIZE_MAX];
+    uint8_t         output[BENCH_BACKEND_SIZE_MAX + 16];
+    uint8_t         key[16];
+    uint8_t         iv[16];
+    uint8_t         aad[4] = { BENCH_TYPE_MESSAGE, 0, 0, 0 };
+    uint8_t         tag[16];
+    size_t          olen;
+    void           *ctx;
+    uint64_t        begin, start, cycle;
+    uint32_t        i;
+    int             ret = 0;
+
+    bench_gen_key(key, iv);
+
+    ctx = crypto->create(mode, SDDC_TRUE, key);
+    sddc_return_value_if_fail(ctx, -1);
+
+    *cycles = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        cycle = bench_cycles();
+
+        if (mode == SDDC_CRYPTO_AES_128_CBC) {
+            ret |= crypto->crypt(ctx, iv, input, len, output, &olen);
+        } else {
+            memcpy(iv + SDDC_UID_LEN, &i, sizeof(i));
+            ret |= crypto->seal(ctx, iv, 12, aad, sizeof(aad), input, len, output, tag, 8);
+        }
+
+        *cycles += bench_cycles() - cycle;
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    crypto->destroy(ctx);
+
+    return ret;
+}
+
+/*
+ * Encrypt with one backend and decrypt with the other, CBC and GCM. Returns 0 if they agree
+ */
+static int bench_backend_interop(const sddc_crypto_ops_t *from, const sddc_crypto_ops_t *to, size_t len)
+{
+    uint8_t     input[BENCH_BACKEND_SIZE_MAX];
+    uint8_t     sealed[BENCH_BACKEND_SIZE_MAX + 16];
+    uint8_t     output[BENCH_BACKEND_SIZE_MAX + 32];
+    uint8_t     key[16];
+    uint8_t     iv[16];
+    uint8_t     aad[4] = { BENCH_TYPE_MESSAGE, 0, 0, 1 };
+    uint8_t     tag[16];
+    size_t      slen, olen, flen;
+    void       *enc, *dec;
+    size_t      i;
+    int         ret = -1;
+
+    for (i = 0; i < len; i++) {
+        input[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    bench_gen_key(key, iv);
+
+    /*
+     * CBC, the receiver decrypts in pieces as the connectors do
+     */
+    enc = from->create(SDDC_CRYPTO_AES_128_CBC, SDDC_TRUE, key);
+    dec = to->create(SDDC_CRYPTO_AES_128_CBC, SDDC_FALSE, key);
+    if (enc && dec &&
+        (from->crypt(enc, iv, input, len, sealed, &slen) == 0) &&
+        (to->start(dec, iv) == 0) &&
+        (to->update(dec, sealed, slen / 2, output, &olen) == 0) &&
+        (to->update(dec, sealed + slen / 2, slen - slen / 2, output + olen, &flen) == 0)) {
+        olen += flen;
+        if ((to->finish(dec, output + olen, &flen) == 0) && (olen + flen == len) &&
+            (memcmp(input, output, len) == 0)) {
+            ret = 0;
+        }
+    }
+    if (enc) {
+        from->destroy(enc);
+    }
+    if (dec) {
+        to->destroy(dec);
+    }
+    sddc_return_value_if_fail(ret == 0, -1);
+
+    /*
+     * GCM, and a flipped tag bit must be refused
+     */
+    ret = -1;
+    enc = from->create(SDDC_CRYPTO_AES_128_GCM, SDDC_TRUE, key);
+    dec = to->create(SDDC_CRYPTO_AES_128_GCM, SDDC_FALSE, key);
+    if (enc && dec &&
+        (from->seal(enc, iv, 12, aad, sizeof(aad), input, len, sealed, tag, 8) == 0) &&
+        (to->open(dec, iv, 12, aad, sizeof(aad), sealed, len, output, tag, 8) == 0) &&
+        (memcmp(input, output, len) == 0)) {
+        tag[0] ^= 0x01;
+        if (to->open(dec, iv, 12, aad, sizeof(aad), sealed, len, output, tag, 8) != 0) {
+            ret = 0;
+        }
+    }
+    if (enc) {
+        from->destroy(enc);
+    }
+    if (dec) {
+        to->destroy(dec);
+    }
+
+    return ret;
+}
+
+static int bench_run_backend(bench_result_t *result)
+{
+    static const sddc_crypto_ops_t *backends[] = {
+        &sddc_crypto_mbedtls,
+#if BENCH_OPENSSL_EN > 0
+        &sddc_crypto_openssl,
+#endif
+    };
+    static const size_t sizes[] = { 64, 512, BENCH_BACKEND_SIZE_MAX };
+    char                name[32];
+    uint64_t            cycles[2][sizeof(sizes) / sizeof(sizes[0])];
+    unsigned int        b, m, i, j;
+    int                 ret = 0;
+
+    for (b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        for (m = 0; m < 2; m++) {
+            for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                snprintf(name, sizeof(name), "%s %s %u", backends[b]->name, m ? "gcm" : "cbc", (unsigned)sizes[i]);
+                result->name = name;
+                ret |= bench_backend(result, backends[b], m ? SDDC_CRYPTO_AES_128_GCM : SDDC_CRYPTO_AES_128_CBC,
+                                     sizes[i], &cycles[m][i]);
+                bench_report(result);
+            }
+        }
+
+        printf("%-20s", "  " BENCH_CYCLES_UNIT "/pkt");
+        for (m = 0; m < 2; m++) {
+            for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                printf(" %s%u:%.0f", m ? "gcm" : "cbc", (unsigned)sizes[i], (double)cycles[m][i] / result->count);
+            }
+        }
+        printf("\n");
+    }
+
+    /*
+     * Every backend must read what every backend (itself included) writes
+     */
+    printf("%-20s", "  interop");
+    for (b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        for (j = 0; j < sizeof(backends) / sizeof(backends[0]); j++) {
+            for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                if (bench_backend_interop(backends[b], backends[j], sizes[i]) != 0) {
+                    break;
+                }
+            }
+            printf(" %s->%s:%s", backends[b]->name, backends[j]->name,
+                   (i == sizeof(sizes) / sizeof(sizes[0])) ? "ok" : "mismatch");
+            if (i != sizeof(sizes) / sizeof(sizes[0])) {
+                ret = -1;
+            }
+        }
+    }
+    printf("\n");
+
+    return ret;
+}
+
+static int bench_run_crypto(uint32_t count)
+{
+    bench_result_t result;
+
+    memset(&result, 0, sizeof(result));
+    result.security_en = SDDC_TRUE;
+    result.count       = count;
+    result.lat_ns      = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    static const struct {
+        const char *name;
+        const char *tag;
+        int         mode;
+    } rows[] = {
+        { "aes per-pkt setup",  "cbc-setup", BENCH_AES_CBC_SETUP },
+        { "aes persistent ctx", "cbc",       BENCH_AES_CBC       },
+#if BENCH_GCM_EN > 0
+        { "aes-gcm seal",       "gcm-seal",  BENCH_AES_GCM_SEAL  },
+        { "aes-gcm open",       "gcm-open",  BENCH_AES_GCM_OPEN  },
+#endif
+    };
+    static const size_t sizes[] = { sizeof(BENCH_MESSAGE) - 1, 64, 512, 1400 };
+    uint64_t            cycles[sizeof(rows) / sizeof(rows[0])];
+    unsigned int        i;
+    int                 ret = 0;
+
+    for (i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        result.name = rows[i].name;
+        ret |= bench_crypto(&result, rows[i].mode, &cycles[i]);
+        bench_report(&result);
+    }
+
+    printf("%-20s", "  " BENCH_CYCLES_UNIT "/pkt");
+    for (i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        printf(" %s:%.0f", rows[i].tag, (double)cycles[i] / count);
+    }
+    printf("\n");
+
+    printf("%-20s", "  wire bytes");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+#if BENCH_GCM_EN > 0
+        printf(" %uB cbc:%u gcm:%u", (unsigned)sizes[i],
+               (unsigned)bench_wire_cbc(sizes[i]), (unsigned)bench_wire_gcm(sizes[i]));
+#else
+        printf(" %uB cbc:%u", (unsigned)sizes[i], (unsigned)bench_wire_cbc(sizes[i]));
+#endif
+    }
+    printf("\n");
+
+    ret |= bench_run_backend(&result);
+
+    free(result.lat_ns);
+
+    return ret;
+}
+#endif
+
+#if SDDC_CFG_LZ_EN > 0
+/* Payloads as the ESP32 examples build them, cJSON_Print is indented */
+static const char bench_lz_report[] =
+    "{\n\t\"report\":\t{\n\t\t\"name\":\t\"IoT Pi\",\n\t\t\"type\":\t\"device\",\n\t\t\"excl\":\tfalse,\n"
+    "\t\t\"desc\":\t\"https://www.edgeros.com/iotpi\",\n\t\t\"model\":\t\"1\",\n\t\t\"vendor\":\t\"ACOINFO\",\n"
+    "\t\t\"sn\":\t\"2402AE8C7F50\"\n\t}\n}";
+static const char bench_lz_invite[] =
+    "{\n\t\"report\":\t{\n\t\t\"name\":\t\"IoT Pi\",\n\t\t\"type\":\t\"device\",\n\t\t\"excl\":\tfalse,\n"
+    "\t\t\"desc\":\t\"https://www.edgeros.com/iotpi\",\n\t\t\"model\":\t\"1\",\n\t\t\"vendor\":\t\"ACOINFO\",\n"
+    "\t\t\"sn\":\t\"2402AE8C7F50\"\n\t},\n\t\"server\":\t{\n\t\t\"vsoa\":\t[{\n\t\t\t\t\"desc\":\t\"/camera\",\n"
+    "\t\t\t\t\"port\":\t3000\n\t\t\t}]\n\t}\n}";
+static const char bench_lz_telemetry[] =
+    "{\"temp\":[23.5,23.5,23.6,23.6,23.6,23.7,23.7,23.7],\"humi\":[41,41,41,42,42,42,42,43],"
+    "\"lock\":false,\"door\":false,\"battery\":87,\"rssi\":-61,\"uptime\":123456}";
+
+/*
+ * Compress and decompress cost per message of the payload codec, and its ratio
+ */
+static int bench_lz(bench_result_t *result, const char *data, size_t len, sddc_bool_t decompress, size_t *lz_len)
+{
+    uint8_t  packed[SDDC_CFG_SEND_BUF_SIZE];
+    uint8_t  output[SDDC_CFG_SEND_BUF_SIZE];
+    ssize_t  plen, olen = -1;
+    uint64_t begin, start;
+    uint32_t i;
+
+    plen = sddc_lz_compress(bench_sddc, data, len, packed, sizeof(packed));
+    sddc_return_value_if_fail(plen > 0, -1);
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+        if (decompress) {
+            olen = sddc_lz_decompress(bench_sddc, packed, plen, output, sizeof(output));
+        } else {
+            plen = sddc_lz_compress(bench_sddc, data, len, packed, sizeof(packed));
+        }
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    if (decompress && ((olen != (ssize_t)len) || (memcmp(output, data, len) != 0))) {
+        fprintf(stderr, "%s: decompressed data mismatch\n", result->name);
+        return -1;
+    }
+
+    *lz_len = plen;
+
+    return 0;
+}
+
+static int bench_run_lz(uint32_t count)
+{
+    static const struct {
+        const char *name;
+        const char *data;
+        size_t      len;
+    } payloads[] = {
+        { "report",    bench_lz_report,    sizeof(bench_lz_report) - 1 },
+        { "invite",    bench_lz_invite,    sizeof(bench_lz_invite) - 1 },
+        { "telemetry", bench_lz_telemetry, sizeof(bench_lz_telemetry) - 1 },
+    };
+    static char    names[2][32];
+    bench_result_t result;
+    size_t         lz_len;
+    unsigned int   i;
+    int            ret = 0;
+
+    memset(&result, 0, sizeof(result));
+    result.count  = count;
+    result.lat_ns = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    bench_sddc = sddc_create(BENCH_ENGINE_PORT);
+    if (bench_sddc == NULL) {
+        free(result.lat_ns);
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+        snprintf(names[0], sizeof(names[0]), "lz %s", payloads[i].name);
+        result.name = names[0];
+        ret |= bench_lz(&result, payloads[i].data, payloads[i].len, SDDC_FALSE, &lz_len);
+        bench_report(&result);
+
+        snprintf(names[1], sizeof(names[1]), "unlz %s", payloads[i].name);
+        result.name = names[1];
+        ret |= bench_lz(&result, payloads[i].data, payloads[i].len, SDDC_TRUE, &lz_len);
+        bench_report(&result);
+
+        printf("%-20s %uB -> %uB (%.1f%%)\n", "  lz ratio", (unsigned)payloads[i].len, (unsigned)lz_len,
+               100.0 * lz_len / payloads[i].len);
+    }
+
+    sddc_destroy(bench_sddc);
+    bench_sddc = NULL;
+    free(result.lat_ns);
+
+    return ret;
+}
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+/* Smart lock command set */
+#define BENCH_CMD_UNLOCK        0
+#define BENCH_CMD_RECV          1
+#define BENCH_CMD_CONNECTOR     2
+
+/*
+ * Encode a smart lock command as CBOR
+ */
+static ssize_t bench_cmd_encode(int cmd, uint8_t *buf, size_t size)
+{
+    sddc_cbor_writer_t writer;
+
+    sddc_cbor_writer_init(&writer, buf, size);
+
+    switch (cmd) {
+    case BENCH_CMD_UNLOCK:
+        sddc_cbor_put_map(&writer, 2);
+        sddc_cbor_put_text(&writer, "cmd", 3);
+        sddc_cbor_put_text(&writer, "unlock", 6);
+        sddc_cbor_put_text(&writer, "timeout", 7);
+        sddc_cbor_put_int(&writer, 5000);
+        break;
+
+    case BENCH_CMD_RECV:
+        sddc_cbor_put_map(&writer, 2);
+        sddc_cbor_put_text(&writer, "cmd", 3);
+        sddc_cbor_put_text(&writer, "recv", 4);
+        sddc_cbor_put_text(&writer, "size", 4);
+        sddc_cbor_put_int(&writer, 23456);
+        break;
+
+    default:
+        sddc_cbor_put_map(&writer, 2);
+        sddc_cbor_put_text(&writer, "cmd", 3);
+        sddc_cbor_put_text(&writer, "recv", 4);
+        sddc_cbor_put_text(&writer, "connector", 9);
+        sddc_cbor_put_map(&writer, 2);
+        sddc_cbor_put_text(&writer, "port", 4);
+        sddc_cbor_put_int(&writer, 39721);
+        sddc_cbor_put_text(&writer, "token", 5);
+        sddc_cbor_put_text(&writer, BENCH_TOKEN, sizeof(BENCH_TOKEN) - 1);
+        break;
+    }
+
+    return sddc_cbor_writer_len(&writer);
+}
+
+/*
+ * Decode a command as esp_on_message of the smart lock, in place
+ */
+static int bench_cmd_cbor_parse(const uint8_t *data, size_t len)
+{
+    sddc_cbor_reader_t reader, map, connector;
+    sddc_cbor_item_t   root, cmd, item;
+
+    sddc_cbor_reader_init(&reader, data, len);
+    sddc_return_value_if_fail(sddc_cbor_read(&reader, &root) == 0 && root.type == SDDC_CBOR_MAP, -1);
+
+    map = reader;
+    sddc_return_value_if_fail(sddc_cbor_map_find(&map, root.len, "cmd", &cmd, NULL) == 0, -1);
+
+    if (sddc_cbor_text_is(&cmd, "unlock")) {
+        sddc_return_value_if_fail(sddc_cbor_map_find(&map, root.len, "timeout", &item, NULL) == 0, -1);
+        return (item.integer == 5000) ? 0 : -1;
+    }
+
+    sddc_return_value_if_fail(sddc_cbor_text_is(&cmd, "recv"), -1);
+
+    if (sddc_cbor_map_find(&map, root.len, "connector", &item, &connector) == 0) {
+        size_t count = item.len;
+
+        sddc_return_value_if_fail(item.type == SDDC_CBOR_MAP, -1);
+        sddc_return_value_if_fail(sddc_cbor_map_find(&connector, count, "port", &item, NULL) == 0, -1);
+        sddc_return_value_if_fail(item.integer == 39721, -1);
+        sddc_return_value_if_fail(sddc_cbor_map_find(&connector, count, "token", &item, NULL) == 0, -1);
+        return sddc_cbor_text_is(&item, BENCH_TOKEN) ? 0 : -1;
+    }
+
+    sddc_return_value_if_fail(sddc_cbor_map_find(&map, root.len, "size", &item, NULL) == 0, -1);
+
+    return (item.integer == 23456) ? 0 : -1;
+}
+
+#if BENCH_CJSON_EN > 0
+/*
+ * Parse a command as esp_on_message of the smart lock, with cJSON
+ */
+static int bench_cmd_json_parse(const char *json)
+{
+    cJSON *root = cJSON_Parse(json);
+    cJSON *cmd, *item, *connector;
+    int    ret = -1;
+
+    sddc_return_value_if_fail(root, -1);
+
+    cmd = cJSON_GetObjectItem(root, "cmd");
+    sddc_goto_error_if_fail(cJSON_IsString(cmd));
+
+    if (strcmp(cmd->valuestring, "unlock") == 0) {
+        item = cJSON_GetObjectItem(root, "timeout");
+        ret  = (cJSON_IsNumber(item) && (item->valuedouble == 5000)) ? 0 : -1;
+
+    } else if ((connector = cJSON_GetObjectItem(root, "connector")) != NULL) {
+        item = cJSON_GetObjectItem(connector, "port");
+        sddc_goto_error_if_fail(cJSON_IsNumber(item) && (item->valuedouble == 39721));
+        item = cJSON_GetObjectItem(connector, "token");
+        ret  = (cJSON_IsString(item) && (strcmp(item->valuestring, BENCH_TOKEN) == 0)) ? 0 : -1;
+
+    } else {
+        item = cJSON_GetObjectItem(root, "size");
+        ret  = (cJSON_IsNumber(item) && (item->valuedouble == 23456)) ? 0 : -1;
+    }
+
+error:
+    cJSON_Delete(root);
+
+    return ret;
+}
+#endif
+
+/*
+ * Parse cost per message of a command, CBOR in place or JSON by cJSON
+ */
+static int bench_cmd_parse(bench_result_t *result, const uint8_t *cbor, size_t cbor_len,
+                           const char *json, sddc_bool_t is_json)
+{
+    uint64_t begin, start;
+    uint32_t i;
+    int      ret = 0;
+
+    bench_count_start();
+    begin = bench_now_ns();
+
+    for (i = 0; i < result->count; i++) {
+        start = bench_now_ns();
+#if BENCH_CJSON_EN > 0
+        if (is_json) {
+            ret |= bench_cmd_json_parse(json);
+        } else
+#endif
+        {
+            ret |= bench_cmd_cbor_parse(cbor, cbor_len);
+        }
+        result->lat_ns[i] = bench_now_ns() - start;
+    }
+
+    result->seconds = (bench_now_ns() - begin) / 1e9;
+    bench_count_stop(result);
+
+    if (ret != 0) {
+        fprintf(stderr, "%s: parse failed\n", result->name);
+    }
+
+    return ret;
+}
+
+static int bench_run_cbor(uint32_t count)
+{
+    static const char *cmds[] = { "unlock", "recv", "connector" };
+    static char        names[2][32];
+    bench_result_t     result;
+    uint8_t            cbor[256];
+    char               json[256];
+    ssize_t            cbor_len, json_len;
+    int                i;
+    int                ret = 0;
+
+    memset(&result, 0, sizeof(result));
+    result.count  = count;
+    result.lat_ns = malloc(count * sizeof(uint32_t));
+    sddc_return_value_if_fail(result.lat_ns, -1);
+
+    for (i = BENCH_CMD_UNLOCK; i <= BENCH_CMD_CONNECTOR; i++) {
+        cbor_len = bench_cmd_encode(i, cbor, sizeof(cbor));
+        json_len = (cbor_len > 0) ? sddc_cbor_to_json(cbor, cbor_len, json, sizeof(json)) : -1;
+        if (json_len < 0) {
+            fprintf(stderr, "cbor %s: encode failed\n", cmds[i]);
+            ret = -1;
+            continue;
+        }
+
+        snprintf(names[0], sizeof(names[0]), "cbor %s", cmds[i]);
+        result.name = names[0];
+        ret |= bench_cmd_parse(&result, cbor, cbor_len, json, SDDC_FALSE);
+        bench_report(&result);
+
+#if BENCH_CJSON_EN > 0
+        snprintf(names[1], sizeof(names[1]), "json %s", cmds[i]);
+        result.name = names[1];
+        ret |= bench_cmd_parse(&result, cbor, cbor_len, json, SDDC_TRUE);
+        bench_report(&result);
+#else
+        (void)names[1];
+#endif
+
+        printf("%-20s json:%uB cbor:%uB (%.1f%%)\n", "  wire bytes", (unsigned)json_len, (unsigned)cbor_len,
+               100.0 * cbor_len / json_len);
+    }
+
+#if BENCH_CJSON_EN == 0
+    printf("%-20s %-4s (cJSON not found)\n", "json *", "off");
+#endif
+
+    free(result.lat_ns);
+
+    return ret;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = BENCH_DEF_COUNT;
+    int      ret   = 0;
+
+    if (argc > 1) {
+        count = strtoul(argv[1], NULL, 0);
+        if (count == 0) {
+            fprintf(stderr, "Usage: %s [count]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    sem_init(&bench_ack_sem, 0, 0);
+    sem_init(&bench_ready_sem, 0, 0);
+    sem_init(&bench_done_sem, 0, 0);
+
+    printf("%-20s %-4s %8s %12s %10s %10s %12s %10s %8s %11s\n",
+           "scenario", "sec", "packets", "pkt/s", "p50(us)", "p99(us)", "alloc B/pkt", "allocs/pkt", "sys/pkt",
+           "copy B/pkt");
+
+    ret |= bench_run(SDDC_FALSE, count);
+#if SDDC_CFG_STATS_EN > 0
+    ret |= bench_run_discover(count);
+#endif
+    ret |= bench_run_poll(count);
+    ret |= bench_run_connector();
+#if SDDC_CFG_SECURITY_EN > 0
+    ret |= bench_run(SDDC_TRUE, count);
+    ret |= bench_run_crypto(count);
+#else
+    printf("%-20s %-4s (SDDC_CFG_SECURITY_EN is 0)\n", "*", "on");
+#endif
+
+#if SDDC_CFG_LZ_EN > 0
+    ret |= bench_run_lz(count);
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+    ret |= bench_run_cbor(count);
+#endif
+
+#if SDDC_CFG_MULTI_EDGEROS_JOIN_EN > 0
+    {
+        static const uint32_t npeers[] = { 1, 16, 256, 4096 };
+        unsigned int i;
+
+        for (i = 0; i < sizeof(npeers) / sizeof(npeers[0]); i++) {
+            if (npeers[i] <= SDDC_CFG_EDGEROS_MAX) {
+                ret |= bench_run_scaling(npeers[i], count);
+            }
+        }
+    }
+#endif
+
+    sem_destroy(&bench_done_sem);
+    sem_destroy(&bench_ready_sem);
+    sem_destroy(&bench_ack_sem);
+
+    return ret ? 1 : 0;
+}
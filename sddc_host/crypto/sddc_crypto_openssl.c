@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2015-2021 ACOINFO Co., Ltd.
+ * All rights reserved.
+ *
+ * Detailed license information can be found in the LICENSE file.
+ *
+ * File: sddc_crypto_openssl.c SDDC crypto backend by OpenSSL EVP (Linux gateways).
+ *
+ * Author: agent <agent@local>
+ *
+ */
+
+#include <openssl/evp.h>
+#include "sddc_crypto_openssl.h"
+
+#if SDDC_CFG_SECURITY_EN > 0
+
+/*
+ * The key schedule is expanded by create, a new IV or nonce keeps it
+ */
+static void *__sddc_openssl_create(int mode, sddc_bool_t encrypt, const uint8_t *key)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+
+    sddc_return_value_if_fail(ctx, NULL);
+
+    if (EVP_CipherInit_ex(ctx, (mode == SDDC_CRYPTO_AES_128_GCM) ? EVP_aes_128_gcm() : EVP_aes_128_cbc(),
+                          NULL, key, NULL, encrypt ? 1 : 0) != 1) {
+        EVP_CIPHER_CTX_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static void __sddc_openssl_destroy(void *ctx)
+{
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+static int __sddc_openssl_start(void *ctx, const uint8_t *iv)
+{
+    return (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, -1) == 1) ? 0 : -1;
+}
+
+static int __sddc_openssl_update(void *ctx, const void *input, size_t len, void *output, size_t *olen)
+{
+    int out;
+
+    if (EVP_CipherUpdate(ctx, output, &out, input, (int)len) != 1) {
+        return -1;
+    }
+
+    *olen = out;
+
+    return 0;
+}
+
+static int __sddc_openssl_finish(void *ctx, void *output, size_t *olen)
+{
+    int out;
+
+    if (EVP_CipherFinal_ex(ctx, output, &out) != 1) {
+        return -1;
+    }
+
+    *olen = out;
+
+    return 0;
+}
+
+static int __sddc_openssl_crypt(void *ctx, const uint8_t *iv, const void *input, size_t len, void *output, size_t *olen)
+{
+    size_t out;
+
+    if ((__sddc_openssl_start(ctx, iv) != 0) ||
+        (__sddc_openssl_update(ctx, input, len, output, olen) != 0) ||
+        (__sddc_openssl_finish(ctx, (uint8_t *)output + *olen, &out) != 0)) {
+        return -1;
+    }
+
+    *olen += out;
+
+    return 0;
+}
+
+/*
+ * GCM: same context both ways, the direction is set with the nonce
+ */
+static int __sddc_openssl_gcm_start(void *ctx, const uint8_t *nonce, size_t nonce_len,
+                                    const uint8_t *aad, size_t aad_len, int encrypt)
+{
+    int out;
+
+    if ((EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, (int)nonce_len, NULL) != 1) ||
+        (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, nonce, encrypt) != 1)) {
+        return -1;
+    }
+
+    if ((aad_len > 0) && (EVP_CipherUpdate(ctx, NULL, &out, aad, (int)aad_len) != 1)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int __sddc_openssl_seal(void *ctx, const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                               const void *input, size_t len, void *output, uint8_t *tag, size_t tag_len)
+{
+    int out;
+
+    if ((__sddc_openssl_gcm_start(ctx, nonce, nonce_len, aad, aad_len, 1) != 0) ||
+        (EVP_CipherUpdate(ctx, output, &out, input, (int)len) != 1) ||
+        (EVP_CipherFinal_ex(ctx, (uint8_t *)output + out, &out) != 1) ||
+        (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, (int)tag_len, tag) != 1)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int __sddc_openssl_open(void *ctx, const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                               const void *input, size_t len, void *output, const uint8_t *tag, size_t tag_len)
+{
+    int out;
+
+    if ((__sddc_openssl_gcm_start(ctx, nonce, nonce_len, aad, aad_len, 0) != 0) ||
+        (EVP_CipherUpdate(ctx, output, &out, input, (int)len) != 1) ||
+        (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, (int)tag_len, (void *)tag) != 1) ||
+        (EVP_CipherFinal_ex(ctx, (uint8_t *)output + out, &out) != 1)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+const sddc_crypto_ops_t sddc_crypto_openssl = {
+    .name        = "openssl",
+    .create      = __sddc_openssl_create,
+    .destroy     = __sddc_openssl_destroy,
+    .crypt       = __sddc_openssl_crypt,
+    .crypt_multi = NULL,
+    .start       = __sddc_openssl_start,
+    .update      = __sddc_openssl_update,
+    .finish      = __sddc_openssl_finish,
+    .seal        = __sddc_openssl_seal,
+    .open        = __sddc_openssl_open,
+};
+
+#endif
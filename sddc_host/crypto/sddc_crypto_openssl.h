@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2015-2021 ACOINFO Co., Ltd.
+ * All rights reserved.
+ *
+ * Detailed license information can be found in the LICENSE file.
+ *
+ * File: sddc_crypto_openssl.h SDDC crypto backend by OpenSSL EVP (Linux gateways).
+ *
+ * Author: agent <agent@local>
+ *
+ */
+
+#ifndef SDDC_CRYPTO_OPENSSL_H
+#define SDDC_CRYPTO_OPENSSL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sddc.h"
+
+#if SDDC_CFG_SECURITY_EN > 0
+/*
+ * OpenSSL EVP backend, AES-NI where the CPU has it. Give it to sddc_create_with_crypto
+ */
+extern const sddc_crypto_ops_t sddc_crypto_openssl;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDDC_CRYPTO_OPENSSL_H */
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2015-2021 ACOINFO Co., Ltd.
+ * All rights reserved.
+ *
+ * Detailed license information can be found in the LICENSE file.
+ *
+ * File: sddc_trace.c SDDC trace dump (sddc_trace_dump) latency breakdown.
+ *
+ * Author: agent <agent@local>
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "sddc.h"
+
+/*
+ * A span is the records of one read, from SDDC_TRACE_READ to SDDC_TRACE_DONE. The time from
+ * a record to the next one of the span is the stage named after the later point
+ */
+#define TRACE_STAGE_NR          (SDDC_TRACE_DONE + 1)
+#define TRACE_TYPE_NR           8
+
+/* Stage samples, in clock ticks */
+typedef struct {
+    uint32_t   *ticks;
+    uint32_t    count;
+    uint32_t    size;
+    uint64_t    total;
+} trace_samples_t;
+
+/* A stage of the span being read, kept until SDDC_TRACE_DONE */
+typedef struct {
+    uint8_t     stage;
+    uint8_t     frame;          /* Packet type + 1, 0: the read */
+    uint32_t    ticks;
+} trace_pending_t;
+
+static const char *trace_stage_names[TRACE_STAGE_NR] = {
+    [SDDC_TRACE_LOCK]        = "lock",
+    [SDDC_TRACE_PACKET]      = "dispatch",
+    [SDDC_TRACE_UNPACK]      = "parse",
+    [SDDC_TRACE_UNPACKED]    = "decrypt",
+    [SDDC_TRACE_CALLOUT]     = "prepare",
+    [SDDC_TRACE_CALLOUT_END] = "callback",
+    [SDDC_TRACE_SEND]        = "ack build+send",
+    [SDDC_TRACE_DONE]        = "flush",
+};
+
+static const char *trace_type_names[TRACE_TYPE_NR] = {
+    "discover", "report", "update", "invite", "ping", "message", "timestamp", "type7"
+};
+
+static trace_samples_t  trace_stages[TRACE_STAGE_NR];
+static trace_samples_t  trace_spans;
+static uint64_t         trace_frames[TRACE_TYPE_NR + 1][TRACE_STAGE_NR];
+static uint32_t         trace_packets;
+static uint32_t         trace_broken;
+static double           trace_ns_per_tick;
+
+static int trace_samples_add(trace_samples_t *samples, uint32_t ticks)
+{
+    if (samples->count == samples->size) {
+        uint32_t  size = samples->size ? samples->size * 2 : 1024;
+        uint32_t *buf  = realloc(samples->ticks, size * sizeof(uint32_t));
+
+        if (buf == NULL) {
+            return -1;
+        }
+        samples->ticks = buf;
+        samples->size  = size;
+    }
+
+    samples->ticks[samples->count++] = ticks;
+    samples->total += ticks;
+
+    return 0;
+}
+
+static int trace_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Split the records into spans, the records of other tasks taken while a callback runs
+ * without the lock are skipped
+ */
+static int trace_parse(const sddc_trace_t *rec, uint32_t count)
+{
+    trace_pending_t *pending;
+    uint32_t         npending = 0;
+    uint32_t         span_begin = 0;
+    uint32_t         last = 0;
+    uint32_t         packets = 0;
+    uint8_t          frame = 0;
+    int              in_span = 0;
+    int              in_callout = 0;
+    uint32_t         i, j;
+
+    pending = malloc(count * sizeof(trace_pending_t));
+    if ((pending == NULL) && (count > 0)) {
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        uint8_t point = rec[i].point;
+
+        if (point == SDDC_TRACE_READ) {
+            if (in_span) {
+                trace_broken++;
+            }
+            in_span    = 1;
+            in_callout = 0;
+            npending   = 0;
+            packets    = 0;
+            frame      = 0;
+            span_begin = rec[i].time;
+            last       = rec[i].time;
+            continue;
+        }
+
+        if (!in_span || (point >= TRACE_STAGE_NR)) {
+            continue;
+        }
+
+        if (in_callout && (point != SDDC_TRACE_CALLOUT_END)) {
+            continue;
+        }
+        in_callout = (point == SDDC_TRACE_CALLOUT);
+
+        if (point == SDDC_TRACE_PACKET) {
+            frame = (rec[i].type < TRACE_TYPE_NR) ? rec[i].type + 1 : 0;
+            packets++;
+        } else if (point == SDDC_TRACE_DONE) {
+            frame = 0;
+        }
+
+        pending[npending].stage = point;
+        pending[npending].frame = frame;
+        pending[npending].ticks = rec[i].time - last;
+        npending++;
+        last = rec[i].time;
+
+        if (point == SDDC_TRACE_DONE) {
+            for (j = 0; j < npending; j++) {
+                if (trace_samples_add(&trace_stages[pending[j].stage], pending[j].ticks) != 0) {
+                    free(pending);
+                    return -1;
+                }
+                trace_frames[pending[j].frame][pending[j].stage] += pending[j].ticks;
+            }
+            if (trace_samples_add(&trace_spans, rec[i].time - span_begin) != 0) {
+                free(pending);
+                return -1;
+            }
+            trace_packets += packets;
+            in_span = 0;
+        }
+    }
+
+    if (in_span) {
+        trace_broken++;
+    }
+
+    free(pending);
+
+    return 0;
+}
+
+static void trace_report_row(const char *name, trace_samples_t *samples, uint64_t span_total)
+{
+    if (samples->count == 0) {
+        return;
+    }
+
+    qsort(samples->ticks, samples->count, sizeof(uint32_t), trace_cmp_u32);
+
+    printf("%-16s %8u %10.2f %10.2f %10.2f %10.2f %7.1f%%\n",
+           name,
+           samples->count,
+           samples->total * trace_ns_per_tick / samples->count / 1000.0,
+           samples->ticks[samples->count / 2] * trace_ns_per_tick / 1000.0,
+           samples->ticks[(uint64_t)samples->count * 99 / 100] * trace_ns_per_tick / 1000.0,
+           samples->ticks[samples->count - 1] * trace_ns_per_tick / 1000.0,
+           span_total ? samples->total * 100.0 / span_total : 0.0);
+}
+
+/*
+ * Per stage latency of all spans
+ */
+static void trace_report_stages(void)
+{
+    int i;
+
+    printf("%-16s %8s %10s %10s %10s %10s %8s\n",
+           "stage", "count", "mean(us)", "p50(us)", "p99(us)", "max(us)", "time");
+
+    for (i = SDDC_TRACE_LOCK; i < TRACE_STAGE_NR; i++) {
+        trace_report_row(trace_stage_names[i], &trace_stages[i], trace_spans.total);
+    }
+
+    trace_report_row("read total", &trace_spans, trace_spans.total);
+}
+
+static uint64_t trace_frame_total(int frame)
+{
+    uint64_t total = 0;
+    int      i;
+
+    for (i = 0; i < TRACE_STAGE_NR; i++) {
+        total += trace_frames[frame][i];
+    }
+
+    return total;
+}
+
+/*
+ * Flame style: the read, its packet types and their stages, by share of the time
+ */
+static void trace_report_flame(void)
+{
+    uint64_t total = trace_spans.total;
+    uint64_t frame_total;
+    char     name[64];
+    int      frame, i;
+
+    if (total == 0) {
+        return;
+    }
+
+    printf("\n%-28s %7s %10s  %s\n", "frame", "time", "total(us)", "");
+
+    printf("%-28s %6.1f%% %10.1f  %.50s\n", "read", 100.0, total * trace_ns_per_tick / 1000.0,
+           "##################################################");
+
+    for (frame = 0; frame <= TRACE_TYPE_NR; frame++) {
+        frame_total = trace_frame_total(frame);
+        if (frame_total == 0) {
+            continue;
+        }
+
+        if (frame > 0) {
+            snprintf(name, sizeof(name), "  %s", trace_type_names[frame - 1]);
+            printf("%-28s %6.1f%% %10.1f  %.*s\n", name, frame_total * 100.0 / total,
+                   frame_total * trace_ns_per_tick / 1000.0, (int)(frame_total * 50 / total),
+                   "##################################################");
+        }
+
+        for (i = 0; i < TRACE_STAGE_NR; i++) {
+            if (trace_frames[frame][i] == 0) {
+                continue;
+            }
+            snprintf(name, sizeof(name), "%s%s", (frame > 0) ? "    " : "  ", trace_stage_names[i]);
+            printf("%-28s %6.1f%% %10.1f  %.*s\n", name, trace_frames[frame][i] * 100.0 / total,
+                   trace_frames[frame][i] * trace_ns_per_tick / 1000.0, (int)(trace_frames[frame][i] * 50 / total),
+                   "##################################################");
+        }
+    }
+}
+
+/*
+ * Folded stacks (flamegraph.pl), nanoseconds
+ */
+static void trace_report_folded(void)
+{
+    int frame, i;
+
+    for (frame = 0; frame <= TRACE_TYPE_NR; frame++) {
+        for (i = 0; i < TRACE_STAGE_NR; i++) {
+            if (trace_frames[frame][i] == 0) {
+                continue;
+            }
+            if (frame > 0) {
+                printf("read;%s;%s %.0f\n", trace_type_names[frame - 1], trace_stage_names[i],
+                       trace_frames[frame][i] * trace_ns_per_tick);
+            } else {
+                printf("read;%s %.0f\n", trace_stage_names[i], trace_frames[frame][i] * trace_ns_per_tick);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    sddc_trace_header_t header;
+    sddc_trace_t       *rec;
+    const char         *path;
+    int                 folded = 0;
+    FILE               *fp;
+
+    if ((argc == 3) && (strcmp(argv[1], "-f") == 0)) {
+        folded = 1;
+        path   = argv[2];
+    } else if (argc == 2) {
+        path = argv[1];
+    } else {
+        fprintf(stderr, "Usage: %s [-f] dump\n  -f: folded stacks for flamegraph.pl\n", argv[0]);
+        return 1;
+    }
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+        fprintf(stderr, "%s: no trace header\n", path);
+        fclose(fp);
+        return 1;
+    }
+
+    if ((header.magic != SDDC_TRACE_MAGIC) || (header.version != SDDC_TRACE_VERSION) ||
+        (header.record_size != sizeof(sddc_trace_t)) || (header.clock_khz == 0)) {
+        fprintf(stderr, "%s: not a version %u trace dump of this byte order\n", path, SDDC_TRACE_VERSION);
+        fclose(fp);
+        return 1;
+    }
+
+    rec = malloc((header.count ? header.count : 1) * sizeof(sddc_trace_t));
+    if ((rec == NULL) || (fread(rec, sizeof(sddc_trace_t), header.count, fp) != header.count)) {
+        fprintf(stderr, "%s: short trace dump\n", path);
+        free(rec);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+
+    trace_ns_per_tick = 1000000.0 / header.clock_khz;
+
+    if (trace_parse(rec, header.count) != 0) {
+        fprintf(stderr, "Out of memory\n");
+        free(rec);
+        return 1;
+    }
+    free(rec);
+
+    if (folded) {
+        trace_report_folded();
+        return 0;
+    }
+
+    printf("records:%u lost:%u clock:%ukHz reads:%u packets:%u incomplete:%u\n\n",
+           header.count, header.lost, header.clock_khz, trace_spans.count, trace_packets, trace_broken);
+
+    trace_report_stages();
+    trace_report_flame();
+
+    return 0;
+}
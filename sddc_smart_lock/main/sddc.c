@@ -10,11 +10,22 @@
  *
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE                     /* recvmmsg/sendmmsg */
+#endif
+
 #include <sys/socket.h>
 #include <netinet/in.h>
+#if defined(__linux__)
+#include <netinet/tcp.h>
+#endif
 #include <strings.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include "sddc_config.h"
 #include "sddc.h"
 #include "sddc_list.h"
@@ -60,6 +71,12 @@
 #define SDDC_SEC_FLAG_NONE      0x00
 #define SDDC_SEC_FLAG_SUPPORT   0x80
 #define SDDC_SEC_FLAG_CRYPTO    0x40
+#define SDDC_SEC_FLAG_LZ_SUPPORT 0x20   /* Takes compressed payload */
+#define SDDC_SEC_FLAG_LZ        0x10    /* Payload compressed (before encryption) */
+#define SDDC_SEC_FLAG_CBOR_SUPPORT 0x08 /* Takes CBOR payload */
+#define SDDC_SEC_FLAG_CBOR      0x04    /* Payload is CBOR, not JSON */
+#define SDDC_SEC_FLAG_GCM_SUPPORT 0x02  /* Takes AES-GCM payload */
+#define SDDC_SEC_FLAG_GCM       0x01    /* Payload sealed by AES-GCM, not CBC (with CRYPTO) */
 
 /* Buffer to hex char */
 #define SDDC_BUF_TO_HEX_CHAR(digit) \
@@ -77,6 +94,134 @@
             x = 0; \
         }
 
+#if SDDC_CFG_SEND_WINDOW == 0
+#error "SDDC_CFG_SEND_WINDOW must be larger than 0"
+#endif
+
+/* Scatter-gather send (header + payload), lwIP sockets chain the iovecs into the pbuf */
+#if defined(SDDC_HAVE_SENDMSG) && (SDDC_HAVE_SENDMSG > 0)
+#define SDDC_SENDMSG_EN         1
+#else
+#define SDDC_SENDMSG_EN         0
+#endif
+
+/* A connector put of many blocks tells the TCP stack more data follows, so full segments leave */
+#ifdef MSG_MORE
+#define SDDC_MSG_MORE           MSG_MORE
+#else
+#define SDDC_MSG_MORE           0
+#endif
+
+/* Batched datagram I/O, lwIP has no recvmmsg/sendmmsg */
+#if (SDDC_CFG_BATCH_IO_EN > 0) && defined(__linux__)
+#define SDDC_BATCH_IO_EN        1
+#else
+#define SDDC_BATCH_IO_EN        0
+#endif
+
+/* Send ring, filled by application tasks and drained by sddc_run */
+#if ((SDDC_CFG_SEND_RING_SIZE & (SDDC_CFG_SEND_RING_SIZE - 1)) != 0) || (SDDC_CFG_SEND_RING_SIZE == 0)
+#error "SDDC_CFG_SEND_RING_SIZE must be a power of 2"
+#endif
+
+#define SDDC_SEND_RING_MASK         (SDDC_CFG_SEND_RING_SIZE - 1)
+
+/* Payload slot of a send ring cell */
+#define SDDC_SEND_SLOT(sddc, req)   ((sddc)->send_stage + ((req) - (sddc)->send_ring) * SDDC_SEND_PAYLOAD_MAX)
+
+/* Atomics shared by application tasks and sddc_run, GCC builtins on every port */
+#define SDDC_ATOMIC_LOAD(p)         __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SDDC_ATOMIC_STORE(p, v)     __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define SDDC_ATOMIC_XCHG(p, v)      __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+#define SDDC_ATOMIC_ADD(p, v)       __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define SDDC_ATOMIC_CAS(p, e, v)    __atomic_compare_exchange_n(p, e, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+/* EdgerOS hash table */
+#if ((SDDC_CFG_EDGEROS_HASH_SIZE & (SDDC_CFG_EDGEROS_HASH_SIZE - 1)) != 0) || \
+    (SDDC_CFG_EDGEROS_HASH_SIZE <= SDDC_CFG_EDGEROS_MAX)
+#error "SDDC_CFG_EDGEROS_HASH_SIZE must be a power of 2 and larger than SDDC_CFG_EDGEROS_MAX"
+#endif
+
+#define SDDC_EDGEROS_HASH_MASK      (SDDC_CFG_EDGEROS_HASH_SIZE - 1)
+
+/* MESSAGE anti-replay window */
+#if ((SDDC_CFG_REPLAY_WINDOW % 32) != 0) || (SDDC_CFG_REPLAY_WINDOW == 0) || (SDDC_CFG_REPLAY_WINDOW > 1024)
+#error "SDDC_CFG_REPLAY_WINDOW must be a multiple of 32 and not larger than 1024"
+#endif
+
+#define SDDC_REPLAY_WORDS           (SDDC_CFG_REPLAY_WINDOW / 32)
+
+/* MESSAGE fragments, the header reserved byte is index << 4 | (count - 1), 0: not fragmented */
+#if SDDC_CFG_FRAG_MAX > 0
+#if (SDDC_CFG_FRAG_MAX < 2) || (SDDC_CFG_FRAG_MAX > 16) || (SDDC_CFG_FRAG_MAX > SDDC_CFG_MQUEUE_SIZE)
+#error "SDDC_CFG_FRAG_MAX must be 2 ~ 16 and not larger than SDDC_CFG_MQUEUE_SIZE"
+#endif
+#if ((SDDC_CFG_FRAG_SIZE + 32) > SDDC_CFG_SEND_BUF_SIZE) || ((SDDC_CFG_FRAG_SIZE + 32) > SDDC_CFG_RECV_BUF_SIZE)
+#error "SDDC_CFG_FRAG_SIZE must leave 32 bytes of the buffers to the header and the cipher padding"
+#endif
+#if SDDC_CFG_REASM_NUM == 0
+#error "SDDC_CFG_REASM_NUM must be larger than 0"
+#endif
+#endif
+
+/*
+ * AES-GCM payload: counter (4 bytes, big endian), ciphertext, tag. The nonce is the sender
+ * UID and the counter, the header type, fragment byte and seqno are authenticated. The counter
+ * starts at sddc_random(), a port without entropy source (SDDC_RANDOM_ENTROPY) stays CBC
+ */
+#if (SDDC_CFG_SECURITY_EN > 0) && (SDDC_CFG_GCM_EN > 0) && (SDDC_RANDOM_ENTROPY > 0)
+#define SDDC_GCM_EN                 1
+#else
+#define SDDC_GCM_EN                 0
+#endif
+
+#if SDDC_GCM_EN > 0
+#if (SDDC_CFG_GCM_TAG_LEN < 4) || (SDDC_CFG_GCM_TAG_LEN > 12)
+#error "SDDC_CFG_GCM_TAG_LEN must be 4 ~ 12, the sealed payload must fit the cipher padding room"
+#endif
+#endif
+
+#define SDDC_GCM_CTR_LEN            4
+
+/* Trace ring */
+#if SDDC_CFG_TRACE_EN > 0
+#if ((SDDC_CFG_TRACE_SIZE & (SDDC_CFG_TRACE_SIZE - 1)) != 0) || (SDDC_CFG_TRACE_SIZE == 0)
+#error "SDDC_CFG_TRACE_SIZE must be a power of 2"
+#endif
+
+#define SDDC_TRACE_MASK             (SDDC_CFG_TRACE_SIZE - 1)
+#endif
+#define SDDC_GCM_NONCE_LEN          (SDDC_UID_LEN + SDDC_GCM_CTR_LEN)
+#define SDDC_GCM_AAD_LEN            4
+#define SDDC_GCM_OVERHEAD           (SDDC_GCM_CTR_LEN + SDDC_CFG_GCM_TAG_LEN)
+
+/* Token key cache */
+#if (SDDC_CFG_SECURITY_EN > 0) && (SDDC_CFG_KEY_CACHE_SIZE > 0)
+#define SDDC_KEY_CACHE_EN           1
+#else
+#define SDDC_KEY_CACHE_EN           0
+#endif
+
+/* Payload compression, LZ77 over a static dictionary of the JSON keys */
+#define SDDC_LZ_HASH_BITS           10
+#define SDDC_LZ_HASH_SIZE           (1 << SDDC_LZ_HASH_BITS)
+#define SDDC_LZ_MATCH_MIN           4
+#define SDDC_LZ_MATCH_MAX           (0x7f + SDDC_LZ_MATCH_MIN)
+#define SDDC_LZ_LITERAL_MAX         0x80
+
+#if SDDC_CFG_RECV_BUF_SIZE > SDDC_CFG_SEND_BUF_SIZE
+#define SDDC_LZ_BUF_SIZE            SDDC_CFG_RECV_BUF_SIZE
+#else
+#define SDDC_LZ_BUF_SIZE            SDDC_CFG_SEND_BUF_SIZE
+#endif
+
+/* Nesting of arrays and maps converted by __sddc_cbor_to_json */
+#define SDDC_CBOR_DEPTH_MAX         8
+
+#define SDDC_FRAG(index, count)     (uint8_t)(((index) << 4) | ((count) - 1))
+#define SDDC_FRAG_INDEX(frag)       ((frag) >> 4)
+#define SDDC_FRAG_COUNT(frag)       (((frag) & 0x0f) + 1)
+
 /* Default abort data */
 #define SDDC_DEF_ABORT_DATA         "{\"abort\":{\"info\":\"power off\"}}"
 #define SDDC_DEF_ABORT_DATA_LEN     (sizeof(SDDC_DEF_ABORT_DATA) - 1)
@@ -92,6 +237,54 @@ typedef struct {
     uint16_t            length;
 } sddc_header_t;
 
+/* Send request kinds */
+#define SDDC_SEND_MESSAGE           0
+#define SDDC_SEND_UPDATE            1
+#define SDDC_SEND_TIMESTAMP         2
+
+#define SDDC_SEND_PAYLOAD_MAX       (SDDC_CFG_SEND_BUF_SIZE - sizeof(sddc_header_t) - 16)
+
+/* Largest MESSAGE, fragmented when it does not fit a datagram */
+#if (SDDC_CFG_FRAG_MAX > 0) && ((SDDC_CFG_FRAG_MAX * SDDC_CFG_FRAG_SIZE) > (SDDC_CFG_SEND_BUF_SIZE - 32))
+#define SDDC_MESSAGE_MAX            (SDDC_CFG_FRAG_MAX * SDDC_CFG_FRAG_SIZE)
+#else
+#define SDDC_MESSAGE_MAX            SDDC_SEND_PAYLOAD_MAX
+#endif
+
+#define SDDC_FRAG_NUM(len)          \
+        (((len) <= SDDC_SEND_PAYLOAD_MAX) ? 1 : (((len) + SDDC_CFG_FRAG_SIZE - 1) / SDDC_CFG_FRAG_SIZE))
+
+/* Send request, a cell of the send ring */
+typedef struct {
+    uint32_t            sequence;           /* Ring position the cell is free or full for */
+    uint8_t             kind;
+    uint8_t             retries;
+    sddc_bool_t         urgent;
+    sddc_bool_t         broadcast;
+    sddc_bool_t         has_uid;            /* No UID: the first EdgerOS */
+    uint16_t            seqno;
+    uint16_t            seqno_count;        /* Seq numbers reserved by a broadcast */
+    uint16_t            payload_len;
+    uint8_t             uid[SDDC_UID_LEN];
+    uint8_t            *large;              /* Heap copy of a MESSAGE sent in fragments, else the
+                                               payload is in the slot of the cell in send_stage */
+    uint8_t             frags;              /* Seq numbers reserved per EdgerOS */
+#if SDDC_CFG_CBOR_EN > 0
+    sddc_bool_t         cbor;               /* The MESSAGE is CBOR */
+    char               *json;               /* Heap JSON of the CBOR MESSAGE, for EdgerOS which do not take CBOR */
+    uint16_t            json_len;
+#endif
+} sddc_send_req_t;
+
+/* Reply cache entry, the ack sent for a request */
+typedef struct {
+    sddc_header_t       header;             /* As sent, network order */
+    uint16_t            seqno;
+    uint8_t             type;
+    sddc_bool_t         valid;
+    sddc_bool_t         invite_data;        /* The INVITE data follows the header */
+} sddc_reply_t;
+
 /* EdgerOS */
 typedef struct {
     sddc_list_head_t    node;
@@ -99,8 +292,26 @@ typedef struct {
     struct sockaddr_in  addr;
     sddc_list_head_t    mqueue;
     uint16_t            mqueue_len;
+    uint16_t            inflight;
+    sddc_bool_t         mqueue_full;        /* A send was refused, call on_message_ready */
     uint16_t            alive;
-    uint16_t            last_seqno;
+    sddc_bool_t         replay_valid;
+    uint16_t            replay_top;         /* Highest MESSAGE seq number received */
+    uint32_t            replay_bitmap[SDDC_REPLAY_WORDS];   /* Bit n: replay_top - n received */
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+    sddc_reply_t        reply_cache[SDDC_CFG_REPLY_CACHE_SIZE];
+    uint8_t             reply_next;
+#endif
+    sddc_bool_t         lz;                 /* Takes compressed payload */
+    sddc_bool_t         cbor;               /* Takes CBOR payload */
+    sddc_bool_t         gcm;                /* Takes AES-GCM payload */
+    sddc_bool_t         rtt_valid;
+    int32_t             srtt;               /* Smoothed RTT << 3 (MS) */
+    int32_t             rttvar;             /* RTT variation << 2 (MS) */
+    uint32_t            rto;                /* Retransmission timeout (MS) */
+#if SDDC_CFG_STATS_EN > 0
+    sddc_stats_counters_t stats;
+#endif
 } sddc_edgeros_t;
 
 /* Message */
@@ -108,11 +319,90 @@ typedef struct {
     sddc_list_head_t    node;
     sddc_edgeros_t     *edgeros;
     uint8_t             retries;
+    uint8_t             pool;
+    uint8_t             transmits;
+    uint8_t             frag;               /* Fragment byte of the header */
+    uint16_t            timer_index;
     uint16_t            seqno;
+    uint16_t            frag_base;          /* Seq number of the first fragment */
     uint16_t            packet_len;
+    uint32_t            sent_time;
+    uint32_t            deadline;
+    uint32_t            rto;
     uint8_t             packet[1];
 } sddc_message_t;
 
+/* Reassembly of a fragmented MESSAGE */
+typedef struct {
+    sddc_edgeros_t     *edgeros;            /* NULL: free */
+    uint16_t            base;               /* Seq number of the first fragment */
+    uint8_t             count;
+    uint16_t            received;           /* Bit n: fragment n stored */
+    size_t              len;
+    uint32_t            deadline;
+    uint8_t            *buf;                /* SDDC_CFG_FRAG_MAX * SDDC_CFG_FRAG_SIZE, allocated by sddc_create */
+} sddc_reasm_t;
+
+#if SDDC_CFG_LZ_EN > 0
+/* Compressor state, allocated on first use */
+typedef struct {
+    uint16_t            hash[SDDC_LZ_HASH_SIZE];
+    uint8_t             buf[SDDC_LZ_BUF_SIZE];  /* Payload sent or received, by the sddc_run task only */
+} sddc_lz_t;
+#endif
+
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+/* DISCOVER source, a token bucket and the REPORT pending for it */
+typedef struct {
+    struct sockaddr_in  addr;
+    uint32_t            refill;             /* Time the tokens were counted */
+    uint32_t            last;               /* Last DISCOVER, the oldest source is replaced */
+    uint32_t            due;                /* Pending REPORT send time */
+    uint8_t             tokens;
+    sddc_bool_t         valid;
+    sddc_bool_t         pending;
+    sddc_bool_t         lz;                 /* Pending REPORT compressed */
+} sddc_discover_t;
+#endif
+
+/* Retransmission timer heap, every sent and unacked message has a timer */
+#define SDDC_TIMER_HEAP_SIZE        (SDDC_CFG_MQUEUE_SIZE * SDDC_CFG_EDGEROS_MAX)
+#define SDDC_TIMER_NONE             0xffff
+
+#define SDDC_TIME_BEFORE_EQ(a, b)   ((int32_t)((a) - (b)) <= 0)
+
+/* Message pool */
+#define SDDC_MPOOL_HEAP             0xff
+
+#define SDDC_MPOOL_LARGE_SIZE       (SDDC_CFG_SEND_BUF_SIZE + 16)
+
+#define SDDC_MPOOL_SLOT_SIZE(size)  \
+        ((offsetof(sddc_message_t, packet) + (size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+typedef struct {
+    sddc_list_head_t    free_list;
+    void               *slab;               /* total slots, allocated by sddc_create */
+    uint16_t            size;
+    uint16_t            total;
+#if SDDC_CFG_STATS_EN > 0
+    uint16_t            used;
+    uint16_t            high_water;
+    uint32_t            exhausted;
+#endif
+} sddc_mpool_t;
+
+#if SDDC_KEY_CACHE_EN > 0
+/* Key of a token, with the idle CBC contexts lent to the connectors */
+typedef struct {
+    char               *token;              /* NULL: free */
+    uint32_t            hash;
+    uint32_t            used;               /* LRU stamp */
+    uint8_t             key[16];
+    uint8_t             iv[16];
+    void               *ctx[2];             /* Decrypt, encrypt. NULL: none or lent */
+} sddc_key_entry_t;
+#endif
+
 /* SDDC */
 struct sddc_context {
     uint8_t                         recv_buf[SDDC_CFG_RECV_BUF_SIZE];
@@ -125,43 +415,177 @@ struct sddc_context {
     size_t                          invite_data_len;
     char *                          abort_data;
     size_t                          abort_data_len;
+    sddc_header_t                   report_header;      /* Prebuilt REPORT, DISCOVER respond */
+    sddc_header_t                   ping_header;        /* Prebuilt PING respond */
+    sddc_header_t                   abort_header;       /* Prebuilt abort UPDATE, PING respond to no joined */
     sddc_on_invite_t                on_invite;
     sddc_on_invite_end_t            on_invite_end;
     sddc_on_update_t                on_update;
     sddc_on_message_t               on_message;
     sddc_on_message_ack_t           on_message_ack;
     sddc_on_message_lost_t          on_message_lost;
+    sddc_on_message_ready_t         on_message_ready;
     sddc_on_edgeros_lost_t          on_edgeros_lost;
     sddc_on_timestamp_t             on_timestamp;
     sddc_list_head_t                edgeros_list;
+    sddc_edgeros_t                 *edgeros_hash[SDDC_CFG_EDGEROS_HASH_SIZE];
+#if SDDC_CFG_EDGEROS_ADDR_INDEX_EN > 0
+    sddc_edgeros_t                 *edgeros_addr_hash[SDDC_CFG_EDGEROS_HASH_SIZE];
+#endif
+    uint16_t                        edgeros_count;
+    sddc_mpool_t                    mpool[SDDC_MPOOL_CLASS_NR];
+    sddc_message_t                 *timer_heap[SDDC_TIMER_HEAP_SIZE];
+    uint16_t                        timer_heap_len;
+    uint32_t                        alive_deadline;
+    struct sockaddr_in              wake_addr;
+    uint32_t                        wake_pending;
+    sddc_send_req_t                 send_ring[SDDC_CFG_SEND_RING_SIZE];
+    uint8_t                        *send_stage;         /* A SDDC_SEND_PAYLOAD_MAX slot per ring cell */
+    uint32_t                        send_head;          /* Application tasks */
+    uint32_t                        send_tail;          /* sddc_run */
+    uint32_t                        send_full;          /* A send was refused, call on_message_ready */
+#if SDDC_CFG_FRAG_MAX > 0
+    sddc_reasm_t                    reasm[SDDC_CFG_REASM_NUM];
+#endif
     int                             fd;
     sddc_mutex_t                    lockid;
-    uint16_t                        seqno;
+    uint32_t                        seqno;              /* Atomic, 16 bits used */
     uint16_t                        port;
 
+#if SDDC_BATCH_IO_EN > 0
+    struct mmsghdr                  rx_msgs[SDDC_CFG_BATCH_SIZE];
+    struct iovec                    rx_iov[SDDC_CFG_BATCH_SIZE];
+    struct sockaddr_in              rx_addr[SDDC_CFG_BATCH_SIZE];
+    uint8_t                         rx_buf[SDDC_CFG_BATCH_SIZE][SDDC_CFG_RECV_BUF_SIZE];
+    struct mmsghdr                  tx_msgs[SDDC_CFG_BATCH_SIZE];
+    struct iovec                    tx_iov[SDDC_CFG_BATCH_SIZE][2];
+    struct sockaddr_in              tx_addr[SDDC_CFG_BATCH_SIZE];
+    sddc_header_t                   tx_header[SDDC_CFG_BATCH_SIZE];
+    uint8_t                         tx_buf[SDDC_CFG_BATCH_SIZE][SDDC_CFG_SEND_BUF_SIZE];
+    uint16_t                        tx_len;
+    uint16_t                        tx_hold;
+#endif
+
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+    sddc_discover_t                 discover[SDDC_CFG_DISCOVER_SLOTS];
+    uint32_t                        discover_rand;      /* Jitter PRNG state */
+#endif
+
+#if SDDC_CFG_STATS_EN > 0
+    sddc_stats_counters_t           stats;
+    sddc_edgeros_t                 *stats_peer;         /* EdgerOS of the packet handled, its sends are counted to it */
+    uint32_t                        stats_lock_count;
+    uint64_t                        stats_lock_wait_us;
+    uint32_t                        stats_callback_count;
+    uint64_t                        stats_callback_us;
+    uint32_t                        stats_callout_begin;
+    uint16_t                        stats_mpool_heap_used;
+    uint16_t                        stats_mpool_heap_high_water;
+    uint32_t                        stats_mpool_alloc_fail;
+    uint32_t                        stats_tx_copy_bytes;
+    uint32_t                        stats_discovers;
+    uint32_t                        stats_discover_reports;
+    uint32_t                        stats_discover_coalesced;
+    uint32_t                        stats_discover_limited;
+#endif
+
+#if SDDC_CFG_TRACE_EN > 0
+    sddc_trace_t                    trace[SDDC_CFG_TRACE_SIZE];     /* Written with the lock */
+    uint32_t                        trace_head;         /* Records written */
+    uint32_t                        trace_tail;         /* Records dumped or discarded */
+#endif
+
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    sddc_connector_t               *conn_pool[SDDC_CFG_CONNECTOR_POOL_SIZE];  /* Idle pooled connectors */
+#endif
+
 #if SDDC_CFG_SECURITY_EN > 0
     uint8_t                         decypt_buf[SDDC_CFG_RECV_BUF_SIZE - sizeof(sddc_header_t) + 16];
-    mbedtls_cipher_context_t        encypt_cipher_ctx;
-    mbedtls_cipher_context_t        decypt_cipher_ctx;
+    const sddc_crypto_ops_t        *crypto;             /* Crypto backend, of the connectors too */
+    void                           *encypt_ctx;
+    void                           *decypt_ctx;
     sddc_bool_t                     security_en;
-    const mbedtls_cipher_info_t    *cipher_info;
     uint8_t                         key[16];
     uint8_t                         iv[16];
+#if SDDC_KEY_CACHE_EN > 0
+    sddc_key_entry_t                key_cache[SDDC_CFG_KEY_CACHE_SIZE];
+    uint32_t                        key_stamp;
+#endif
+#if SDDC_GCM_EN > 0
+    void                           *gcm_ctx;            /* Seal and open */
+    uint32_t                        gcm_counter;        /* Nonce counter of the packets sealed */
+#endif
+    uint8_t                        *report_crypto;      /* Report data ciphertext for UPDATE requests */
+    size_t                          report_crypto_len;
+#if SDDC_CFG_LZ_EN > 0
+    uint8_t                        *report_lz_crypto;   /* Compressed report data ciphertext */
+    size_t                          report_lz_crypto_len;
+#endif
+#endif
+
+#if SDDC_CFG_LZ_EN > 0
+    sddc_lz_t                      *lz;                 /* NULL: nothing compressed yet */
+    uint8_t                        *report_lz;          /* Compressed report data, NULL: no gain */
+    size_t                          report_lz_len;
+    sddc_header_t                   report_lz_header;   /* Prebuilt REPORT, compressed */
+    uint8_t                        *invite_lz;          /* Compressed (and encrypted) invite data */
+    size_t                          invite_lz_len;
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+    sddc_bool_t                     rx_cbor;            /* The payload given to the callback is CBOR */
 #endif
 };
 
+/* Non-blocking connector states */
+#define SDDC_CONNECTOR_CONNECTING   0
+#define SDDC_CONNECTOR_OPEN         1
+#define SDDC_CONNECTOR_FINISH       2       /* All data taken, flushing */
+#define SDDC_CONNECTOR_CLOSED       3
+#define SDDC_CONNECTOR_DONE         4       /* Pooled, the transfer ended and the connection is kept */
+
+/* Data bytes encrypted by one cipher call and sent by one syscall */
+#define SDDC_CONNECTOR_CHUNK        SDDC_CFG_CONNECTOR_BLOCK_SIZE
+
+/* iovecs given to one sendmsg of a plain put */
+#define SDDC_CONNECTOR_IOV_MAX      64
+
+/*
+ * A pooled connector frames its output: a 4 byte big endian length before the bytes
+ * (ciphertext if encrypted), an empty frame ends the transfer
+ */
+#define SDDC_CONNECTOR_FRAME_HDR    4
+#define SDDC_CONNECTOR_FRAME_IOV    4       /* iovecs of a framed put sent by one sendmsg */
+#define SDDC_CONNECTOR_DATA_OFF(c)  (((c)->sddc != NULL) ? SDDC_CONNECTOR_FRAME_HDR : 0)
+
 struct sddc_connector {
     int                             sockfd;
     sddc_bool_t                     get_mode;
+    sddc_on_connector_t             on_event;           /* Non-blocking connector, NULL: blocking */
+    void                           *arg;
+    uint8_t                         state;
+    sddc_bool_t                     blocked;            /* A write was short, SDDC_CONNECTOR_EV_WRITABLE is due */
+    uint32_t                        pend_off;           /* Staged output not sent yet */
+    uint32_t                        pend_len;
+    uint8_t                        *tx_buf;             /* Staged output: ciphertext or frames, NULL: none */
+    sddc_t                         *sddc;               /* Pooled connector, NULL: not pooled */
+    uint8_t                         uid[SDDC_UID_LEN];  /* Pool key */
+    struct sockaddr_in              addr;
+    uint32_t                        idle_since;
 #if SDDC_CFG_SECURITY_EN > 0
-#if SDDC_CFG_SEND_BUF_SIZE > SDDC_CFG_RECV_BUF_SIZE
-    uint8_t                         crypto_buf[SDDC_CFG_SEND_BUF_SIZE + 16];
+    /*
+     * A chunk of CBC output is up to 15 bytes longer than its input (data left by the
+     * last update) plus the padding block of the finish, and the frame lengths if pooled
+     */
+#if SDDC_CONNECTOR_CHUNK > SDDC_CFG_RECV_BUF_SIZE
+    uint8_t                         crypto_buf[SDDC_CONNECTOR_CHUNK + 32 + 2 * SDDC_CONNECTOR_FRAME_HDR];
 #else
-    uint8_t                         crypto_buf[SDDC_CFG_RECV_BUF_SIZE + 16];
+    uint8_t                         crypto_buf[SDDC_CFG_RECV_BUF_SIZE + 32 + 2 * SDDC_CONNECTOR_FRAME_HDR];
 #endif
-    mbedtls_cipher_context_t        cipher_ctx;
+    const sddc_crypto_ops_t        *crypto;
+    void                           *crypto_ctx;
+    sddc_t                         *owner;              /* Key cache the context goes back to */
     sddc_bool_t                     security_en;
-    const mbedtls_cipher_info_t    *cipher_info;
     uint8_t                         key[16];
     uint8_t                         iv[16];
 #endif
@@ -170,6 +594,78 @@ struct sddc_connector {
 
 #define SDDC_PACKET_PAYLOAD(packet)     ((char *)(packet) + sizeof(sddc_header_t))
 
+static int __sddc_edgeros_destroy(sddc_t *sddc, sddc_edgeros_t *edgeros);
+static void __sddc_send_drain(sddc_t *sddc);
+static void __sddc_prebuild(sddc_t *sddc);
+static void __sddc_connector_free(sddc_connector_t *connector);
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+static void __sddc_connector_pool_expire(sddc_t *sddc, uint32_t now);
+#endif
+static inline uint32_t __sddc_hash(const uint8_t *data, size_t len);
+
+/*
+ * Statistics, counted to all EdgerOS and to edgeros if it is not NULL. The engine ones
+ * (sddc_stats_t but the total) are counted by SDDC_STATS_ENGINE_*
+ */
+#if SDDC_CFG_STATS_EN > 0
+#define SDDC_STATS_ADD(sddc, edgeros, field, n) \
+        do { \
+            (sddc)->stats.field += (n); \
+            if ((edgeros) != NULL) { \
+                (edgeros)->stats.field += (n); \
+            } \
+        } while (0)
+#define SDDC_STATS_INC(sddc, edgeros, field)    SDDC_STATS_ADD(sddc, edgeros, field, 1)
+#define SDDC_STATS_ENGINE_ADD(sddc, field, n)   ((sddc)->stats_##field += (n))
+#define SDDC_STATS_ENGINE_INC(sddc, field)      ((sddc)->stats_##field++)
+#define SDDC_STATS_PEER(sddc, edgeros)  ((sddc)->stats_peer = (edgeros))
+#else
+#define SDDC_STATS_ADD(sddc, edgeros, field, n)
+#define SDDC_STATS_INC(sddc, edgeros, field)
+#define SDDC_STATS_ENGINE_ADD(sddc, field, n)
+#define SDDC_STATS_ENGINE_INC(sddc, field)
+#define SDDC_STATS_PEER(sddc, edgeros)
+#endif
+
+/*
+ * Trace points, a clock read and a record store, nothing without SDDC_CFG_TRACE_EN.
+ * They are taken with the lock, SDDC_TRACE_AT records a time read before it
+ */
+#if SDDC_CFG_TRACE_EN > 0
+static inline void __sddc_trace(sddc_t *sddc, uint32_t time, uint8_t point, uint8_t type, uint16_t seqno)
+{
+    sddc_trace_t *rec = &sddc->trace[sddc->trace_head++ & SDDC_TRACE_MASK];
+
+    rec->time  = time;
+    rec->point = point;
+    rec->type  = type;
+    rec->seqno = seqno;
+}
+
+#define SDDC_TRACE(sddc, point, type, seqno)        __sddc_trace(sddc, sddc_trace_clock(), point, type, seqno)
+#define SDDC_TRACE_AT(sddc, time, point, type, seqno) __sddc_trace(sddc, time, point, type, seqno)
+#else
+#define SDDC_TRACE(sddc, point, type, seqno)
+#define SDDC_TRACE_AT(sddc, time, point, type, seqno)
+#endif
+
+/*
+ * Take the SDDC lock, the wait is timed with SDDC_CFG_STATS_EN
+ */
+static inline void __sddc_lock(sddc_t *sddc)
+{
+#if SDDC_CFG_STATS_EN > 0
+    uint32_t begin = sddc_time_us();
+
+    sddc_mutex_lock(&sddc->lockid);
+
+    sddc->stats_lock_count++;
+    sddc->stats_lock_wait_us += sddc_time_us() - begin;
+#else
+    sddc_mutex_lock(&sddc->lockid);
+#endif
+}
+
 #if SDDC_CFG_SECURITY_EN > 0
 
 static int __sddc_gen_key(const char *token, uint8_t *key, uint8_t *iv)
@@ -197,666 +693,3850 @@ static int __sddc_gen_key(const char *token, uint8_t *key, uint8_t *iv)
     return 0;
 }
 
-/**
- * @brief Set device token.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] token         Pointer to token string
- *
- * @return Error number
+/*
+ * mbedtls backend: a cipher context with the expanded key, IV is set on each use
  */
-int sddc_set_token(sddc_t *sddc, const char *token)
+static void *__sddc_mbedtls_create(int mode, sddc_bool_t encrypt, const uint8_t *key)
 {
-    sddc_return_value_if_fail(sddc && token, -1);
+    mbedtls_cipher_context_t *ctx;
+    const mbedtls_cipher_info_t *cipher_info;
+
+    cipher_info = mbedtls_cipher_info_from_type((mode == SDDC_CRYPTO_AES_128_GCM) ?
+                                                MBEDTLS_CIPHER_AES_128_GCM : MBEDTLS_CIPHER_AES_128_CBC);
+    sddc_return_value_if_fail(cipher_info, NULL);
+
+    ctx = sddc_malloc(sizeof(mbedtls_cipher_context_t));
+    sddc_return_value_if_fail(ctx, NULL);
+
+    mbedtls_cipher_init(ctx);
+
+    /*
+     * GCM only runs the forward cipher, it takes the encrypt key schedule both ways
+     */
+    if ((mbedtls_cipher_setup(ctx, cipher_info) != 0) ||
+        (mbedtls_cipher_setkey(ctx, key, 128, (encrypt || (mode == SDDC_CRYPTO_AES_128_GCM)) ?
+                               MBEDTLS_ENCRYPT : MBEDTLS_DECRYPT) != 0)) {
+        mbedtls_cipher_free(ctx);
+        sddc_free(ctx);
+        return NULL;
+    }
 
-    __sddc_gen_key(token, sddc->key, sddc->iv);
+    return ctx;
+}
 
-    sddc->cipher_info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CBC);
+static void __sddc_mbedtls_destroy(void *ctx)
+{
+    mbedtls_cipher_free(ctx);
+    sddc_free(ctx);
+}
 
-    sddc->security_en = SDDC_TRUE;
+static int __sddc_mbedtls_crypt(void *ctx, const uint8_t *iv, const void *input, size_t len, void *output, size_t *olen)
+{
+    return mbedtls_cipher_crypt(ctx, iv, 16, input, len, output, olen);
+}
 
-    sddc_set_abort_data(sddc, SDDC_DEF_ABORT_DATA, SDDC_DEF_ABORT_DATA_LEN);
+static int __sddc_mbedtls_start(void *ctx, const uint8_t *iv)
+{
+    if (mbedtls_cipher_set_iv(ctx, iv, 16) != 0) {
+        return -1;
+    }
 
-    return 0;
+    return mbedtls_cipher_reset(ctx);
 }
 
-static int __sddc_decrypt(sddc_t *sddc, const void *data, size_t len, void *output, size_t *olen)
+static int __sddc_mbedtls_update(void *ctx, const void *input, size_t len, void *output, size_t *olen)
 {
-    int ret;
-    size_t ulen;
-    size_t flen;
-
-    *olen = 0;
+    return mbedtls_cipher_update(ctx, input, len, output, olen);
+}
 
-    sddc_return_value_if_fail(sddc->security_en, -1);
+static int __sddc_mbedtls_finish(void *ctx, void *output, size_t *olen)
+{
+    return mbedtls_cipher_finish(ctx, output, olen);
+}
 
-    mbedtls_cipher_init(&sddc->decypt_cipher_ctx);
+static int __sddc_mbedtls_seal(void *ctx, const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                               const void *input, size_t len, void *output, uint8_t *tag, size_t tag_len)
+{
+    size_t olen;
 
-    mbedtls_cipher_setup(&sddc->decypt_cipher_ctx, sddc->cipher_info);
+    return mbedtls_cipher_auth_encrypt(ctx, nonce, nonce_len, aad, aad_len, input, len, output, &olen, tag, tag_len);
+}
 
-    mbedtls_cipher_set_iv(&sddc->decypt_cipher_ctx, sddc->iv, sizeof(sddc->iv));
+static int __sddc_mbedtls_open(void *ctx, const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                               const void *input, size_t len, void *output, const uint8_t *tag, size_t tag_len)
+{
+    size_t olen;
 
-    mbedtls_cipher_setkey(&sddc->decypt_cipher_ctx, sddc->key, sizeof(sddc->key) * 8, MBEDTLS_DECRYPT);
+    return mbedtls_cipher_auth_decrypt(ctx, nonce, nonce_len, aad, aad_len, input, len, output, &olen, tag, tag_len);
+}
 
-    ret = mbedtls_cipher_update(&sddc->decypt_cipher_ctx, data, len, output, &ulen);
-    sddc_return_value_if_fail(ret == 0, -1);
+const sddc_crypto_ops_t sddc_crypto_mbedtls = {
+    .name        = "mbedtls",
+    .create      = __sddc_mbedtls_create,
+    .destroy     = __sddc_mbedtls_destroy,
+    .crypt       = __sddc_mbedtls_crypt,
+    .crypt_multi = NULL,
+    .start       = __sddc_mbedtls_start,
+    .update      = __sddc_mbedtls_update,
+    .finish      = __sddc_mbedtls_finish,
+    .seal        = __sddc_mbedtls_seal,
+    .open        = __sddc_mbedtls_open,
+};
 
-    ret = mbedtls_cipher_finish(&sddc->decypt_cipher_ctx, (uint8_t *)output + ulen, &flen);
-    sddc_return_value_if_fail(ret == 0, -1);
+/*
+ * Encrypt or decrypt independent messages with the same IV, by one backend call if it can
+ */
+static int __sddc_crypto_multi(const sddc_crypto_ops_t *crypto, void *ctx, const uint8_t *iv,
+                               sddc_crypto_buf_t *bufs, int count)
+{
+    int i;
 
-    mbedtls_cipher_free(&sddc->decypt_cipher_ctx);
+    if (crypto->crypt_multi != NULL) {
+        return crypto->crypt_multi(ctx, iv, bufs, count);
+    }
 
-    *olen = ulen + flen;
+    for (i = 0; i < count; i++) {
+        if (crypto->crypt(ctx, iv, bufs[i].input, bufs[i].len, bufs[i].output, &bufs[i].olen) != 0) {
+            return -1;
+        }
+    }
 
     return 0;
 }
 
-static int __sddc_encrypt(sddc_t *sddc, const void *data, size_t len, void *output, size_t *olen)
+/*
+ * Free the cipher contexts of SDDC (with lock)
+ */
+static void __sddc_crypto_free(sddc_t *sddc)
 {
-    int ret;
-    size_t ulen;
-    size_t flen;
-
-    *olen = 0;
+    if (sddc->encypt_ctx != NULL) {
+        sddc->crypto->destroy(sddc->encypt_ctx);
+        sddc->encypt_ctx = NULL;
+    }
+    if (sddc->decypt_ctx != NULL) {
+        sddc->crypto->destroy(sddc->decypt_ctx);
+        sddc->decypt_ctx = NULL;
+    }
+#if SDDC_GCM_EN > 0
+    if (sddc->gcm_ctx != NULL) {
+        sddc->crypto->destroy(sddc->gcm_ctx);
+        sddc->gcm_ctx = NULL;
+    }
+#endif
+}
 
-    sddc_return_value_if_fail(sddc->security_en, -1);
+#if SDDC_KEY_CACHE_EN > 0
+/*
+ * Empty a key cache entry (with lock)
+ */
+static void __sddc_key_entry_free(sddc_t *sddc, sddc_key_entry_t *entry)
+{
+    int i;
 
-    mbedtls_cipher_init(&sddc->encypt_cipher_ctx);
+    for (i = 0; i < 2; i++) {
+        if (entry->ctx[i] != NULL) {
+            sddc->crypto->destroy(entry->ctx[i]);
+            entry->ctx[i] = NULL;
+        }
+    }
 
-    mbedtls_cipher_setup(&sddc->encypt_cipher_ctx, sddc->cipher_info);
+    if (entry->token != NULL) {
+        sddc_free(entry->token);
+        entry->token = NULL;
+    }
+}
+#endif
 
-    mbedtls_cipher_set_iv(&sddc->encypt_cipher_ctx, sddc->iv, sizeof(sddc->iv));
+/*
+ * Key and IV of token. ctx: if not NULL, takes the idle CBC context of the direction
+ * with the key schedule expanded, NULL if there is none
+ */
+static void __sddc_key_get(sddc_t *sddc, const char *token, uint8_t *key, uint8_t *iv, sddc_bool_t encrypt, void **ctx)
+{
+#if SDDC_KEY_CACHE_EN > 0
+    sddc_key_entry_t *entry, *slot = NULL;
+    size_t            token_len = strlen(token);
+    uint32_t          hash = __sddc_hash((const uint8_t *)token, token_len);
+    int               i;
+
+    if (ctx != NULL) {
+        *ctx = NULL;
+    }
 
-    mbedtls_cipher_setkey(&sddc->encypt_cipher_ctx, sddc->key, sizeof(sddc->key) * 8, MBEDTLS_ENCRYPT);
+    __sddc_lock(sddc);
+
+    for (i = 0; i < SDDC_CFG_KEY_CACHE_SIZE; i++) {
+        entry = &sddc->key_cache[i];
+        if ((entry->token != NULL) && (entry->hash == hash) && (strcmp(entry->token, token) == 0)) {
+            entry->used = ++sddc->key_stamp;
+            memcpy(key, entry->key, 16);
+            memcpy(iv, entry->iv, 16);
+            if (ctx != NULL) {
+                *ctx = entry->ctx[encrypt ? 1 : 0];
+                entry->ctx[encrypt ? 1 : 0] = NULL;
+            }
+            sddc_mutex_unlock(&sddc->lockid);
+            return;
+        }
 
-    ret = mbedtls_cipher_update(&sddc->encypt_cipher_ctx, data, len, output, &ulen);
-    sddc_return_value_if_fail(ret == 0, -1);
+        if ((slot == NULL) || (entry->token == NULL) ||
+            ((slot->token != NULL) && ((int32_t)(entry->used - slot->used) < 0))) {
+            slot = entry;
+        }
+    }
 
-    ret = mbedtls_cipher_finish(&sddc->encypt_cipher_ctx, (uint8_t *)output + ulen, &flen);
-    sddc_return_value_if_fail(ret == 0, -1);
+    __sddc_gen_key(token, key, iv);
 
-    mbedtls_cipher_free(&sddc->encypt_cipher_ctx);
+    /*
+     * The least recently used token makes room
+     */
+    __sddc_key_entry_free(sddc, slot);
 
-    *olen = ulen + flen;
+    slot->token = sddc_malloc(token_len + 1);
+    if (slot->token != NULL) {
+        memcpy(slot->token, token, token_len + 1);
+        slot->hash = hash;
+        slot->used = ++sddc->key_stamp;
+        memcpy(slot->key, key, 16);
+        memcpy(slot->iv, iv, 16);
+    }
 
-    return 0;
-}
+    sddc_mutex_unlock(&sddc->lockid);
+#else
+    __sddc_gen_key(token, key, iv);
 
+    if (ctx != NULL) {
+        *ctx = NULL;
+    }
 #endif
+}
 
-/**
- * @brief Set device uniquely id.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] mac_addr      Pointer to device mac address
- *
- * @return Error number
+/*
+ * Give back the CBC context of key, destroyed if the key left the cache or the cache has one
  */
-int sddc_set_uid(sddc_t *sddc, const uint8_t *mac_addr)
+static void __sddc_key_put(sddc_t *sddc, const uint8_t *key, sddc_bool_t encrypt, void *ctx)
 {
-    sddc_return_value_if_fail(sddc && mac_addr, -1);
+#if SDDC_KEY_CACHE_EN > 0
+    sddc_key_entry_t *entry;
+    int               i;
+
+    __sddc_lock(sddc);
+
+    for (i = 0; i < SDDC_CFG_KEY_CACHE_SIZE; i++) {
+        entry = &sddc->key_cache[i];
+        if ((entry->token != NULL) && (entry->ctx[encrypt ? 1 : 0] == NULL) &&
+            (memcmp(entry->key, key, 16) == 0)) {
+            entry->ctx[encrypt ? 1 : 0] = ctx;
+            ctx = NULL;
+            break;
+        }
+    }
 
-    sddc->uid[0] = mac_addr[0];
-    sddc->uid[1] = mac_addr[1];
-    sddc->uid[2] = mac_addr[2];
-    sddc->uid[3] = 0xfe;
-    sddc->uid[4] = 0x80;
-    sddc->uid[5] = mac_addr[3];
-    sddc->uid[6] = mac_addr[4];
-    sddc->uid[7] = mac_addr[5];
+    sddc_mutex_unlock(&sddc->lockid);
+#endif
 
-    return 0;
+    if (ctx != NULL) {
+        sddc->crypto->destroy(ctx);
+    }
 }
 
 /**
- * @brief Set callback function of on receive MESSAGE request.
+ * @brief Set device token.
  *
  * @param[in] sddc          Pointer to SDDC
- * @param[in] on_message    callback function
+ * @param[in] token         Pointer to token string
  *
  * @return Error number
  */
-int sddc_set_on_message(sddc_t *sddc, sddc_on_message_t on_message)
+int sddc_set_token(sddc_t *sddc, const char *token)
 {
-    sddc_return_value_if_fail(sddc && on_message, -1);
+    int ret = -1;
 
-    sddc->on_message = on_message;
+    sddc_return_value_if_fail(sddc && token, -1);
 
-    return 0;
-}
+    __sddc_lock(sddc);
 
-/**
- * @brief Set callback function of on receive MESSAGE ACK.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] on_message    callback function
- *
- * @return Error number
- */
-int sddc_set_on_message_ack(sddc_t *sddc, sddc_on_message_ack_t on_message_ack)
-{
-    sddc_return_value_if_fail(sddc && on_message_ack, -1);
+    sddc->security_en = SDDC_FALSE;
+    __sddc_crypto_free(sddc);
 
-    sddc->on_message_ack = on_message_ack;
+    __sddc_key_get(sddc, token, sddc->key, sddc->iv, SDDC_FALSE, NULL);
 
-    return 0;
+    /*
+     * Key schedules are expanded once here, packets only reset the IV
+     */
+    sddc->encypt_ctx = sddc->crypto->create(SDDC_CRYPTO_AES_128_CBC, SDDC_TRUE, sddc->key);
+    sddc->decypt_ctx = sddc->crypto->create(SDDC_CRYPTO_AES_128_CBC, SDDC_FALSE, sddc->key);
+#if SDDC_GCM_EN > 0
+    /*
+     * GCM is not advertised if the backend has no AEAD
+     */
+    if ((sddc->crypto->seal != NULL) && (sddc->crypto->open != NULL)) {
+        sddc->gcm_ctx = sddc->crypto->create(SDDC_CRYPTO_AES_128_GCM, SDDC_TRUE, sddc->key);
+    }
+#endif
+    if ((sddc->encypt_ctx == NULL) || (sddc->decypt_ctx == NULL)) {
+        __sddc_crypto_free(sddc);
+        sddc_goto_error_if_fail(sddc->encypt_ctx && sddc->decypt_ctx);
+    }
+
+    ret = 0;
+    sddc->security_en = SDDC_TRUE;
+
+    sddc_set_abort_data(sddc, SDDC_DEF_ABORT_DATA, SDDC_DEF_ABORT_DATA_LEN);
+
+error:
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return ret;
 }
 
-/**
- * @brief Set callback function of on lost MESSAGE ACK.
- *
- * @param[in] sddc              Pointer to SDDC
- * @param[in] on_message_lost   callback function
- *
- * @return Error number
- */
-int sddc_set_on_message_lost(sddc_t *sddc, sddc_on_message_lost_t on_message_lost)
+static int __sddc_decrypt(sddc_t *sddc, const void *data, size_t len, void *output, size_t *olen)
 {
-    sddc_return_value_if_fail(sddc && on_message_lost, -1);
+    int ret;
 
-    sddc->on_message_lost = on_message_lost;
+    *olen = 0;
+
+    sddc_return_value_if_fail(sddc->security_en, -1);
+
+    ret = sddc->crypto->crypt(sddc->decypt_ctx, sddc->iv, data, len, output, olen);
+    sddc_return_value_if_fail(ret == 0, -1);
 
     return 0;
 }
 
-/**
- * @brief Set callback function of on EdgerOS disconnection.
- *
- * @param[in] sddc              Pointer to SDDC
- * @param[in] on_edgeros_lost   callback function
- *
- * @return Error number
- */
-int sddc_set_on_edgeros_lost(sddc_t *sddc, sddc_on_edgeros_lost_t on_edgeros_lost)
+static int __sddc_encrypt(sddc_t *sddc, const void *data, size_t len, void *output, size_t *olen)
 {
-    sddc_return_value_if_fail(sddc && on_edgeros_lost, -1);
+    int ret;
 
-    sddc->on_edgeros_lost = on_edgeros_lost;
+    *olen = 0;
+
+    sddc_return_value_if_fail(sddc->security_en, -1);
+
+    ret = sddc->crypto->crypt(sddc->encypt_ctx, sddc->iv, data, len, output, olen);
+    sddc_return_value_if_fail(ret == 0, -1);
 
     return 0;
 }
 
-/**
- * @brief Set callback function of on receive TIMESTAMP ack.
- *
- * @param[in] sddc              Pointer to SDDC
- * @param[in] on_timestamp      callback function
- *
- * @return Error number
+#if SDDC_GCM_EN > 0
+/*
+ * GCM nonce: sender UID and the counter carried by the payload
  */
-int sddc_set_on_timestamp(sddc_t *sddc, sddc_on_timestamp_t on_timestamp)
+static void __sddc_gcm_nonce(uint8_t *nonce, const uint8_t *uid, const uint8_t *counter)
 {
-    sddc_return_value_if_fail(sddc && on_timestamp, -1);
-
-    sddc->on_timestamp = on_timestamp;
+    memcpy(nonce, uid, SDDC_UID_LEN);
+    memcpy(nonce + SDDC_UID_LEN, counter, SDDC_GCM_CTR_LEN);
+}
 
-    return 0;
+/*
+ * GCM additional data: the header fields which are not in the nonce (seqno wraps, so it
+ * is authenticated but does not make the nonce unique)
+ */
+static void __sddc_gcm_aad(uint8_t *aad, uint8_t type, uint8_t frag, uint16_t seqno)
+{
+    aad[0] = type;
+    aad[1] = frag;
+    aad[2] = (uint8_t)(seqno >> 8);
+    aad[3] = (uint8_t)seqno;
 }
 
-/**
- * @brief Set callback function of on receive INVITE request.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] on_invite     callback function
- *
- * @return Error number
+/*
+ * Seal a payload with AES-GCM, the output takes len + SDDC_GCM_OVERHEAD bytes
  */
-int sddc_set_on_invite(sddc_t *sddc, sddc_on_invite_t on_invite)
+static int __sddc_seal(sddc_t *sddc, uint8_t type, uint8_t frag, uint16_t seqno,
+                       const void *data, size_t len, void *output, size_t *olen)
 {
-    sddc_return_value_if_fail(sddc && on_invite, -1);
+    uint8_t  nonce[SDDC_GCM_NONCE_LEN];
+    uint8_t  aad[SDDC_GCM_AAD_LEN];
+    uint8_t *out = output;
+    uint32_t counter;
+    int      ret;
 
-    sddc->on_invite = on_invite;
+    *olen = 0;
+
+    sddc_return_value_if_fail(sddc->security_en && sddc->gcm_ctx, -1);
+
+    counter = sddc->gcm_counter++;
+    out[0]  = (uint8_t)(counter >> 24);
+    out[1]  = (uint8_t)(counter >> 16);
+    out[2]  = (uint8_t)(counter >> 8);
+    out[3]  = (uint8_t)counter;
+
+    __sddc_gcm_nonce(nonce, sddc->uid, out);
+    __sddc_gcm_aad(aad, type, frag, seqno);
+
+    ret = sddc->crypto->seal(sddc->gcm_ctx, nonce, sizeof(nonce), aad, sizeof(aad),
+                             data, len, out + SDDC_GCM_CTR_LEN, out + SDDC_GCM_CTR_LEN + len, SDDC_CFG_GCM_TAG_LEN);
+    sddc_return_value_if_fail(ret == 0, -1);
+
+    *olen = len + SDDC_GCM_OVERHEAD;
 
     return 0;
 }
 
-/**
- * @brief Set callback function of after send INVITE respond.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] on_invite_end callback function
- *
- * @return Error number
+/*
+ * Open a payload sealed by AES-GCM, fails if the tag does not match
  */
-int sddc_set_on_invite_end(sddc_t *sddc, sddc_on_invite_end_t on_invite_end)
+static int __sddc_open(sddc_t *sddc, const sddc_header_t *header,
+                       const void *data, size_t len, void *output, size_t *olen)
 {
-    sddc_return_value_if_fail(sddc && on_invite_end, -1);
+    uint8_t        nonce[SDDC_GCM_NONCE_LEN];
+    uint8_t        aad[SDDC_GCM_AAD_LEN];
+    const uint8_t *in = data;
+    int            ret;
 
-    sddc->on_invite_end = on_invite_end;
+    *olen = 0;
+
+    sddc_return_value_if_fail(sddc->security_en && sddc->gcm_ctx, -1);
+    sddc_return_value_if_fail(len >= SDDC_GCM_OVERHEAD, -1);
+
+    len -= SDDC_GCM_OVERHEAD;
+
+    __sddc_gcm_nonce(nonce, header->uid, in);
+    __sddc_gcm_aad(aad, SDDC_GET_TYPE(header), header->reserved, header->seqno);
+
+    ret = sddc->crypto->open(sddc->gcm_ctx, nonce, sizeof(nonce), aad, sizeof(aad),
+                             in + SDDC_GCM_CTR_LEN, len, output, in + SDDC_GCM_CTR_LEN + len, SDDC_CFG_GCM_TAG_LEN);
+    if (ret != 0) {
+        SDDC_LOG_ERR("Payload authentication error!\n");
+        return -1;
+    }
+
+    *olen = len;
 
     return 0;
 }
+#endif
 
-/**
- * @brief Set callback function on receive UPDATE request.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] on_update     callback function
- *
- * @return Error number
+#endif
+
+#if SDDC_CFG_LZ_EN > 0
+/*
+ * Static dictionary, the window starts with it on both ends: keys of the report, invite and
+ * message JSON as cJSON_Print formats them. The most frequent ones last (shortest offset).
  */
-int sddc_set_on_update(sddc_t *sddc, sddc_on_update_t on_update)
-{
-    sddc_return_value_if_fail(sddc && on_update, -1);
+static const uint8_t __sddc_lz_dict[] =
+    "\"server\":\t{\n\t\t\"vsoa\":\t[{\n\t\t\t\t\"desc\":\t\"\",\n\t\t\t\t\"port\":\t}]\n\t}\n}"
+    "{\"abort\":{\"info\":\"\"}}"
+    "{\"cmd\":\"\",\"timeout\":,\"size\":,\"connector\":{\"port\":,\"token\":\"\"}}"
+    "true,false,null,"
+    "{\n\t\"report\":\t{\n\t\t\"name\":\t\"\",\n\t\t\"type\":\t\"device\",\n\t\t\"excl\":\tfalse,\n"
+    "\t\t\"desc\":\t\"\",\n\t\t\"model\":\t\"\",\n\t\t\"vendor\":\t\"ACOINFO\",\n\t\t\"sn\":\t\"\"\n\t}";
 
-    sddc->on_update = on_update;
+#define SDDC_LZ_DICT_LEN            (sizeof(__sddc_lz_dict) - 1)
 
-    return 0;
+/* Byte of the window: dictionary then data */
+#define SDDC_LZ_AT(data, pos)       \
+        (((pos) < SDDC_LZ_DICT_LEN) ? __sddc_lz_dict[pos] : (data)[(pos) - SDDC_LZ_DICT_LEN])
+
+static inline uint32_t __sddc_lz_hash(const uint8_t *data, size_t pos)
+{
+    uint32_t v = SDDC_LZ_AT(data, pos) | (SDDC_LZ_AT(data, pos + 1) << 8) |
+                 (SDDC_LZ_AT(data, pos + 2) << 16) | ((uint32_t)SDDC_LZ_AT(data, pos + 3) << 24);
+
+    return (v * 2654435761U) >> (32 - SDDC_LZ_HASH_BITS);
 }
 
-/**
- * @brief Set REPORT data.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] report_data   Pointer to REPORT data
- * @param[in] len           The length to REPORT data
- *
- * @return Error number
+/*
+ * Compress: literal run (0x00 | run - 1, bytes) or match (0x80 | len - 4, 16 bits offset
+ * back in the window). Return the compressed length, -1 if it does not fit size.
  */
-int sddc_set_report_data(sddc_t *sddc, const char *report_data, size_t len)
+static ssize_t __sddc_lz_compress(uint16_t *hash, const uint8_t *data, size_t len, uint8_t *output, size_t size)
 {
-    sddc_return_value_if_fail(sddc && report_data && len, -1);
-    sddc_return_value_if_fail(len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t)), -1);
+    size_t   end = SDDC_LZ_DICT_LEN + len;
+    size_t   pos, cand, literal, mlen, run;
+    size_t   olen = 0;
+    uint32_t h;
 
-    sddc->report_data     = report_data;
-    sddc->report_data_len = len;
+    if (end > 0xffff) {
+        return -1;
+    }
 
-    return 0;
+    for (pos = 0; pos + SDDC_LZ_MATCH_MIN <= SDDC_LZ_DICT_LEN; pos++) {
+        hash[__sddc_lz_hash(data, pos)] = pos;
+    }
+
+    pos     = SDDC_LZ_DICT_LEN;
+    literal = pos;
+
+    while (pos + SDDC_LZ_MATCH_MIN <= end) {
+        h    = __sddc_lz_hash(data, pos);
+        cand = hash[h];
+        hash[h] = pos;
+
+        /*
+         * Entries left by a previous call are checked as any candidate
+         */
+        mlen = 0;
+        if (cand < pos) {
+            while ((pos + mlen < end) && (mlen < SDDC_LZ_MATCH_MAX) &&
+                   (SDDC_LZ_AT(data, cand + mlen) == SDDC_LZ_AT(data, pos + mlen))) {
+                mlen++;
+            }
+        }
+
+        if (mlen < SDDC_LZ_MATCH_MIN) {
+            pos++;
+            continue;
+        }
+
+        while (literal < pos) {
+            run = (pos - literal > SDDC_LZ_LITERAL_MAX) ? SDDC_LZ_LITERAL_MAX : pos - literal;
+            if (olen + 1 + run > size) {
+                return -1;
+            }
+            output[olen++] = run - 1;
+            memcpy(output + olen, data + literal - SDDC_LZ_DICT_LEN, run);
+            olen    += run;
+            literal += run;
+        }
+
+        if (olen + 3 > size) {
+            return -1;
+        }
+        output[olen++] = 0x80 | (mlen - SDDC_LZ_MATCH_MIN);
+        output[olen++] = (pos - cand) >> 8;
+        output[olen++] = (pos - cand) & 0xff;
+
+        for (pos++, mlen--; mlen > 0; pos++, mlen--) {
+            if (pos + SDDC_LZ_MATCH_MIN <= end) {
+                hash[__sddc_lz_hash(data, pos)] = pos;
+            }
+        }
+        literal = pos;
+    }
+
+    while (literal < end) {
+        run = (end - literal > SDDC_LZ_LITERAL_MAX) ? SDDC_LZ_LITERAL_MAX : end - literal;
+        if (olen + 1 + run > size) {
+            return -1;
+        }
+        output[olen++] = run - 1;
+        memcpy(output + olen, data + literal - SDDC_LZ_DICT_LEN, run);
+        olen    += run;
+        literal += run;
+    }
+
+    return olen;
 }
 
-/**
- * @brief Set INVITE data.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] invite_data   Pointer to INVITE data
- * @param[in] len           The length to INVITE data
- *
- * @return Error number
+/*
+ * Decompress, return the data length, -1 if it is corrupted or does not fit size
  */
-int sddc_set_invite_data(sddc_t *sddc, const char *invite_data, size_t len)
+static ssize_t __sddc_lz_decompress(const uint8_t *data, size_t len, uint8_t *output, size_t size)
 {
-    sddc_return_value_if_fail(sddc && invite_data && len, -1);
-    sddc_return_value_if_fail(len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t) - 16), -1);
+    size_t  i = 0;
+    size_t  olen = 0;
+    size_t  run, offset, src;
+    uint8_t c;
 
-#if SDDC_CFG_SECURITY_EN > 0
-    if (sddc->security_en) {
-        sddc->invite_data = sddc_malloc(len + 16);
-        sddc_return_value_if_fail(sddc->invite_data, -1);
+    while (i < len) {
+        c = data[i++];
 
-        return __sddc_encrypt(sddc, invite_data, len,
-                              (void *)sddc->invite_data, &sddc->invite_data_len);
+        if (c & 0x80) {
+            if (i + 2 > len) {
+                return -1;
+            }
 
-    } else
-#endif
-    {
-        sddc->invite_data     = invite_data;
-        sddc->invite_data_len = len;
+            run    = (c & 0x7f) + SDDC_LZ_MATCH_MIN;
+            offset = (data[i] << 8) | data[i + 1];
+            i     += 2;
+
+            if ((offset == 0) || (offset > SDDC_LZ_DICT_LEN + olen) || (olen + run > size)) {
+                return -1;
+            }
+
+            for (src = SDDC_LZ_DICT_LEN + olen - offset; run > 0; run--, src++) {
+                output[olen++] = SDDC_LZ_AT(output, src);
+            }
+
+        } else {
+            run = c + 1;
+            if ((i + run > len) || (olen + run > size)) {
+                return -1;
+            }
+
+            memcpy(output + olen, data + i, run);
+            i    += run;
+            olen += run;
+        }
     }
 
-    return 0;
+    return olen;
 }
 
-/**
- * @brief Set ABORT data.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] abort_data    Pointer to ABORT data
- * @param[in] len           The length to ABORT data
- *
- * @return Error number
+/*
+ * Compressor state (with lock), allocated on first use
  */
-int sddc_set_abort_data(sddc_t *sddc, const char *abort_data, size_t len)
+static sddc_lz_t *__sddc_lz_get(sddc_t *sddc)
 {
-    sddc_return_value_if_fail(sddc && abort_data && len, -1);
-    sddc_return_value_if_fail(len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t) - 16), -1);
-
-    if (sddc->abort_data) {
-        sddc_free((void *)sddc->abort_data);
-        sddc->abort_data = NULL;
-        sddc->abort_data_len = 0;
+    if (sddc->lz == NULL) {
+        sddc->lz = sddc_malloc(sizeof(sddc_lz_t));
+        if (sddc->lz == NULL) {
+            SDDC_LOG_ERR("Failed to allocate memory!\n");
+        }
     }
 
-#if SDDC_CFG_SECURITY_EN > 0
-    if (sddc->security_en) {
-        sddc->abort_data = sddc_malloc(len + 16);
-        sddc_return_value_if_fail(sddc->abort_data, -1);
+    return sddc->lz;
+}
 
-        return __sddc_encrypt(sddc, abort_data, len,
-                              (void *)sddc->abort_data, &sddc->abort_data_len);
+/*
+ * Compress prebuilt data (report, invite) into a new buffer (with lock), NULL if it is not smaller.
+ * The output is not the lz buffer, which holds the payload of a callback run without the lock
+ */
+static uint8_t *__sddc_lz_prebuild(sddc_t *sddc, const void *data, size_t len, size_t *lz_len)
+{
+    sddc_lz_t *lz;
+    uint8_t   *buf;
+    ssize_t    ret;
 
-    } else
-#endif
-    {
-        sddc->abort_data = sddc_malloc(len);
-        sddc_return_value_if_fail(sddc->abort_data, -1);
+    if (len < SDDC_CFG_LZ_MIN) {
+        return NULL;
+    }
 
-        sddc->abort_data_len = len;
-        memcpy(sddc->abort_data, abort_data, len);
+    lz = __sddc_lz_get(sddc);
+    if (lz == NULL) {
+        return NULL;
     }
 
-    return 0;
+    buf = sddc_malloc(len - 1);
+    if (buf == NULL) {
+        SDDC_LOG_ERR("Failed to allocate memory!\n");
+        return NULL;
+    }
+
+    ret = __sddc_lz_compress(lz->hash, data, len, buf, len - 1);
+    if (ret <= 0) {
+        sddc_free(buf);
+        return NULL;
+    }
+
+    *lz_len = ret;
+
+    return buf;
 }
 
 /**
- * @brief Destroy SDDC.
+ * @brief Compress data as SDDC compresses payloads.
  *
  * @param[in] sddc          Pointer to SDDC
+ * @param[in] data          Pointer to data
+ * @param[in] len           The length of data
+ * @param[out] output       Pointer to output buffer
+ * @param[in] size          The size of output buffer
  *
- * @return Error number
+ * @return The length of compressed data, -1 if it does not fit the output buffer
  */
-int sddc_destroy(sddc_t *sddc)
+ssize_t sddc_lz_compress(sddc_t *sddc, const void *data, size_t len, void *output, size_t size)
 {
-    sddc_return_value_if_fail(sddc, -1);
+    sddc_lz_t *lz;
+    ssize_t    ret = -1;
 
-#if SDDC_CFG_SECURITY_EN > 0
-    if (sddc->security_en) {
-        sddc_free((void *)sddc->invite_data);
-    }
-#endif
+    sddc_return_value_if_fail(sddc && data && len && output, -1);
 
-    if (sddc->abort_data) {
-        sddc_free((void *)sddc->abort_data);
+    __sddc_lock(sddc);
+
+    lz = __sddc_lz_get(sddc);
+    if (lz != NULL) {
+        ret = __sddc_lz_compress(lz->hash, data, len, output, size);
     }
 
-    close(sddc->fd);
-    sddc_mutex_destroy(&sddc->lockid);
-    sddc_free(sddc);
+    sddc_mutex_unlock(&sddc->lockid);
 
-    return 0;
+    return ret;
 }
 
 /**
- * @brief Create SDDC.
+ * @brief Decompress data compressed by SDDC or sddc_lz_compress.
  *
- * @param[in] port          UDP port
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] data          Pointer to compressed data
+ * @param[in] len           The length of compressed data
+ * @param[out] output       Pointer to output buffer
+ * @param[in] size          The size of output buffer
  *
- * @return Pointer to SDDC
+ * @return The length of data, -1 if it is corrupted or does not fit the output buffer
  */
-sddc_t *sddc_create(uint16_t port)
+ssize_t sddc_lz_decompress(sddc_t *sddc, const void *data, size_t len, void *output, size_t size)
 {
-    sddc_t            *sddc;
-    struct sockaddr_in serv_addr;
-    int                broadcast = 1;
+    sddc_return_value_if_fail(sddc && data && len && output, -1);
 
-    sddc_return_value_if_fail(port, NULL);
+    return __sddc_lz_decompress(data, len, output, size);
+}
+#endif
 
-    sddc = sddc_malloc(sizeof(sddc_t));
-    if (sddc == NULL) {
-        SDDC_LOG_ERR("Failed to allocate memory!\n");
-        return NULL;
+#if SDDC_CFG_CBOR_EN > 0
+/*
+ * CBOR (RFC 8949) subset: definite lengths, integers, strings, arrays, maps,
+ * simple values and floats. Tags are skipped on decode.
+ */
+static int __sddc_cbor_put_head(sddc_cbor_writer_t *writer, uint8_t major, uint64_t value)
+{
+    uint8_t head[9];
+    size_t  n, i;
+
+    if (value < 24) {
+        head[0] = (major << 5) | (uint8_t)value;
+        n = 0;
+    } else if (value <= 0xff) {
+        head[0] = (major << 5) | 24;
+        n = 1;
+    } else if (value <= 0xffff) {
+        head[0] = (major << 5) | 25;
+        n = 2;
+    } else if (value <= 0xffffffffULL) {
+        head[0] = (major << 5) | 26;
+        n = 4;
+    } else {
+        head[0] = (major << 5) | 27;
+        n = 8;
     }
 
-    bzero(sddc, sizeof(sddc_t));
-
-    sddc->port = port;
-    SDDC_LIST_HEAD_INIT(&sddc->edgeros_list);
-
-    if (sddc_mutex_create(&sddc->lockid) != 0) {
-        SDDC_LOG_ERR("Failed to create lock!\n");
-        sddc_free(sddc);
-        return NULL;
+    for (i = 0; i < n; i++) {
+        head[n - i] = (uint8_t)(value >> (i * 8));
     }
 
-    sddc->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sddc->fd < 0) {
-        SDDC_LOG_ERR("Failed to create socket!\n");
-        sddc_mutex_destroy(&sddc->lockid);
-        sddc_free(sddc);
-        return NULL;
+    if (writer->error || (writer->len + n + 1 > writer->size)) {
+        writer->error = SDDC_TRUE;
+        return -1;
     }
 
-    bzero(&serv_addr, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serv_addr.sin_port = htons(port);
-#if !defined(__linux__)
-    serv_addr.sin_len  = sizeof(struct sockaddr_in);
-#endif
-
-    if (bind(sddc->fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-        SDDC_LOG_ERR("Failed to bind port %u!\n", (unsigned)port);
-        sddc_destroy(sddc);
-        return NULL;
-    }
+    memcpy(writer->buf + writer->len, head, n + 1);
+    writer->len += n + 1;
 
-    setsockopt(sddc->fd, SOL_SOCKET, SO_BROADCAST, (const char *)&broadcast, sizeof(broadcast));
+    return 0;
+}
 
-    sddc_set_abort_data(sddc, SDDC_DEF_ABORT_DATA, SDDC_DEF_ABORT_DATA_LEN);
+/**
+ * @brief Init CBOR encoder.
+ *
+ * @param[out] writer       Pointer to CBOR encoder
+ * @param[in] buf           Pointer to output buffer
+ * @param[in] size          The size of output buffer
+ */
+void sddc_cbor_writer_init(sddc_cbor_writer_t *writer, void *buf, size_t size)
+{
+    sddc_return_if_fail(writer);
 
-    return sddc;
+    writer->buf   = buf;
+    writer->size  = buf ? size : 0;
+    writer->len   = 0;
+    writer->error = SDDC_FALSE;
 }
 
-static ssize_t __sddc_build_packet(sddc_t *sddc, uint8_t *packet, uint8_t type, uint8_t flags, uint8_t security_flag,
-                                   uint16_t seqno, const void *payload, size_t payload_len)
+/**
+ * @brief Get the length of CBOR data encoded.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ *
+ * @return The length of CBOR data, -1 if the output buffer overflowed
+ */
+ssize_t sddc_cbor_writer_len(const sddc_cbor_writer_t *writer)
 {
-    sddc_header_t *header = (sddc_header_t *)packet;
+    sddc_return_value_if_fail(writer, -1);
 
-    bzero(header, sizeof(sddc_header_t));
-    header->magic_ver = SDDC_MAGIC | (SDDC_VERSION << 4);
-    SDDC_SET_TYPE(header, type);
-    header->flags_type |= flags;
+    return writer->error ? -1 : (ssize_t)writer->len;
+}
 
-#if SDDC_CFG_SECURITY_EN > 0
-    if (sddc->security_en) {
-        header->security = security_flag | SDDC_SEC_FLAG_SUPPORT;
-    }
-#endif
+/**
+ * @brief Encode a map header, count key and value pairs follow.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] count         The number of pairs
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_map(sddc_cbor_writer_t *writer, size_t count)
+{
+    sddc_return_value_if_fail(writer, -1);
 
-    header->seqno  = htons(seqno);
-    header->length = htons(payload_len);
-    memcpy(header->uid, sddc->uid, sizeof(header->uid));
+    return __sddc_cbor_put_head(writer, 5, count);
+}
 
-    if ((payload_len > 0) && (payload != NULL) && ((unsigned long)payload != ((unsigned long)packet + sizeof(sddc_header_t)))) {
-        memcpy(packet + sizeof(sddc_header_t), payload, payload_len);
-    }
+/**
+ * @brief Encode an array header, count items follow.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] count         The number of items
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_array(sddc_cbor_writer_t *writer, size_t count)
+{
+    sddc_return_value_if_fail(writer, -1);
 
-    return sizeof(sddc_header_t) + payload_len;
+    return __sddc_cbor_put_head(writer, 4, count);
 }
 
-static sddc_edgeros_t *__sddc_edgeros_find(sddc_t *sddc, const uint8_t *uid)
+/**
+ * @brief Encode a text string.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] str           Pointer to UTF8 string
+ * @param[in] len           The length of string
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_text(sddc_cbor_writer_t *writer, const char *str, size_t len)
 {
-    sddc_edgeros_t   *edgeros;
-    sddc_list_head_t *itervar;
+    sddc_return_value_if_fail(writer && (str || !len), -1);
 
-    sddc_list_for_each(itervar, &sddc->edgeros_list) {
-        edgeros = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
-        if (memcmp(edgeros->uid, uid, sizeof(edgeros->uid)) == 0) {
-            return edgeros;
-        }
+    if (__sddc_cbor_put_head(writer, 3, len) < 0) {
+        return -1;
     }
 
-    return NULL;
+    if (writer->len + len > writer->size) {
+        writer->error = SDDC_TRUE;
+        return -1;
+    }
+
+    memcpy(writer->buf + writer->len, str, len);
+    writer->len += len;
+
+    return 0;
 }
 
-static sddc_edgeros_t *__sddc_edgeros_update(sddc_t *sddc, const uint8_t *uid, const struct sockaddr_in *cli_addr)
+/**
+ * @brief Encode an integer.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] value         Integer
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_int(sddc_cbor_writer_t *writer, int64_t value)
 {
-    sddc_edgeros_t *edgeros = __sddc_edgeros_find(sddc, uid);
+    sddc_return_value_if_fail(writer, -1);
 
-    if (edgeros != NULL) {
-        edgeros->addr  = *cli_addr;
+    if (value < 0) {
+        return __sddc_cbor_put_head(writer, 1, (uint64_t)(-1 - value));
     }
 
-    return edgeros;
+    return __sddc_cbor_put_head(writer, 0, (uint64_t)value);
 }
 
-static int __sddc_edgeros_destroy(sddc_edgeros_t *edgeros)
+/**
+ * @brief Encode a boolean.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] value         Boolean
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_bool(sddc_cbor_writer_t *writer, sddc_bool_t value)
 {
-    char ip_str[IP4ADDR_STRLEN_MAX];
-
-    inet_ntoa_r(edgeros->addr.sin_addr, ip_str, sizeof(ip_str));
-    SDDC_LOG_DBG("EdgerOS lost %s!\n", ip_str);
-
-    while (edgeros->mqueue_len > 0) {
-        sddc_message_t *message = SDDC_CONTAINER_OF(edgeros->mqueue.next, sddc_message_t, node);
-        sddc_list_del(&message->node);
-        sddc_free(message);
-        edgeros->mqueue_len--;
-    }
+    sddc_return_value_if_fail(writer, -1);
 
-    sddc_list_del(&edgeros->node);
+    return __sddc_cbor_put_head(writer, 7, value ? 21 : 20);
+}
 
-    sddc_free(edgeros);
+/**
+ * @brief Encode null.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_null(sddc_cbor_writer_t *writer)
+{
+    sddc_return_value_if_fail(writer, -1);
 
-    return 0;
+    return __sddc_cbor_put_head(writer, 7, 22);
 }
 
-static int __sddc_after_invite_respond(sddc_t *sddc, sddc_edgeros_t *edgeros, const uint8_t *uid, struct sockaddr_in *cli_addr)
+/**
+ * @brief Encode a floating point number, as float if it has no loss.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] value         Number
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_double(sddc_cbor_writer_t *writer, double value)
 {
-    if (edgeros == NULL) {
-        edgeros = sddc_malloc(sizeof(sddc_edgeros_t));
-        if (edgeros != NULL) {
-            memcpy(edgeros->uid, uid, sizeof(edgeros->uid));
-            edgeros->addr       = *cli_addr;
-            edgeros->alive      = SDDC_CFG_EDGEROS_ALIVE;
-            edgeros->last_seqno = -1;
-            edgeros->mqueue_len = 0;
-            SDDC_LIST_HEAD_INIT(&edgeros->mqueue);
-            sddc_list_add(&edgeros->node, &sddc->edgeros_list);
-
-        } else {
-            SDDC_LOG_ERR("Failed to allocate memory!\n");
+    union { float f; uint32_t u; } f32;
+    union { double d; uint64_t u; } f64;
+    uint8_t  buf[9];
+    size_t   n, i;
+
+    sddc_return_value_if_fail(writer, -1);
+
+    f32.f = (float)value;
+    if ((double)f32.f == value) {
+        buf[0] = 0xfa;
+        for (i = 0; i < 4; i++) {
+            buf[4 - i] = (uint8_t)(f32.u >> (i * 8));
         }
+        n = 5;
     } else {
-        edgeros->addr       = *cli_addr;
-        edgeros->last_seqno = -1;
+        f64.d  = value;
+        buf[0] = 0xfb;
+        for (i = 0; i < 8; i++) {
+            buf[8 - i] = (uint8_t)(f64.u >> (i * 8));
+        }
+        n = 9;
     }
 
-    sddc_return_value_if_fail(edgeros != NULL, -1);
-
-    if (sddc->on_invite_end != NULL) {
-        sddc->on_invite_end(sddc, edgeros->uid);
+    if (writer->error || (writer->len + n > writer->size)) {
+        writer->error = SDDC_TRUE;
+        return -1;
     }
 
+    memcpy(writer->buf + writer->len, buf, n);
+    writer->len += n;
+
     return 0;
 }
 
-static sddc_bool_t __sddc_edgeros_can_join (sddc_t *sddc, sddc_edgeros_t *edgeros)
+/**
+ * @brief Init CBOR decoder, it reads the data in place.
+ *
+ * @param[out] reader       Pointer to CBOR decoder
+ * @param[in] data          Pointer to CBOR data
+ * @param[in] len           The length of CBOR data
+ */
+void sddc_cbor_reader_init(sddc_cbor_reader_t *reader, const void *data, size_t len)
 {
-#if SDDC_CFG_MULTI_EDGEROS_JOIN_EN > 0
-    return SDDC_TRUE;
-#else
-    if (sddc_list_is_empty(&sddc->edgeros_list)) {
-        return SDDC_TRUE;
-    } else {
-        if (SDDC_CONTAINER_OF(sddc->edgeros_list.next, sddc_edgeros_t, node) == edgeros) {
-            return SDDC_TRUE;
-        } else {
-            return SDDC_FALSE;
-        }
-    }
-#endif
+    sddc_return_if_fail(reader);
+
+    reader->pos = data;
+    reader->end = reader->pos + (data ? len : 0);
 }
 
-static void __sddc_read_handle(sddc_t *sddc)
+/**
+ * @brief Decode the next item.
+ *
+ * @notice A string is not copied: item->str points into the CBOR data and is not
+ *         NUL terminated. For an array or map, the reader is left on its first item.
+ *
+ * @param[in] reader        Pointer to CBOR decoder
+ * @param[out] item         Pointer to item
+ *
+ * @return Error number, -1 at the end of the data or if it is malformed
+ */
+int sddc_cbor_read(sddc_cbor_reader_t *reader, sddc_cbor_item_t *item)
 {
-    struct sockaddr_in cli_addr;
-    socklen_t          addrlen = sizeof(cli_addr);
+    const uint8_t *pos;
+    uint8_t  major, info;
+    uint64_t value;
+    size_t   n, i;
 
-    int len = recvfrom(sddc->fd, sddc->recv_buf, sizeof(sddc->recv_buf), 0,
-                       (struct sockaddr *)&cli_addr, &addrlen);
-    if (len >= sizeof(sddc_header_t)) {
-        sddc_header_t  *header = (sddc_header_t *)sddc->recv_buf;
-        char            ip_str[IP4ADDR_STRLEN_MAX];
-        sddc_edgeros_t *edgeros;
-        size_t          payload_len;
-        void           *payload;
-        int             unpack_ret;
-        uint8_t         flag_type;
-        uint16_t        src_port = ntohs(cli_addr.sin_port);
+    sddc_return_value_if_fail(reader && item, -1);
 
-        inet_ntoa_r(cli_addr.sin_addr, ip_str, sizeof(ip_str));
+    pos = reader->pos;
 
-        if (src_port != SDDC_CFG_PORT) {
-            SDDC_LOG_ERR("Receive packet source port error, from: %s:%d.\n", ip_str, src_port);
-            return;
+    do {
+        if (pos >= reader->end) {
+            return -1;
         }
 
-        header->seqno  = ntohs(header->seqno);
-        header->length = ntohs(header->length);
+        major = *pos >> 5;
+        info  = *pos & 0x1f;
+        pos++;
 
-        sddc_mutex_lock(&sddc->lockid);
+        if (info < 24) {
+            n = 0;
+            value = info;
+        } else if (info <= 27) {
+            n = (size_t)1 << (info - 24);
+            value = 0;
+        } else {
+            return -1;                                              /* Indefinite length    */
+        }
 
-        /*
-         * Updated EdgerOS address info
-         */
-        edgeros   = __sddc_edgeros_update(sddc, header->uid, &cli_addr);
-        flag_type = SDDC_GET_TYPE(header);
-        if (flag_type != SDDC_TYPE_DISCOVER && edgeros) {
-            edgeros->alive = SDDC_CFG_EDGEROS_ALIVE;
+        if ((size_t)(reader->end - pos) < n) {
+            return -1;
         }
+        for (i = 0; i < n; i++) {
+            value = (value << 8) | *pos++;
+        }
+    } while (major == 6);                                           /* Skip tags            */
 
-        switch (flag_type) {
-        case SDDC_TYPE_PING:                                        /* PING                 */
-            if (header->flags_type & SDDC_FLAG_REQ) {               /* PING request         */
-                SDDC_LOG_DBG("Receive ping from: %s.\n", ip_str);
-                if (!edgeros && (header->flags_type & SDDC_FLAG_JOIN)) {
-                    /*
-                     * Build abort info
-                     */
-                    len = __sddc_build_packet(sddc, sddc->send_buf,
-                                              SDDC_TYPE_UPDATE,
-                                              SDDC_FLAG_NONE,
-#if SDDC_CFG_SECURITY_EN > 0
-                                              sddc->security_en ? SDDC_SEC_FLAG_CRYPTO : SDDC_SEC_FLAG_NONE,
-#else
-                                              SDDC_SEC_FLAG_NONE,
-#endif
-                                              header->seqno,
-                                              sddc->abort_data, sddc->abort_data_len);
+    memset(item, 0, sizeof(sddc_cbor_item_t));
 
-                    /*
-                     * Send abort info to EdgerOS
-                     */
-                    sendto(sddc->fd, sddc->send_buf, len, 0,
-                           (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
+    switch (major) {
+    case 0:
+    case 1:
+        if (value > INT64_MAX) {
+            return -1;
+        }
+        item->type    = SDDC_CBOR_INT;
+        item->integer = (major == 0) ? (int64_t)value : -1 - (int64_t)value;
+        item->number  = (double)item->integer;
+        break;
+
+    case 2:
+    case 3:
+        if (value > (uint64_t)(reader->end - pos)) {
+            return -1;
+        }
+        item->type = (major == 2) ? SDDC_CBOR_BYTES : SDDC_CBOR_TEXT;
+        item->str  = (const char *)pos;
+        item->len  = (size_t)value;
+        pos += value;
+        break;
+
+    case 4:
+    case 5:
+        /*
+         * Each item takes at least one byte, this bounds the count
+         */
+        if (value > (uint64_t)(reader->end - pos) / ((major == 5) ? 2 : 1)) {
+            return -1;
+        }
+        item->type = (major == 4) ? SDDC_CBOR_ARRAY : SDDC_CBOR_MAP;
+        item->len  = (size_t)value;
+        break;
+
+    default:
+        switch (info) {
+        case 20:
+        case 21:
+            item->type    = SDDC_CBOR_BOOL;
+            item->integer = info - 20;
+            break;
 
-                    SDDC_LOG_DBG("Send abort info to: %s.\n", ip_str);
-                } else {
-                    /*
-                     * Build PING respond
-                     */
-                    len = __sddc_build_packet(sddc, sddc->send_buf,
-                                              SDDC_TYPE_PING,
-                                              SDDC_FLAG_ACK,
-                                              SDDC_SEC_FLAG_NONE,
-                                              header->seqno,
-                                              NULL, 0);
+        case 22:
+        case 23:
+            item->type = SDDC_CBOR_NULL;
+            break;
 
-                    /*
-                     * Send PING respond to EdgerOS
-                     */
-                    sendto(sddc->fd, sddc->send_buf, len, 0,
-                           (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
+        case 25: {
+            uint32_t exp  = (value >> 10) & 0x1f;
+            uint32_t mant = value & 0x3ff;
+            union { float f; uint32_t u; } f32;
 
-                    SDDC_LOG_DBG("Send ping respond to: %s.\n", ip_str);
+            /*
+             * Half to float: rebias the exponent, subnormals scaled by 2^-24
+             */
+            if (exp == 0) {
+                f32.f = (float)mant / 16777216.0f;
+                if (value & 0x8000) {
+                    f32.f = -f32.f;
                 }
             } else {
-                SDDC_LOG_DBG("Receive ping respond from: %s.\n", ip_str);
+                f32.u = ((uint32_t)(value & 0x8000) << 16) |
+                        (((exp == 0x1f) ? 0xff : (exp + 112)) << 23) | (mant << 13);
             }
+            item->type   = SDDC_CBOR_FLOAT;
+            item->number = f32.f;
             break;
+        }
 
-        case SDDC_TYPE_DISCOVER:
-            SDDC_LOG_DBG("Receive discover from: %s.\n", ip_str);
+        case 26: {
+            union { float f; uint32_t u; } f32;
 
-            if ((edgeros == NULL) && (sddc->report_data != NULL)) {
-                /*
-                * Build REPORT
-                */
-                len = __sddc_build_packet(sddc, sddc->send_buf,
-                                        SDDC_TYPE_REPORT,
-                                        SDDC_FLAG_NONE,
-                                        SDDC_SEC_FLAG_NONE,
-                                        sddc->seqno++,
-                                        sddc->report_data, sddc->report_data_len);
+            f32.u = (uint32_t)value;
+            item->type   = SDDC_CBOR_FLOAT;
+            item->number = f32.f;
+            break;
+        }
 
-                /*
-                * Send REPORT to EdgerOS
-                */
-                sendto(sddc->fd, sddc->send_buf, len, 0,
-                    (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
+        case 27: {
+            union { double d; uint64_t u; } f64;
 
-                SDDC_LOG_DBG("Send discover respond to: %s.\n", ip_str);
-            }
+            f64.u = value;
+            item->type   = SDDC_CBOR_FLOAT;
+            item->number = f64.d;
+            break;
+        }
+
+        default:
+            return -1;
+        }
+
+        if (item->type == SDDC_CBOR_FLOAT) {
+            item->integer = (int64_t)item->number;
+        }
+        break;
+    }
+
+    reader->pos = pos;
+
+    return 0;
+}
+
+/**
+ * @brief Skip the next item, with the items of an array or map.
+ *
+ * @param[in] reader        Pointer to CBOR decoder
+ *
+ * @return Error number
+ */
+int sddc_cbor_skip(sddc_cbor_reader_t *reader)
+{
+    sddc_cbor_item_t item;
+    size_t           remain = 1;
+
+    sddc_return_value_if_fail(reader, -1);
+
+    while (remain > 0) {
+        if (sddc_cbor_read(reader, &item) < 0) {
+            return -1;
+        }
+        remain--;
+
+        if (item.type == SDDC_CBOR_ARRAY) {
+            remain += item.len;
+        } else if (item.type == SDDC_CBOR_MAP) {
+            remain += item.len * 2;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Find a text key in a map.
+ *
+ * @param[in] map           Pointer to CBOR decoder left on the first key by sddc_cbor_read
+ * @param[in] count         The number of pairs of the map
+ * @param[in] key           Key string
+ * @param[out] value        Pointer to the value item
+ * @param[out] inner        Pointer to CBOR decoder left after the value header (NULL: ignore),
+ *                          on its first item for an array or map
+ *
+ * @return Error number, -1 if the key is not found
+ */
+int sddc_cbor_map_find(const sddc_cbor_reader_t *map, size_t count, const char *key,
+                       sddc_cbor_item_t *value, sddc_cbor_reader_t *inner)
+{
+    sddc_cbor_reader_t reader;
+    sddc_cbor_item_t   item;
+    size_t             key_len;
+
+    sddc_return_value_if_fail(map && key && value, -1);
+
+    reader  = *map;
+    key_len = strlen(key);
+
+    while (count-- > 0) {
+        if (sddc_cbor_read(&reader, &item) < 0) {
+            return -1;
+        }
+
+        if ((item.type == SDDC_CBOR_TEXT) && (item.len == key_len) && (memcmp(item.str, key, key_len) == 0)) {
+            if (sddc_cbor_read(&reader, value) < 0) {
+                return -1;
+            }
+            if (inner != NULL) {
+                *inner = reader;
+            }
+            return 0;
+        }
+
+        if ((item.type == SDDC_CBOR_ARRAY) || (item.type == SDDC_CBOR_MAP)) {
+            return -1;                                              /* Not a scalar key     */
+        }
+
+        if (sddc_cbor_skip(&reader) < 0) {
+            return -1;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Check whether a text item is a string.
+ *
+ * @param[in] item          Pointer to item
+ * @param[in] str           Pointer to string
+ *
+ * @return SDDC_TRUE if the item is the text string
+ */
+sddc_bool_t sddc_cbor_text_is(const sddc_cbor_item_t *item, const char *str)
+{
+    size_t len;
+
+    sddc_return_value_if_fail(item && str, SDDC_FALSE);
+
+    len = strlen(str);
+
+    return ((item->type == SDDC_CBOR_TEXT) && (item->len == len) && (memcmp(item->str, str, len) == 0))
+           ? SDDC_TRUE : SDDC_FALSE;
+}
+
+/* JSON output of __sddc_cbor_to_json, output NULL only counts */
+typedef struct {
+    char   *output;
+    size_t  size;
+    size_t  len;
+} sddc_json_out_t;
+
+static int __sddc_json_put(sddc_json_out_t *out, const char *str, size_t len)
+{
+    if (out->output != NULL) {
+        if (out->len + len >= out->size) {                          /* Room for NUL         */
+            return -1;
+        }
+        memcpy(out->output + out->len, str, len);
+    }
+    out->len += len;
+
+    return 0;
+}
+
+static int __sddc_json_put_string(sddc_json_out_t *out, const sddc_cbor_item_t *item)
+{
+    static const char hex[] = "0123456789abcdef";
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    const uint8_t *str = (const uint8_t *)item->str;
+    char           esc[6];
+    size_t         i, run;
+
+    if (__sddc_json_put(out, "\"", 1) < 0) {
+        return -1;
+    }
+
+    if (item->type == SDDC_CBOR_BYTES) {
+        /*
+         * Byte strings as base64url without padding (RFC 8949 6.1)
+         */
+        for (i = 0; i < item->len; i += 3) {
+            uint32_t v = (uint32_t)str[i] << 16;
+            size_t   n = item->len - i;
+
+            if (n > 1) {
+                v |= (uint32_t)str[i + 1] << 8;
+            }
+            if (n > 2) {
+                v |= str[i + 2];
+            }
+            esc[0] = b64[(v >> 18) & 0x3f];
+            esc[1] = b64[(v >> 12) & 0x3f];
+            esc[2] = b64[(v >> 6) & 0x3f];
+            esc[3] = b64[v & 0x3f];
+            if (__sddc_json_put(out, esc, (n > 2) ? 4 : n + 1) < 0) {
+                return -1;
+            }
+        }
+
+    } else {
+        for (i = 0; i < item->len; i += run) {
+            for (run = 0; (i + run < item->len) && (str[i + run] >= 0x20) &&
+                          (str[i + run] != '"') && (str[i + run] != '\\'); run++) {
+            }
+
+            if (run > 0) {
+                if (__sddc_json_put(out, (const char *)str + i, run) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+
+            esc[0] = '\\';
+            switch (str[i]) {
+            case '"':  esc[1] = '"';  run = 2; break;
+            case '\\': esc[1] = '\\'; run = 2; break;
+            case '\n': esc[1] = 'n';  run = 2; break;
+            case '\r': esc[1] = 'r';  run = 2; break;
+            case '\t': esc[1] = 't';  run = 2; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[str[i] >> 4];
+                esc[5] = hex[str[i] & 0xf];
+                run = 6;
+                break;
+            }
+            if (__sddc_json_put(out, esc, run) < 0) {
+                return -1;
+            }
+            run = 1;
+        }
+    }
+
+    return __sddc_json_put(out, "\"", 1);
+}
+
+/*
+ * CBOR to JSON, return the JSON length (NUL not counted), -1 if the CBOR is
+ * malformed, nests too deep, has non text or integer keys or does not fit
+ */
+static ssize_t __sddc_cbor_to_json(const void *data, size_t len, char *output, size_t size)
+{
+    sddc_cbor_reader_t reader;
+    sddc_cbor_item_t   item;
+    sddc_json_out_t    out = { output, size, 0 };
+    size_t             remain[SDDC_CBOR_DEPTH_MAX + 1];
+    sddc_bool_t        is_map[SDDC_CBOR_DEPTH_MAX + 1];
+    sddc_bool_t        first = SDDC_TRUE;
+    unsigned int       depth = 0;
+    char               num[32];
+    int                n;
+
+    sddc_cbor_reader_init(&reader, data, len);
+
+    remain[0] = 1;
+    is_map[0] = SDDC_FALSE;
+
+    while (1) {
+        /*
+         * Close the arrays and maps done
+         */
+        while ((depth > 0) && (remain[depth] == 0)) {
+            if (__sddc_json_put(&out, is_map[depth] ? "}" : "]", 1) < 0) {
+                return -1;
+            }
+            depth--;
+            first = SDDC_FALSE;
+        }
+
+        if (remain[depth] == 0) {
+            break;
+        }
+
+        if (sddc_cbor_read(&reader, &item) < 0) {
+            return -1;
+        }
+        remain[depth]--;
+
+        /*
+         * In a map, remain is odd after a key was read
+         */
+        if (is_map[depth] && (remain[depth] & 1)) {
+            if (!first && (__sddc_json_put(&out, ",", 1) < 0)) {
+                return -1;
+            }
+            if (item.type == SDDC_CBOR_TEXT) {
+                n = __sddc_json_put_string(&out, &item);
+            } else if (item.type == SDDC_CBOR_INT) {
+                n = snprintf(num, sizeof(num), "\"%lld\"", (long long)item.integer);
+                n = __sddc_json_put(&out, num, n);
+            } else {
+                return -1;
+            }
+            if ((n < 0) || (__sddc_json_put(&out, ":", 1) < 0)) {
+                return -1;
+            }
+            first = SDDC_TRUE;                                      /* No ',' before value  */
+            continue;
+        }
+
+        if (!first && !is_map[depth] && (__sddc_json_put(&out, ",", 1) < 0)) {
+            return -1;
+        }
+        first = SDDC_FALSE;
+
+        switch (item.type) {
+        case SDDC_CBOR_INT:
+            n = snprintf(num, sizeof(num), "%lld", (long long)item.integer);
+            n = __sddc_json_put(&out, num, n);
+            break;
+
+        case SDDC_CBOR_FLOAT:
+            if ((item.number != item.number) || (item.number - item.number != 0)) {
+                n = __sddc_json_put(&out, "null", 4);               /* NaN, Infinity        */
+            } else {
+                n = snprintf(num, sizeof(num), "%.17g", item.number);
+                n = __sddc_json_put(&out, num, n);
+            }
+            break;
+
+        case SDDC_CBOR_BYTES:
+        case SDDC_CBOR_TEXT:
+            n = __sddc_json_put_string(&out, &item);
+            break;
+
+        case SDDC_CBOR_BOOL:
+            n = item.integer ? __sddc_json_put(&out, "true", 4) : __sddc_json_put(&out, "false", 5);
+            break;
+
+        case SDDC_CBOR_NULL:
+            n = __sddc_json_put(&out, "null", 4);
+            break;
+
+        default:
+            if (depth >= SDDC_CBOR_DEPTH_MAX) {
+                return -1;
+            }
+            n = __sddc_json_put(&out, (item.type == SDDC_CBOR_MAP) ? "{" : "[", 1);
+            depth++;
+            is_map[depth] = (item.type == SDDC_CBOR_MAP) ? SDDC_TRUE : SDDC_FALSE;
+            remain[depth] = is_map[depth] ? item.len * 2 : item.len;
+            first = SDDC_TRUE;
+            break;
+        }
+
+        if (n < 0) {
+            return -1;
+        }
+    }
+
+    if (reader.pos != reader.end) {
+        return -1;                                                  /* Trailing data        */
+    }
+
+    if (output != NULL) {
+        output[out.len] = '\0';
+    }
+
+    return out.len;
+}
+
+/**
+ * @brief Convert CBOR data to JSON text, for EdgerOS which do not take CBOR or to log it.
+ *
+ * @param[in] data          Pointer to CBOR data
+ * @param[in] len           The length of CBOR data
+ * @param[out] output       Pointer to output buffer, NUL terminated (NULL: only get the length)
+ * @param[in] size          The size of output buffer
+ *
+ * @return The length of JSON text, -1 if the data is malformed or does not fit the output buffer
+ */
+ssize_t sddc_cbor_to_json(const void *data, size_t len, char *output, size_t size)
+{
+    sddc_return_value_if_fail(data && len, -1);
+
+    return __sddc_cbor_to_json(data, len, output, size);
+}
+#endif
+
+static void __sddc_mpool_free(sddc_t *sddc)
+{
+    int i;
+
+    for (i = 0; i < SDDC_MPOOL_CLASS_NR; i++) {
+        if (sddc->mpool[i].slab != NULL) {
+            sddc_free(sddc->mpool[i].slab);
+            sddc->mpool[i].slab = NULL;
+        }
+    }
+}
+
+/*
+ * Allocate the slab of each class, kept out of sddc_t so the large class (full size
+ * messages) can be small and fall back to heap
+ */
+static int __sddc_mpool_init(sddc_t *sddc)
+{
+    uint16_t sizes[SDDC_MPOOL_CLASS_NR] = { SDDC_CFG_MPOOL_SMALL_SIZE, SDDC_CFG_MPOOL_MEDIUM_SIZE, SDDC_MPOOL_LARGE_SIZE };
+    uint16_t nums[SDDC_MPOOL_CLASS_NR]  = { SDDC_CFG_MPOOL_NUM, SDDC_CFG_MPOOL_NUM, SDDC_CFG_MPOOL_LARGE_NUM };
+    int      i, j;
+
+    for (i = 0; i < SDDC_MPOOL_CLASS_NR; i++) {
+        sddc_mpool_t *mpool = &sddc->mpool[i];
+
+        SDDC_LIST_HEAD_INIT(&mpool->free_list);
+        mpool->size  = sizes[i];
+        mpool->total = nums[i];
+
+        if (nums[i] == 0) {
+            continue;
+        }
+
+        mpool->slab = sddc_malloc(nums[i] * SDDC_MPOOL_SLOT_SIZE(sizes[i]));
+        if (mpool->slab == NULL) {
+            __sddc_mpool_free(sddc);
+            return -1;
+        }
+
+        for (j = 0; j < nums[i]; j++) {
+            sddc_message_t *message = (sddc_message_t *)((uint8_t *)mpool->slab + j * SDDC_MPOOL_SLOT_SIZE(sizes[i]));
+
+            message->pool = i;
+            sddc_list_add_tail(&message->node, &mpool->free_list);
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Allocate a message able to hold packet_len bytes packet, from the smallest class which has free one
+ */
+static sddc_message_t *__sddc_message_alloc(sddc_t *sddc, size_t packet_len)
+{
+    sddc_message_t *message;
+    int             i;
+
+    for (i = 0; i < SDDC_MPOOL_CLASS_NR; i++) {
+        sddc_mpool_t *mpool = &sddc->mpool[i];
+
+        if (packet_len > mpool->size) {
+            continue;
+        }
+
+        if (sddc_list_is_empty(&mpool->free_list)) {
+#if SDDC_CFG_STATS_EN > 0
+            mpool->exhausted++;
+#endif
+            continue;
+        }
+
+        message = SDDC_CONTAINER_OF(mpool->free_list.next, sddc_message_t, node);
+        sddc_list_del(&message->node);
+
+#if SDDC_CFG_STATS_EN > 0
+        if (++mpool->used > mpool->high_water) {
+            mpool->high_water = mpool->used;
+        }
+#endif
+
+        return message;
+    }
+
+#if SDDC_CFG_MPOOL_HEAP_EN > 0
+    message = sddc_malloc(sizeof(sddc_message_t) + packet_len);
+    if (message != NULL) {
+        message->pool = SDDC_MPOOL_HEAP;
+
+#if SDDC_CFG_STATS_EN > 0
+        if (++sddc->stats_mpool_heap_used > sddc->stats_mpool_heap_high_water) {
+            sddc->stats_mpool_heap_high_water = sddc->stats_mpool_heap_used;
+        }
+#endif
+
+        return message;
+    }
+#endif
+
+    SDDC_STATS_ENGINE_INC(sddc, mpool_alloc_fail);
+
+    return NULL;
+}
+
+static void __sddc_message_free(sddc_t *sddc, sddc_message_t *message)
+{
+#if SDDC_CFG_MPOOL_HEAP_EN > 0
+    if (message->pool == SDDC_MPOOL_HEAP) {
+        SDDC_STATS_ENGINE_ADD(sddc, mpool_heap_used, -1);
+        sddc_free(message);
+        return;
+    }
+#endif
+
+    sddc_list_add(&message->node, &sddc->mpool[message->pool].free_list);
+#if SDDC_CFG_STATS_EN > 0
+    sddc->mpool[message->pool].used--;
+#endif
+}
+
+/**
+ * @brief Set device uniquely id.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] mac_addr      Pointer to device mac address
+ *
+ * @return Error number
+ */
+int sddc_set_uid(sddc_t *sddc, const uint8_t *mac_addr)
+{
+    sddc_return_value_if_fail(sddc && mac_addr, -1);
+
+    __sddc_lock(sddc);
+
+    sddc->uid[0] = mac_addr[0];
+    sddc->uid[1] = mac_addr[1];
+    sddc->uid[2] = mac_addr[2];
+    sddc->uid[3] = 0xfe;
+    sddc->uid[4] = 0x80;
+    sddc->uid[5] = mac_addr[3];
+    sddc->uid[6] = mac_addr[4];
+    sddc->uid[7] = mac_addr[5];
+
+    __sddc_prebuild(sddc);
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on receive MESSAGE request.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] on_message    callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_message(sddc_t *sddc, sddc_on_message_t on_message)
+{
+    sddc_return_value_if_fail(sddc && on_message, -1);
+
+    sddc->on_message = on_message;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on receive MESSAGE ACK.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] on_message    callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_message_ack(sddc_t *sddc, sddc_on_message_ack_t on_message_ack)
+{
+    sddc_return_value_if_fail(sddc && on_message_ack, -1);
+
+    sddc->on_message_ack = on_message_ack;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on lost MESSAGE ACK.
+ *
+ * @param[in] sddc              Pointer to SDDC
+ * @param[in] on_message_lost   callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_message_lost(sddc_t *sddc, sddc_on_message_lost_t on_message_lost)
+{
+    sddc_return_value_if_fail(sddc && on_message_lost, -1);
+
+    sddc->on_message_lost = on_message_lost;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on EdgerOS message queue has room again.
+ *
+ * @param[in] sddc              Pointer to SDDC
+ * @param[in] on_message_ready  callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_message_ready(sddc_t *sddc, sddc_on_message_ready_t on_message_ready)
+{
+    sddc_return_value_if_fail(sddc && on_message_ready, -1);
+
+    sddc->on_message_ready = on_message_ready;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on EdgerOS disconnection.
+ *
+ * @param[in] sddc              Pointer to SDDC
+ * @param[in] on_edgeros_lost   callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_edgeros_lost(sddc_t *sddc, sddc_on_edgeros_lost_t on_edgeros_lost)
+{
+    sddc_return_value_if_fail(sddc && on_edgeros_lost, -1);
+
+    sddc->on_edgeros_lost = on_edgeros_lost;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on receive TIMESTAMP ack.
+ *
+ * @param[in] sddc              Pointer to SDDC
+ * @param[in] on_timestamp      callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_timestamp(sddc_t *sddc, sddc_on_timestamp_t on_timestamp)
+{
+    sddc_return_value_if_fail(sddc && on_timestamp, -1);
+
+    sddc->on_timestamp = on_timestamp;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of on receive INVITE request.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] on_invite     callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_invite(sddc_t *sddc, sddc_on_invite_t on_invite)
+{
+    sddc_return_value_if_fail(sddc && on_invite, -1);
+
+    sddc->on_invite = on_invite;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function of after send INVITE respond.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] on_invite_end callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_invite_end(sddc_t *sddc, sddc_on_invite_end_t on_invite_end)
+{
+    sddc_return_value_if_fail(sddc && on_invite_end, -1);
+
+    sddc->on_invite_end = on_invite_end;
+
+    return 0;
+}
+
+/**
+ * @brief Set callback function on receive UPDATE request.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] on_update     callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_update(sddc_t *sddc, sddc_on_update_t on_update)
+{
+    sddc_return_value_if_fail(sddc && on_update, -1);
+
+    sddc->on_update = on_update;
+
+    return 0;
+}
+
+/**
+ * @brief Set REPORT data.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] report_data   Pointer to REPORT data
+ * @param[in] len           The length to REPORT data
+ *
+ * @return Error number
+ */
+int sddc_set_report_data(sddc_t *sddc, const char *report_data, size_t len)
+{
+    sddc_return_value_if_fail(sddc && report_data && len, -1);
+    sddc_return_value_if_fail(len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t)), -1);
+
+    __sddc_lock(sddc);
+
+    sddc->report_data     = report_data;
+    sddc->report_data_len = len;
+
+    __sddc_prebuild(sddc);
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return 0;
+}
+
+/**
+ * @brief Set INVITE data.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] invite_data   Pointer to INVITE data
+ * @param[in] len           The length to INVITE data
+ *
+ * @return Error number
+ */
+int sddc_set_invite_data(sddc_t *sddc, const char *invite_data, size_t len)
+{
+    sddc_return_value_if_fail(sddc && invite_data && len, -1);
+    sddc_return_value_if_fail(len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t) - 16), -1);
+
+#if SDDC_CFG_LZ_EN > 0
+    __sddc_lock(sddc);
+
+    if (sddc->invite_lz != NULL) {
+        sddc_free(sddc->invite_lz);
+        sddc->invite_lz = NULL;
+    }
+
+    /*
+     * Compressed invite data for EdgerOS which take it, kept only if smaller
+     */
+    {
+        size_t   lz_len;
+        uint8_t *lz = __sddc_lz_prebuild(sddc, invite_data, len, &lz_len);
+
+        if (lz != NULL) {
+#if SDDC_CFG_SECURITY_EN > 0
+            if (sddc->security_en) {
+                if ((sddc->invite_lz = sddc_malloc(lz_len + 16)) != NULL) {
+                    if (__sddc_encrypt(sddc, lz, lz_len, sddc->invite_lz, &sddc->invite_lz_len) != 0) {
+                        sddc_free(sddc->invite_lz);
+                        sddc->invite_lz = NULL;
+                    }
+                }
+                sddc_free(lz);
+            } else
+#endif
+            {
+                sddc->invite_lz     = lz;
+                sddc->invite_lz_len = lz_len;
+            }
+        }
+    }
+
+    sddc_mutex_unlock(&sddc->lockid);
+#endif
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (sddc->security_en) {
+        sddc->invite_data = sddc_malloc(len + 16);
+        sddc_return_value_if_fail(sddc->invite_data, -1);
+
+        return __sddc_encrypt(sddc, invite_data, len,
+                              (void *)sddc->invite_data, &sddc->invite_data_len);
+
+    } else
+#endif
+    {
+        sddc->invite_data     = invite_data;
+        sddc->invite_data_len = len;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Set ABORT data.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] abort_data    Pointer to ABORT data
+ * @param[in] len           The length to ABORT data
+ *
+ * @return Error number
+ */
+int sddc_set_abort_data(sddc_t *sddc, const char *abort_data, size_t len)
+{
+    int ret = -1;
+
+    sddc_return_value_if_fail(sddc && abort_data && len, -1);
+    sddc_return_value_if_fail(len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t) - 16), -1);
+
+    __sddc_lock(sddc);
+
+    if (sddc->abort_data) {
+        sddc_free((void *)sddc->abort_data);
+        sddc->abort_data = NULL;
+        sddc->abort_data_len = 0;
+    }
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (sddc->security_en) {
+        sddc->abort_data = sddc_malloc(len + 16);
+        sddc_goto_error_if_fail(sddc->abort_data);
+
+        ret = __sddc_encrypt(sddc, abort_data, len,
+                             (void *)sddc->abort_data, &sddc->abort_data_len);
+
+    } else
+#endif
+    {
+        sddc->abort_data = sddc_malloc(len);
+        sddc_goto_error_if_fail(sddc->abort_data);
+
+        sddc->abort_data_len = len;
+        memcpy(sddc->abort_data, abort_data, len);
+        ret = 0;
+    }
+
+error:
+    __sddc_prebuild(sddc);
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return ret;
+}
+
+/*
+ * Free the buffers allocated by __sddc_buffers_init
+ */
+static void __sddc_buffers_free(sddc_t *sddc)
+{
+#if SDDC_CFG_FRAG_MAX > 0
+    int i;
+#endif
+
+    __sddc_mpool_free(sddc);
+
+    if (sddc->send_stage != NULL) {
+        sddc_free(sddc->send_stage);
+        sddc->send_stage = NULL;
+    }
+
+#if SDDC_CFG_FRAG_MAX > 0
+    /*
+     * The reassembly buffers are one allocation, starting with the first one
+     */
+    if (sddc->reasm[0].buf != NULL) {
+        sddc_free(sddc->reasm[0].buf);
+        for (i = 0; i < SDDC_CFG_REASM_NUM; i++) {
+            sddc->reasm[i].buf = NULL;
+        }
+    }
+#endif
+}
+
+/*
+ * Allocate the fixed buffers of SDDC: message pool slabs, send ring payload slots and
+ * reassembly buffers
+ */
+static int __sddc_buffers_init(sddc_t *sddc)
+{
+#if SDDC_CFG_FRAG_MAX > 0
+    uint8_t *buf;
+    int      i;
+#endif
+
+    if (__sddc_mpool_init(sddc) != 0) {
+        return -1;
+    }
+
+    sddc->send_stage = sddc_malloc(SDDC_CFG_SEND_RING_SIZE * SDDC_SEND_PAYLOAD_MAX);
+    if (sddc->send_stage == NULL) {
+        __sddc_buffers_free(sddc);
+        return -1;
+    }
+
+#if SDDC_CFG_FRAG_MAX > 0
+    buf = sddc_malloc(SDDC_CFG_REASM_NUM * SDDC_CFG_FRAG_MAX * SDDC_CFG_FRAG_SIZE);
+    if (buf == NULL) {
+        __sddc_buffers_free(sddc);
+        return -1;
+    }
+
+    for (i = 0; i < SDDC_CFG_REASM_NUM; i++) {
+        sddc->reasm[i].buf = buf + i * SDDC_CFG_FRAG_MAX * SDDC_CFG_FRAG_SIZE;
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Destroy SDDC.
+ *
+ * @notice Destroy the connectors of SDDC before, they give their cipher contexts back to it
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Error number
+ */
+int sddc_destroy(sddc_t *sddc)
+{
+    int i;
+
+    sddc_return_value_if_fail(sddc, -1);
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (sddc->security_en) {
+        sddc_free((void *)sddc->invite_data);
+        __sddc_crypto_free(sddc);
+    }
+#endif
+
+    if (sddc->abort_data) {
+        sddc_free((void *)sddc->abort_data);
+    }
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (sddc->report_crypto != NULL) {
+        sddc_free(sddc->report_crypto);
+    }
+#if SDDC_CFG_LZ_EN > 0
+    if (sddc->report_lz_crypto != NULL) {
+        sddc_free(sddc->report_lz_crypto);
+    }
+#endif
+#endif
+
+#if SDDC_CFG_LZ_EN > 0
+    if (sddc->report_lz != NULL) {
+        sddc_free(sddc->report_lz);
+    }
+    if (sddc->invite_lz != NULL) {
+        sddc_free(sddc->invite_lz);
+    }
+    if (sddc->lz != NULL) {
+        sddc_free(sddc->lz);
+    }
+#endif
+
+    while (!sddc_list_is_empty(&sddc->edgeros_list)) {
+        __sddc_edgeros_destroy(sddc, SDDC_CONTAINER_OF(sddc->edgeros_list.next, sddc_edgeros_t, node));
+    }
+
+    for (i = 0; i < SDDC_CFG_SEND_RING_SIZE; i++) {
+        if (sddc->send_ring[i].large != NULL) {
+            sddc_free(sddc->send_ring[i].large);
+        }
+#if SDDC_CFG_CBOR_EN > 0
+        if (sddc->send_ring[i].json != NULL) {
+            sddc_free(sddc->send_ring[i].json);
+        }
+#endif
+    }
+
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    for (i = 0; i < SDDC_CFG_CONNECTOR_POOL_SIZE; i++) {
+        if (sddc->conn_pool[i] != NULL) {
+            __sddc_connector_free(sddc->conn_pool[i]);
+        }
+    }
+#endif
+
+#if SDDC_KEY_CACHE_EN > 0
+    for (i = 0; i < SDDC_CFG_KEY_CACHE_SIZE; i++) {
+        __sddc_key_entry_free(sddc, &sddc->key_cache[i]);
+    }
+#endif
+
+    __sddc_buffers_free(sddc);
+
+    close(sddc->fd);
+    sddc_mutex_destroy(&sddc->lockid);
+    sddc_free(sddc);
+
+    return 0;
+}
+
+/**
+ * @brief Create SDDC.
+ *
+ * @param[in] port          UDP port
+ *
+ * @return Pointer to SDDC
+ */
+sddc_t *sddc_create(uint16_t port)
+{
+    sddc_t            *sddc;
+    struct sockaddr_in serv_addr;
+    int                broadcast = 1;
+    int                i;
+
+    sddc_return_value_if_fail(port, NULL);
+
+    sddc = sddc_malloc(sizeof(sddc_t));
+    if (sddc == NULL) {
+        SDDC_LOG_ERR("Failed to allocate memory!\n");
+        return NULL;
+    }
+
+    bzero(sddc, sizeof(sddc_t));
+
+    if (__sddc_buffers_init(sddc) != 0) {
+        SDDC_LOG_ERR("Failed to allocate memory!\n");
+        sddc_free(sddc);
+        return NULL;
+    }
+
+    sddc->port = port;
+    SDDC_LIST_HEAD_INIT(&sddc->edgeros_list);
+    sddc->alive_deadline = sddc_time_ms() + SDDC_CFG_RETRIES_INTERVAL;
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+    sddc->discover_rand = sddc->alive_deadline | 1;
+#endif
+#if SDDC_CFG_SECURITY_EN > 0
+    sddc->crypto = &sddc_crypto_mbedtls;
+#endif
+#if SDDC_GCM_EN > 0
+    sddc->gcm_counter = sddc_random();              /* Nonces of a reboot do not restart at 0 */
+#endif
+
+    for (i = 0; i < SDDC_CFG_SEND_RING_SIZE; i++) {
+        sddc->send_ring[i].sequence = i;
+    }
+
+    if (sddc_mutex_create(&sddc->lockid) != 0) {
+        SDDC_LOG_ERR("Failed to create lock!\n");
+        __sddc_buffers_free(sddc);
+        sddc_free(sddc);
+        return NULL;
+    }
+
+    sddc->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sddc->fd < 0) {
+        SDDC_LOG_ERR("Failed to create socket!\n");
+        sddc_mutex_destroy(&sddc->lockid);
+        __sddc_buffers_free(sddc);
+        sddc_free(sddc);
+        return NULL;
+    }
+
+    bzero(&serv_addr, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(port);
+#if !defined(__linux__)
+    serv_addr.sin_len  = sizeof(struct sockaddr_in);
+#endif
+
+    if (bind(sddc->fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        SDDC_LOG_ERR("Failed to bind port %u!\n", (unsigned)port);
+        sddc_destroy(sddc);
+        return NULL;
+    }
+
+    setsockopt(sddc->fd, SOL_SOCKET, SO_BROADCAST, (const char *)&broadcast, sizeof(broadcast));
+
+    /*
+     * Other tasks queueing a send wake up sddc_run by a datagram to the SDDC socket on loopback
+     */
+    bzero(&sddc->wake_addr, sizeof(sddc->wake_addr));
+    sddc->wake_addr.sin_family = AF_INET;
+    sddc->wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sddc->wake_addr.sin_port = htons(port);
+#if !defined(__linux__)
+    sddc->wake_addr.sin_len  = sizeof(struct sockaddr_in);
+#endif
+
+#if SDDC_BATCH_IO_EN > 0
+    for (i = 0; i < SDDC_CFG_BATCH_SIZE; i++) {
+        sddc->rx_iov[i].iov_base              = sddc->rx_buf[i];
+        sddc->rx_iov[i].iov_len               = sizeof(sddc->rx_buf[i]);
+        sddc->rx_msgs[i].msg_hdr.msg_name     = &sddc->rx_addr[i];
+        sddc->rx_msgs[i].msg_hdr.msg_namelen  = sizeof(sddc->rx_addr[i]);
+        sddc->rx_msgs[i].msg_hdr.msg_iov      = &sddc->rx_iov[i];
+        sddc->rx_msgs[i].msg_hdr.msg_iovlen   = 1;
+
+        sddc->tx_iov[i][0].iov_base           = &sddc->tx_header[i];
+        sddc->tx_iov[i][0].iov_len            = sizeof(sddc->tx_header[i]);
+        sddc->tx_msgs[i].msg_hdr.msg_name     = &sddc->tx_addr[i];
+        sddc->tx_msgs[i].msg_hdr.msg_namelen  = sizeof(sddc->tx_addr[i]);
+        sddc->tx_msgs[i].msg_hdr.msg_iov      = sddc->tx_iov[i];
+    }
+#endif
+
+    sddc_set_abort_data(sddc, SDDC_DEF_ABORT_DATA, SDDC_DEF_ABORT_DATA_LEN);
+
+    return sddc;
+}
+
+#if SDDC_CFG_SECURITY_EN > 0
+/**
+ * @brief Create SDDC with a crypto backend.
+ *
+ * @param[in] port          UDP port
+ * @param[in] crypto        Crypto backend of SDDC and its connectors, NULL: sddc_crypto_mbedtls
+ *
+ * @return Pointer to SDDC
+ */
+sddc_t *sddc_create_with_crypto(uint16_t port, const sddc_crypto_ops_t *crypto)
+{
+    sddc_t *sddc;
+
+    sddc_return_value_if_fail(!crypto || (crypto->create && crypto->destroy && crypto->crypt &&
+                                          crypto->start && crypto->update && crypto->finish), NULL);
+
+    sddc = sddc_create(port);
+    if ((sddc != NULL) && (crypto != NULL)) {
+        sddc->crypto = crypto;
+    }
+
+    return sddc;
+}
+#endif
+
+static void __sddc_build_header(sddc_t *sddc, sddc_header_t *header, uint8_t type, uint8_t flags, uint8_t security_flag,
+                                uint16_t seqno, size_t payload_len)
+{
+    bzero(header, sizeof(sddc_header_t));
+    header->magic_ver = SDDC_MAGIC | (SDDC_VERSION << 4);
+    SDDC_SET_TYPE(header, type);
+    header->flags_type |= flags;
+
+#if SDDC_CFG_LZ_EN > 0
+    header->security |= (security_flag & SDDC_SEC_FLAG_LZ) | SDDC_SEC_FLAG_LZ_SUPPORT;
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+    header->security |= (security_flag & SDDC_SEC_FLAG_CBOR) | SDDC_SEC_FLAG_CBOR_SUPPORT;
+#endif
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (sddc->security_en) {
+        header->security |= security_flag | SDDC_SEC_FLAG_SUPPORT;
+#if SDDC_GCM_EN > 0
+        if (sddc->gcm_ctx != NULL) {
+            header->security |= SDDC_SEC_FLAG_GCM_SUPPORT;
+        }
+#endif
+    }
+#endif
+
+    header->seqno  = htons(seqno);
+    header->length = htons(payload_len);
+    memcpy(header->uid, sddc->uid, sizeof(header->uid));
+}
+
+/*
+ * Build the responds which only differ by seq number once, when SDDC data, UID or token change
+ */
+static void __sddc_prebuild(sddc_t *sddc)
+{
+    __sddc_build_header(sddc, &sddc->report_header,
+                        SDDC_TYPE_REPORT,
+                        SDDC_FLAG_NONE,
+                        SDDC_SEC_FLAG_NONE,
+                        0,
+                        sddc->report_data_len);
+
+    __sddc_build_header(sddc, &sddc->ping_header,
+                        SDDC_TYPE_PING,
+                        SDDC_FLAG_ACK,
+                        SDDC_SEC_FLAG_NONE,
+                        0,
+                        0);
+
+    __sddc_build_header(sddc, &sddc->abort_header,
+                        SDDC_TYPE_UPDATE,
+                        SDDC_FLAG_NONE,
+#if SDDC_CFG_SECURITY_EN > 0
+                        sddc->security_en ? SDDC_SEC_FLAG_CRYPTO : SDDC_SEC_FLAG_NONE,
+#else
+                        SDDC_SEC_FLAG_NONE,
+#endif
+                        0,
+                        sddc->abort_data_len);
+
+#if SDDC_CFG_LZ_EN > 0
+    if (sddc->report_lz != NULL) {
+        sddc_free(sddc->report_lz);
+        sddc->report_lz = NULL;
+    }
+
+    /*
+     * Compressed report data for EdgerOS which take it, kept only if smaller
+     */
+    if (sddc->report_data != NULL) {
+        sddc->report_lz = __sddc_lz_prebuild(sddc, sddc->report_data, sddc->report_data_len, &sddc->report_lz_len);
+
+        if (sddc->report_lz != NULL) {
+            __sddc_build_header(sddc, &sddc->report_lz_header,
+                                SDDC_TYPE_REPORT,
+                                SDDC_FLAG_NONE,
+                                SDDC_SEC_FLAG_LZ,
+                                0,
+                                sddc->report_lz_len);
+        }
+    }
+#endif
+
+#if SDDC_CFG_SECURITY_EN > 0
+    if (sddc->report_crypto != NULL) {
+        sddc_free(sddc->report_crypto);
+        sddc->report_crypto = NULL;
+    }
+
+#if SDDC_CFG_LZ_EN > 0
+    if (sddc->report_lz_crypto != NULL) {
+        sddc_free(sddc->report_lz_crypto);
+        sddc->report_lz_crypto = NULL;
+    }
+#endif
+
+    /*
+     * UPDATE requests carry the report data, encrypt it once (and its compressed form,
+     * by the same backend call)
+     */
+    if (sddc->security_en && (sddc->report_data != NULL)) {
+        sddc_crypto_buf_t bufs[2];
+        int               count = 0;
+
+        sddc->report_crypto = sddc_malloc(sddc->report_data_len + 16);
+        if (sddc->report_crypto != NULL) {
+            bufs[count].input  = sddc->report_data;
+            bufs[count].len    = sddc->report_data_len;
+            bufs[count].output = sddc->report_crypto;
+            count++;
+        }
+
+#if SDDC_CFG_LZ_EN > 0
+        if ((sddc->report_lz != NULL) && ((sddc->report_lz_crypto = sddc_malloc(sddc->report_lz_len + 16)) != NULL)) {
+            bufs[count].input  = sddc->report_lz;
+            bufs[count].len    = sddc->report_lz_len;
+            bufs[count].output = sddc->report_lz_crypto;
+            count++;
+        }
+#endif
+
+        if ((count > 0) && (__sddc_crypto_multi(sddc->crypto, sddc->encypt_ctx, sddc->iv, bufs, count) != 0)) {
+            count = 0;
+        }
+
+        if (sddc->report_crypto != NULL) {
+            if (count > 0) {
+                sddc->report_crypto_len = bufs[0].olen;
+            } else {
+                sddc_free(sddc->report_crypto);
+                sddc->report_crypto = NULL;
+            }
+        }
+
+#if SDDC_CFG_LZ_EN > 0
+        if (sddc->report_lz_crypto != NULL) {
+            if (count > 0) {
+                sddc->report_lz_crypto_len = bufs[count - 1].olen;
+            } else {
+                sddc_free(sddc->report_lz_crypto);
+                sddc->report_lz_crypto = NULL;
+            }
+        }
+#endif
+    }
+#endif
+}
+
+/*
+ * Build a whole packet into a message of the queue (kept for retransmission)
+ */
+static ssize_t __sddc_build_packet(sddc_t *sddc, uint8_t *packet, uint8_t type, uint8_t flags, uint8_t security_flag,
+                                   uint16_t seqno, const void *payload, size_t payload_len)
+{
+    __sddc_build_header(sddc, (sddc_header_t *)packet, type, flags, security_flag, seqno, payload_len);
+
+    if ((payload_len > 0) && (payload != NULL) && ((unsigned long)payload != ((unsigned long)packet + sizeof(sddc_header_t)))) {
+        memcpy(packet + sizeof(sddc_header_t), payload, payload_len);
+        SDDC_STATS_ENGINE_ADD(sddc, tx_copy_bytes, payload_len);
+    }
+
+    return sizeof(sddc_header_t) + payload_len;
+}
+
+static inline void __sddc_timer_set(sddc_t *sddc, uint16_t index, sddc_message_t *message)
+{
+    sddc->timer_heap[index] = message;
+    message->timer_index    = index;
+}
+
+static void __sddc_timer_sift_up(sddc_t *sddc, uint16_t index)
+{
+    sddc_message_t *message = sddc->timer_heap[index];
+    uint16_t        parent;
+
+    while (index > 0) {
+        parent = (index - 1) / 2;
+        if (SDDC_TIME_BEFORE_EQ(sddc->timer_heap[parent]->deadline, message->deadline)) {
+            break;
+        }
+        __sddc_timer_set(sddc, index, sddc->timer_heap[parent]);
+        index = parent;
+    }
+
+    __sddc_timer_set(sddc, index, message);
+}
+
+static void __sddc_timer_sift_down(sddc_t *sddc, uint16_t index)
+{
+    sddc_message_t *message = sddc->timer_heap[index];
+    uint16_t        child;
+
+    while ((child = index * 2 + 1) < sddc->timer_heap_len) {
+        if ((child + 1 < sddc->timer_heap_len) &&
+            !SDDC_TIME_BEFORE_EQ(sddc->timer_heap[child]->deadline, sddc->timer_heap[child + 1]->deadline)) {
+            child++;
+        }
+        if (SDDC_TIME_BEFORE_EQ(message->deadline, sddc->timer_heap[child]->deadline)) {
+            break;
+        }
+        __sddc_timer_set(sddc, index, sddc->timer_heap[child]);
+        index = child;
+    }
+
+    __sddc_timer_set(sddc, index, message);
+}
+
+/*
+ * Reserve seq numbers, application tasks take them without lock
+ */
+static inline uint16_t __sddc_seqno_alloc(sddc_t *sddc, uint16_t count)
+{
+    return (uint16_t)SDDC_ATOMIC_ADD(&sddc->seqno, count);
+}
+
+/*
+ * Make the SDDC socket readable to wake up sddc_run or the application event loop,
+ * the datagram is shorter than a header and dropped
+ */
+static void __sddc_wakeup(sddc_t *sddc)
+{
+    uint8_t wake = 0;
+
+    sendto(sddc->fd, &wake, sizeof(wake), 0,
+           (const struct sockaddr *)&sddc->wake_addr, sizeof(sddc->wake_addr));
+}
+
+static void __sddc_timer_add(sddc_t *sddc, sddc_message_t *message)
+{
+    __sddc_timer_set(sddc, sddc->timer_heap_len++, message);
+    __sddc_timer_sift_up(sddc, message->timer_index);
+}
+
+static void __sddc_timer_remove(sddc_t *sddc, sddc_message_t *message)
+{
+    uint16_t index = message->timer_index;
+
+    message->timer_index = SDDC_TIMER_NONE;
+
+    if (index != --sddc->timer_heap_len) {
+        __sddc_timer_set(sddc, index, sddc->timer_heap[sddc->timer_heap_len]);
+        __sddc_timer_sift_up(sddc, index);
+        __sddc_timer_sift_down(sddc, sddc->timer_heap[index]->timer_index);
+    }
+}
+
+/*
+ * RFC 6298 RTO estimation from a RTT sample (Karn: only samples of messages sent once)
+ */
+static void __sddc_edgeros_rtt_sample(sddc_edgeros_t *edgeros, uint32_t rtt)
+{
+    int32_t delta;
+    int32_t rto;
+
+    if (!edgeros->rtt_valid) {
+        edgeros->srtt      = rtt << 3;
+        edgeros->rttvar    = rtt << 1;
+        edgeros->rtt_valid = SDDC_TRUE;
+    } else {
+        delta = (int32_t)rtt - (edgeros->srtt >> 3);
+        edgeros->srtt += delta;
+        if (delta < 0) {
+            delta = -delta;
+        }
+        edgeros->rttvar += delta - (edgeros->rttvar >> 2);
+    }
+
+    rto = (edgeros->srtt >> 3) + ((edgeros->rttvar > 0) ? edgeros->rttvar : 1);
+    if (rto < SDDC_CFG_RTO_MIN) {
+        rto = SDDC_CFG_RTO_MIN;
+    } else if (rto > SDDC_CFG_RTO_MAX) {
+        rto = SDDC_CFG_RTO_MAX;
+    }
+
+    edgeros->rto = rto;
+}
+
+#if SDDC_CFG_STATS_EN > 0
+/*
+ * Count an ack RTT sample in the histograms, bucket n: 2^(n-1) ~ 2^n - 1 MS
+ */
+static void __sddc_stats_rtt(sddc_t *sddc, sddc_edgeros_t *edgeros, uint32_t rtt)
+{
+    int bucket = 0;
+
+    while ((rtt > 0) && (bucket < SDDC_STATS_RTT_NR - 1)) {
+        rtt >>= 1;
+        bucket++;
+    }
+
+    SDDC_STATS_INC(sddc, edgeros, rtt_hist[bucket]);
+}
+#endif
+
+#if SDDC_BATCH_IO_EN > 0
+/*
+ * Send all datagrams batched by __sddc_send_packet
+ */
+static void __sddc_tx_flush(sddc_t *sddc)
+{
+    int i = 0;
+    int ret;
+
+    while (i < sddc->tx_len) {
+        ret = sendmmsg(sddc->fd, &sddc->tx_msgs[i], sddc->tx_len - i, 0);
+        if (ret > 0) {
+            i += ret;
+        } else {
+            /*
+             * Drop the failed datagram as sendto would, keep the others
+             */
+            i++;
+        }
+    }
+
+    sddc->tx_len = 0;
+}
+
+/*
+ * Does the batch still reference this memory
+ */
+static sddc_bool_t __sddc_tx_pending(sddc_t *sddc, const void *data, size_t len)
+{
+    const uint8_t *base;
+    int i;
+
+    for (i = 0; i < sddc->tx_len; i++) {
+        base = sddc->tx_iov[i][1].iov_base;
+        if ((sddc->tx_msgs[i].msg_hdr.msg_iovlen > 1) &&
+            (base >= (const uint8_t *)data) && (base < (const uint8_t *)data + len)) {
+            return SDDC_TRUE;
+        }
+    }
+
+    return SDDC_FALSE;
+}
+#endif
+
+/*
+ * Batch the datagrams sent until __sddc_tx_end (with lock)
+ */
+static inline void __sddc_tx_begin(sddc_t *sddc)
+{
+#if SDDC_BATCH_IO_EN > 0
+    sddc->tx_hold++;
+#endif
+}
+
+static inline void __sddc_tx_end(sddc_t *sddc)
+{
+#if SDDC_BATCH_IO_EN > 0
+    if ((--sddc->tx_hold == 0) && (sddc->tx_len > 0)) {
+        __sddc_tx_flush(sddc);
+    }
+#endif
+}
+
+/*
+ * Application callbacks are called without the lock (held once by sddc_run), the batched
+ * datagrams are sent first so they do not wait for the application
+ */
+static inline void __sddc_callout_begin(sddc_t *sddc)
+{
+#if SDDC_BATCH_IO_EN > 0
+    if (sddc->tx_len > 0) {
+        __sddc_tx_flush(sddc);
+    }
+#endif
+
+#if SDDC_CFG_STATS_EN > 0
+    sddc->stats_callout_begin = sddc_time_us();
+#endif
+
+    SDDC_TRACE(sddc, SDDC_TRACE_CALLOUT, 0, 0);
+
+    sddc_mutex_unlock(&sddc->lockid);
+}
+
+static inline void __sddc_callout_end(sddc_t *sddc)
+{
+#if SDDC_CFG_STATS_EN > 0
+    uint32_t spent = sddc_time_us() - sddc->stats_callout_begin;
+#endif
+
+    __sddc_lock(sddc);
+
+    SDDC_TRACE(sddc, SDDC_TRACE_CALLOUT_END, 0, 0);
+
+#if SDDC_CFG_STATS_EN > 0
+    sddc->stats_callback_count++;
+    sddc->stats_callback_us += spent;
+#endif
+}
+
+#define SDDC_CALLOUT(sddc, call) \
+        do { \
+            __sddc_callout_begin(sddc); \
+            call; \
+            __sddc_callout_end(sddc); \
+        } while (0)
+
+/*
+ * Where to put a payload produced for one send (ciphertext): the next batch slot, so it
+ * is sent without copy, or the send buffer
+ */
+static uint8_t *__sddc_tx_payload_buf(sddc_t *sddc)
+{
+#if SDDC_BATCH_IO_EN > 0
+    if (sddc->tx_hold > 0) {
+        if (sddc->tx_len == SDDC_CFG_BATCH_SIZE) {
+            __sddc_tx_flush(sddc);
+        }
+        return sddc->tx_buf[sddc->tx_len];
+    }
+#endif
+
+    return sddc->send_buf + sizeof(sddc_header_t);
+}
+
+/*
+ * Send header and payload as one datagram on SDDC socket, without staging copy when
+ * the port has sendmsg.
+ *
+ * Between __sddc_tx_begin and __sddc_tx_end the datagram is batched for one sendmmsg and
+ * payload is referenced: it is a queued message, a send ring cell, SDDC data or comes from
+ * __sddc_tx_payload_buf, all alive until the batch is flushed.
+ */
+static int __sddc_send_packet(sddc_t *sddc, const sddc_header_t *header, const void *payload, size_t payload_len,
+                              const struct sockaddr_in *addr)
+{
+#if SDDC_CFG_STATS_EN > 0
+    SDDC_STATS_ADD(sddc, sddc->stats_peer, tx_bytes, sizeof(sddc_header_t) + payload_len);
+    if (SDDC_GET_TYPE(header) < SDDC_STATS_TYPE_NR) {
+        SDDC_STATS_INC(sddc, sddc->stats_peer, tx_packets[SDDC_GET_TYPE(header)]);
+    }
+#endif
+
+    SDDC_TRACE(sddc, SDDC_TRACE_SEND, SDDC_GET_TYPE(header), ntohs(header->seqno));
+
+#if SDDC_BATCH_IO_EN > 0
+    if (sddc->tx_hold > 0) {
+        struct msghdr *msg;
+        struct iovec  *iov;
+
+        if (sddc->tx_len == SDDC_CFG_BATCH_SIZE) {
+            __sddc_tx_flush(sddc);
+        }
+
+        msg = &sddc->tx_msgs[sddc->tx_len].msg_hdr;
+        iov = sddc->tx_iov[sddc->tx_len];
+
+        sddc->tx_header[sddc->tx_len] = *header;
+        sddc->tx_addr[sddc->tx_len]   = *addr;
+        msg->msg_iovlen = 1;
+
+        if (payload_len > 0) {
+            iov[1].iov_base = (void *)payload;
+            iov[1].iov_len  = payload_len;
+            msg->msg_iovlen = 2;
+        }
+
+        sddc->tx_len++;
+
+        return sizeof(sddc_header_t) + payload_len;
+    }
+#endif
+
+#if SDDC_SENDMSG_EN > 0
+    {
+        struct msghdr msg;
+        struct iovec  iov[2];
+
+        iov[0].iov_base = (void *)header;
+        iov[0].iov_len  = sizeof(sddc_header_t);
+        iov[1].iov_base = (void *)payload;
+        iov[1].iov_len  = payload_len;
+
+        bzero(&msg, sizeof(msg));
+        msg.msg_name    = (void *)addr;
+        msg.msg_namelen = sizeof(*addr);
+        msg.msg_iov     = iov;
+        msg.msg_iovlen  = (payload_len > 0) ? 2 : 1;
+
+        return sendmsg(sddc->fd, &msg, 0);
+    }
+#else
+    if ((payload_len > 0) && (payload != (const void *)(header + 1))) {
+        /*
+         * Stage the datagram in the send buffer, unless it is already contiguous (queued message)
+         */
+        if ((const uint8_t *)payload != sddc->send_buf + sizeof(sddc_header_t)) {
+            memcpy(sddc->send_buf + sizeof(sddc_header_t), payload, payload_len);
+            SDDC_STATS_ENGINE_ADD(sddc, tx_copy_bytes, payload_len);
+        }
+        memcpy(sddc->send_buf, header, sizeof(sddc_header_t));
+        header = (const sddc_header_t *)sddc->send_buf;
+    }
+
+    return sendto(sddc->fd, header, sizeof(sddc_header_t) + payload_len, 0, (const struct sockaddr *)addr, sizeof(*addr));
+#endif
+}
+
+/*
+ * Send a packet to edgeros, counted to it
+ */
+static int __sddc_send_to_edgeros(sddc_t *sddc, sddc_edgeros_t *edgeros, const sddc_header_t *header,
+                                  const void *payload, size_t payload_len)
+{
+#if SDDC_CFG_STATS_EN > 0
+    sddc_edgeros_t *peer = sddc->stats_peer;
+    int             ret;
+
+    sddc->stats_peer = edgeros;
+    ret = __sddc_send_packet(sddc, header, payload, payload_len, &edgeros->addr);
+    sddc->stats_peer = peer;
+
+    return ret;
+#else
+    return __sddc_send_packet(sddc, header, payload, payload_len, &edgeros->addr);
+#endif
+}
+
+/*
+ * Take a message out of the EdgerOS message queue and free it
+ */
+static void __sddc_message_release(sddc_t *sddc, sddc_message_t *message)
+{
+    sddc_edgeros_t *edgeros = message->edgeros;
+
+#if SDDC_BATCH_IO_EN > 0
+    if ((sddc->tx_len > 0) && __sddc_tx_pending(sddc, message->packet, message->packet_len)) {
+        __sddc_tx_flush(sddc);
+    }
+#endif
+
+    sddc_list_del(&message->node);
+
+    if (message->timer_index != SDDC_TIMER_NONE) {
+        __sddc_timer_remove(sddc, message);
+    }
+
+    if (message->transmits > 0) {
+        edgeros->inflight--;
+    }
+
+    edgeros->mqueue_len--;
+
+    __sddc_message_free(sddc, message);
+}
+
+/*
+ * Take every queued fragment of a MESSAGE out of the EdgerOS message queue
+ */
+static void __sddc_message_release_fragments(sddc_t *sddc, sddc_edgeros_t *edgeros, uint16_t frag_base)
+{
+    sddc_list_head_t *itervar;
+    sddc_list_head_t *savevar;
+    sddc_message_t   *message;
+
+    sddc_list_for_each_safe(itervar, savevar, &edgeros->mqueue) {
+        message = SDDC_CONTAINER_OF(itervar, sddc_message_t, node);
+        if ((message->frag != 0) && (message->frag_base == frag_base)) {
+            __sddc_message_release(sddc, message);
+        }
+    }
+}
+
+/*
+ * Send a queued message, request is kept with a backed off retransmission timer
+ */
+static void __sddc_message_transmit(sddc_t *sddc, sddc_message_t *message, uint32_t now)
+{
+    sddc_edgeros_t *edgeros = message->edgeros;
+    sddc_header_t  *header  = (sddc_header_t *)message->packet;
+
+    __sddc_send_to_edgeros(sddc, edgeros, header, message->packet + sizeof(sddc_header_t),
+                           message->packet_len - sizeof(sddc_header_t));
+
+    if (!(header->flags_type & SDDC_FLAG_REQ)) {
+        __sddc_message_release(sddc, message);
+        return;
+    }
+
+    if (message->retries > 0) {
+        message->retries--;
+    }
+
+    if (message->transmits++ == 0) {
+        edgeros->inflight++;
+        message->rto = edgeros->rto;
+    } else {
+        message->rto = (message->rto * 2 < SDDC_CFG_RTO_MAX) ? message->rto * 2 : SDDC_CFG_RTO_MAX;
+        SDDC_STATS_INC(sddc, edgeros, retransmits);
+    }
+
+    message->sent_time = now;
+    message->deadline  = now + message->rto;
+    __sddc_timer_add(sddc, message);
+}
+
+/*
+ * Send the queued messages not sent yet while the send window has room,
+ * and tell the application a refused EdgerOS can take messages again
+ */
+static void __sddc_mqueue_kick(sddc_t *sddc, sddc_edgeros_t *edgeros, uint32_t now)
+{
+    sddc_list_head_t *itervar;
+    sddc_list_head_t *savevar;
+    sddc_message_t   *message;
+
+    sddc_list_for_each_safe(itervar, savevar, &edgeros->mqueue) {
+        if (edgeros->inflight >= SDDC_CFG_SEND_WINDOW) {
+            break;
+        }
+
+        message = SDDC_CONTAINER_OF(itervar, sddc_message_t, node);
+        if (message->transmits == 0) {
+            __sddc_message_transmit(sddc, message, now);
+        }
+    }
+
+    if (edgeros->mqueue_full && (edgeros->mqueue_len < SDDC_CFG_MQUEUE_SIZE)) {
+        edgeros->mqueue_full = SDDC_FALSE;
+
+        if (sddc->on_message_ready != NULL) {
+            SDDC_CALLOUT(sddc, sddc->on_message_ready(sddc, edgeros->uid));
+        }
+    }
+}
+
+/*
+ * Request acked (in any order inside the send window), take the RTT sample
+ * and send the next queued messages. The ack of a fragment echoes its fragment byte,
+ * return SDDC_FALSE until every fragment of the MESSAGE is acked
+ */
+static sddc_bool_t __sddc_message_ack(sddc_t *sddc, sddc_edgeros_t *edgeros, uint16_t seqno, uint8_t frag,
+                                      uint16_t *msg_seqno)
+{
+    sddc_list_head_t *itervar;
+    sddc_message_t   *message;
+    uint16_t          frag_base = seqno - SDDC_FRAG_INDEX(frag);
+    sddc_bool_t       complete  = (frag == 0) ? SDDC_TRUE : SDDC_FALSE;
+    uint32_t          now = sddc_time_ms();
+
+    sddc_list_for_each(itervar, &edgeros->mqueue) {
+        message = SDDC_CONTAINER_OF(itervar, sddc_message_t, node);
+        if ((message->seqno == seqno) && (message->transmits > 0)) {
+            if (message->transmits == 1) {
+                __sddc_edgeros_rtt_sample(edgeros, now - message->sent_time);
+#if SDDC_CFG_STATS_EN > 0
+                __sddc_stats_rtt(sddc, edgeros, now - message->sent_time);
+#endif
+            }
+
+            frag      = message->frag;
+            frag_base = message->frag_base;
+            __sddc_message_release(sddc, message);
+
+            if (frag != 0) {
+                complete = SDDC_TRUE;
+                sddc_list_for_each(itervar, &edgeros->mqueue) {
+                    message = SDDC_CONTAINER_OF(itervar, sddc_message_t, node);
+                    if ((message->frag != 0) && (message->frag_base == frag_base)) {
+                        complete = SDDC_FALSE;
+                        break;
+                    }
+                }
+            }
+
+            __sddc_mqueue_kick(sddc, edgeros, now);
+            break;
+        }
+    }
+
+    if (msg_seqno != NULL) {
+        *msg_seqno = frag_base;
+    }
+
+    return complete;
+}
+
+/*
+ * FNV-1a, cheap enough for the 8 bytes UID on MCU
+ */
+static inline uint32_t __sddc_hash(const uint8_t *data, size_t len)
+{
+    uint32_t hash = 2166136261U;
+
+    while (len-- > 0) {
+        hash ^= *data++;
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static inline uint32_t __sddc_edgeros_uid_hash(const sddc_edgeros_t *edgeros)
+{
+    return __sddc_hash(edgeros->uid, sizeof(edgeros->uid));
+}
+
+/*
+ * Insert EdgerOS to a open addressing (linear probing) table, the table never full: HASH_SIZE > EDGEROS_MAX
+ */
+static void __sddc_edgeros_hash_insert(sddc_edgeros_t **table, uint32_t hash, sddc_edgeros_t *edgeros)
+{
+    uint32_t i = hash & SDDC_EDGEROS_HASH_MASK;
+
+    while (table[i] != NULL) {
+        i = (i + 1) & SDDC_EDGEROS_HASH_MASK;
+    }
+
+    table[i] = edgeros;
+}
+
+/*
+ * Remove EdgerOS from a open addressing table, backward shift the following entries (no tombstone)
+ */
+static void __sddc_edgeros_hash_remove(sddc_edgeros_t **table, uint32_t (*hash_func)(const sddc_edgeros_t *),
+                                       sddc_edgeros_t *edgeros)
+{
+    uint32_t i = hash_func(edgeros) & SDDC_EDGEROS_HASH_MASK;
+    uint32_t j;
+    uint32_t k;
+
+    while (table[i] != edgeros) {
+        if (table[i] == NULL) {
+            return;
+        }
+        i = (i + 1) & SDDC_EDGEROS_HASH_MASK;
+    }
+
+    for (j = i; ; ) {
+        j = (j + 1) & SDDC_EDGEROS_HASH_MASK;
+        if (table[j] == NULL) {
+            break;
+        }
+
+        /*
+         * Move table[j] to the hole unless its home slot k lies cyclically in (i, j]
+         */
+        k = hash_func(table[j]) & SDDC_EDGEROS_HASH_MASK;
+        if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+            continue;
+        }
+
+        table[i] = table[j];
+        i = j;
+    }
+
+    table[i] = NULL;
+}
+
+static sddc_edgeros_t *__sddc_edgeros_find(sddc_t *sddc, const uint8_t *uid)
+{
+    sddc_edgeros_t *edgeros;
+    uint32_t        i = __sddc_hash(uid, SDDC_UID_LEN) & SDDC_EDGEROS_HASH_MASK;
+
+    while ((edgeros = sddc->edgeros_hash[i]) != NULL) {
+        if (memcmp(edgeros->uid, uid, sizeof(edgeros->uid)) == 0) {
+            return edgeros;
+        }
+        i = (i + 1) & SDDC_EDGEROS_HASH_MASK;
+    }
+
+    return NULL;
+}
+
+#if SDDC_CFG_EDGEROS_ADDR_INDEX_EN > 0
+static inline uint32_t __sddc_addr_hash(const struct sockaddr_in *addr)
+{
+    uint8_t key[sizeof(addr->sin_addr.s_addr) + sizeof(addr->sin_port)];
+
+    memcpy(key, &addr->sin_addr.s_addr, sizeof(addr->sin_addr.s_addr));
+    memcpy(key + sizeof(addr->sin_addr.s_addr), &addr->sin_port, sizeof(addr->sin_port));
+
+    return __sddc_hash(key, sizeof(key));
+}
+
+static inline uint32_t __sddc_edgeros_addr_hash(const sddc_edgeros_t *edgeros)
+{
+    return __sddc_addr_hash(&edgeros->addr);
+}
+
+/*
+ * Find EdgerOS by source address, several EdgerOS may share one address (the caller checks UID)
+ */
+static sddc_edgeros_t *__sddc_edgeros_find_by_addr(sddc_t *sddc, const struct sockaddr_in *addr)
+{
+    sddc_edgeros_t *edgeros;
+    uint32_t        i = __sddc_addr_hash(addr) & SDDC_EDGEROS_HASH_MASK;
+
+    while ((edgeros = sddc->edgeros_addr_hash[i]) != NULL) {
+        if ((edgeros->addr.sin_addr.s_addr == addr->sin_addr.s_addr) &&
+            (edgeros->addr.sin_port == addr->sin_port)) {
+            return edgeros;
+        }
+        i = (i + 1) & SDDC_EDGEROS_HASH_MASK;
+    }
+
+    return NULL;
+}
+#endif
+
+static void __sddc_edgeros_set_addr(sddc_t *sddc, sddc_edgeros_t *edgeros, const struct sockaddr_in *cli_addr)
+{
+#if SDDC_CFG_EDGEROS_ADDR_INDEX_EN > 0
+    if ((edgeros->addr.sin_addr.s_addr != cli_addr->sin_addr.s_addr) ||
+        (edgeros->addr.sin_port != cli_addr->sin_port)) {
+        __sddc_edgeros_hash_remove(sddc->edgeros_addr_hash, __sddc_edgeros_addr_hash, edgeros);
+        edgeros->addr = *cli_addr;
+        __sddc_edgeros_hash_insert(sddc->edgeros_addr_hash, __sddc_addr_hash(cli_addr), edgeros);
+    }
+#else
+    edgeros->addr = *cli_addr;
+#endif
+}
+
+static sddc_edgeros_t *__sddc_edgeros_update(sddc_t *sddc, const uint8_t *uid, const struct sockaddr_in *cli_addr)
+{
+    sddc_edgeros_t *edgeros;
+
+#if SDDC_CFG_EDGEROS_ADDR_INDEX_EN > 0
+    /*
+     * Fast path: known source address, nothing to update
+     */
+    edgeros = __sddc_edgeros_find_by_addr(sddc, cli_addr);
+    if ((edgeros != NULL) && (memcmp(edgeros->uid, uid, sizeof(edgeros->uid)) == 0)) {
+        return edgeros;
+    }
+#endif
+
+    edgeros = __sddc_edgeros_find(sddc, uid);
+    if (edgeros != NULL) {
+        __sddc_edgeros_set_addr(sddc, edgeros, cli_addr);
+    }
+
+    return edgeros;
+}
+
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+static void __sddc_reply_cache_reset(sddc_edgeros_t *edgeros)
+{
+    bzero(edgeros->reply_cache, sizeof(edgeros->reply_cache));
+    edgeros->reply_next = 0;
+}
+
+/*
+ * Keep the ack of a request (oldest replaced), a retransmission of the request is answered with it
+ */
+static void __sddc_reply_cache_add(sddc_edgeros_t *edgeros, uint8_t type, const sddc_header_t *reply,
+                                   sddc_bool_t invite_data)
+{
+    sddc_reply_t *entry = &edgeros->reply_cache[edgeros->reply_next];
+
+    edgeros->reply_next = (edgeros->reply_next + 1) % SDDC_CFG_REPLY_CACHE_SIZE;
+
+    entry->header      = *reply;
+    entry->seqno       = ntohs(reply->seqno);
+    entry->type        = type;
+    entry->valid       = SDDC_TRUE;
+    entry->invite_data = invite_data;
+}
+
+/*
+ * Answer a retransmitted request with the cached ack: no decrypt, no callback
+ */
+static sddc_bool_t __sddc_reply_cache_send(sddc_t *sddc, sddc_edgeros_t *edgeros, uint8_t type, uint16_t seqno,
+                                           const struct sockaddr_in *cli_addr)
+{
+    sddc_reply_t *entry;
+    int           i;
+
+    SDDC_STATS_INC(sddc, edgeros, reply_requests);
+
+    for (i = 0; i < SDDC_CFG_REPLY_CACHE_SIZE; i++) {
+        entry = &edgeros->reply_cache[i];
+
+        if (entry->valid && (entry->type == type) && (entry->seqno == seqno)) {
+            if (entry->invite_data) {
+                const void *invite_data     = sddc->invite_data;
+                size_t      invite_data_len = sddc->invite_data_len;
+
+#if SDDC_CFG_LZ_EN > 0
+                if (entry->header.security & SDDC_SEC_FLAG_LZ) {
+                    invite_data     = sddc->invite_lz;
+                    invite_data_len = sddc->invite_lz_len;
+                }
+#endif
+
+                /*
+                 * INVITE data changed since, build the respond again
+                 */
+                if ((invite_data == NULL) || (ntohs(entry->header.length) != invite_data_len)) {
+                    return SDDC_FALSE;
+                }
+                __sddc_send_packet(sddc, &entry->header, invite_data, invite_data_len, cli_addr);
+            } else {
+                __sddc_send_packet(sddc, &entry->header, NULL, 0, cli_addr);
+            }
+
+            SDDC_STATS_INC(sddc, edgeros, reply_hits);
+            return SDDC_TRUE;
+        }
+    }
+
+    return SDDC_FALSE;
+}
+#endif
+
+#if SDDC_CFG_STATS_EN > 0
+/**
+ * @brief Get engine and EdgerOS statistics.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[out] stats        Pointer to engine statistics
+ * @param[out] edgeros      Pointer to EdgerOS statistics array, NULL: engine only
+ * @param[in] max           The size of EdgerOS statistics array
+ *
+ * @return Error number
+ */
+int sddc_get_stats(sddc_t *sddc, sddc_stats_t *stats, sddc_edgeros_stats_t *edgeros, uint16_t max)
+{
+    sddc_list_head_t *itervar;
+    sddc_edgeros_t   *peer;
+    int               i;
+
+    sddc_return_value_if_fail(sddc && stats, -1);
+
+    __sddc_lock(sddc);
+
+    stats->total          = sddc->stats;
+    stats->lock_count     = sddc->stats_lock_count;
+    stats->lock_wait_us   = sddc->stats_lock_wait_us;
+    stats->callback_count = sddc->stats_callback_count;
+    stats->callback_us    = sddc->stats_callback_us;
+    stats->edgeros_count  = 0;
+
+    for (i = 0; i < SDDC_MPOOL_CLASS_NR; i++) {
+        stats->mpool[i].size       = sddc->mpool[i].size;
+        stats->mpool[i].total      = sddc->mpool[i].total;
+        stats->mpool[i].used       = sddc->mpool[i].used;
+        stats->mpool[i].high_water = sddc->mpool[i].high_water;
+        stats->mpool[i].exhausted  = sddc->mpool[i].exhausted;
+    }
+    stats->mpool_heap_used       = sddc->stats_mpool_heap_used;
+    stats->mpool_heap_high_water = sddc->stats_mpool_heap_high_water;
+    stats->mpool_alloc_fail      = sddc->stats_mpool_alloc_fail;
+
+    stats->tx_copy_bytes      = sddc->stats_tx_copy_bytes;
+    stats->discovers          = sddc->stats_discovers;
+    stats->discover_reports   = sddc->stats_discover_reports;
+    stats->discover_coalesced = sddc->stats_discover_coalesced;
+    stats->discover_limited   = sddc->stats_discover_limited;
+
+    if (edgeros != NULL) {
+        sddc_list_for_each(itervar, &sddc->edgeros_list) {
+            if (stats->edgeros_count >= max) {
+                break;
+            }
+
+            peer = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
+            memcpy(edgeros[stats->edgeros_count].uid, peer->uid, SDDC_UID_LEN);
+            edgeros[stats->edgeros_count].counters = peer->stats;
+            stats->edgeros_count++;
+        }
+    }
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return 0;
+}
+#endif
+
+#if SDDC_CFG_TRACE_EN > 0
+/**
+ * @brief Dump the trace records taken since the last dump, and discard them.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[out] buf          Pointer to dump buffer, NULL: discard only
+ * @param[in] size          The size of dump buffer, the newest records are kept if it is short
+ *
+ * @return The length of dump, -1 on error
+ */
+ssize_t sddc_trace_dump(sddc_t *sddc, void *buf, size_t size)
+{
+    sddc_trace_header_t header;
+    uint32_t            count;
+    uint32_t            first;
+    uint32_t            part;
+    uint8_t            *rec;
+
+    sddc_return_value_if_fail(sddc, -1);
+    sddc_return_value_if_fail((buf == NULL) || (size >= sizeof(sddc_trace_header_t)), -1);
+
+    __sddc_lock(sddc);
+
+    count       = sddc->trace_head - sddc->trace_tail;
+    header.lost = 0;
+
+    if (count > SDDC_CFG_TRACE_SIZE) {
+        header.lost = count - SDDC_CFG_TRACE_SIZE;
+        count       = SDDC_CFG_TRACE_SIZE;
+    }
+
+    if (buf != NULL) {
+        if (count > (size - sizeof(sddc_trace_header_t)) / sizeof(sddc_trace_t)) {
+            header.lost += count - (size - sizeof(sddc_trace_header_t)) / sizeof(sddc_trace_t);
+            count        = (size - sizeof(sddc_trace_header_t)) / sizeof(sddc_trace_t);
+        }
+
+        header.magic       = SDDC_TRACE_MAGIC;
+        header.version     = SDDC_TRACE_VERSION;
+        header.record_size = sizeof(sddc_trace_t);
+        header.clock_khz   = sddc_trace_clock_khz();
+        header.count       = count;
+
+        memcpy(buf, &header, sizeof(sddc_trace_header_t));
+
+        /*
+         * Oldest first, the ring may wrap once
+         */
+        rec   = (uint8_t *)buf + sizeof(sddc_trace_header_t);
+        first = (sddc->trace_head - count) & SDDC_TRACE_MASK;
+        part  = ((SDDC_CFG_TRACE_SIZE - first) < count) ? (SDDC_CFG_TRACE_SIZE - first) : count;
+
+        memcpy(rec, &sddc->trace[first], part * sizeof(sddc_trace_t));
+        memcpy(rec + part * sizeof(sddc_trace_t), sddc->trace, (count - part) * sizeof(sddc_trace_t));
+    }
+
+    sddc->trace_tail = sddc->trace_head;
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return (buf != NULL) ? (ssize_t)(sizeof(sddc_trace_header_t) + count * sizeof(sddc_trace_t)) : 0;
+}
+#endif
+
+/*
+ * Shift the anti-replay window to a higher top seq number
+ */
+static void __sddc_replay_shift(uint32_t *bitmap, uint32_t n)
+{
+    int      words = n >> 5;
+    uint32_t bits  = n & 31;
+    int      i;
+
+    if (n >= SDDC_CFG_REPLAY_WINDOW) {
+        bzero(bitmap, SDDC_REPLAY_WORDS * sizeof(uint32_t));
+        return;
+    }
+
+    for (i = SDDC_REPLAY_WORDS - 1; i >= 0; i--) {
+        uint32_t word = (i >= words) ? (bitmap[i - words] << bits) : 0;
+
+        if ((bits != 0) && (i > words)) {
+            word |= bitmap[i - words - 1] >> (32 - bits);
+        }
+        bitmap[i] = word;
+    }
+}
+
+/*
+ * MESSAGE anti-replay window (as IPsec), checked before the payload is decrypted.
+ * Return 1 if seqno was not received yet (reordered messages inside the window included),
+ * 0 if it was, -1 if it is behind the window. Nothing is marked, see __sddc_replay_mark
+ */
+static int __sddc_replay_check(sddc_edgeros_t *edgeros, uint16_t seqno)
+{
+    int32_t  diff = (int16_t)(seqno - edgeros->replay_top);
+    uint32_t off;
+
+    if (!edgeros->replay_valid || (diff > 0)) {
+        return 1;
+    }
+
+    if (diff <= -(int32_t)SDDC_CFG_REPLAY_WINDOW) {
+        return -1;
+    }
+
+    off = -diff;
+
+    return (edgeros->replay_bitmap[off >> 5] & (1U << (off & 31))) ? 0 : 1;
+}
+
+/*
+ * Mark seqno received, once its MESSAGE is unpacked and accepted, so a packet failing
+ * decryption or forged with a guessed seqno does not take it
+ */
+static void __sddc_replay_mark(sddc_edgeros_t *edgeros, uint16_t seqno)
+{
+    int32_t  diff = (int16_t)(seqno - edgeros->replay_top);
+    uint32_t off;
+
+    if (!edgeros->replay_valid) {
+        /*
+         * First message after join (or re-invite)
+         */
+        bzero(edgeros->replay_bitmap, sizeof(edgeros->replay_bitmap));
+        edgeros->replay_bitmap[0] = 1;
+        edgeros->replay_top       = seqno;
+        edgeros->replay_valid     = SDDC_TRUE;
+
+    } else if (diff > 0) {
+        __sddc_replay_shift(edgeros->replay_bitmap, diff);
+        edgeros->replay_bitmap[0] |= 1;
+        edgeros->replay_top        = seqno;
+
+    } else if (diff > -(int32_t)SDDC_CFG_REPLAY_WINDOW) {
+        off = -diff;
+        edgeros->replay_bitmap[off >> 5] |= 1U << (off & 31);
+    }
+}
+
+#if SDDC_CFG_FRAG_MAX > 0
+static sddc_reasm_t *__sddc_reasm_find(sddc_t *sddc, sddc_edgeros_t *edgeros, uint16_t base)
+{
+    int i;
+
+    for (i = 0; i < SDDC_CFG_REASM_NUM; i++) {
+        if ((sddc->reasm[i].edgeros == edgeros) && (sddc->reasm[i].base == base)) {
+            return &sddc->reasm[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void __sddc_reasm_free(sddc_reasm_t *reasm)
+{
+    reasm->edgeros = NULL;
+}
+
+/*
+ * Reassembly buffer of a fragment, taken for the first fragment of its MESSAGE. NULL if
+ * the fragment byte is invalid, its count differs from the other fragments or no buffer is
+ * free: the fragment is then dropped before decryption and the anti-replay window
+ */
+static sddc_reasm_t *__sddc_reasm_get(sddc_t *sddc, sddc_edgeros_t *edgeros, uint16_t seqno, uint8_t frag)
+{
+    sddc_reasm_t *reasm;
+    uint8_t       index = SDDC_FRAG_INDEX(frag);
+    uint8_t       count = SDDC_FRAG_COUNT(frag);
+    int           i;
+
+    if ((count > SDDC_CFG_FRAG_MAX) || (index >= count)) {
+        return NULL;
+    }
+
+    reasm = __sddc_reasm_find(sddc, edgeros, seqno - index);
+    if (reasm != NULL) {
+        if (reasm->count != count) {
+            SDDC_LOG_ERR("Fragment count error!\n");
+            return NULL;
+        }
+        return reasm;
+    }
+
+    for (i = 0; (i < SDDC_CFG_REASM_NUM) && (reasm == NULL); i++) {
+        if (sddc->reasm[i].edgeros == NULL) {
+            reasm = &sddc->reasm[i];
+        }
+    }
+    if (reasm == NULL) {
+        return NULL;
+    }
+
+    reasm->edgeros  = edgeros;
+    reasm->base     = seqno - index;
+    reasm->count    = count;
+    reasm->received = 0;
+    reasm->len      = 0;
+    reasm->deadline = sddc_time_ms() + SDDC_CFG_REASM_TIMEOUT;
+
+    return reasm;
+}
+
+/*
+ * Store a fragment into its reassembly buffer, return 1 once every fragment is stored,
+ * 0 if some are missing, -1 if its length is wrong (the buffer is freed if it holds nothing)
+ */
+static int __sddc_reasm_add(sddc_reasm_t *reasm, uint8_t frag, const void *payload, size_t len)
+{
+    uint8_t index = SDDC_FRAG_INDEX(frag);
+    uint8_t count = SDDC_FRAG_COUNT(frag);
+
+    /*
+     * Every fragment but the last one is SDDC_CFG_FRAG_SIZE bytes
+     */
+    if ((index < count - 1) ? (len != SDDC_CFG_FRAG_SIZE) : ((len == 0) || (len > SDDC_CFG_FRAG_SIZE))) {
+        SDDC_LOG_ERR("Fragment length error!\n");
+        if (reasm->received == 0) {
+            __sddc_reasm_free(reasm);
+        }
+        return -1;
+    }
+
+    if (!(reasm->received & (1U << index))) {
+        memcpy(reasm->buf + index * SDDC_CFG_FRAG_SIZE, payload, len);
+        reasm->received |= 1U << index;
+        if (index == count - 1) {
+            reasm->len = index * SDDC_CFG_FRAG_SIZE + len;
+        }
+    }
+
+    return (reasm->received == (uint16_t)((1U << count) - 1)) ? 1 : 0;
+}
+
+/*
+ * Drop the fragmented MESSAGE not complete in time
+ */
+static void __sddc_reasm_expire(sddc_t *sddc, uint32_t now)
+{
+    sddc_reasm_t *reasm;
+    int           i;
+
+    for (i = 0; i < SDDC_CFG_REASM_NUM; i++) {
+        reasm = &sddc->reasm[i];
+        if (reasm->edgeros == NULL) {
+            continue;
+        }
+
+        if (SDDC_TIME_BEFORE_EQ(reasm->deadline, now)) {
+            SDDC_LOG_WARN("Fragmented message %u reassembly timeout!\n", reasm->base);
+            __sddc_reasm_free(reasm);
+        }
+    }
+}
+#endif
+
+static sddc_edgeros_t *__sddc_edgeros_create(sddc_t *sddc, const uint8_t *uid, const struct sockaddr_in *cli_addr)
+{
+    sddc_edgeros_t *edgeros;
+
+    sddc_return_value_if_fail(sddc->edgeros_count < SDDC_CFG_EDGEROS_MAX, NULL);
+
+    edgeros = sddc_malloc(sizeof(sddc_edgeros_t));
+    if (edgeros == NULL) {
+        SDDC_LOG_ERR("Failed to allocate memory!\n");
+        return NULL;
+    }
+
+    memcpy(edgeros->uid, uid, sizeof(edgeros->uid));
+    edgeros->addr         = *cli_addr;
+    edgeros->alive        = SDDC_CFG_EDGEROS_ALIVE;
+    edgeros->replay_valid = SDDC_FALSE;
+    edgeros->mqueue_len   = 0;
+    edgeros->inflight     = 0;
+    edgeros->mqueue_full  = SDDC_FALSE;
+    edgeros->lz           = SDDC_FALSE;
+    edgeros->cbor         = SDDC_FALSE;
+    edgeros->gcm          = SDDC_FALSE;
+    edgeros->rtt_valid    = SDDC_FALSE;
+    edgeros->rto          = SDDC_CFG_RETRIES_INTERVAL;
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+    __sddc_reply_cache_reset(edgeros);
+#endif
+#if SDDC_CFG_STATS_EN > 0
+    bzero(&edgeros->stats, sizeof(edgeros->stats));
+#endif
+    SDDC_LIST_HEAD_INIT(&edgeros->mqueue);
+    sddc_list_add(&edgeros->node, &sddc->edgeros_list);
+
+    __sddc_edgeros_hash_insert(sddc->edgeros_hash, __sddc_edgeros_uid_hash(edgeros), edgeros);
+#if SDDC_CFG_EDGEROS_ADDR_INDEX_EN > 0
+    __sddc_edgeros_hash_insert(sddc->edgeros_addr_hash, __sddc_edgeros_addr_hash(edgeros), edgeros);
+#endif
+    sddc->edgeros_count++;
+
+    return edgeros;
+}
+
+static int __sddc_edgeros_destroy(sddc_t *sddc, sddc_edgeros_t *edgeros)
+{
+    char ip_str[IP4ADDR_STRLEN_MAX];
+#if SDDC_CFG_FRAG_MAX > 0
+    int  i;
+#endif
+
+    inet_ntoa_r(edgeros->addr.sin_addr, ip_str, sizeof(ip_str));
+    SDDC_LOG_DBG("EdgerOS lost %s!\n", ip_str);
+
+    while (edgeros->mqueue_len > 0) {
+        __sddc_message_release(sddc, SDDC_CONTAINER_OF(edgeros->mqueue.next, sddc_message_t, node));
+    }
+
+#if SDDC_CFG_FRAG_MAX > 0
+    for (i = 0; i < SDDC_CFG_REASM_NUM; i++) {
+        if (sddc->reasm[i].edgeros == edgeros) {
+            __sddc_reasm_free(&sddc->reasm[i]);
+        }
+    }
+#endif
+
+    __sddc_edgeros_hash_remove(sddc->edgeros_hash, __sddc_edgeros_uid_hash, edgeros);
+#if SDDC_CFG_EDGEROS_ADDR_INDEX_EN > 0
+    __sddc_edgeros_hash_remove(sddc->edgeros_addr_hash, __sddc_edgeros_addr_hash, edgeros);
+#endif
+    sddc->edgeros_count--;
+
+#if SDDC_CFG_STATS_EN > 0
+    if (sddc->stats_peer == edgeros) {
+        sddc->stats_peer = NULL;
+    }
+#endif
+
+    sddc_list_del(&edgeros->node);
+
+    sddc_free(edgeros);
+
+    return 0;
+}
+
+/*
+ * security: security flags of the INVITE request, the GCM mode of the session is taken from them
+ */
+static int __sddc_after_invite_respond(sddc_t *sddc, sddc_edgeros_t *edgeros, const uint8_t *uid, uint8_t security,
+                                       const sddc_header_t *reply, const struct sockaddr_in *cli_addr)
+{
+    if (edgeros == NULL) {
+        edgeros = __sddc_edgeros_create(sddc, uid, cli_addr);
+    } else {
+        __sddc_edgeros_set_addr(sddc, edgeros, cli_addr);
+        edgeros->replay_valid = SDDC_FALSE;
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+        __sddc_reply_cache_reset(edgeros);
+#endif
+    }
+
+    sddc_return_value_if_fail(edgeros != NULL, -1);
+
+#if SDDC_GCM_EN > 0
+    /*
+     * Latched until the next INVITE, the flag of the later packets is not authenticated
+     */
+    edgeros->gcm = ((security & SDDC_SEC_FLAG_GCM_SUPPORT) && (sddc->gcm_ctx != NULL)) ? SDDC_TRUE : SDDC_FALSE;
+#endif
+
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+    __sddc_reply_cache_add(edgeros, SDDC_TYPE_INVITE, reply, SDDC_TRUE);
+#endif
+
+    if (sddc->on_invite_end != NULL) {
+        SDDC_CALLOUT(sddc, sddc->on_invite_end(sddc, edgeros->uid));
+    }
+
+    return 0;
+}
+
+static sddc_bool_t __sddc_edgeros_can_join (sddc_t *sddc, sddc_edgeros_t *edgeros)
+{
+#if SDDC_CFG_MULTI_EDGEROS_JOIN_EN > 0
+    return ((edgeros != NULL) || (sddc->edgeros_count < SDDC_CFG_EDGEROS_MAX)) ? SDDC_TRUE : SDDC_FALSE;
+#else
+    if (sddc_list_is_empty(&sddc->edgeros_list)) {
+        return SDDC_TRUE;
+    } else {
+        if (SDDC_CONTAINER_OF(sddc->edgeros_list.next, sddc_edgeros_t, node) == edgeros) {
+            return SDDC_TRUE;
+        } else {
+            return SDDC_FALSE;
+        }
+    }
+#endif
+}
+
+/*
+ * Send the prebuilt REPORT to a not joined EdgerOS
+ */
+static void __sddc_send_report(sddc_t *sddc, sddc_bool_t lz, const struct sockaddr_in *cli_addr)
+{
+    sddc_header_t reply;
+
+    SDDC_STATS_ENGINE_INC(sddc, discover_reports);
+
+#if SDDC_CFG_LZ_EN > 0
+    if (lz && (sddc->report_lz != NULL)) {
+        reply       = sddc->report_lz_header;
+        reply.seqno = htons(__sddc_seqno_alloc(sddc, 1));
+
+        __sddc_send_packet(sddc, &reply, sddc->report_lz, sddc->report_lz_len, cli_addr);
+        return;
+    }
+#endif
+
+    reply       = sddc->report_header;
+    reply.seqno = htons(__sddc_seqno_alloc(sddc, 1));
+
+    __sddc_send_packet(sddc, &reply, sddc->report_data, sddc->report_data_len, cli_addr);
+}
+
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+/*
+ * Take a DISCOVER from a not joined EdgerOS, the REPORT is sent by __sddc_discover_expire after a random delay.
+ * Return SDDC_FALSE if it is coalesced or rate limited
+ */
+static sddc_bool_t __sddc_discover_schedule(sddc_t *sddc, sddc_bool_t lz, const struct sockaddr_in *cli_addr)
+{
+    sddc_discover_t *discover = NULL;
+    sddc_discover_t *oldest   = &sddc->discover[0];
+    uint32_t         now      = sddc_time_ms();
+    uint32_t         add;
+    int              i;
+
+    for (i = 0; i < SDDC_CFG_DISCOVER_SLOTS; i++) {
+        if (sddc->discover[i].valid &&
+            (sddc->discover[i].addr.sin_addr.s_addr == cli_addr->sin_addr.s_addr) &&
+            (sddc->discover[i].addr.sin_port == cli_addr->sin_port)) {
+            discover = &sddc->discover[i];
+            break;
+        }
+
+        if (oldest->valid &&
+            (!sddc->discover[i].valid || SDDC_TIME_BEFORE_EQ(sddc->discover[i].last, oldest->last))) {
+            oldest = &sddc->discover[i];
+        }
+    }
+
+    if (discover == NULL) {
+        /*
+         * A new source replaces the oldest one, a pending REPORT is sent before it is lost
+         */
+        discover = oldest;
+        if (discover->valid && discover->pending) {
+            __sddc_send_report(sddc, discover->lz, &discover->addr);
+        }
+
+        discover->addr    = *cli_addr;
+        discover->refill  = now;
+        discover->tokens  = SDDC_CFG_DISCOVER_BURST;
+        discover->valid   = SDDC_TRUE;
+        discover->pending = SDDC_FALSE;
+    }
+
+    discover->last = now;
+
+    if (discover->pending) {
+        discover->lz = lz;
+        SDDC_STATS_ENGINE_INC(sddc, discover_coalesced);
+        return SDDC_FALSE;
+    }
+
+    add = (now - discover->refill) / SDDC_CFG_DISCOVER_RATE;
+    if (add > 0) {
+        discover->refill += add * SDDC_CFG_DISCOVER_RATE;
+        discover->tokens  = (add >= SDDC_CFG_DISCOVER_BURST - discover->tokens) ?
+                            SDDC_CFG_DISCOVER_BURST : discover->tokens + add;
+    }
+    if (discover->tokens == SDDC_CFG_DISCOVER_BURST) {
+        discover->refill = now;
+    }
+
+    if (discover->tokens == 0) {
+        SDDC_STATS_ENGINE_INC(sddc, discover_limited);
+        return SDDC_FALSE;
+    }
+
+    discover->tokens--;
+
+    /*
+     * xorshift32, devices answering the same broadcast DISCOVER are spread over the jitter
+     */
+    sddc->discover_rand ^= sddc->discover_rand << 13;
+    sddc->discover_rand ^= sddc->discover_rand >> 17;
+    sddc->discover_rand ^= sddc->discover_rand << 5;
+
+    discover->pending = SDDC_TRUE;
+    discover->lz      = lz;
+    discover->due     = now + (sddc->discover_rand % (SDDC_CFG_DISCOVER_JITTER + 1));
+
+    return SDDC_TRUE;
+}
+
+/*
+ * Send the REPORT which are due
+ */
+static void __sddc_discover_expire(sddc_t *sddc, uint32_t now)
+{
+    sddc_discover_t *discover;
+    int              i;
+
+    for (i = 0; i < SDDC_CFG_DISCOVER_SLOTS; i++) {
+        discover = &sddc->discover[i];
+
+        if (!discover->pending) {
+            continue;
+        }
+
+        if (SDDC_TIME_BEFORE_EQ(discover->due, now)) {
+            discover->pending = SDDC_FALSE;
+            __sddc_send_report(sddc, discover->lz, &discover->addr);
+        }
+    }
+}
+#endif
+
+/*
+ * Decrypt and decompress the payload of a received packet, edgeros: the sender if it joined
+ */
+static int __sddc_unpack(sddc_t *sddc, const sddc_edgeros_t *edgeros, uint8_t *recv_buf, const sddc_header_t *header,
+                         void **payload, size_t *payload_len)
+{
+    int ret = 0;
+
+    SDDC_TRACE(sddc, SDDC_TRACE_UNPACK, SDDC_GET_TYPE(header), header->seqno);
+
+#if SDDC_CFG_CBOR_EN > 0
+    sddc->rx_cbor = (header->security & SDDC_SEC_FLAG_CBOR) ? SDDC_TRUE : SDDC_FALSE;
+#endif
+
+#if SDDC_GCM_EN > 0
+    if ((edgeros != NULL) && edgeros->gcm &&
+        ((header->security & (SDDC_SEC_FLAG_CRYPTO | SDDC_SEC_FLAG_GCM)) != (SDDC_SEC_FLAG_CRYPTO | SDDC_SEC_FLAG_GCM))) {
+        /*
+         * A EdgerOS which joined in GCM mode only sends sealed payloads, a CBC or plain one
+         * has its flags stripped
+         */
+        SDDC_LOG_ERR("Payload not sealed!\n");
+        *payload     = NULL;
+        *payload_len = 0;
+        ret          = -1;
+    } else if ((header->security & (SDDC_SEC_FLAG_CRYPTO | SDDC_SEC_FLAG_GCM)) == (SDDC_SEC_FLAG_CRYPTO | SDDC_SEC_FLAG_GCM)) {
+        /*
+         * Tampered or garbage payloads are dropped here, before any parsing
+         */
+        ret      = __sddc_open(sddc, header, SDDC_PACKET_PAYLOAD(recv_buf), header->length,
+                               sddc->decypt_buf, payload_len);
+        *payload = sddc->decypt_buf;
+    } else
+#endif
+#if SDDC_CFG_SECURITY_EN > 0
+    if (header->security & SDDC_SEC_FLAG_CRYPTO) {
+        ret      = __sddc_decrypt(sddc, SDDC_PACKET_PAYLOAD(recv_buf), header->length,
+                                  sddc->decypt_buf, payload_len);
+        *payload = sddc->decypt_buf;
+    } else
+#endif
+    {
+        *payload     = SDDC_PACKET_PAYLOAD(recv_buf);
+        *payload_len = header->length;
+    }
+
+    if (ret != 0) {
+        SDDC_STATS_INC(sddc, sddc->stats_peer, decrypt_fail);
+    }
+
+#if SDDC_CFG_LZ_EN > 0
+    if ((ret == 0) && (header->security & SDDC_SEC_FLAG_LZ)) {
+        sddc_lz_t *lz = __sddc_lz_get(sddc);
+        ssize_t    lz_len = -1;
+
+        if (lz != NULL) {
+            lz_len = __sddc_lz_decompress(*payload, *payload_len, lz->buf, sizeof(lz->buf));
+        }
+
+        if (lz_len < 0) {
+            SDDC_LOG_ERR("Decompress error!\n");
+            ret = -1;
+        } else {
+            *payload     = lz->buf;
+            *payload_len = lz_len;
+        }
+    }
+#endif
+
+    SDDC_TRACE(sddc, SDDC_TRACE_UNPACKED, SDDC_GET_TYPE(header), header->seqno);
+
+    return ret;
+}
+
+static void __sddc_packet_handle(sddc_t *sddc, uint8_t *recv_buf, int len, const struct sockaddr_in *cli_addr)
+{
+    if (len >= sizeof(sddc_header_t)) {
+        sddc_header_t  *header = (sddc_header_t *)recv_buf;
+        sddc_header_t   reply;
+        char            ip_str[IP4ADDR_STRLEN_MAX];
+        sddc_edgeros_t *edgeros;
+        size_t          payload_len;
+        void           *payload;
+        int             unpack_ret;
+        int             replay;
+        sddc_bool_t     accept = SDDC_FALSE;
+        uint8_t         flag_type;
+        uint16_t        msg_seqno;
+        uint16_t        src_port = ntohs(cli_addr->sin_port);
+#if SDDC_CFG_FRAG_MAX > 0
+        sddc_reasm_t   *reasm;
+#endif
+
+        inet_ntoa_r(cli_addr->sin_addr, ip_str, sizeof(ip_str));
+
+        if (src_port != SDDC_CFG_PORT) {
+            SDDC_LOG_ERR("Receive packet source port error, from: %s:%d.\n", ip_str, src_port);
+            return;
+        }
+
+        header->seqno  = ntohs(header->seqno);
+        header->length = ntohs(header->length);
+
+        SDDC_TRACE(sddc, SDDC_TRACE_PACKET, SDDC_GET_TYPE(header), header->seqno);
+
+        /*
+         * Updated EdgerOS address info
+         */
+        edgeros   = __sddc_edgeros_update(sddc, header->uid, cli_addr);
+        flag_type = SDDC_GET_TYPE(header);
+
+#if SDDC_CFG_STATS_EN > 0
+        SDDC_STATS_PEER(sddc, edgeros);
+        if (flag_type < SDDC_STATS_TYPE_NR) {
+            SDDC_STATS_INC(sddc, edgeros, rx_packets[flag_type]);
+        }
+#endif
+        if (flag_type != SDDC_TYPE_DISCOVER && edgeros) {
+            edgeros->alive = SDDC_CFG_EDGEROS_ALIVE;
+        }
+
+#if SDDC_CFG_LZ_EN > 0
+        if (edgeros != NULL) {
+            edgeros->lz = (header->security & SDDC_SEC_FLAG_LZ_SUPPORT) ? SDDC_TRUE : SDDC_FALSE;
+        }
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+        if (edgeros != NULL) {
+            edgeros->cbor = (header->security & SDDC_SEC_FLAG_CBOR_SUPPORT) ? SDDC_TRUE : SDDC_FALSE;
+        }
+#endif
+
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+        /*
+         * EdgerOS retransmits a request when our ack was lost
+         */
+        if ((edgeros != NULL) && (header->flags_type & SDDC_FLAG_REQ) &&
+            ((flag_type == SDDC_TYPE_UPDATE) || (flag_type == SDDC_TYPE_INVITE) || (flag_type == SDDC_TYPE_MESSAGE)) &&
+            __sddc_reply_cache_send(sddc, edgeros, flag_type, header->seqno, cli_addr)) {
+            SDDC_STATS_INC(sddc, edgeros, duplicates);
+            SDDC_LOG_DBG("Send cached respond to: %s.\n", ip_str);
+            return;
+        }
+#endif
+
+        switch (flag_type) {
+        case SDDC_TYPE_PING:                                        /* PING                 */
+            if (header->flags_type & SDDC_FLAG_REQ) {               /* PING request         */
+                SDDC_LOG_DBG("Receive ping from: %s.\n", ip_str);
+                if (!edgeros && (header->flags_type & SDDC_FLAG_JOIN)) {
+                    /*
+                     * Prebuilt abort info
+                     */
+                    reply       = sddc->abort_header;
+                    reply.seqno = htons(header->seqno);
+
+                    /*
+                     * Send abort info to EdgerOS
+                     */
+                    __sddc_send_packet(sddc, &reply, sddc->abort_data, sddc->abort_data_len, cli_addr);
+
+                    SDDC_LOG_DBG("Send abort info to: %s.\n", ip_str);
+                } else {
+                    /*
+                     * Prebuilt PING respond
+                     */
+                    reply       = sddc->ping_header;
+                    reply.seqno = htons(header->seqno);
+
+                    /*
+                     * Send PING respond to EdgerOS
+                     */
+                    __sddc_send_packet(sddc, &reply, NULL, 0, cli_addr);
+
+                    SDDC_LOG_DBG("Send ping respond to: %s.\n", ip_str);
+                }
+            } else {
+                SDDC_LOG_DBG("Receive ping respond from: %s.\n", ip_str);
+            }
+            break;
+
+        case SDDC_TYPE_DISCOVER:
+            SDDC_LOG_DBG("Receive discover from: %s.\n", ip_str);
+
+            if ((edgeros == NULL) && (sddc->report_data != NULL)) {
+                SDDC_STATS_ENGINE_INC(sddc, discovers);
+
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+                /*
+                 * REPORT after a random delay, at most one pending and BURST per RATE for a source
+                 */
+                if (__sddc_discover_schedule(sddc, (header->security & SDDC_SEC_FLAG_LZ_SUPPORT) ? SDDC_TRUE : SDDC_FALSE,
+                                             cli_addr)) {
+                    SDDC_LOG_DBG("Schedule discover respond to: %s.\n", ip_str);
+                } else {
+                    SDDC_LOG_DBG("Drop discover from: %s.\n", ip_str);
+                }
+#else
+                /*
+                 * Send prebuilt REPORT to EdgerOS
+                 */
+                __sddc_send_report(sddc, (header->security & SDDC_SEC_FLAG_LZ_SUPPORT) ? SDDC_TRUE : SDDC_FALSE, cli_addr);
+
+                SDDC_LOG_DBG("Send discover respond to: %s.\n", ip_str);
+#endif
+            }
             break;
 
         case SDDC_TYPE_UPDATE:
@@ -865,487 +4545,1154 @@ static void __sddc_read_handle(sddc_t *sddc)
 
                 if ((len - sizeof(sddc_header_t)) >= header->length) {
                     if (sddc->on_update != NULL) {
-#if SDDC_CFG_SECURITY_EN > 0
-                        if (header->security & SDDC_SEC_FLAG_CRYPTO) {
-                            unpack_ret = __sddc_decrypt(sddc, SDDC_PACKET_PAYLOAD(sddc->recv_buf), header->length,
-                                                        sddc->decypt_buf, &payload_len);
-                            payload    = sddc->decypt_buf;
-                        } else
-#endif
-                        {
-                            payload     = SDDC_PACKET_PAYLOAD(sddc->recv_buf);
-                            payload_len = header->length;
-                            unpack_ret  = 0;
+                        unpack_ret = __sddc_unpack(sddc, edgeros, recv_buf, header, &payload, &payload_len);
+
+                        if (unpack_ret == 0) {
+                            SDDC_CALLOUT(sddc, accept = sddc->on_update(sddc, header->uid, payload, payload_len));
                         }
 
-                        if ((unpack_ret == 0) && sddc->on_update(sddc, header->uid, payload, payload_len)) {
+                        if (accept) {
                             /*
                              * Build update respond
                              */
-                            len = __sddc_build_packet(sddc, sddc->send_buf,
-                                                      SDDC_TYPE_UPDATE,
-                                                      SDDC_FLAG_ACK,
-                                                      SDDC_SEC_FLAG_NONE,
-                                                      header->seqno,
-                                                      NULL, 0);
+                            __sddc_build_header(sddc, &reply,
+                                                SDDC_TYPE_UPDATE,
+                                                SDDC_FLAG_ACK,
+                                                SDDC_SEC_FLAG_NONE,
+                                                header->seqno,
+                                                0);
 
                             /*
                              * Send update respond to EdgerOS
                              */
-                            sendto(sddc->fd, sddc->send_buf, len, 0,
-                                   (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
+                            __sddc_send_packet(sddc, &reply, NULL, 0, cli_addr);
+
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+                            if (edgeros != NULL) {
+                                __sddc_reply_cache_add(edgeros, SDDC_TYPE_UPDATE, &reply, SDDC_FALSE);
+                            }
+#endif
+
+                            SDDC_LOG_DBG("Send update respond to: %s.\n", ip_str);
+                        }
+                    }
+                } else {                                            /* Payload length error */
+                    SDDC_LOG_ERR("Payload length error!\n");
+                }
+            } else {                                                /* UPDATE respond       */
+                SDDC_LOG_DBG("Receive update respond from: %s.\n", ip_str);
+            }
+            break;
+
+        case SDDC_TYPE_INVITE:
+            if ((header->flags_type & SDDC_FLAG_REQ) &&             /* INVITE request       */
+                __sddc_edgeros_can_join(sddc, edgeros)) {           /* Can join             */
+                SDDC_LOG_DBG("Receive invite request from: %s.\n", ip_str);
+                if ((len - sizeof(sddc_header_t)) >= header->length) {
+                    if (sddc->on_invite != NULL) {
+                        /*
+                         * An INVITE opens a new session, the GCM mode of the last one is not enforced
+                         */
+                        unpack_ret = __sddc_unpack(sddc, NULL, recv_buf, header, &payload, &payload_len);
+
+                        if (unpack_ret == 0) {
+                            SDDC_CALLOUT(sddc, accept = sddc->on_invite(sddc, header->uid, payload, payload_len));
+                        }
+
+                        if (accept) {
+                            const void *invite_data     = sddc->invite_data;
+                            size_t      invite_data_len = sddc->invite_data_len;
+                            uint8_t     security_flag   = SDDC_SEC_FLAG_NONE;
+
+#if SDDC_CFG_SECURITY_EN > 0
+                            if (sddc->security_en) {
+                                security_flag = SDDC_SEC_FLAG_CRYPTO;
+                            }
+#endif
+#if SDDC_CFG_LZ_EN > 0
+                            if ((header->security & SDDC_SEC_FLAG_LZ_SUPPORT) && (sddc->invite_lz != NULL)) {
+                                invite_data     = sddc->invite_lz;
+                                invite_data_len = sddc->invite_lz_len;
+                                security_flag  |= SDDC_SEC_FLAG_LZ;
+                            }
+#endif
+
+                            /*
+                             * Build INVITE respond
+                             */
+                            __sddc_build_header(sddc, &reply,
+                                                SDDC_TYPE_INVITE,
+                                                SDDC_FLAG_ACK | SDDC_FLAG_JOIN,
+                                                security_flag,
+                                                header->seqno,
+                                                invite_data_len);
+
+                            /*
+                             * Send INVITE respond to EdgerOS
+                             */
+                            __sddc_send_packet(sddc, &reply, invite_data, invite_data_len, cli_addr);
+
+                            SDDC_LOG_DBG("Send invite respond to: %s.\n", ip_str);
+
+                            /*
+                             * Call after send INVITE respond
+                             */
+                            __sddc_after_invite_respond(sddc, edgeros, header->uid, header->security, &reply, cli_addr);
+
+                        } else {
+                            sddc_sleep(1);
+
+                            /*
+                             * Build REFUSE respond
+                             */
+                            __sddc_build_header(sddc, &reply,
+                                                SDDC_TYPE_INVITE,
+                                                SDDC_FLAG_ACK,
+                                                SDDC_SEC_FLAG_NONE,
+                                                header->seqno,
+                                                0);
+
+                            /*
+                             * Send REFUSE respond to EdgerOS
+                             */
+                            __sddc_send_packet(sddc, &reply, NULL, 0, cli_addr);
+
+                            if (edgeros) {
+                                __sddc_edgeros_destroy(sddc, edgeros);
+                            }
+
+                            SDDC_LOG_DBG("Send refuse respond to: %s.\n", ip_str);
+                        }
+                    }
+                } else {                                            /* Payload length error */
+                    SDDC_LOG_ERR("Payload length error!\n");
+                }
+            } else {                                                /* Invite respond       */
+                SDDC_LOG_DBG("Receive invite respond from: %s.\n", ip_str);
+            }
+            break;
+
+        case SDDC_TYPE_MESSAGE:
+            if (edgeros != NULL) {
+                if (header->flags_type & SDDC_FLAG_ACK) {           /* MESSAGE ACK          */
+                    SDDC_LOG_DBG("Receive message respond from: %s.\n", ip_str);
+
+                    if (__sddc_message_ack(sddc, edgeros, header->seqno, header->reserved, &msg_seqno) &&
+                        (sddc->on_message_ack != NULL)) {
+                        SDDC_CALLOUT(sddc, sddc->on_message_ack(sddc, edgeros->uid, msg_seqno));
+                    }
+
+                } else {                                            /* MESSAGE request      */
+                    SDDC_LOG_DBG("Receive message request from: %s.\n", ip_str);
+
+                    if ((len - sizeof(sddc_header_t)) >= header->length) {
+#if SDDC_CFG_FRAG_MAX > 0
+                        /*
+                         * No reassembly buffer: drop the fragment unacked, EdgerOS will retransmit it
+                         */
+                        reasm = NULL;
+                        if ((header->reserved != 0) && (sddc->on_message != NULL) &&
+                            (__sddc_replay_check(edgeros, header->seqno) > 0)) {
+                            reasm = __sddc_reasm_get(sddc, edgeros, header->seqno, header->reserved);
+                            if (reasm == NULL) {
+                                SDDC_LOG_WARN("Drop message fragment from: %s.\n", ip_str);
+                                break;
+                            }
+                        }
+#endif
+
+                        replay = __sddc_replay_check(edgeros, header->seqno);
+                        if (replay < 0) {
+                            /*
+                             * Behind the window: a replay, or too late to tell
+                             */
+                            SDDC_STATS_INC(sddc, edgeros, duplicates);
+                            SDDC_LOG_WARN("Drop old message %u from: %s.\n", header->seqno, ip_str);
+
+                        } else if (replay > 0) {
+                            if (sddc->on_message != NULL) {
+                                unpack_ret = __sddc_unpack(sddc, edgeros, recv_buf, header, &payload, &payload_len);
+
+#if SDDC_CFG_FRAG_MAX > 0
+                                if (reasm != NULL) {
+                                    /*
+                                     * Each fragment is acked once stored, the last one when the MESSAGE
+                                     * is accepted
+                                     */
+                                    if (unpack_ret == 0) {
+                                        unpack_ret = __sddc_reasm_add(reasm, header->reserved, payload, payload_len);
+                                    } else if (reasm->received == 0) {
+                                        __sddc_reasm_free(reasm);
+                                    }
+                                    if (unpack_ret > 0) {
+                                        /*
+                                         * A rejected MESSAGE is kept until its reassembly timeout: the
+                                         * other fragments are acked, only the last one is sent again
+                                         */
+                                        SDDC_CALLOUT(sddc, accept = sddc->on_message(sddc, edgeros->uid,
+                                                                                     (const char *)reasm->buf,
+                                                                                     reasm->len));
+                                        if (accept) {
+                                            __sddc_reasm_free(reasm);
+                                        }
+                                    } else {
+                                        accept = (unpack_ret == 0) ? SDDC_TRUE : SDDC_FALSE;
+                                    }
+                                } else
+#endif
+                                if (unpack_ret == 0) {
+                                    SDDC_CALLOUT(sddc, accept = sddc->on_message(sddc, edgeros->uid, payload, payload_len));
+                                }
+
+                                if (accept) {
+                                    __sddc_replay_mark(edgeros, header->seqno);
+
+                                    if (header->flags_type & SDDC_FLAG_REQ) {
+                                        /*
+                                         * Build MESSAGE ACK
+                                         */
+                                        __sddc_build_header(sddc, &reply,
+                                                            SDDC_TYPE_MESSAGE,
+                                                            SDDC_FLAG_ACK,
+                                                            SDDC_SEC_FLAG_NONE,
+                                                            header->seqno,
+                                                            0);
+                                        reply.reserved = header->reserved;
+
+                                        /*
+                                         * Send MESSAGE ACK to EdgerOS
+                                         */
+                                        __sddc_send_packet(sddc, &reply, NULL, 0, cli_addr);
+
+#if SDDC_CFG_REPLY_CACHE_SIZE > 0
+                                        __sddc_reply_cache_add(edgeros, SDDC_TYPE_MESSAGE, &reply, SDDC_FALSE);
+#endif
+                                    }
+                                }
+                            }
+                        } else {
+                            SDDC_STATS_INC(sddc, edgeros, duplicates);
+
+                            if (header->flags_type & SDDC_FLAG_REQ) {
+                                /*
+                                 * Build MESSAGE ACK
+                                 */
+                                __sddc_build_header(sddc, &reply,
+                                                    SDDC_TYPE_MESSAGE,
+                                                    SDDC_FLAG_ACK,
+                                                    SDDC_SEC_FLAG_NONE,
+                                                    header->seqno,
+                                                    0);
+                                reply.reserved = header->reserved;
+
+                                /*
+                                 * Send MESSAGE ACK to EdgerOS
+                                 */
+                                __sddc_send_packet(sddc, &reply, NULL, 0, cli_addr);
+                            }
+                        }
+                    } else {                                            /* Payload length error */
+                        SDDC_LOG_ERR("Payload length error.\n");
+                    }
+                }
+            }
+            break;
+
+        case SDDC_TYPE_REPORT:
+            /*
+             * Do nothing
+             */
+            SDDC_LOG_DBG("Receive report from: %s.\n", ip_str);
+            break;
+
+        case SDDC_TYPE_TIMESTAMP:
+            if (edgeros != NULL) {
+                if (header->flags_type & SDDC_FLAG_ACK) {               /* TIMESTAMP ACK          */
+                    SDDC_LOG_DBG("Receive TIMESTAMP respond from: %s.\n", ip_str);
 
-                            SDDC_LOG_DBG("Send update respond to: %s.\n", ip_str);
+                    if (sddc->on_timestamp != NULL) {
+                        unpack_ret = __sddc_unpack(sddc, edgeros, recv_buf, header, &payload, &payload_len);
+
+                        if (unpack_ret == 0) {
+                            SDDC_CALLOUT(sddc, sddc->on_timestamp(sddc, edgeros->uid, payload, payload_len));
                         }
                     }
-                } else {                                            /* Payload length error */
-                    SDDC_LOG_ERR("Payload length error!\n");
+
+                    __sddc_message_ack(sddc, edgeros, header->seqno, 0, NULL);
                 }
-            } else {                                                /* UPDATE respond       */
-                SDDC_LOG_DBG("Receive update respond from: %s.\n", ip_str);
             }
             break;
 
-        case SDDC_TYPE_INVITE:
-            if ((header->flags_type & SDDC_FLAG_REQ) &&             /* INVITE request       */
-                __sddc_edgeros_can_join(sddc, edgeros)) {           /* Can join             */
-                SDDC_LOG_DBG("Receive invite request from: %s.\n", ip_str);
-                if ((len - sizeof(sddc_header_t)) >= header->length) {
-                    if (sddc->on_invite != NULL) {
-#if SDDC_CFG_SECURITY_EN > 0
-                        if (header->security & SDDC_SEC_FLAG_CRYPTO) {
-                            unpack_ret = __sddc_decrypt(sddc, SDDC_PACKET_PAYLOAD(sddc->recv_buf), header->length,
-                                                        sddc->decypt_buf, &payload_len);
-                            payload    = sddc->decypt_buf;
-                        } else
-#endif
-                        {
-                            payload     = SDDC_PACKET_PAYLOAD(sddc->recv_buf);
-                            payload_len = header->length;
-                            unpack_ret  = 0;
-                        }
+        default:
+            /*
+             * Do nothing
+             */
+            SDDC_LOG_ERR("Receive unrecognizable packet from: %s.\n", ip_str);
+            break;
+        }
+    }
+}
 
-                        if ((unpack_ret == 0) && sddc->on_invite(sddc, header->uid, payload, payload_len)) {
-                            /*
-                             * Build INVITE respond
-                             */
-                            len = __sddc_build_packet(sddc, sddc->send_buf,
-                                                      SDDC_TYPE_INVITE,
-                                                      SDDC_FLAG_ACK | SDDC_FLAG_JOIN,
-#if SDDC_CFG_SECURITY_EN > 0
-                                                      sddc->security_en ? SDDC_SEC_FLAG_CRYPTO : SDDC_SEC_FLAG_NONE,
+/*
+ * Receive and handle datagrams, up to SDDC_CFG_BATCH_SIZE by one recvmmsg with batched I/O,
+ * return the number received, 0 if none is pending
+ */
+static int __sddc_read_handle(sddc_t *sddc)
+{
+#if SDDC_BATCH_IO_EN > 0
+    int i, n;
+
+    for (i = 0; i < SDDC_CFG_BATCH_SIZE; i++) {
+        sddc->rx_msgs[i].msg_hdr.msg_namelen = sizeof(sddc->rx_addr[i]);
+    }
+
+    n = recvmmsg(sddc->fd, sddc->rx_msgs, SDDC_CFG_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (n > 0) {
+#if SDDC_CFG_TRACE_EN > 0
+        uint32_t read_time = sddc_trace_clock();
+#endif
+
+        __sddc_lock(sddc);
+        SDDC_TRACE_AT(sddc, read_time, SDDC_TRACE_READ, 0, n);
+        SDDC_TRACE(sddc, SDDC_TRACE_LOCK, 0, 0);
+        __sddc_tx_begin(sddc);
+
+        for (i = 0; i < n; i++) {
+            __sddc_packet_handle(sddc, sddc->rx_buf[i], sddc->rx_msgs[i].msg_len, &sddc->rx_addr[i]);
+            SDDC_STATS_PEER(sddc, NULL);
+        }
+
+        __sddc_tx_end(sddc);
+        SDDC_TRACE(sddc, SDDC_TRACE_DONE, 0, n);
+        sddc_mutex_unlock(&sddc->lockid);
+    }
+
+    return (n > 0) ? n : 0;
 #else
-                                                      SDDC_SEC_FLAG_NONE,
+    struct sockaddr_in cli_addr;
+    socklen_t          addrlen = sizeof(cli_addr);
+
+    int len = recvfrom(sddc->fd, sddc->recv_buf, sizeof(sddc->recv_buf), MSG_DONTWAIT,
+                       (struct sockaddr *)&cli_addr, &addrlen);
+    if (len < 0) {
+        return 0;
+    }
+
+#if SDDC_CFG_TRACE_EN > 0
+    uint32_t read_time = sddc_trace_clock();
 #endif
-                                                      header->seqno,
-                                                      sddc->invite_data, sddc->invite_data_len);
 
-                            /*
-                             * Send INVITE respond to EdgerOS
-                             */
-                            sendto(sddc->fd, sddc->send_buf, len, 0,
-                                   (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
+    __sddc_lock(sddc);
+    SDDC_TRACE_AT(sddc, read_time, SDDC_TRACE_READ, 0, 1);
+    SDDC_TRACE(sddc, SDDC_TRACE_LOCK, 0, 0);
+    __sddc_packet_handle(sddc, sddc->recv_buf, len, &cli_addr);
+    SDDC_STATS_PEER(sddc, NULL);
+    SDDC_TRACE(sddc, SDDC_TRACE_DONE, 0, 1);
+    sddc_mutex_unlock(&sddc->lockid);
 
-                            SDDC_LOG_DBG("Send invite respond to: %s.\n", ip_str);
+    return 1;
+#endif
+}
 
-                            /*
-                             * Call after send INVITE respond
-                             */
-                            __sddc_after_invite_respond(sddc, edgeros, header->uid, &cli_addr);
+/*
+ * Lower next to the MS until deadline, 0 if it is passed
+ */
+static inline void __sddc_deadline_lower(uint32_t deadline, uint32_t now, uint32_t *next)
+{
+    if (SDDC_TIME_BEFORE_EQ(deadline, now)) {
+        *next = 0;
+    } else if ((deadline - now) < *next) {
+        *next = deadline - now;
+    }
+}
 
-                        } else {
-                            sddc_sleep(1);
+/*
+ * MS until the next retransmission, EdgerOS alive, reassembly, REPORT or idle connector deadline (with lock)
+ */
+static uint32_t __sddc_timer_next(sddc_t *sddc, uint32_t now)
+{
+    uint32_t next = SDDC_CFG_RETRIES_INTERVAL;
+    int      i;
 
-                            /*
-                             * Build REFUSE respond
-                             */
-                            len = __sddc_build_packet(sddc, sddc->send_buf,
-                                                      SDDC_TYPE_INVITE,
-                                                      SDDC_FLAG_ACK,
-                                                      SDDC_SEC_FLAG_NONE,
-                                                      header->seqno,
-                                                      NULL, 0);
+    __sddc_deadline_lower(sddc->alive_deadline, now, &next);
 
-                            /*
-                             * Send REFUSE respond to EdgerOS
-                             */
-                            sendto(sddc->fd, sddc->send_buf, len, 0,
-                                   (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
+    if (sddc->timer_heap_len > 0) {
+        __sddc_deadline_lower(sddc->timer_heap[0]->deadline, now, &next);
+    }
 
-                            if (edgeros) {
-                                __sddc_edgeros_destroy(edgeros);
-                            }
+#if SDDC_CFG_FRAG_MAX > 0
+    for (i = 0; i < SDDC_CFG_REASM_NUM; i++) {
+        if (sddc->reasm[i].edgeros != NULL) {
+            __sddc_deadline_lower(sddc->reasm[i].deadline, now, &next);
+        }
+    }
+#endif
 
-                            SDDC_LOG_DBG("Send refuse respond to: %s.\n", ip_str);
-                        }
-                    }
-                } else {                                            /* Payload length error */
-                    SDDC_LOG_ERR("Payload length error!\n");
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+    for (i = 0; i < SDDC_CFG_DISCOVER_SLOTS; i++) {
+        if (sddc->discover[i].pending) {
+            __sddc_deadline_lower(sddc->discover[i].due, now, &next);
+        }
+    }
+#endif
+
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    for (i = 0; i < SDDC_CFG_CONNECTOR_POOL_SIZE; i++) {
+        if (sddc->conn_pool[i] != NULL) {
+            __sddc_deadline_lower(sddc->conn_pool[i]->idle_since + SDDC_CFG_CONNECTOR_IDLE, now, &next);
+        }
+    }
+#endif
+
+    (void)i;
+
+    return next;
+}
+
+/*
+ * Handle expired retransmission timers, EdgerOS alive, pending REPORT and idle pooled connectors,
+ * return MS until the next deadline
+ */
+static uint32_t __sddc_timer_handle(sddc_t *sddc)
+{
+    sddc_list_head_t *itervar;
+    sddc_list_head_t *savevar;
+    sddc_edgeros_t   *edgeros;
+    sddc_message_t   *message;
+    uint32_t          now = sddc_time_ms();
+    uint32_t          next;
+
+    __sddc_lock(sddc);
+    __sddc_tx_begin(sddc);
+
+    while ((sddc->timer_heap_len > 0) && SDDC_TIME_BEFORE_EQ(sddc->timer_heap[0]->deadline, now)) {
+        message = sddc->timer_heap[0];
+        edgeros = message->edgeros;
+
+        __sddc_timer_remove(sddc, message);
+
+        if (message->retries > 0) {
+            __sddc_message_transmit(sddc, message, now);
+
+        } else {
+            SDDC_STATS_INC(sddc, edgeros, lost);
+            if (sddc->on_message_lost != NULL) {
+                SDDC_CALLOUT(sddc, sddc->on_message_lost(sddc, edgeros->uid, message->frag_base));
+            }
+
+            /*
+             * A MESSAGE is lost with any of its fragments
+             */
+            if (message->frag != 0) {
+                __sddc_message_release_fragments(sddc, edgeros, message->frag_base);
+            } else {
+                __sddc_message_release(sddc, message);
+            }
+            __sddc_mqueue_kick(sddc, edgeros, now);
+        }
+    }
+
+    if (SDDC_TIME_BEFORE_EQ(sddc->alive_deadline, now)) {
+        sddc->alive_deadline = now + SDDC_CFG_RETRIES_INTERVAL;
+
+        sddc_list_for_each_safe(itervar, savevar, &sddc->edgeros_list) {
+            edgeros = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
+
+            if (edgeros->alive > 0) {
+                edgeros->alive--;
+            } else {
+                if (sddc->on_edgeros_lost != NULL) {
+                    SDDC_CALLOUT(sddc, sddc->on_edgeros_lost(sddc, edgeros->uid));
                 }
-            } else {                                                /* Invite respond       */
-                SDDC_LOG_DBG("Receive invite respond from: %s.\n", ip_str);
+                __sddc_edgeros_destroy(sddc, edgeros);
             }
+        }
+    }
+
+#if SDDC_CFG_FRAG_MAX > 0
+    __sddc_reasm_expire(sddc, now);
+#endif
+
+#if SDDC_CFG_DISCOVER_SLOTS > 0
+    __sddc_discover_expire(sddc, now);
+#endif
+
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    __sddc_connector_pool_expire(sddc, now);
+#endif
+
+    __sddc_tx_end(sddc);
+
+    next = __sddc_timer_next(sddc, now);
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return next;
+}
+
+/**
+ * @brief Run SDDC.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Error number
+ */
+int sddc_run(sddc_t *sddc)
+{
+    fd_set  rfds;
+
+    sddc_return_value_if_fail(sddc, -1);
+
+    FD_ZERO(&rfds);
+
+    while (1) {
+        struct timeval tv;
+        uint32_t       timeout;
+        int            ret;
+
+        /*
+         * Queued sends and timers are handled on every wakeup, received traffic can not postpone them
+         */
+        __sddc_send_drain(sddc);
+        timeout = __sddc_timer_handle(sddc);
+
+        FD_SET(sddc->fd, &rfds);
+
+        tv.tv_sec  = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+
+        ret = select(sddc->fd + 1, &rfds, NULL, NULL, &tv);
+
+        if (ret > 0) {
+            __sddc_read_handle(sddc);
+
+        } else if (ret < 0) {
             break;
+        }
+    }
 
-        case SDDC_TYPE_MESSAGE:
-            if (edgeros != NULL) {
-                if (header->flags_type & SDDC_FLAG_ACK) {           /* MESSAGE ACK          */
-                    SDDC_LOG_DBG("Receive message respond from: %s.\n", ip_str);
+    return -1;
+}
 
-                    if (sddc->on_message_ack != NULL) {
-                        sddc->on_message_ack(sddc, edgeros->uid, header->seqno);
-                    }
+/**
+ * @brief Get the SDDC socket, for an application event loop in place of sddc_run.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Socket
+ */
+int sddc_get_fd(sddc_t *sddc)
+{
+    sddc_return_value_if_fail(sddc, -1);
 
-                    if (edgeros->mqueue_len > 0) {
-                        sddc_list_head_t *itervar;
-                        sddc_message_t *message;
+    return sddc->fd;
+}
 
-                        sddc_list_for_each(itervar, &edgeros->mqueue) {
-                            message = SDDC_CONTAINER_OF(itervar, sddc_message_t, node);
-                            if (message->seqno == header->seqno) {
-                                sddc_list_del(&message->node);
-                                sddc_free(message);
-                                edgeros->mqueue_len--;
-                                break;
-                            }
-                        }
-                    }
+/**
+ * @brief Handle all the datagrams pending on the SDDC socket and the queued sends.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Number of datagrams handled, -1 on error
+ */
+int sddc_process_readable(sddc_t *sddc)
+{
+    int total = 0;
+    int n;
+
+    sddc_return_value_if_fail(sddc, -1);
+
+    while ((n = __sddc_read_handle(sddc)) > 0) {
+        total += n;
+    }
+
+    __sddc_send_drain(sddc);
+
+    return total;
+}
+
+/**
+ * @brief Handle expired timers (retransmission, EdgerOS alive, reassembly, REPORT) and the queued sends.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Error number
+ */
+int sddc_process_timers(sddc_t *sddc)
+{
+    sddc_return_value_if_fail(sddc, -1);
+
+    __sddc_send_drain(sddc);
+    __sddc_timer_handle(sddc);
+
+    return 0;
+}
+
+/**
+ * @brief Get MS until sddc_process_timers has work to do.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return MS, 0: call sddc_process_timers now
+ */
+uint32_t sddc_next_deadline_ms(sddc_t *sddc)
+{
+    uint32_t next;
+
+    sddc_return_value_if_fail(sddc, 0);
+
+    if (SDDC_ATOMIC_LOAD(&sddc->wake_pending)) {
+        return 0;                                                   /* Queued sends         */
+    }
+
+    __sddc_lock(sddc);
+    next = __sddc_timer_next(sddc, sddc_time_ms());
+    sddc_mutex_unlock(&sddc->lockid);
+
+    return next;
+}
+
+#if SDDC_CFG_SECURITY_EN > 0
+/*
+ * Encrypt a payload for a EdgerOS: AES-GCM if it takes it, else (or if sealing fails) CBC.
+ * The security flags of the output are added to security_flag, return -1 if it is not encrypted
+ */
+static int __sddc_encrypt_for(sddc_t *sddc, sddc_edgeros_t *edgeros, uint8_t type, uint8_t frag, uint16_t seqno,
+                              const void *data, size_t len, void *output, size_t *olen, uint8_t *security_flag)
+{
+#if SDDC_GCM_EN > 0
+    if (edgeros->gcm && (sddc->gcm_ctx != NULL)) {
+        if (__sddc_seal(sddc, type, frag, seqno, data, len, output, olen) == 0) {
+            *security_flag |= SDDC_SEC_FLAG_CRYPTO | SDDC_SEC_FLAG_GCM;
+            return 0;
+        }
+        SDDC_LOG_WARN("Seal error, send CBC!\n");
+    }
+#endif
+
+    if (__sddc_encrypt(sddc, data, len, output, olen) != 0) {
+        SDDC_LOG_ERR("Encrypt error!\n");
+        return -1;
+    }
+
+    *security_flag |= SDDC_SEC_FLAG_CRYPTO;
+    return 0;
+}
+#endif
+
+/*
+ * Send message request to a EdgerOS (with lock), return -1 if it is not sent or queued.
+ * packed: SDDC_SEC_FLAG_LZ and SDDC_SEC_FLAG_CRYPTO already applied to the payload (prebuilt),
+ * frag: fragment byte of the header
+ */
+static int __sddc_send_message(sddc_t *sddc, sddc_edgeros_t *edgeros, uint8_t type,
+                               const void *payload, size_t payload_len, uint8_t packed,
+                               uint8_t retries, sddc_bool_t urgent,
+                               uint16_t seqno, uint8_t frag)
+{
+    sddc_header_t header;
+    uint8_t flag;
+    uint8_t security_flag = packed;
+    int ret = -1;
+
+    flag = (retries > 0) ? SDDC_FLAG_REQ : 0;
+    if (urgent) {
+        flag |= SDDC_FLAG_URGENT;
+    }
 
-                } else {                                            /* MESSAGE request      */
-                    SDDC_LOG_DBG("Receive message request from: %s.\n", ip_str);
+#if SDDC_CFG_LZ_EN > 0
+    /*
+     * Compress before encryption, kept only if smaller
+     */
+    if (edgeros->lz && !(packed & (SDDC_SEC_FLAG_LZ | SDDC_SEC_FLAG_CRYPTO)) && (payload_len >= SDDC_CFG_LZ_MIN) &&
+        (__sddc_lz_get(sddc) != NULL)) {
+        ssize_t lz_len = __sddc_lz_compress(sddc->lz->hash, payload, payload_len, sddc->lz->buf, payload_len - 1);
+
+        if (lz_len > 0) {
+            payload        = sddc->lz->buf;
+            payload_len    = lz_len;
+            security_flag |= SDDC_SEC_FLAG_LZ;
+        }
+    }
+#endif
 
-                    if ((len - sizeof(sddc_header_t)) >= header->length) {
-                        if (edgeros->last_seqno != header->seqno) {
-                            edgeros->last_seqno = header->seqno;
-                            if (sddc->on_message != NULL) {
+    if ((retries == 0) && (urgent || (edgeros->mqueue_len == 0))) {
+__send_urgent:
 #if SDDC_CFG_SECURITY_EN > 0
-                                if (header->security & SDDC_SEC_FLAG_CRYPTO) {
-                                    unpack_ret = __sddc_decrypt(sddc, SDDC_PACKET_PAYLOAD(sddc->recv_buf), header->length,
-                                                                sddc->decypt_buf, &payload_len);
-                                    payload    = sddc->decypt_buf;
-                                } else
+        if (!(security_flag & SDDC_SEC_FLAG_CRYPTO) &&
+            sddc->security_en && (payload != NULL) && (payload_len > 0)) {
+            uint8_t *crypto_buf = __sddc_tx_payload_buf(sddc);
+
+            if (__sddc_encrypt_for(sddc, edgeros, type, frag, seqno,
+                                   payload, payload_len, crypto_buf, &payload_len, &security_flag) < 0) {
+                return -1;
+            }
+            payload = crypto_buf;
+        }
 #endif
-                                {
-                                    payload     = SDDC_PACKET_PAYLOAD(sddc->recv_buf);
-                                    payload_len = header->length;
-                                    unpack_ret  = 0;
-                                }
 
-                                if ((unpack_ret == 0) && sddc->on_message(sddc, edgeros->uid, payload, payload_len)) {
-                                    if (header->flags_type & SDDC_FLAG_REQ) {
-                                        /*
-                                         * Build MESSAGE ACK
-                                         */
-                                        len = __sddc_build_packet(sddc, sddc->send_buf,
-                                                                  SDDC_TYPE_MESSAGE,
-                                                                  SDDC_FLAG_ACK,
-                                                                  SDDC_SEC_FLAG_NONE,
-                                                                  header->seqno,
-                                                                  NULL, 0);
+#if SDDC_CFG_LZ_EN > 0
+        /*
+         * The batch keeps the payload until it is flushed, the compress buffer is used again
+         */
+        if ((sddc->lz != NULL) && (payload == sddc->lz->buf)) {
+            uint8_t *lz_buf = __sddc_tx_payload_buf(sddc);
 
-                                        /*
-                                         * Send MESSAGE ACK to EdgerOS
-                                         */
-                                        sendto(sddc->fd, sddc->send_buf, len, 0,
-                                               (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
-                                    }
-                                }
-                            }
-                        } else {
-                            if (header->flags_type & SDDC_FLAG_REQ) {
-                                /*
-                                 * Build MESSAGE ACK
-                                 */
-                                len = __sddc_build_packet(sddc, sddc->send_buf,
-                                                          SDDC_TYPE_MESSAGE,
-                                                          SDDC_FLAG_ACK,
-                                                          SDDC_SEC_FLAG_NONE,
-                                                          header->seqno,
-                                                          NULL, 0);
+            memcpy(lz_buf, payload, payload_len);
+            payload = lz_buf;
+        }
+#endif
 
-                                /*
-                                 * Send MESSAGE ACK to EdgerOS
-                                 */
-                                sendto(sddc->fd, sddc->send_buf, len, 0,
-                                       (const struct sockaddr *)&cli_addr, sizeof(cli_addr));
-                            }
-                        }
-                    } else {                                            /* Payload length error */
-                        SDDC_LOG_ERR("Payload length error.\n");
-                    }
-                }
-            }
-            break;
+        __sddc_build_header(sddc, &header,
+                            type,
+                            flag,
+                            security_flag,
+                            seqno,
+                            payload_len);
+        header.reserved = frag;
 
-        case SDDC_TYPE_REPORT:
-            /*
-             * Do nothing
-             */
-            SDDC_LOG_DBG("Receive report from: %s.\n", ip_str);
-            break;
+        /*
+         * Lost as any datagram if the socket refuses it
+         */
+        __sddc_send_to_edgeros(sddc, edgeros, &header, payload, payload_len);
 
-        case SDDC_TYPE_TIMESTAMP:
-            if (edgeros != NULL) {
-                if (header->flags_type & SDDC_FLAG_ACK) {               /* TIMESTAMP ACK          */
-                    SDDC_LOG_DBG("Receive TIMESTAMP respond from: %s.\n", ip_str);
+        ret = 0;
+    } else {
+        sddc_message_t *message = NULL;
 
-                    if (sddc->on_timestamp != NULL) {
+        if (edgeros->mqueue_len < SDDC_CFG_MQUEUE_SIZE) {
+            message = __sddc_message_alloc(sddc, sizeof(sddc_header_t) + payload_len
 #if SDDC_CFG_SECURITY_EN > 0
-                        if (header->security & SDDC_SEC_FLAG_CRYPTO) {
-                            unpack_ret = __sddc_decrypt(sddc, SDDC_PACKET_PAYLOAD(sddc->recv_buf), header->length,
-                                                        sddc->decypt_buf, &payload_len);
-                            payload    = sddc->decypt_buf;
-                        } else
-#endif
-                        {
-                            payload     = SDDC_PACKET_PAYLOAD(sddc->recv_buf);
-                            payload_len = header->length;
-                            unpack_ret  = 0;
-                        }
+                                           + ((sddc->security_en && !(security_flag & SDDC_SEC_FLAG_CRYPTO)) ? 16 : 0)
+#endif
+                                          );
+
+            if (message != NULL) {
+                message->edgeros     = edgeros;
+                message->retries     = retries;
+                message->seqno       = seqno;
+                message->frag        = frag;
+                message->frag_base   = seqno - SDDC_FRAG_INDEX(frag);
+                message->transmits   = 0;
+                message->timer_index = SDDC_TIMER_NONE;
 
-                        sddc->on_timestamp(sddc, edgeros->uid, payload, payload_len);
+#if SDDC_CFG_SECURITY_EN > 0
+                if (!(security_flag & SDDC_SEC_FLAG_CRYPTO) &&
+                    sddc->security_en && (payload != NULL) && (payload_len > 0)) {
+                    if (__sddc_encrypt_for(sddc, edgeros, type, frag, seqno, payload, payload_len,
+                                           message->packet + sizeof(sddc_header_t), &payload_len,
+                                           &security_flag) < 0) {
+                        __sddc_message_free(sddc, message);
+                        return -1;
                     }
+                    payload = message->packet + sizeof(sddc_header_t);
+                }
+#endif
 
-                    if (edgeros->mqueue_len > 0) {
-                        sddc_list_head_t *itervar;
-                        sddc_message_t *message;
+                message->packet_len = __sddc_build_packet(sddc, message->packet,
+                                                          type,
+                                                          flag,
+                                                          security_flag,
+                                                          seqno,
+                                                          payload, payload_len);
+                ((sddc_header_t *)message->packet)->reserved = frag;
 
-                        sddc_list_for_each(itervar, &edgeros->mqueue) {
-                            message = SDDC_CONTAINER_OF(itervar, sddc_message_t, node);
-                            if (message->seqno == header->seqno) {
-                                sddc_list_del(&message->node);
-                                sddc_free(message);
-                                edgeros->mqueue_len--;
-                                break;
-                            }
-                        }
-                    }
+                if (urgent) {
+                    sddc_list_add(&message->node, &edgeros->mqueue);
+                } else {
+                    sddc_list_add_tail(&message->node, &edgeros->mqueue);
                 }
-            }
-            break;
 
-        default:
+                edgeros->mqueue_len++;
+#if SDDC_CFG_STATS_EN > 0
+                if (edgeros->mqueue_len > edgeros->stats.mqueue_high_water) {
+                    edgeros->stats.mqueue_high_water = edgeros->mqueue_len;
+                }
+                if (edgeros->mqueue_len > sddc->stats.mqueue_high_water) {
+                    sddc->stats.mqueue_high_water = edgeros->mqueue_len;
+                }
+#endif
+
+                ret = 0;
+            }
+        } else {
             /*
-             * Do nothing
+             * Backpressure, on_message_ready is called when an ack or a loss makes room
              */
-            SDDC_LOG_ERR("Receive unrecognizable packet from: %s.\n", ip_str);
-            break;
+            edgeros->mqueue_full = SDDC_TRUE;
         }
 
-        sddc_mutex_unlock(&sddc->lockid);
+        if (urgent) {
+            if (message != NULL) {
+                __sddc_message_transmit(sddc, message, sddc_time_ms());
+            } else {
+                goto __send_urgent;
+            }
+        } else {
+            __sddc_mqueue_kick(sddc, edgeros, sddc_time_ms());
+        }
     }
+
+    return ret;
 }
 
-static void __sddc_timeout_handle(sddc_t *sddc)
+/*
+ * Send a MESSAGE in count fragments of SDDC_CFG_FRAG_SIZE (with lock), fragment n has
+ * seq number seqno + n. A fragment that can not be queued drops the whole MESSAGE
+ */
+static int __sddc_send_fragments(sddc_t *sddc, sddc_edgeros_t *edgeros, uint8_t type,
+                                 const uint8_t *payload, size_t payload_len, uint8_t packed,
+                                 uint8_t count, uint8_t retries, sddc_bool_t urgent,
+                                 uint16_t seqno)
 {
-    sddc_list_head_t *itervar;
-    sddc_list_head_t *savevar;
-    sddc_edgeros_t   *edgeros;
+    size_t  len;
+    uint8_t i;
 
-    sddc_mutex_lock(&sddc->lockid);
+    if (count == 1) {
+        return __sddc_send_message(sddc, edgeros, type, payload, payload_len, packed,
+                                   retries, urgent, seqno, 0);
+    }
 
-    sddc_list_for_each_safe(itervar, savevar, &sddc->edgeros_list) {
-        edgeros = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
+    for (i = 0; i < count; i++) {
+        len = (i < count - 1) ? SDDC_CFG_FRAG_SIZE : (payload_len - i * SDDC_CFG_FRAG_SIZE);
 
-        while (edgeros->mqueue_len > 0) {
-            sddc_message_t *message = SDDC_CONTAINER_OF(edgeros->mqueue.next, sddc_message_t, node);
-            sddc_header_t  *header  = (sddc_header_t *)message->packet;
+        if (__sddc_send_message(sddc, edgeros, type, payload + i * SDDC_CFG_FRAG_SIZE, len, packed,
+                                retries, urgent, (uint16_t)(seqno + i), SDDC_FRAG(i, count)) < 0) {
+            __sddc_message_release_fragments(sddc, edgeros, seqno);
+            return -1;
+        }
+    }
 
-            if (header->flags_type & SDDC_FLAG_REQ) {
-                if (message->retries > 0) {
-                    message->retries--;
-                    sendto(sddc->fd, message->packet, message->packet_len, 0,
-                           (const struct sockaddr *)&edgeros->addr, sizeof(edgeros->addr));
-                    break;
+    return 0;
+}
 
-                } else {
-                    if (sddc->on_message_lost != NULL) {
-                        sddc->on_message_lost(sddc, edgeros->uid, message->seqno);
-                    }
-                }
-            } else {
-                sendto(sddc->fd, message->packet, message->packet_len, 0,
-                       (const struct sockaddr *)&edgeros->addr, sizeof(edgeros->addr));
-            }
+/*
+ * Take a free cell of the send ring (multiple producers, no lock)
+ */
+static sddc_send_req_t *__sddc_send_ring_get(sddc_t *sddc, uint32_t *pos)
+{
+    sddc_send_req_t *req;
+    uint32_t         head = SDDC_ATOMIC_LOAD(&sddc->send_head);
+    int32_t          diff;
 
-            sddc_list_del(&message->node);
-            sddc_free(message);
-            edgeros->mqueue_len--;
-        }
+    while (1) {
+        req  = &sddc->send_ring[head & SDDC_SEND_RING_MASK];
+        diff = (int32_t)(SDDC_ATOMIC_LOAD(&req->sequence) - head);
 
-        if (edgeros->alive > 0) {
-            edgeros->alive--;
-        } else {
-            if (sddc->on_edgeros_lost != NULL) {
-                sddc->on_edgeros_lost(sddc, edgeros->uid);
+        if (diff == 0) {
+            if (SDDC_ATOMIC_CAS(&sddc->send_head, &head, head + 1)) {
+                *pos = head;
+                return req;
             }
-            __sddc_edgeros_destroy(edgeros);
+        } else if (diff < 0) {
+            return NULL;                                            /* Full                 */
+        } else {
+            head = SDDC_ATOMIC_LOAD(&sddc->send_head);              /* Taken by other task  */
         }
     }
-
-    sddc_mutex_unlock(&sddc->lockid);
 }
 
-/**
- * @brief Run SDDC.
- *
- * @param[in] sddc          Pointer to SDDC
- *
- * @return Error number
+/*
+ * Queue a send for sddc_run, json_len: the JSON length of a CBOR MESSAGE, 0 if it is not CBOR
  */
-int sddc_run(sddc_t *sddc)
+static int __sddc_send_request(sddc_t *sddc, uint8_t kind, const uint8_t *uid, sddc_bool_t broadcast,
+                               const void *payload, size_t payload_len,
+                               uint8_t retries, sddc_bool_t urgent,
+                               uint16_t *seqno, size_t json_len)
 {
-    fd_set  rfds;
+    sddc_send_req_t *req;
+    uint8_t         *large = NULL;
+    uint32_t         pos;
+    uint16_t         count;
+    uint16_t         frags = (kind == SDDC_SEND_MESSAGE) ? SDDC_FRAG_NUM(payload_len) : 1;
+    uint16_t         i;
+
+    /*
+     * Enough seq numbers for the CBOR or the JSON form
+     */
+    if ((json_len > 0) && (SDDC_FRAG_NUM(json_len) > frags)) {
+        frags = SDDC_FRAG_NUM(json_len);
+    }
 
-    sddc_return_value_if_fail(sddc, -1);
+    /*
+     * A datagram payload is copied in the slot of the ring cell, a MESSAGE sent in
+     * fragments on the heap
+     */
+    if (payload_len > SDDC_SEND_PAYLOAD_MAX) {
+        large = sddc_malloc(payload_len);
+        if (large == NULL) {
+            SDDC_LOG_ERR("Failed to allocate memory!\n");
+            return -1;
+        }
+        memcpy(large, payload, payload_len);
+    }
 
-    FD_ZERO(&rfds);
+    req = __sddc_send_ring_get(sddc, &pos);
+    if (req == NULL) {
+        /*
+         * Backpressure, on_message_ready is called when sddc_run drained the ring,
+         * try again as it may have done so before it could see the flag
+         */
+        SDDC_ATOMIC_XCHG(&sddc->send_full, 1);
 
-    while (1) {
-        struct timeval tv;
-        int            ret;
+        req = __sddc_send_ring_get(sddc, &pos);
+        if (req == NULL) {
+            if (large != NULL) {
+                sddc_free(large);
+            }
+            return -1;
+        }
+    }
 
-        FD_SET(sddc->fd, &rfds);
+    req->kind      = kind;
+    req->retries   = retries;
+    req->urgent    = urgent;
+    req->broadcast = broadcast;
+    req->has_uid   = (uid != NULL) ? SDDC_TRUE : SDDC_FALSE;
 
-        tv.tv_sec  = SDDC_CFG_RETRIES_INTERVAL / 1000;
-        tv.tv_usec = (SDDC_CFG_RETRIES_INTERVAL % 1000) * 1000;
+    if (uid != NULL) {
+        memcpy(req->uid, uid, SDDC_UID_LEN);
+    }
 
-        ret = select(sddc->fd + 1, &rfds, NULL, NULL, &tv);
-        if (ret > 0) {
-            __sddc_read_handle(sddc);
+    req->large = large;
+    if ((large == NULL) && (payload_len > 0)) {
+        memcpy(SDDC_SEND_SLOT(sddc, req), payload, payload_len);
+    }
+    req->payload_len = payload_len;
+    req->frags       = frags;
+#if SDDC_CFG_CBOR_EN > 0
+    req->cbor        = (json_len > 0) ? SDDC_TRUE : SDDC_FALSE;
+    req->json_len    = json_len;
+#endif
 
-        } else if (ret == 0) {
-            __sddc_timeout_handle(sddc);
+    count = broadcast ? SDDC_ATOMIC_LOAD(&sddc->edgeros_count) : 1;
 
-        } else {
-            break;
+    /*
+     * Each fragment has a seq number, the application gets the one of the first fragment
+     */
+    req->seqno       = __sddc_seqno_alloc(sddc, count * frags);
+    req->seqno_count = count;
+
+    if (seqno != NULL) {
+        for (i = 0; i < count; i++) {
+            seqno[i] = req->seqno + i * frags;
         }
     }
 
-    return -1;
+    SDDC_ATOMIC_STORE(&req->sequence, pos + 1);
+
+    if (SDDC_ATOMIC_XCHG(&sddc->wake_pending, 1) == 0) {
+        __sddc_wakeup(sddc);
+    }
+
+    return 0;
 }
 
-/**
- * @brief Send message request to a specified EdgerOS which connected.
- *
- * @param[in] sddc          Pointer to SDDC
- * @param[in] uid           Pointer to EdgerOS UID
- * @param[in] type          The type of message
- * @param[in] payload       Pointer to message payload data
- * @param[in] payload_len   The length of payload data
- * @param[in] retries       The count of retry send
- * @param[in] urgent        Does urgent request
- * @param[out] seqno        Seq number
- *
- * @return Error number
+/*
+ * Send a request of the send ring to a EdgerOS (with lock), the report data
+ * is picked as the EdgerOS takes it
  */
-static int __sddc_send_message(sddc_t *sddc, const uint8_t *uid, uint8_t type,
-                               const void *payload, size_t payload_len,
-                               uint8_t retries, sddc_bool_t urgent,
-                               uint16_t *seqno)
+static int __sddc_send_req_to(sddc_t *sddc, sddc_send_req_t *req, sddc_edgeros_t *edgeros, uint16_t seqno)
 {
-    sddc_edgeros_t *edgeros;
-    uint8_t flag;
-    uint8_t security_flag = SDDC_SEC_FLAG_NONE;
-    int len;
-    int ret = -1;
+    const void *payload;
+    size_t      payload_len;
+    uint8_t     packed = SDDC_SEC_FLAG_NONE;
+    uint8_t     type;
+    uint8_t     frags  = 1;
+
+    switch (req->kind) {
+    case SDDC_SEND_UPDATE:
+        type        = SDDC_TYPE_UPDATE;
+#if SDDC_CFG_LZ_EN > 0
+        if (edgeros->lz && (sddc->report_lz != NULL)) {
+#if SDDC_CFG_SECURITY_EN > 0
+            if (sddc->report_lz_crypto != NULL) {
+                payload     = sddc->report_lz_crypto;
+                payload_len = sddc->report_lz_crypto_len;
+                packed      = SDDC_SEC_FLAG_LZ | SDDC_SEC_FLAG_CRYPTO;
+                break;
+            }
+#endif
+            payload     = sddc->report_lz;
+            payload_len = sddc->report_lz_len;
+            packed      = SDDC_SEC_FLAG_LZ;
+            break;
+        }
+#endif
+#if SDDC_CFG_SECURITY_EN > 0
+        if (sddc->report_crypto != NULL) {
+            payload     = sddc->report_crypto;
+            payload_len = sddc->report_crypto_len;
+            packed      = SDDC_SEC_FLAG_CRYPTO;
+            break;
+        }
+#endif
+        payload     = sddc->report_data;
+        payload_len = sddc->report_data_len;
+        break;
+
+    case SDDC_SEND_TIMESTAMP:
+        type        = SDDC_TYPE_TIMESTAMP;
+        payload     = NULL;
+        payload_len = 0;
+        break;
+
+    default:
+        type        = SDDC_TYPE_MESSAGE;
+        payload     = (req->large != NULL) ? req->large : SDDC_SEND_SLOT(sddc, req);
+        payload_len = req->payload_len;
+#if SDDC_CFG_CBOR_EN > 0
+        if (req->cbor) {
+            if (edgeros->cbor) {
+                packed = SDDC_SEC_FLAG_CBOR;
 
-    sddc_return_value_if_fail(sddc && uid, -1);
+            } else {
+                /*
+                 * JSON for EdgerOS which do not take CBOR, converted once per request
+                 */
+                if (req->json == NULL) {
+                    req->json = sddc_malloc(req->json_len + 1);
+                    if (req->json == NULL) {
+                        SDDC_LOG_ERR("Failed to allocate memory!\n");
+                        return -1;
+                    }
+                    __sddc_cbor_to_json(payload, payload_len, req->json, req->json_len + 1);
+                }
+                payload     = req->json;
+                payload_len = req->json_len;
+            }
+        }
+#endif
+        frags       = SDDC_FRAG_NUM(payload_len);
+        break;
+    }
 
-    sddc_mutex_lock(&sddc->lockid);
+    return __sddc_send_fragments(sddc, edgeros, type, payload, payload_len, packed,
+                                 frags, req->retries, req->urgent, seqno);
+}
 
-    edgeros = __sddc_edgeros_find(sddc, uid);
-    sddc_goto_error_if_fail(edgeros != NULL);
+/*
+ * Send a request of the send ring (with lock), -1 keeps it in the ring until
+ * the EdgerOS message queue has room
+ */
+static int __sddc_send_req_handle(sddc_t *sddc, sddc_send_req_t *req)
+{
+    sddc_list_head_t *itervar;
+    sddc_edgeros_t   *edgeros;
+    uint8_t           frags = req->frags;
+    uint16_t          seqno;
+    uint16_t          i = 0;
 
-    if (seqno != NULL) {
-        *seqno = sddc->seqno;
-    }
+    if (req->broadcast) {
+        sddc_list_for_each(itervar, &sddc->edgeros_list) {
+            edgeros = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
 
-    flag = (retries > 0) ? SDDC_FLAG_REQ : 0;
-    if (urgent) {
-        flag |= SDDC_FLAG_URGENT;
-    }
+            /*
+             * EdgerOS joined after the call get new seq numbers
+             */
+            seqno = (i < req->seqno_count) ? (uint16_t)(req->seqno + i * frags) : __sddc_seqno_alloc(sddc, frags);
+            i++;
 
-    if ((retries == 0) && (urgent || (edgeros->mqueue_len == 0))) {
-__send_urgent:
-#if SDDC_CFG_SECURITY_EN > 0
-        if (sddc->security_en && (payload != NULL) && (payload_len > 0)) {
-            __sddc_encrypt(sddc, payload, payload_len, sddc->send_buf + sizeof(sddc_header_t), &payload_len);
-            payload = sddc->send_buf + sizeof(sddc_header_t);
-            security_flag |= SDDC_SEC_FLAG_CRYPTO;
+            if ((__sddc_send_req_to(sddc, req, edgeros, seqno) < 0) && (req->retries > 0)) {
+                SDDC_STATS_INC(sddc, edgeros, lost);
+                if (sddc->on_message_lost != NULL) {
+                    SDDC_CALLOUT(sddc, sddc->on_message_lost(sddc, edgeros->uid, seqno));
+                }
+            }
         }
-#endif
 
-        len = __sddc_build_packet(sddc, sddc->send_buf,
-                                  type,
-                                  flag,
-                                  security_flag,
-                                  sddc->seqno++,
-                                  payload, payload_len);
+    } else {
+        if (req->has_uid) {
+            edgeros = __sddc_edgeros_find(sddc, req->uid);
+        } else if (!sddc_list_is_empty(&sddc->edgeros_list)) {
+            edgeros = SDDC_CONTAINER_OF(sddc->edgeros_list.next, sddc_edgeros_t, node);
+        } else {
+            edgeros = NULL;
+        }
 
-        if (sendto(sddc->fd, sddc->send_buf, len, 0,
-                   (const struct sockaddr *)&edgeros->addr, sizeof(edgeros->addr)) == len) {
-            ret = 0;
+        if (edgeros == NULL) {
+            if ((req->kind == SDDC_SEND_MESSAGE) && (req->retries > 0)) {
+                SDDC_STATS_INC(sddc, edgeros, lost);
+                if (sddc->on_message_lost != NULL) {
+                    SDDC_CALLOUT(sddc, sddc->on_message_lost(sddc, req->uid, req->seqno));
+                }
+            }
+            return 0;
         }
-    } else {
-        sddc_message_t *message = NULL;
 
-        if (edgeros->mqueue_len < SDDC_CFG_MQUEUE_SIZE) {
-            message = sddc_malloc(sizeof(sddc_message_t) + sizeof(sddc_header_t) + payload_len
-#if SDDC_CFG_SECURITY_EN > 0
-                                  + (sddc->security_en ? 16 : 0)
-#endif
-                                 );
+        /*
+         * Keep the order of the application sends
+         */
+        if (!req->urgent && ((edgeros->mqueue_len + frags) > SDDC_CFG_MQUEUE_SIZE)) {
+            return -1;
+        }
+
+        if ((__sddc_send_req_to(sddc, req, edgeros, req->seqno) < 0) && !req->urgent) {
+            return -1;                                              /* Message pool empty   */
+        }
+    }
+
+    if (req->kind == SDDC_SEND_MESSAGE) {
+        SDDC_STATS_ENGINE_ADD(sddc, tx_copy_bytes, req->payload_len);
+    }
+
+    return 0;
+}
+
+/*
+ * Send the requests queued by application tasks, ring cells are given back once
+ * the batch referencing their payload is flushed
+ */
+static void __sddc_send_drain(sddc_t *sddc)
+{
+    sddc_send_req_t *req;
+    uint32_t         tail;
 
-            if (message != NULL) {
-                message->edgeros = edgeros;
-                message->retries = retries;
-                message->seqno   = sddc->seqno;
+    SDDC_ATOMIC_XCHG(&sddc->wake_pending, 0);
 
-#if SDDC_CFG_SECURITY_EN > 0
-                if (sddc->security_en && (payload != NULL) && (payload_len > 0)) {
-                    __sddc_encrypt(sddc, payload, payload_len, message->packet + sizeof(sddc_header_t), &payload_len);
-                    payload = message->packet + sizeof(sddc_header_t);
-                    security_flag |= SDDC_SEC_FLAG_CRYPTO;
-                }
-#endif
+    tail = sddc->send_tail;
+    req  = &sddc->send_ring[tail & SDDC_SEND_RING_MASK];
+    if ((int32_t)(SDDC_ATOMIC_LOAD(&req->sequence) - (tail + 1)) < 0) {
+        return;                                                     /* Empty                */
+    }
 
-                message->packet_len = __sddc_build_packet(sddc, message->packet,
-                                                          type,
-                                                          flag,
-                                                          security_flag,
-                                                          sddc->seqno++,
-                                                          payload, payload_len);
+    __sddc_lock(sddc);
+    __sddc_tx_begin(sddc);
 
-                if (urgent) {
-                    sddc_list_add(&message->node, &edgeros->mqueue);
-                } else {
-                    sddc_list_add_tail(&message->node, &edgeros->mqueue);
-                }
+    while ((int32_t)(SDDC_ATOMIC_LOAD(&req->sequence) - (tail + 1)) >= 0) {
+        if (__sddc_send_req_handle(sddc, req) < 0) {
+            break;
+        }
 
-                edgeros->mqueue_len++;
+        tail++;
+        req = &sddc->send_ring[tail & SDDC_SEND_RING_MASK];
+    }
 
-                ret = 0;
+    __sddc_tx_end(sddc);
+
+    if (tail != sddc->send_tail) {
+        while (sddc->send_tail != tail) {
+            req = &sddc->send_ring[sddc->send_tail & SDDC_SEND_RING_MASK];
+            if (req->large != NULL) {
+                sddc_free(req->large);
+                req->large = NULL;
+            }
+#if SDDC_CFG_CBOR_EN > 0
+            if (req->json != NULL) {
+                sddc_free(req->json);
+                req->json = NULL;
             }
+#endif
+            SDDC_ATOMIC_STORE(&req->sequence, sddc->send_tail + SDDC_CFG_SEND_RING_SIZE);
+            sddc->send_tail++;
         }
 
-        if (urgent) {
-            if (message != NULL) {
-                if (message->retries > 0) {
-                    message->retries--;
-                }
-                sendto(sddc->fd, message->packet, message->packet_len, 0,
-                       (const struct sockaddr *)&edgeros->addr, sizeof(edgeros->addr));
-            } else {
-                goto __send_urgent;
-            }
+        if (SDDC_ATOMIC_XCHG(&sddc->send_full, 0) && (sddc->on_message_ready != NULL)) {
+            SDDC_CALLOUT(sddc, sddc->on_message_ready(sddc, NULL));
         }
     }
 
-error:
     sddc_mutex_unlock(&sddc->lockid);
-
-    return ret;
 }
 
 /**
@@ -1362,8 +5709,7 @@ int sddc_send_update(sddc_t *sddc, const uint8_t *uid)
 {
     sddc_return_value_if_fail(sddc && uid, -1);
 
-    return __sddc_send_message(sddc, uid, SDDC_TYPE_UPDATE,
-                               sddc->report_data, sddc->report_data_len, 1, SDDC_TRUE, NULL);
+    return __sddc_send_request(sddc, SDDC_SEND_UPDATE, uid, SDDC_FALSE, NULL, 0, 1, SDDC_TRUE, NULL, 0);
 }
 
 /**
@@ -1377,24 +5723,9 @@ int sddc_send_update(sddc_t *sddc, const uint8_t *uid)
  */
 int sddc_broadcast_update(sddc_t *sddc)
 {
-    sddc_list_head_t *itervar;
-    sddc_edgeros_t   *edgeros;
-    int               ret = 0;
-
     sddc_return_value_if_fail(sddc, -1);
 
-    sddc_mutex_lock(&sddc->lockid);
-
-    sddc_list_for_each(itervar, &sddc->edgeros_list) {
-        edgeros = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
-
-        ret |= __sddc_send_message(sddc, edgeros->uid, SDDC_TYPE_UPDATE,
-                                   sddc->report_data, sddc->report_data_len, 1, SDDC_TRUE, NULL);
-    }
-
-    sddc_mutex_unlock(&sddc->lockid);
-
-    return ret;
+    return __sddc_send_request(sddc, SDDC_SEND_UPDATE, NULL, SDDC_TRUE, NULL, 0, 1, SDDC_TRUE, NULL, 0);
 }
 
 /**
@@ -1409,15 +5740,7 @@ int sddc_send_timestamp_request(sddc_t *sddc, const uint8_t *uid)
 {
     sddc_return_value_if_fail(sddc, -1);
 
-    if (uid == NULL) {
-        sddc_return_value_if_fail(!sddc_list_is_empty(&sddc->edgeros_list), -1);
-
-        sddc_edgeros_t *edgeros = SDDC_CONTAINER_OF(sddc->edgeros_list.next, sddc_edgeros_t, node);
-
-        uid = edgeros->uid;
-    }
-
-    return __sddc_send_message(sddc, uid, SDDC_TYPE_TIMESTAMP, NULL, 0, 1, SDDC_TRUE, NULL);
+    return __sddc_send_request(sddc, SDDC_SEND_TIMESTAMP, uid, SDDC_FALSE, NULL, 0, 1, SDDC_TRUE, NULL, 0);
 }
 
 /**
@@ -1439,9 +5762,10 @@ int sddc_send_message(sddc_t *sddc, const uint8_t *uid,
                       uint16_t *seqno)
 {
     sddc_return_value_if_fail(sddc && uid && payload && payload_len, -1);
-    sddc_return_value_if_fail(payload_len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t) - 16), -1);
+    sddc_return_value_if_fail(payload_len <= SDDC_MESSAGE_MAX, -1);
 
-    return __sddc_send_message(sddc, uid, SDDC_TYPE_MESSAGE, payload, payload_len, retries, urgent, seqno);
+    return __sddc_send_request(sddc, SDDC_SEND_MESSAGE, uid, SDDC_FALSE,
+                               payload, payload_len, retries, urgent, seqno, 0);
 }
 
 /**
@@ -1461,62 +5785,163 @@ int sddc_broadcast_message(sddc_t *sddc,
                            uint8_t retries, sddc_bool_t urgent,
                            uint16_t *seqno)
 {
-    sddc_list_head_t *itervar;
-    sddc_edgeros_t   *edgeros;
-    int               ret = 0;
-
     sddc_return_value_if_fail(sddc && payload && payload_len, -1);
-    sddc_return_value_if_fail(payload_len <= (sizeof(sddc->send_buf) - sizeof(sddc_header_t) - 16), -1);
+    sddc_return_value_if_fail(payload_len <= SDDC_MESSAGE_MAX, -1);
 
-    sddc_mutex_lock(&sddc->lockid);
+    return __sddc_send_request(sddc, SDDC_SEND_MESSAGE, NULL, SDDC_TRUE,
+                               payload, payload_len, retries, urgent, seqno, 0);
+}
 
-    sddc_list_for_each(itervar, &sddc->edgeros_list) {
-        edgeros = SDDC_CONTAINER_OF(itervar, sddc_edgeros_t, node);
+#if SDDC_CFG_CBOR_EN > 0
+/*
+ * JSON length of a CBOR MESSAGE, -1 if it is malformed or too large as JSON
+ */
+static ssize_t __sddc_cbor_message_check(const void *payload, size_t payload_len)
+{
+    ssize_t json_len = __sddc_cbor_to_json(payload, payload_len, NULL, 0);
 
-        if (seqno != NULL) {
-            ret |= sddc_send_message(sddc, edgeros->uid,
-                                     payload, payload_len,
-                                     retries, urgent, seqno);
-            seqno++;
-        } else {
-            ret |= sddc_send_message(sddc, edgeros->uid,
-                                     payload, payload_len,
-                                     retries, urgent, NULL);
-        }
+    if ((json_len <= 0) || (json_len > SDDC_MESSAGE_MAX)) {
+        SDDC_LOG_ERR("CBOR message malformed or too large!\n");
+        return -1;
     }
 
-    sddc_mutex_unlock(&sddc->lockid);
-
-    return ret;
+    return json_len;
 }
 
 /**
- * @brief Create a SDDC connector.
+ * @brief Send CBOR message request to a specified EdgerOS which connected.
  *
- * @param[in] connector     Pointer to SDDC
+ * @param[in] sddc          Pointer to SDDC
  * @param[in] uid           Pointer to EdgerOS UID
- * @param[in] port          EdgerOS TCP server port
- * @param[in] token         Pointer to token string
- * @param[in] get_mode      Get data mode?
+ * @param[in] payload       Pointer to CBOR message
+ * @param[in] payload_len   The length of CBOR message
+ * @param[in] retries       The count of retry send
+ * @param[in] urgent        Does urgent request
+ * @param[out] seqno        Seq number
  *
- * @return Pointer to SDDC connector.
+ * @return Error number
  */
-sddc_connector_t *sddc_connector_create(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token, sddc_bool_t get_mode)
+int sddc_send_cbor_message(sddc_t *sddc, const uint8_t *uid,
+                           const void *payload, size_t payload_len,
+                           uint8_t retries, sddc_bool_t urgent,
+                           uint16_t *seqno)
+{
+    ssize_t json_len;
+
+    sddc_return_value_if_fail(sddc && uid && payload && payload_len, -1);
+    sddc_return_value_if_fail(payload_len <= SDDC_MESSAGE_MAX, -1);
+
+    json_len = __sddc_cbor_message_check(payload, payload_len);
+    if (json_len < 0) {
+        return -1;
+    }
+
+    return __sddc_send_request(sddc, SDDC_SEND_MESSAGE, uid, SDDC_FALSE,
+                               payload, payload_len, retries, urgent, seqno, json_len);
+}
+
+/**
+ * @brief Broadcast CBOR message request to all EdgerOS which connected.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] payload       Pointer to CBOR message
+ * @param[in] payload_len   The length of CBOR message
+ * @param[in] retries       The count of retry send
+ * @param[in] urgent        Does urgent request
+ * @param[out] seqno        Seq number array
+ *
+ * @return Error number
+ */
+int sddc_broadcast_cbor_message(sddc_t *sddc,
+                                const void *payload, size_t payload_len,
+                                uint8_t retries, sddc_bool_t urgent,
+                                uint16_t *seqno)
+{
+    ssize_t json_len;
+
+    sddc_return_value_if_fail(sddc && payload && payload_len, -1);
+    sddc_return_value_if_fail(payload_len <= SDDC_MESSAGE_MAX, -1);
+
+    json_len = __sddc_cbor_message_check(payload, payload_len);
+    if (json_len < 0) {
+        return -1;
+    }
+
+    return __sddc_send_request(sddc, SDDC_SEND_MESSAGE, NULL, SDDC_TRUE,
+                               payload, payload_len, retries, urgent, seqno, json_len);
+}
+
+/**
+ * @brief Whether the payload given to the running callback is CBOR.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return SDDC_TRUE if the payload is CBOR
+ */
+sddc_bool_t sddc_payload_is_cbor(sddc_t *sddc)
+{
+    sddc_return_value_if_fail(sddc, SDDC_FALSE);
+
+    return sddc->rx_cbor;
+}
+#endif
+
+/*
+ * TCP options of a pooled connector: keepalive while it is idle, no Nagle delay of the small end frame
+ */
+static void __sddc_connector_sockopt(int sockfd)
+{
+    int on = 1;
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL)
+    int secs = SDDC_CFG_CONNECTOR_KEEPALIVE;
+#endif
+
+    setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL)
+    setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &secs, sizeof(secs));
+    setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, &secs, sizeof(secs));
+#endif
+#ifdef TCP_NODELAY
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#endif
+}
+
+/*
+ * Create a connector, on_event: NULL for a blocking one
+ */
+static sddc_connector_t *__sddc_connector_create(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token,
+                                                 sddc_bool_t get_mode, sddc_on_connector_t on_event, void *arg,
+                                                 sddc_bool_t pooled)
 {
     sddc_connector_t *connector;
     sddc_edgeros_t *edgeros;
     struct sockaddr_in dest_addr;
     struct timeval recv_timeout = { SDDC_CFG_CONNECTOR_TIMEOUT / 1000, (SDDC_CFG_CONNECTOR_TIMEOUT % 1000) * 1000 };
+    size_t stage_size;
     int ret;
 
-    sddc_return_value_if_fail(sddc && uid, NULL);
+    /*
+     * A plain pooled connector stages its frames after the structure
+     */
+    stage_size = pooled ? (SDDC_CONNECTOR_CHUNK + 2 * SDDC_CONNECTOR_FRAME_HDR) : 0;
+#if SDDC_CFG_SECURITY_EN > 0
+    stage_size = token ? 0 : stage_size;
+#endif
 
-    connector = sddc_malloc(sizeof(struct sddc_connector) + (get_mode ? SDDC_CFG_RECV_BUF_SIZE : 0));
+    connector = sddc_malloc(sizeof(struct sddc_connector) + (get_mode ? SDDC_CFG_RECV_BUF_SIZE : 0) + stage_size);
     sddc_return_value_if_fail(connector, NULL);
 
     connector->get_mode = get_mode;
+    connector->on_event = on_event;
+    connector->arg      = arg;
+    connector->state    = SDDC_CONNECTOR_OPEN;
+    connector->blocked  = SDDC_FALSE;
+    connector->pend_off = 0;
+    connector->pend_len = 0;
+    connector->tx_buf   = (stage_size > 0) ? connector->recv_buf : NULL;
+    connector->sddc     = pooled ? sddc : NULL;
 
-    sddc_mutex_lock(&sddc->lockid);
+    __sddc_lock(sddc);
 
     edgeros = __sddc_edgeros_find(sddc, uid);
     if (edgeros == NULL) {
@@ -1533,12 +5958,27 @@ sddc_connector_t *sddc_connector_create(sddc_t *sddc, const uint8_t *uid, uint16
 
     sddc_mutex_unlock(&sddc->lockid);
 
+    memcpy(connector->uid, uid, SDDC_UID_LEN);
+    connector->addr = dest_addr;
+
     connector->sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     sddc_goto_error_if_fail(connector->sockfd >= 0);
 
-    setsockopt(connector->sockfd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(struct timeval));
+    if (pooled) {
+        __sddc_connector_sockopt(connector->sockfd);
+    }
+
+    if (on_event != NULL) {
+        fcntl(connector->sockfd, F_SETFL, fcntl(connector->sockfd, F_GETFL, 0) | O_NONBLOCK);
+    } else {
+        setsockopt(connector->sockfd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(struct timeval));
+    }
 
     ret = connect(connector->sockfd, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
+    if ((ret < 0) && (on_event != NULL) && (errno == EINPROGRESS)) {
+        connector->state = SDDC_CONNECTOR_CONNECTING;
+        ret = 0;
+    }
     if (ret < 0) {
         close(connector->sockfd);
         sddc_goto_error_if_fail(ret == 0);
@@ -1546,29 +5986,254 @@ sddc_connector_t *sddc_connector_create(sddc_t *sddc, const uint8_t *uid, uint16
 
 #if SDDC_CFG_SECURITY_EN > 0
     if (token) {
-        __sddc_gen_key(token, connector->key, connector->iv);
+        /*
+         * A recent token has its key and maybe an idle context in the cache
+         */
+        __sddc_key_get(sddc, token, connector->key, connector->iv, !get_mode, &connector->crypto_ctx);
+
+        connector->crypto = sddc->crypto;
+        connector->owner  = sddc;
+        if (connector->crypto_ctx == NULL) {
+            connector->crypto_ctx = connector->crypto->create(SDDC_CRYPTO_AES_128_CBC, !get_mode, connector->key);
+        }
+        if (connector->crypto_ctx == NULL) {
+            close(connector->sockfd);
+            sddc_goto_error_if_fail(connector->crypto_ctx);
+        }
+
+        /*
+         * One CBC stream per transfer, the IV is only set at the start
+         */
+        connector->crypto->start(connector->crypto_ctx, connector->iv);
 
-        connector->cipher_info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CBC);
         connector->security_en = SDDC_TRUE;
+        connector->tx_buf      = connector->crypto_buf;
+    } else {
+        connector->security_en = SDDC_FALSE;
+    }
+#endif
+
+    return connector;
+
+error:
+    sddc_free(connector);
+    return NULL;
+}
+
+/**
+ * @brief Create a SDDC connector.
+ *
+ * @param[in] connector     Pointer to SDDC
+ * @param[in] uid           Pointer to EdgerOS UID
+ * @param[in] port          EdgerOS TCP server port
+ * @param[in] token         Pointer to token string
+ * @param[in] get_mode      Get data mode?
+ *
+ * @return Pointer to SDDC connector.
+ */
+sddc_connector_t *sddc_connector_create(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token, sddc_bool_t get_mode)
+{
+    sddc_return_value_if_fail(sddc && uid, NULL);
+
+    return __sddc_connector_create(sddc, uid, port, token, get_mode, NULL, NULL, SDDC_FALSE);
+}
+
+/**
+ * @brief Create a non-blocking SDDC connector in put mode.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] uid           Pointer to EdgerOS UID
+ * @param[in] port          EdgerOS TCP server port
+ * @param[in] token         Pointer to token string
+ * @param[in] on_event      Event callback
+ * @param[in] arg           Event callback argument
+ *
+ * @return Pointer to SDDC connector.
+ */
+sddc_connector_t *sddc_connector_create_async(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token,
+                                              sddc_on_connector_t on_event, void *arg)
+{
+    sddc_return_value_if_fail(sddc && uid && on_event, NULL);
+
+    return __sddc_connector_create(sddc, uid, port, token, SDDC_FALSE, on_event, arg, SDDC_FALSE);
+}
+
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+/*
+ * Take the idle pooled connector to the port of EdgerOS uid with the key of token, NULL if none is alive
+ */
+static sddc_connector_t *__sddc_connector_pool_get(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token)
+{
+    sddc_connector_t *connector = NULL;
+    sddc_edgeros_t   *edgeros;
+    uint8_t           peek;
+    ssize_t           ret;
+    int               i;
+#if SDDC_CFG_SECURITY_EN > 0
+    uint8_t           key[16];
+    uint8_t           iv[16];
+
+    if (token) {
+        __sddc_key_get(sddc, token, key, iv, SDDC_FALSE, NULL);
+    }
+#endif
+
+    __sddc_lock(sddc);
+
+    edgeros = __sddc_edgeros_find(sddc, uid);
+
+    for (i = 0; (edgeros != NULL) && (i < SDDC_CFG_CONNECTOR_POOL_SIZE); i++) {
+        connector = sddc->conn_pool[i];
+        if ((connector != NULL) && (connector->addr.sin_port == htons(port)) &&
+            (connector->addr.sin_addr.s_addr == edgeros->addr.sin_addr.s_addr) &&
+#if SDDC_CFG_SECURITY_EN > 0
+            (connector->security_en == (token != NULL)) &&
+            (!token || (memcmp(connector->key, key, sizeof(key)) == 0)) &&
+#endif
+            (memcmp(connector->uid, uid, SDDC_UID_LEN) == 0)) {
+            sddc->conn_pool[i] = NULL;
+            break;
+        }
+        connector = NULL;
+    }
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    if (connector != NULL) {
+        /*
+         * EdgerOS sends nothing on a put connection, readable means it is closed or broken
+         */
+        ret = recv(connector->sockfd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+        if ((ret >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+            __sddc_connector_free(connector);
+            connector = NULL;
+        }
+    }
+
+    return connector;
+}
+
+/*
+ * Keep a pooled connector whose transfer ended, the longest idle one makes room
+ */
+static void __sddc_connector_pool_put(sddc_connector_t *connector)
+{
+    sddc_t           *sddc = connector->sddc;
+    sddc_connector_t *evict;
+    int               i, slot = 0;
+
+    connector->idle_since = sddc_time_ms();
+
+    __sddc_lock(sddc);
+
+    for (i = 0; i < SDDC_CFG_CONNECTOR_POOL_SIZE; i++) {
+        if (sddc->conn_pool[i] == NULL) {
+            slot = i;
+            break;
+        }
+        if (SDDC_TIME_BEFORE_EQ(sddc->conn_pool[i]->idle_since, sddc->conn_pool[slot]->idle_since)) {
+            slot = i;
+        }
+    }
+
+    evict = sddc->conn_pool[slot];
+    sddc->conn_pool[slot] = connector;
+
+    sddc_mutex_unlock(&sddc->lockid);
+
+    if (evict != NULL) {
+        __sddc_connector_free(evict);
+    }
+}
+
+/*
+ * Close the pooled connectors idle for SDDC_CFG_CONNECTOR_IDLE (with lock)
+ */
+static void __sddc_connector_pool_expire(sddc_t *sddc, uint32_t now)
+{
+    int i;
+
+    for (i = 0; i < SDDC_CFG_CONNECTOR_POOL_SIZE; i++) {
+        if ((sddc->conn_pool[i] != NULL) &&
+            SDDC_TIME_BEFORE_EQ(sddc->conn_pool[i]->idle_since + SDDC_CFG_CONNECTOR_IDLE, now)) {
+            __sddc_connector_free(sddc->conn_pool[i]);
+            sddc->conn_pool[i] = NULL;
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Create a pooled SDDC connector in put mode.
+ *
+ * @notice Takes the idle connection to the same EdgerOS port and token if the pool keeps one.
+ *         The output is framed (4 byte big endian length, an empty frame ends the transfer),
+ *         so the EdgerOS server must read framed transfers. finish ends the transfer without
+ *         closing and sddc_connector_destroy keeps the connection in the pool, with TCP
+ *         keepalive, until it is idle for SDDC_CFG_CONNECTOR_IDLE.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] uid           Pointer to EdgerOS UID
+ * @param[in] port          EdgerOS TCP server port
+ * @param[in] token         Pointer to token string
+ * @param[in] on_event      Event callback, NULL: blocking connector
+ * @param[in] arg           Event callback argument
+ *
+ * @return Pointer to SDDC connector.
+ */
+sddc_connector_t *sddc_connector_create_pooled(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token,
+                                               sddc_on_connector_t on_event, void *arg)
+{
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    sddc_connector_t *connector;
+    int               flags;
+#endif
+
+    sddc_return_value_if_fail(sddc && uid, NULL);
+
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    connector = __sddc_connector_pool_get(sddc, uid, port, token);
+    if (connector != NULL) {
+        flags = fcntl(connector->sockfd, F_GETFL, 0);
+        fcntl(connector->sockfd, F_SETFL, on_event ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+
+#if SDDC_CFG_SECURITY_EN > 0
+        if (connector->security_en) {
+            connector->crypto->start(connector->crypto_ctx, connector->iv);
+        }
+#endif
 
-        mbedtls_cipher_init(&connector->cipher_ctx);
+        /*
+         * A non-blocking one gets SDDC_CONNECTOR_EV_CONNECTED as if it connected again
+         */
+        connector->on_event = on_event;
+        connector->arg      = arg;
+        connector->blocked  = SDDC_FALSE;
+        connector->state    = on_event ? SDDC_CONNECTOR_CONNECTING : SDDC_CONNECTOR_OPEN;
 
-        mbedtls_cipher_setup(&connector->cipher_ctx, connector->cipher_info);
+        return connector;
+    }
+#endif
 
-        mbedtls_cipher_set_iv(&connector->cipher_ctx, connector->iv, sizeof(connector->iv));
+    return __sddc_connector_create(sddc, uid, port, token, SDDC_FALSE, on_event, arg, SDDC_TRUE);
+}
 
-        mbedtls_cipher_setkey(&connector->cipher_ctx, connector->key, sizeof(connector->key) * 8,
-                              get_mode ? MBEDTLS_DECRYPT : MBEDTLS_ENCRYPT);
-    } else {
-        connector->security_en = SDDC_FALSE;
+/*
+ * Close and free a connector
+ */
+static void __sddc_connector_free(sddc_connector_t *connector)
+{
+#if SDDC_CFG_SECURITY_EN > 0
+    if (connector->security_en) {
+        __sddc_key_put(connector->owner, connector->key, !connector->get_mode, connector->crypto_ctx);
     }
 #endif
 
-    return connector;
+    if (connector->sockfd >= 0) {
+        close(connector->sockfd);
+    }
 
-error:
     sddc_free(connector);
-    return NULL;
 }
 
 /**
@@ -1582,17 +6247,14 @@ int sddc_connector_destroy(sddc_connector_t *connector)
 {
     sddc_return_value_if_fail(connector, -1);
 
-#if SDDC_CFG_SECURITY_EN > 0
-    if (connector->security_en) {
-        mbedtls_cipher_free(&connector->cipher_ctx);
+#if SDDC_CFG_CONNECTOR_POOL_SIZE > 0
+    if ((connector->sddc != NULL) && (connector->state == SDDC_CONNECTOR_DONE)) {
+        __sddc_connector_pool_put(connector);
+        return 0;
     }
 #endif
 
-    if (connector->sockfd >= 0) {
-        close(connector->sockfd);
-    }
-
-    sddc_free(connector);
+    __sddc_connector_free(connector);
 
     return 0;
 }
@@ -1625,65 +6287,284 @@ int sddc_connector_mode(sddc_connector_t *connector)
     return connector->get_mode;
 }
 
+/*
+ * Send all of a buffer on a blocking connector
+ */
+static int __sddc_connector_send(sddc_connector_t *connector, const uint8_t *data, size_t len, int flags)
+{
+    ssize_t ret;
+
+    while (len > 0) {
+        ret = send(connector->sockfd, data, len, flags);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        data += ret;
+        len  -= ret;
+    }
+
+    return 0;
+}
+
+/*
+ * Send all of the iovecs on a blocking connector, unencrypted, more: more data follows
+ */
+static int __sddc_connector_sendv(sddc_connector_t *connector, const struct iovec *iov, int iovcnt, sddc_bool_t more)
+{
+#if SDDC_SENDMSG_EN > 0
+    struct msghdr msg;
+    ssize_t       ret;
+
+    while (iovcnt > 0) {
+        bzero(&msg, sizeof(msg));
+        msg.msg_iov    = (struct iovec *)iov;
+        msg.msg_iovlen = (iovcnt > SDDC_CONNECTOR_IOV_MAX) ? SDDC_CONNECTOR_IOV_MAX : iovcnt;
+
+        ret = sendmsg(connector->sockfd, &msg, ((iovcnt > SDDC_CONNECTOR_IOV_MAX) || more) ? SDDC_MSG_MORE : 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        while ((iovcnt > 0) && ((size_t)ret >= iov->iov_len)) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (ret > 0) {
+            /*
+             * Short send (signal), the rest of this iovec goes alone
+             */
+            if (__sddc_connector_send(connector, (const uint8_t *)iov->iov_base + ret, iov->iov_len - ret,
+                                      ((iovcnt > 1) || more) ? SDDC_MSG_MORE : 0) < 0) {
+                return -1;
+            }
+            iov++;
+            iovcnt--;
+        }
+    }
+#else
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        if (__sddc_connector_send(connector, iov[i].iov_base, iov[i].iov_len,
+                                  ((i < iovcnt - 1) || more) ? SDDC_MSG_MORE : 0) < 0) {
+            return -1;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ * Frame length, big endian
+ */
+static inline void __sddc_connector_frame_len(uint8_t *buf, uint32_t len)
+{
+    buf[0] = (uint8_t)(len >> 24);
+    buf[1] = (uint8_t)(len >> 16);
+    buf[2] = (uint8_t)(len >> 8);
+    buf[3] = (uint8_t)len;
+}
+
+/*
+ * Frame the out bytes staged at tx_buf + SDDC_CONNECTOR_DATA_OFF of a pooled connector, add the
+ * empty frame if the transfer ends. Return the size of the staged output which starts at *start
+ */
+static size_t __sddc_connector_frame(sddc_connector_t *connector, size_t out, sddc_bool_t end, size_t *start)
+{
+    size_t len;
+
+    if (connector->sddc == NULL) {
+        *start = 0;
+        return out;
+    }
+
+    __sddc_connector_frame_len(connector->tx_buf, out);
+
+    len = SDDC_CONNECTOR_FRAME_HDR + out;
+    if (end) {
+        __sddc_connector_frame_len(connector->tx_buf + len, 0);
+        len += SDDC_CONNECTOR_FRAME_HDR;
+    }
+
+    *start = (out > 0) ? 0 : SDDC_CONNECTOR_FRAME_HDR;
+
+    return len - *start;
+}
+
+/*
+ * Send the iovecs as one frame on a blocking pooled connector, unencrypted
+ */
+static int __sddc_connector_sendv_framed(sddc_connector_t *connector, const struct iovec *iov, int iovcnt,
+                                         sddc_bool_t finish)
+{
+    uint8_t     *buf = connector->tx_buf;
+    struct iovec vec[SDDC_CONNECTOR_FRAME_IOV];
+    size_t       total = 0;
+    int          i;
+
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+    }
+
+    /*
+     * A put of a few iovecs leaves with its frame length and end frame by one sendmsg
+     */
+    if ((total > 0) && (iovcnt + 2 <= SDDC_CONNECTOR_FRAME_IOV)) {
+        __sddc_connector_frame_len(buf, total);
+        __sddc_connector_frame_len(buf + SDDC_CONNECTOR_FRAME_HDR, 0);
+
+        vec[0].iov_base = buf;
+        vec[0].iov_len  = SDDC_CONNECTOR_FRAME_HDR;
+        memcpy(&vec[1], iov, iovcnt * sizeof(struct iovec));
+        vec[iovcnt + 1].iov_base = buf + SDDC_CONNECTOR_FRAME_HDR;
+        vec[iovcnt + 1].iov_len  = finish ? SDDC_CONNECTOR_FRAME_HDR : 0;
+
+        return __sddc_connector_sendv(connector, vec, iovcnt + 2, SDDC_FALSE);
+    }
+
+    if (total > 0) {
+        __sddc_connector_frame_len(buf, total);
+        sddc_return_value_if_fail(__sddc_connector_send(connector, buf, SDDC_CONNECTOR_FRAME_HDR, SDDC_MSG_MORE) == 0, -1);
+        sddc_return_value_if_fail(__sddc_connector_sendv(connector, iov, iovcnt, finish) == 0, -1);
+    }
+
+    if (finish) {
+        __sddc_connector_frame_len(buf, 0);
+        sddc_return_value_if_fail(__sddc_connector_send(connector, buf, SDDC_CONNECTOR_FRAME_HDR, 0) == 0, -1);
+    }
+
+    return 0;
+}
+
+#if SDDC_CFG_SECURITY_EN > 0
+/*
+ * Encrypt the iovecs into chunks of ciphertext and send them on a blocking connector,
+ * small iovecs share a chunk
+ */
+static int __sddc_connector_sendv_crypto(sddc_connector_t *connector, const struct iovec *iov, int iovcnt,
+                                         sddc_bool_t finish)
+{
+    uint8_t       *buf = connector->tx_buf + SDDC_CONNECTOR_DATA_OFF(connector);
+    const uint8_t *data;
+    size_t         rest = 0;
+    size_t         crypto_len = 0;
+    size_t         len, in, out, start;
+    int            i;
+
+    for (i = 0; i < iovcnt; i++) {
+        rest += iov[i].iov_len;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        data = iov[i].iov_base;
+        len  = iov[i].iov_len;
+
+        while (len > 0) {
+            in = SDDC_CONNECTOR_CHUNK - crypto_len;
+            in = (len < in) ? len : in;
+
+            sddc_return_value_if_fail(connector->crypto->update(connector->crypto_ctx, data, in,
+                                                            buf + crypto_len, &out) == 0, -1);
+            crypto_len += out;
+            data       += in;
+            len        -= in;
+            rest       -= in;
+
+            if ((crypto_len >= SDDC_CONNECTOR_CHUNK) && (rest > 0)) {
+                out = __sddc_connector_frame(connector, crypto_len, SDDC_FALSE, &start);
+                sddc_return_value_if_fail(__sddc_connector_send(connector, connector->tx_buf + start, out,
+                                                                SDDC_MSG_MORE) == 0, -1);
+                crypto_len = 0;
+            }
+        }
+    }
+
+    if (finish) {
+        sddc_return_value_if_fail(connector->crypto->finish(connector->crypto_ctx, buf + crypto_len, &out) == 0, -1);
+        crypto_len += out;
+    }
+
+    out = __sddc_connector_frame(connector, crypto_len, finish, &start);
+
+    return __sddc_connector_send(connector, connector->tx_buf + start, out, 0);
+}
+#endif
+
 /**
- * @brief Put data to SDDC connector.
+ * @brief Put iovecs to SDDC connector.
  *
  * @param[in] connector     Pointer to SDDC connector
- * @param[in] data          Pointer to data buffer
- * @param[in] len           The size of data buffer
+ * @param[in] iov           Pointer to iovec array
+ * @param[in] iovcnt        The number of iovecs
  * @param[in] finish        Whether to end the transfer
  *
  * @return 0 if success, -1 if failure.
  */
-int sddc_connector_put(sddc_connector_t *connector, const void *data, size_t len, sddc_bool_t finish)
+int sddc_connector_putv(sddc_connector_t *connector, const struct iovec *iov, int iovcnt, sddc_bool_t finish)
 {
     int ret;
-    const void *put_data;
-    size_t put_len;
 
     sddc_return_value_if_fail(connector && (connector->sockfd >= 0) && !connector->get_mode, -1);
-    sddc_return_value_if_fail((!data && !len) || (data && len), -1);
-    sddc_return_value_if_fail(len <= (SDDC_CFG_SEND_BUF_SIZE - 16), -1);
+    sddc_return_value_if_fail((connector->on_event == NULL) && (connector->state == SDDC_CONNECTOR_OPEN), -1);
+    sddc_return_value_if_fail((iov && (iovcnt > 0)) || (iovcnt == 0), -1);
 
 #if SDDC_CFG_SECURITY_EN > 0
     if (connector->security_en) {
-        if (finish && !data) {
-__finish:
-            ret = mbedtls_cipher_finish(&connector->cipher_ctx, connector->crypto_buf, &put_len);
-        } else {
-            ret = mbedtls_cipher_update(&connector->cipher_ctx, data, len, connector->crypto_buf, &put_len);
-        }
-
-        sddc_return_value_if_fail(ret == 0, -1);
-
-        put_data = connector->crypto_buf;
+        ret = __sddc_connector_sendv_crypto(connector, iov, iovcnt, finish);
     } else
 #endif
-    {
-        put_data = data;
-        put_len  = len;
-    }
-
-    if (put_data && put_len) {
-        ret = send(connector->sockfd, put_data, put_len, 0);
-        sddc_return_value_if_fail(ret == put_len, -1);
+    if (connector->sddc != NULL) {
+        ret = __sddc_connector_sendv_framed(connector, iov, iovcnt, finish);
+    } else {
+        ret = __sddc_connector_sendv(connector, iov, iovcnt, SDDC_FALSE);
     }
 
-#if SDDC_CFG_SECURITY_EN > 0
-    if (connector->security_en && finish && data) {
-        data = NULL;
-        goto __finish;
-    }
-#endif
+    sddc_return_value_if_fail(ret == 0, -1);
 
     if (finish) {
-        close(connector->sockfd);
-        connector->sockfd = -1;
+        if (connector->sddc != NULL) {
+            connector->state = SDDC_CONNECTOR_DONE;         /* Kept by sddc_connector_destroy */
+        } else {
+            close(connector->sockfd);
+            connector->sockfd = -1;
+        }
     }
 
     return 0;
 }
 
+/**
+ * @brief Put data to SDDC connector.
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ * @param[in] data          Pointer to data buffer
+ * @param[in] len           The size of data buffer
+ * @param[in] finish        Whether to end the transfer
+ *
+ * @return 0 if success, -1 if failure.
+ */
+int sddc_connector_put(sddc_connector_t *connector, const void *data, size_t len, sddc_bool_t finish)
+{
+    struct iovec iov;
+
+    sddc_return_value_if_fail((!data && !len) || (data && len), -1);
+
+    iov.iov_base = (void *)data;
+    iov.iov_len  = len;
+
+    return sddc_connector_putv(connector, &iov, (len > 0) ? 1 : 0, finish);
+}
+
 /**
  * @brief Get data from SDDC connector.
  *
@@ -1726,13 +6607,13 @@ ssize_t sddc_connector_get(sddc_connector_t *connector, void **data, sddc_bool_t
             close(connector->sockfd);
             connector->sockfd = -1;
 
-            ret = mbedtls_cipher_finish(&connector->cipher_ctx, connector->crypto_buf, &len);
+            ret = connector->crypto->finish(connector->crypto_ctx, connector->crypto_buf, &len);
             sddc_return_value_if_fail(ret == 0, -1);
 
             *finish = SDDC_TRUE;
             *data = connector->crypto_buf;
         } else {
-            ret = mbedtls_cipher_update(&connector->cipher_ctx, connector->recv_buf, ret, connector->crypto_buf, &len);
+            ret = connector->crypto->update(connector->crypto_ctx, connector->recv_buf, ret, connector->crypto_buf, &len);
             sddc_return_value_if_fail(ret == 0, -1);
 
             *finish = SDDC_FALSE;
@@ -1743,3 +6624,212 @@ ssize_t sddc_connector_get(sddc_connector_t *connector, void **data, sddc_bool_t
     }
 #endif
 }
+
+/*
+ * Close a non-blocking connector and tell the application
+ */
+static void __sddc_connector_close(sddc_connector_t *connector, int event)
+{
+    close(connector->sockfd);
+    connector->sockfd   = -1;
+    connector->state    = SDDC_CONNECTOR_CLOSED;
+    connector->pend_len = 0;
+
+    connector->on_event(connector, event, connector->arg);
+}
+
+/*
+ * Send the staged output left by a short write, return -1 on error
+ */
+static int __sddc_connector_flush(sddc_connector_t *connector)
+{
+    ssize_t ret;
+
+    while (connector->pend_len > 0) {
+        ret = send(connector->sockfd, connector->tx_buf + connector->pend_off, connector->pend_len, MSG_DONTWAIT);
+        if (ret < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+
+        connector->pend_off += ret;
+        connector->pend_len -= ret;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write data to a non-blocking SDDC connector.
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ * @param[in] data          Pointer to data buffer
+ * @param[in] len           The size of data buffer
+ * @param[in] finish        Whether to end the transfer
+ *
+ * @return The size of data taken (0 if the socket is full), -1 if failure.
+ */
+ssize_t sddc_connector_write(sddc_connector_t *connector, const void *data, size_t len, sddc_bool_t finish)
+{
+    ssize_t ret;
+
+    sddc_return_value_if_fail(connector && connector->on_event && (connector->sockfd >= 0), -1);
+    sddc_return_value_if_fail((!data && !len) || (data && len), -1);
+    sddc_return_value_if_fail((connector->state == SDDC_CONNECTOR_OPEN) ||
+                              (connector->state == SDDC_CONNECTOR_CONNECTING), -1);
+
+    if (connector->state == SDDC_CONNECTOR_CONNECTING) {
+        return 0;
+    }
+
+    if (connector->tx_buf != NULL) {
+        uint8_t    *buf = connector->tx_buf + SDDC_CONNECTOR_DATA_OFF(connector);
+        size_t      out;
+        size_t      start;
+        sddc_bool_t end;
+
+        /*
+         * CBC output and frames can not be taken back, the staged output of a short write
+         * is kept and sent before more data is taken
+         */
+        sddc_return_value_if_fail(__sddc_connector_flush(connector) == 0, -1);
+        if (connector->pend_len > 0) {
+            connector->blocked = SDDC_TRUE;
+            return 0;
+        }
+
+        ret = (len > SDDC_CONNECTOR_CHUNK) ? SDDC_CONNECTOR_CHUNK : len;
+        end = finish && (ret == len);
+
+#if SDDC_CFG_SECURITY_EN > 0
+        if (connector->security_en) {
+            size_t finish_len;
+
+            out = 0;
+            if (ret > 0) {
+                sddc_return_value_if_fail(connector->crypto->update(connector->crypto_ctx, data, ret, buf, &out) == 0, -1);
+            }
+
+            if (end) {
+                sddc_return_value_if_fail(connector->crypto->finish(connector->crypto_ctx, buf + out, &finish_len) == 0, -1);
+                out += finish_len;
+            }
+        } else
+#endif
+        {
+            if (ret > 0) {
+                memcpy(buf, data, ret);
+            }
+            out = ret;
+        }
+
+        if (end) {
+            connector->state = SDDC_CONNECTOR_FINISH;
+        }
+
+        connector->pend_len = __sddc_connector_frame(connector, out, end, &start);
+        connector->pend_off = start;
+        sddc_return_value_if_fail(__sddc_connector_flush(connector) == 0, -1);
+
+        if ((connector->pend_len > 0) || (ret < len)) {
+            connector->blocked = SDDC_TRUE;
+        }
+
+        return ret;
+    }
+
+    ret = 0;
+    if (len > 0) {
+        ret = send(connector->sockfd, data, len, MSG_DONTWAIT);
+        if (ret < 0) {
+            sddc_return_value_if_fail((errno == EAGAIN) || (errno == EWOULDBLOCK), -1);
+            ret = 0;
+        }
+    }
+
+    if (ret < len) {
+        connector->blocked = SDDC_TRUE;
+    } else if (finish) {
+        connector->state = SDDC_CONNECTOR_FINISH;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Whether a non-blocking SDDC connector waits its fd writable.
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ *
+ * @return SDDC_TRUE: call sddc_connector_process when the fd is writable
+ */
+sddc_bool_t sddc_connector_want_write(sddc_connector_t *connector)
+{
+    sddc_return_value_if_fail(connector && connector->on_event, SDDC_FALSE);
+
+    return ((connector->state == SDDC_CONNECTOR_CONNECTING) || (connector->state == SDDC_CONNECTOR_FINISH) ||
+            (connector->pend_len > 0) || connector->blocked) ? SDDC_TRUE : SDDC_FALSE;
+}
+
+/**
+ * @brief Progress a non-blocking SDDC connector when its fd is writable.
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ *
+ * @return Error number
+ */
+int sddc_connector_process(sddc_connector_t *connector)
+{
+    struct sockaddr_in addr;
+    socklen_t          addrlen = sizeof(addr);
+    int                error   = 0;
+
+    sddc_return_value_if_fail(connector && connector->on_event, -1);
+
+    switch (connector->state) {
+
+    case SDDC_CONNECTOR_CONNECTING:
+        if (getpeername(connector->sockfd, (struct sockaddr *)&addr, &addrlen) == 0) {
+            connector->state = SDDC_CONNECTOR_OPEN;
+            connector->on_event(connector, SDDC_CONNECTOR_EV_CONNECTED, connector->arg);
+            return 0;
+        }
+
+        addrlen = sizeof(error);
+        getsockopt(connector->sockfd, SOL_SOCKET, SO_ERROR, &error, &addrlen);
+        if (error != 0) {
+            __sddc_connector_close(connector, SDDC_CONNECTOR_EV_ERROR);
+            return -1;
+        }
+        return 0;                                                   /* Still connecting     */
+
+    case SDDC_CONNECTOR_CLOSED:
+    case SDDC_CONNECTOR_DONE:
+        return -1;
+
+    default:
+        break;
+    }
+
+    if (__sddc_connector_flush(connector) < 0) {
+        __sddc_connector_close(connector, SDDC_CONNECTOR_EV_ERROR);
+        return -1;
+    }
+    if (connector->pend_len > 0) {
+        return 0;
+    }
+
+    if (connector->state == SDDC_CONNECTOR_FINISH) {
+        if (connector->sddc != NULL) {
+            connector->state = SDDC_CONNECTOR_DONE;         /* Kept by sddc_connector_destroy */
+            connector->on_event(connector, SDDC_CONNECTOR_EV_DONE, connector->arg);
+        } else {
+            __sddc_connector_close(connector, SDDC_CONNECTOR_EV_DONE);
+        }
+
+    } else if (connector->blocked) {
+        connector->blocked = SDDC_FALSE;
+        connector->on_event(connector, SDDC_CONNECTOR_EV_WRITABLE, connector->arg);
+    }
+
+    return 0;
+}
@@ -36,18 +36,33 @@ static const char *TAG = "smart_lock";
 
 #define GPIO_INPUT_IO_SMARTCOFNIG     12 
 
-#define ESP_KEY_TASK_STACK_SIZE       4096
-#define ESP_KEY_TASK_PRIO             25
+#define ESP_KEY_POLL_MS               50
+
+#define ESP_SMART_CONFIG_TASK_STACK_SIZE  4096
+#define ESP_SMART_CONFIG_TASK_PRIO        5
 
 #define ESP_SDDC_TASK_STACK_SIZE      4096
 #define ESP_SDDC_TASK_PRIO            10
 
-#define ESP_CONNECTOR_TASK_STACK_SIZE 4096
-#define ESP_CONNECTOR_TASK_PRIO       20
+#define ESP_IMAGE_PUT_MAX             4
+
+/*
+ * 1: keep the image connections to EdgerOS in the connector pool (framed transfers,
+ * the EdgerOS connector server must read them), 0: one connection per image
+ */
+#define ESP_IMAGE_POOL_EN             0
 
 static camera_pixelformat_t s_pixel_format;
 
-static QueueHandle_t conn_mqueue_handle;
+/* Image transfer to a EdgerOS connector server */
+typedef struct {
+    sddc_connector_t *conn;
+    const uint8_t *data;
+    size_t size;
+    size_t off;
+} esp_image_put_t;
+
+static esp_image_put_t image_puts[ESP_IMAGE_PUT_MAX];
 
 static TimerHandle_t lock_timer_handle;
 
@@ -55,25 +70,44 @@ static TimerHandle_t lock_timer_handle;
 #define min(a, b)  ((a) < (b) ? (a) : (b))
 #endif
 
+#ifndef max
+#define max(a, b)  ((a) > (b) ? (a) : (b))
+#endif
+
 #define CAMERA_PIXEL_FORMAT CAMERA_PF_JPEG
 #define CAMERA_FRAME_SIZE   CAMERA_FS_SVGA
 
 static struct timeval last_capture_time;
 
 /*
- * Send image to connector
+ * A transfer reads the camera frame buffer
  */
-static void esp_send_image(sddc_connector_t *conn)
+static sddc_bool_t esp_image_busy(void)
+{
+    int i;
+
+    for (i = 0; i < ESP_IMAGE_PUT_MAX; i++) {
+        if (image_puts[i].conn != NULL) {
+            return SDDC_TRUE;
+        }
+    }
+
+    return SDDC_FALSE;
+}
+
+/*
+ * Capture a new picture if the last one is old, not while a transfer reads it
+ */
+static void esp_image_capture(void)
 {
-    void *data;
-    size_t size;
-    size_t totol_len = 0;
-    size_t len;
-    int ret;
     struct timeval cur_time;
     struct timeval diff_time;
     long diff_msec;
 
+    if (esp_image_busy()) {
+        return;
+    }
+
     gettimeofday(&cur_time, NULL);
 
     timersub(&cur_time, &last_capture_time, &diff_time);
@@ -82,44 +116,92 @@ static void esp_send_image(sddc_connector_t *conn)
         camera_run();
         last_capture_time = cur_time;
     }
+}
 
-    data = camera_get_fb();
-    size = camera_get_data_size();
-
-    while (totol_len < size) {
-        len = min((size - totol_len), (1460 - 16));
-
-        ret = sddc_connector_put(conn, data, len, (totol_len + len) == size);
-        if (ret < 0) {
-            sddc_printf("Failed to put!\n");
+/*
+ * Put image to connector until the socket is full
+ */
+static void esp_image_write(esp_image_put_t *put)
+{
+    ssize_t len;
+
+    while (put->off < put->size) {
+        len = sddc_connector_write(put->conn, put->data + put->off, put->size - put->off, SDDC_TRUE);
+        if (len < 0) {
+            /*
+             * The connector will not be writable again, free the transfer slot
+             */
+            sddc_printf("Failed to put image, put %d byte!\n", put->off);
+            sddc_connector_destroy(put->conn);
+            put->conn = NULL;
             break;
         }
-        totol_len += len;
-        data += len;
-
-        sddc_printf("Put %d byte\n", len);
+        if (len == 0) {
+            break;
+        }
+        put->off += len;
     }
+}
 
-    sddc_printf("Total put %d byte\n", totol_len);
+/*
+ * Image connector event
+ */
+static void esp_on_image_put(sddc_connector_t *conn, int event, void *arg)
+{
+    esp_image_put_t *put = arg;
+
+    switch (event) {
+
+    case SDDC_CONNECTOR_EV_CONNECTED:
+    case SDDC_CONNECTOR_EV_WRITABLE:
+        esp_image_write(put);
+        break;
+
+    case SDDC_CONNECTOR_EV_DONE:
+        sddc_printf("Total put %d byte\n", put->off);
+        sddc_connector_destroy(conn);
+        put->conn = NULL;
+        break;
+
+    default:
+        sddc_printf("Failed to put image, put %d byte!\n", put->off);
+        sddc_connector_destroy(conn);
+        put->conn = NULL;
+        break;
+    }
 }
 
 /*
- * sddc connector task
+ * Add the image connectors which wait writable to wfds
  */
-static void esp_connector_task(void *arg)
+static void esp_image_fds(fd_set *wfds, int *max_fd)
 {
-    sddc_connector_t *conn;
-    BaseType_t ret;
+    int i, fd;
 
-    while (1) {
-        ret = xQueueReceive(conn_mqueue_handle, &conn, portMAX_DELAY);
-        if (ret == pdTRUE) {
-            esp_send_image(conn);
-            sddc_connector_destroy(conn);
+    for (i = 0; i < ESP_IMAGE_PUT_MAX; i++) {
+        if ((image_puts[i].conn != NULL) && sddc_connector_want_write(image_puts[i].conn)) {
+            fd = sddc_connector_fd(image_puts[i].conn);
+            FD_SET(fd, wfds);
+            *max_fd = max(fd, *max_fd);
         }
     }
+}
 
-    vTaskDelete(NULL);
+/*
+ * Progress the image connectors which are writable
+ */
+static void esp_image_process(fd_set *wfds)
+{
+    int i, fd;
+
+    for (i = 0; i < ESP_IMAGE_PUT_MAX; i++) {
+        if (image_puts[i].conn != NULL) {
+            fd = sddc_connector_fd(image_puts[i].conn);
+            if ((fd >= 0) && FD_ISSET(fd, wfds)) {
+                sddc_connector_process(image_puts[i].conn);
+            }
+        }
+    }
 }
 
 /*
@@ -130,15 +212,148 @@ static void esp_lock_timer_callback(TimerHandle_t handle)
     sddc_printf("Close the door!\n");
 }
 
+#if SDDC_CFG_CBOR_EN > 0
+/*
+ * Check and print CBOR data
+ */
+static sddc_bool_t esp_cbor_print(const char *tag, const char *data, size_t len)
+{
+    sddc_cbor_reader_t reader;
+    char str[256];
+
+    sddc_cbor_reader_init(&reader, data, len);
+    sddc_return_value_if_fail(sddc_cbor_skip(&reader) == 0, SDDC_FALSE);
+
+    if (sddc_cbor_to_json(data, len, str, sizeof(str)) >= 0) {
+        sddc_printf("%s: %s\n", tag, str);
+    }
+
+    return SDDC_TRUE;
+}
+#endif
+
+/*
+ * Open the door
+ */
+static void esp_lock_open(uint32_t timeout_ms)
+{
+    if (timeout_ms < 2000) {
+        timeout_ms = 2000;
+    }
+
+    xTimerChangePeriod(lock_timer_handle, timeout_ms / portTICK_RATE_MS, 1);
+    xTimerStart(lock_timer_handle, 0);
+
+    sddc_printf("Open the door, timeout %dms!\n", timeout_ms);
+}
+
+/*
+ * Send image to EdgerOS connector server, the transfer goes on from the SDDC task loop
+ */
+static int esp_connector_start(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token)
+{
+    esp_image_put_t *put = NULL;
+    int i;
+
+    for (i = 0; i < ESP_IMAGE_PUT_MAX; i++) {
+        if (image_puts[i].conn == NULL) {
+            put = &image_puts[i];
+            break;
+        }
+    }
+    sddc_return_value_if_fail(put, -1);
+
+    esp_image_capture();
+
+    put->data = camera_get_fb();
+    put->size = camera_get_data_size();
+    put->off  = 0;
+#if ESP_IMAGE_POOL_EN > 0
+    put->conn = sddc_connector_create_pooled(sddc, uid, port, token, esp_on_image_put, put);
+#else
+    put->conn = sddc_connector_create_async(sddc, uid, port, token, esp_on_image_put, put);
+#endif
+    sddc_return_value_if_fail(put->conn, -1);
+
+    return 0;
+}
+
+#if SDDC_CFG_CBOR_EN > 0
+/*
+ * Handle MESSAGE in CBOR, decoded in place
+ */
+static sddc_bool_t esp_on_cbor_message(sddc_t *sddc, const uint8_t *uid, const char *message, size_t len)
+{
+    sddc_cbor_reader_t reader, map, connector;
+    sddc_cbor_item_t root, cmd, item;
+    char token[64];
+    size_t count;
+
+    esp_cbor_print("esp_on_message", message, len);
+
+    sddc_cbor_reader_init(&reader, message, len);
+    sddc_return_value_if_fail(sddc_cbor_read(&reader, &root) == 0 && root.type == SDDC_CBOR_MAP, SDDC_TRUE);
+    map = reader;
+
+    if (sddc_cbor_map_find(&map, root.len, "cmd", &cmd, NULL) < 0) {
+        sddc_printf("Command no specify!\n");
+        return SDDC_TRUE;
+    }
+
+    if (sddc_cbor_text_is(&cmd, "unlock")) {
+        if ((sddc_cbor_map_find(&map, root.len, "timeout", &item, NULL) == 0) &&
+            ((item.type == SDDC_CBOR_INT) || (item.type == SDDC_CBOR_FLOAT))) {
+            esp_lock_open((item.integer > 0) ? (uint32_t)item.integer : 0);
+        } else {
+            esp_lock_open(5000);
+        }
+        return SDDC_TRUE;
+
+    } else if (!sddc_cbor_text_is(&cmd, "recv")) {
+        sddc_printf("Command no support!\n");
+        return SDDC_TRUE;
+    }
+
+    sddc_return_value_if_fail(sddc_cbor_map_find(&map, root.len, "connector", &item, &connector) == 0, SDDC_TRUE);
+    sddc_return_value_if_fail(item.type == SDDC_CBOR_MAP, SDDC_TRUE);
+    count = item.len;
+
+    sddc_return_value_if_fail(sddc_cbor_map_find(&connector, count, "port", &item, NULL) == 0, SDDC_TRUE);
+    sddc_return_value_if_fail(item.type == SDDC_CBOR_INT, SDDC_TRUE);
+    uint16_t port = item.integer;
+
+    /*
+     * Strings are not NUL terminated in the CBOR data
+     */
+    if (sddc_cbor_map_find(&connector, count, "token", &item, NULL) == 0) {
+        sddc_return_value_if_fail(item.type == SDDC_CBOR_TEXT && item.len < sizeof(token), SDDC_TRUE);
+        memcpy(token, item.str, item.len);
+        token[item.len] = '\0';
+        esp_connector_start(sddc, uid, port, token);
+    } else {
+        esp_connector_start(sddc, uid, port, NULL);
+    }
+
+    return SDDC_TRUE;
+}
+#endif
+
 /*
  * Handle MESSAGE
  */
 static sddc_bool_t esp_on_message(sddc_t *sddc, const uint8_t *uid, const char *message, size_t len)
 {
-    cJSON *root = cJSON_Parse(message);
+    cJSON *root;
     cJSON *cmd;
     char *str;
 
+#if SDDC_CFG_CBOR_EN > 0
+    if (sddc_payload_is_cbor(sddc)) {
+        return esp_on_cbor_message(sddc, uid, message, len);
+    }
+#endif
+
+    root = cJSON_Parse(message);
     sddc_return_value_if_fail(root, SDDC_TRUE);
 
     str = cJSON_Print(root);
@@ -157,17 +372,11 @@ static sddc_bool_t esp_on_message(sddc_t *sddc, const uint8_t *uid, const char *
 
             if (timeout && cJSON_IsNumber(timeout)) {
                 timeout_ms = timeout->valuedouble;
-                if (timeout_ms < 2000) {
-                    timeout_ms = 2000;
-                }
             } else {
                 timeout_ms = 5000;
             }
 
-            xTimerChangePeriod(lock_timer_handle, timeout_ms / portTICK_RATE_MS, 1);
-            xTimerStart(lock_timer_handle, 0);
-
-            sddc_printf("Open the door, timeout %dms!\n", timeout_ms);
+            esp_lock_open(timeout_ms);
             goto done;
         } else {
             sddc_printf("Command no support!\n");
@@ -183,14 +392,7 @@ static sddc_bool_t esp_on_message(sddc_t *sddc, const uint8_t *uid, const char *
         cJSON *token = cJSON_GetObjectItem(connector, "token");
         sddc_goto_error_if_fail(!token || cJSON_IsString(token));
 
-        sddc_connector_t *conn = sddc_connector_create(sddc, uid, port->valuedouble, token ? token->valuestring : NULL, SDDC_FALSE);
-        sddc_goto_error_if_fail(conn);
-
-        int ret = xQueueSend(conn_mqueue_handle, &conn, 0);
-        if (ret != pdTRUE) {
-            sddc_connector_destroy(conn);
-            sddc_goto_error_if_fail(ret == pdTRUE);
-        }
+        esp_connector_start(sddc, uid, port->valuedouble, token ? token->valuestring : NULL);
     } else {
         sddc_printf("Command no specify!\n");
     }
@@ -228,9 +430,16 @@ static void esp_on_edgeros_lost(sddc_t *sddc, const uint8_t *uid)
  */
 static sddc_bool_t esp_on_update(sddc_t *sddc, const uint8_t *uid, const char *udpate_data, size_t len)
 {
-    cJSON *root = cJSON_Parse(udpate_data);
+    cJSON *root;
     char *str;
 
+#if SDDC_CFG_CBOR_EN > 0
+    if (sddc_payload_is_cbor(sddc)) {
+        return esp_cbor_print("esp_on_update", udpate_data, len);
+    }
+#endif
+
+    root = cJSON_Parse(udpate_data);
     sddc_return_value_if_fail(root, SDDC_FALSE);
 
     /*
@@ -258,9 +467,16 @@ error:
  */
 static sddc_bool_t esp_on_invite(sddc_t *sddc, const uint8_t *uid, const char *invite_data, size_t len)
 {
-    cJSON *root = cJSON_Parse(invite_data);
+    cJSON *root;
     char *str;
 
+#if SDDC_CFG_CBOR_EN > 0
+    if (sddc_payload_is_cbor(sddc)) {
+        return esp_cbor_print("esp_on_invite", invite_data, len);
+    }
+#endif
+
+    root = cJSON_Parse(invite_data);
     sddc_return_value_if_fail(root, SDDC_FALSE);
 
     /*
@@ -382,59 +598,120 @@ static char *esp_invite_data_create(void)
 }
 
 /*
- * key task
+ * Take a picture and tell EdgerOS to receive it
  */
-static void esp_key_task(void *arg)
+static void esp_picture_notify(sddc_t *sddc)
 {
-    sddc_t *sddc = arg;
-    int i = 0;
+#if SDDC_CFG_CBOR_EN > 0
+    sddc_cbor_writer_t writer;
+    uint8_t cbor[32];
+    size_t size;
+    int ret;
 
-    while (1) {
-        vTaskDelay(50 / portTICK_RATE_MS);
+    if (esp_image_busy()) {
+        sddc_printf("Picture transfer in progress, try later!\n");
+        return;
+    }
 
-        if (!gpio_get_level(GPIO_INPUT_IO_SMARTCOFNIG)) {
-            i++;
-            if (i > (3 * 20)) {
-                i = 0;
-                sddc_printf("Start SmartConfig....\n");
-                example_smart_config();
-            }
-        } else {
-            if (i > 0) {
-                cJSON *root = NULL;
-                char *str;
-                size_t size;
-                int ret;
+    ret = camera_run();
+    sddc_return_if_fail(ret == ESP_OK);
+
+    gettimeofday(&last_capture_time, NULL);
+
+    size = camera_get_data_size();
+
+    /*
+     * Sent as JSON to EdgerOS which do not take CBOR
+     */
+    sddc_cbor_writer_init(&writer, cbor, sizeof(cbor));
+    sddc_cbor_put_map(&writer, 2);
+    sddc_cbor_put_text(&writer, "cmd", 3);
+    sddc_cbor_put_text(&writer, "recv", 4);
+    sddc_cbor_put_text(&writer, "size", 4);
+    sddc_cbor_put_int(&writer, size);
+    sddc_return_if_fail(sddc_cbor_writer_len(&writer) > 0);
+
+    sddc_printf("Send picture to EdgerOS, file size %d\n", size);
+
+    sddc_broadcast_cbor_message(sddc, cbor, sddc_cbor_writer_len(&writer), 1, SDDC_FALSE, NULL);
+#else
+    cJSON *root = NULL;
+    char *str;
+    size_t size;
+    int ret;
+
+    if (esp_image_busy()) {
+        sddc_printf("Picture transfer in progress, try later!\n");
+        return;
+    }
 
-                ret = camera_run();
-                sddc_goto_error_if_fail(ret == ESP_OK);
+    ret = camera_run();
+    sddc_goto_error_if_fail(ret == ESP_OK);
 
-                gettimeofday(&last_capture_time, NULL);
-                
-                size = camera_get_data_size();
+    gettimeofday(&last_capture_time, NULL);
 
-                root = cJSON_CreateObject();
-                sddc_goto_error_if_fail(root);
+    size = camera_get_data_size();
 
-                cJSON_AddStringToObject(root, "cmd", "recv");
-                cJSON_AddNumberToObject(root, "size", size);
+    root = cJSON_CreateObject();
+    sddc_goto_error_if_fail(root);
 
-                sddc_printf("Send picture to EdgerOS, file size %d\n", size);
+    cJSON_AddStringToObject(root, "cmd", "recv");
+    cJSON_AddNumberToObject(root, "size", size);
 
-                str = cJSON_Print(root);
-                sddc_goto_error_if_fail(str);
+    sddc_printf("Send picture to EdgerOS, file size %d\n", size);
 
-                sddc_broadcast_message(sddc, str, strlen(str), 1, SDDC_FALSE, NULL);
-                cJSON_free(str);
+    str = cJSON_Print(root);
+    sddc_goto_error_if_fail(str);
+
+    sddc_broadcast_message(sddc, str, strlen(str), 1, SDDC_FALSE, NULL);
+    cJSON_free(str);
 
 error:
-                cJSON_Delete(root);
-            }
+    cJSON_Delete(root);
+#endif
+}
+
+static volatile sddc_bool_t smart_config_running;
+
+/*
+ * SmartConfig task, example_smart_config() waits until ESPTouch is done
+ */
+static void esp_smart_config_task(void *arg)
+{
+    example_smart_config();
+
+    smart_config_running = SDDC_FALSE;
+
+    vTaskDelete(NULL);
+}
+
+/*
+ * Poll key every ESP_KEY_POLL_MS, SmartConfig runs in its own task to keep the SDDC loop going
+ */
+static void esp_key_poll(sddc_t *sddc)
+{
+    static int i = 0;
+
+    if (!gpio_get_level(GPIO_INPUT_IO_SMARTCOFNIG)) {
+        i++;
+        if (i > (3 * 1000 / ESP_KEY_POLL_MS)) {
             i = 0;
+            if (!smart_config_running) {
+                sddc_printf("Start SmartConfig....\n");
+                smart_config_running = SDDC_TRUE;
+                if (xTaskCreate(esp_smart_config_task, "smart_config", ESP_SMART_CONFIG_TASK_STACK_SIZE,
+                                NULL, ESP_SMART_CONFIG_TASK_PRIO, NULL) != pdPASS) {
+                    sddc_printf("Failed to start SmartConfig!\n");
+                    smart_config_running = SDDC_FALSE;
+                }
+            }
+        }
+    } else {
+        if (i > 0) {
+            esp_picture_notify(sddc);
         }
+        i = 0;
     }
-
-    vTaskDelete(NULL);
 }
 
 /*
@@ -447,6 +724,8 @@ static void esp_sddc_task(void *arg)
     uint8_t mac[6];
     char ip[sizeof("255.255.255.255")];
     tcpip_adapter_ip_info_t ip_info = { 0 };
+    TickType_t key_time;
+    int fd;
 
     /*
      * Set call backs
@@ -498,14 +777,37 @@ static void esp_sddc_task(void *arg)
     sddc_printf("IP addr: %s\n", ip);
 
     /*
-     * SDDC run
+     * SDDC, key and image transfers share this task
      */
+    sddc_printf("SDDC running...\n");
+
+    fd = sddc_get_fd(sddc);
+    key_time = xTaskGetTickCount();
+
     while (1) {
-        sddc_printf("SDDC running...\n");
+        uint32_t timeout = min(sddc_next_deadline_ms(sddc), ESP_KEY_POLL_MS);
+        struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+        fd_set rfds, wfds;
+        int max_fd = fd;
+
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(fd, &rfds);
+        esp_image_fds(&wfds, &max_fd);
+
+        if (select(max_fd + 1, &rfds, &wfds, NULL, &tv) > 0) {
+            if (FD_ISSET(fd, &rfds)) {
+                sddc_process_readable(sddc);
+            }
+            esp_image_process(&wfds);
+        }
 
-        sddc_run(sddc);
+        sddc_process_timers(sddc);
 
-        sddc_printf("SDDC quit!\n");
+        if ((xTaskGetTickCount() - key_time) >= (ESP_KEY_POLL_MS / portTICK_RATE_MS)) {
+            key_time = xTaskGetTickCount();
+            esp_key_poll(sddc);
+        }
     }
 
     /*
@@ -628,8 +930,6 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_gpio_init());
     ESP_ERROR_CHECK(esp_cam_init());
 
-    conn_mqueue_handle = xQueueCreate(4, sizeof(sddc_connector_t *));
-
     lock_timer_handle  = xTimerCreate("lock_timer",
                                       2000 / portTICK_RATE_MS,
                                       pdFALSE,
@@ -641,6 +941,4 @@ void app_main(void)
     sddc_t *sddc = sddc_create(SDDC_CFG_PORT);
 
     xTaskCreate(esp_sddc_task, "sddc_task", ESP_SDDC_TASK_STACK_SIZE, sddc, ESP_SDDC_TASK_PRIO, NULL);
-    xTaskCreate(esp_key_task, "key_task", ESP_KEY_TASK_STACK_SIZE, sddc, ESP_KEY_TASK_PRIO, NULL);
-    xTaskCreate(esp_connector_task, "connector_task1", ESP_CONNECTOR_TASK_STACK_SIZE, sddc, ESP_CONNECTOR_TASK_PRIO, NULL);
 }
@@ -98,6 +98,13 @@ typedef uint8_t sddc_bool_t;
  * void *sddc_malloc(size_t size);
  * void  sddc_free(void *ptr);
  *
+ * uint32_t sddc_time_ms(void);     (Monotonic milliseconds, may wrap)
+ * uint32_t sddc_time_us(void);     (Monotonic microseconds, may wrap, SDDC_CFG_STATS_EN only)
+ * uint32_t sddc_random(void);      (Differs from boot to boot)
+ *
+ * uint32_t sddc_trace_clock(void);     (Free running cycle or time counter, SDDC_CFG_TRACE_EN only)
+ * uint32_t sddc_trace_clock_khz(void); (Its rate, kHz)
+ *
  * int sddc_mutex_create(sddc_mutex_t *mutex);
  * int sddc_mutex_destroy(sddc_mutex_t mutex);
  * int sddc_mutex_lock(sddc_mutex_t mutex);
@@ -213,12 +220,181 @@ typedef uint8_t sddc_bool_t;
 /* Header uid length */
 #define SDDC_UID_LEN     8
 
+/* Message pool size classes: small, medium, MTU */
+#define SDDC_MPOOL_CLASS_NR     3
+
 struct sddc_context;
 typedef struct sddc_context sddc_t;
 
 struct sddc_connector;
 typedef struct sddc_connector sddc_connector_t;
 
+#if SDDC_CFG_STATS_EN > 0
+#define SDDC_STATS_TYPE_NR      8   /* Packet types counted, DISCOVER ~ TIMESTAMP */
+#define SDDC_STATS_RTT_NR       12  /* Ack RTT histogram buckets */
+
+/* Counters of all EdgerOS or of one EdgerOS */
+typedef struct {
+    uint32_t    rx_packets[SDDC_STATS_TYPE_NR]; /* By packet type, requests and responds */
+    uint32_t    tx_packets[SDDC_STATS_TYPE_NR]; /* By packet type, retransmits included */
+    uint32_t    retransmits;    /* Requests sent again after their RTO */
+    uint32_t    lost;           /* Requests lost (on_message_lost) */
+    uint32_t    decrypt_fail;   /* Payloads failing decryption or the GCM tag */
+    uint32_t    duplicates;     /* Requests received again: answered from the reply cache or dropped */
+    uint32_t    reply_requests; /* UPDATE, INVITE and MESSAGE requests looked up in the reply cache */
+    uint32_t    reply_hits;     /* Retransmitted requests answered from the reply cache */
+    uint32_t    tx_bytes;       /* Bytes sent, headers included */
+    uint16_t    mqueue_high_water;
+    /* Ack RTT of the requests sent once, bucket 0: < 1 MS, n: 2^(n-1) ~ 2^n - 1 MS, the last one: more */
+    uint32_t    rtt_hist[SDDC_STATS_RTT_NR];
+} sddc_stats_counters_t;
+
+/* Message pool class statistics */
+typedef struct {
+    uint16_t    size;           /* Packet size of the class */
+    uint16_t    total;          /* Number of messages of the class */
+    uint16_t    used;           /* Number of messages in use */
+    uint16_t    high_water;     /* Max number of messages in use */
+    uint32_t    exhausted;      /* Allocations that found the class empty */
+} sddc_mpool_class_stat_t;
+
+/* Engine statistics */
+typedef struct {
+    sddc_stats_counters_t total;    /* All EdgerOS, the ones gone included */
+    sddc_mpool_class_stat_t mpool[SDDC_MPOOL_CLASS_NR];
+    uint16_t    mpool_heap_used;        /* Messages allocated from heap in use */
+    uint16_t    mpool_heap_high_water;  /* Max number of messages allocated from heap in use */
+    uint32_t    mpool_alloc_fail;       /* Message allocations that failed */
+    uint32_t    tx_copy_bytes;  /* Payload bytes copied by the transmit path */
+    uint32_t    discovers;      /* DISCOVER from not joined EdgerOS */
+    uint32_t    discover_reports;   /* REPORT sent in respond */
+    uint32_t    discover_coalesced; /* DISCOVER merged into a pending REPORT */
+    uint32_t    discover_limited;   /* DISCOVER dropped by the source rate limit */
+    uint32_t    lock_count;     /* SDDC lock taken */
+    uint64_t    lock_wait_us;   /* Time waited for the SDDC lock */
+    uint32_t    callback_count; /* Application callbacks called */
+    uint64_t    callback_us;    /* Time spent in application callbacks */
+    uint16_t    edgeros_count;  /* EdgerOS statistics filled in */
+} sddc_stats_t;
+
+/* EdgerOS statistics, since it was found */
+typedef struct {
+    uint8_t     uid[SDDC_UID_LEN];
+    sddc_stats_counters_t counters;
+} sddc_edgeros_stats_t;
+#endif
+
+/*
+ * Trace dump (sddc_trace_dump): a header then the records, oldest first, in the byte order
+ * of the device. Read by the sddc_trace host tool, so it is defined whatever SDDC_CFG_TRACE_EN
+ */
+#define SDDC_TRACE_MAGIC        0x52544453U /* "SDTR" */
+#define SDDC_TRACE_VERSION      1U
+
+/* Trace points of the receive pipeline */
+typedef enum {
+    SDDC_TRACE_READ = 1,        /* Datagrams read (seqno: how many), the lock is not taken yet */
+    SDDC_TRACE_LOCK,            /* SDDC lock taken */
+    SDDC_TRACE_PACKET,          /* Packet handle begin (type, seqno of the packet) */
+    SDDC_TRACE_UNPACK,          /* Payload decrypt and decompress begin */
+    SDDC_TRACE_UNPACKED,        /* Payload decrypt and decompress end */
+    SDDC_TRACE_CALLOUT,         /* Application callback, lock released */
+    SDDC_TRACE_CALLOUT_END,     /* Application callback returned, lock taken */
+    SDDC_TRACE_SEND,            /* Datagram sent or batched (type, seqno of the datagram) */
+    SDDC_TRACE_DONE,            /* Datagrams handled, batch flushed, the lock is released next */
+} sddc_trace_point_t;
+
+typedef struct {
+    uint32_t    magic;          /* SDDC_TRACE_MAGIC */
+    uint16_t    version;        /* SDDC_TRACE_VERSION */
+    uint16_t    record_size;    /* sizeof(sddc_trace_t) */
+    uint32_t    clock_khz;      /* Rate of the record time */
+    uint32_t    count;          /* Records following */
+    uint32_t    lost;           /* Records overwritten or not fitting since the last dump */
+} sddc_trace_header_t;
+
+typedef struct {
+    uint32_t    time;           /* sddc_trace_clock(), wraps */
+    uint8_t     point;          /* sddc_trace_point_t */
+    uint8_t     type;           /* Packet type, 0 if none */
+    uint16_t    seqno;
+} sddc_trace_t;
+
+#if SDDC_CFG_SECURITY_EN > 0
+/* Crypto backend cipher modes, AES-128 with the key of the token */
+#define SDDC_CRYPTO_AES_128_CBC 0   /* PKCS7 padding */
+#define SDDC_CRYPTO_AES_128_GCM 1
+
+/* One buffer of a multi-buffer operation */
+typedef struct {
+    const void *input;
+    size_t      len;
+    void       *output;         /* len + 16 bytes */
+    size_t      olen;           /* Output length (out) */
+} sddc_crypto_buf_t;
+
+/*
+ * Crypto backend. A context is for one cipher mode and direction (GCM contexts do both),
+ * the key schedule is expanded when it is created. Functions return 0 if success.
+ */
+typedef struct {
+    const char *name;
+    void *(*create)(int mode, sddc_bool_t encrypt, const uint8_t *key);
+    void  (*destroy)(void *ctx);
+    /* CBC: one message with the IV */
+    int   (*crypt)(void *ctx, const uint8_t *iv, const void *input, size_t len, void *output, size_t *olen);
+    /* CBC: independent messages with the same IV, NULL: crypt of each */
+    int   (*crypt_multi)(void *ctx, const uint8_t *iv, sddc_crypto_buf_t *bufs, int count);
+    /* CBC: one message in pieces, start sets the IV */
+    int   (*start)(void *ctx, const uint8_t *iv);
+    int   (*update)(void *ctx, const void *input, size_t len, void *output, size_t *olen);
+    int   (*finish)(void *ctx, void *output, size_t *olen);
+    /* GCM: output has len bytes, open fails if the tag does not match */
+    int   (*seal)(void *ctx, const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                  const void *input, size_t len, void *output, uint8_t *tag, size_t tag_len);
+    int   (*open)(void *ctx, const uint8_t *nonce, size_t nonce_len, const uint8_t *aad, size_t aad_len,
+                  const void *input, size_t len, void *output, const uint8_t *tag, size_t tag_len);
+} sddc_crypto_ops_t;
+
+/* Default backend, mbedtls cipher layer (the AES peripheral on ESP32 when mbedtls uses it) */
+extern const sddc_crypto_ops_t sddc_crypto_mbedtls;
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+/* CBOR item types */
+#define SDDC_CBOR_INT       0   /* Unsigned or negative integer */
+#define SDDC_CBOR_BYTES     1
+#define SDDC_CBOR_TEXT      2
+#define SDDC_CBOR_ARRAY     3
+#define SDDC_CBOR_MAP       4
+#define SDDC_CBOR_BOOL      5
+#define SDDC_CBOR_NULL      6   /* Null or undefined */
+#define SDDC_CBOR_FLOAT     7
+
+/* CBOR encoder, writes into the caller buffer */
+typedef struct {
+    uint8_t        *buf;
+    size_t          size;
+    size_t          len;
+    sddc_bool_t     error;      /* The buffer overflowed */
+} sddc_cbor_writer_t;
+
+/* CBOR decoder, reads the data in place */
+typedef struct {
+    const uint8_t  *pos;
+    const uint8_t  *end;
+} sddc_cbor_reader_t;
+
+/* CBOR item */
+typedef struct {
+    uint8_t         type;       /* SDDC_CBOR_* */
+    int64_t         integer;    /* INT, BOOL, FLOAT truncated */
+    double          number;     /* INT, FLOAT */
+    const char     *str;        /* BYTES, TEXT: in the CBOR data, not NUL terminated */
+    size_t          len;        /* BYTES, TEXT length, ARRAY, MAP count */
+} sddc_cbor_item_t;
+#endif
+
 /**
  * @brief Callback function on receive INVITE request.
  *
@@ -256,6 +432,8 @@ typedef sddc_bool_t (*sddc_on_update_t)(sddc_t *sddc, const uint8_t *uid, const
 /**
  * @brief Callback function on receive MESSAGE request.
  *
+ * @notice A fragmented message is called once, when every fragment is received
+ *
  * @param[in] uid           Pointer to EdgerOS UID
  * @param[in] message       Pointer to message data
  * @param[in] len           The length of message data
@@ -281,6 +459,15 @@ typedef void (*sddc_on_message_ack_t)(sddc_t *sddc, const uint8_t *uid, uint16_t
  */
 typedef void (*sddc_on_message_lost_t)(sddc_t *sddc, const uint8_t *uid, uint16_t seqno);
 
+/**
+ * @brief Callback function on EdgerOS message queue has room again.
+ *
+ * @notice Only called after a send failed because the send queue or a message queue was full
+ *
+ * @param[in] uid           Pointer to EdgerOS UID, NULL if the send queue has room again
+ */
+typedef void (*sddc_on_message_ready_t)(sddc_t *sddc, const uint8_t *uid);
+
 /**
  * @brief Callback function on receive TIMESTAMP respond.
  *
@@ -297,6 +484,24 @@ typedef void (*sddc_on_timestamp_t)(sddc_t *sddc, const uint8_t *uid, const char
  */
 typedef void (*sddc_on_edgeros_lost_t)(sddc_t *sddc, const uint8_t *uid);
 
+/* Non-blocking connector events */
+#define SDDC_CONNECTOR_EV_CONNECTED 0   /* Connected, data can be written */
+#define SDDC_CONNECTOR_EV_WRITABLE  1   /* A short write can be continued */
+#define SDDC_CONNECTOR_EV_DONE      2   /* The transfer is finished and sent, the socket is closed (kept if pooled) */
+#define SDDC_CONNECTOR_EV_ERROR     3   /* Connect or send failed, the socket is closed */
+
+/**
+ * @brief Callback function on non-blocking connector event.
+ *
+ * @notice Called from sddc_connector_process, the connector can be destroyed on
+ *         SDDC_CONNECTOR_EV_DONE and SDDC_CONNECTOR_EV_ERROR
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ * @param[in] event         SDDC_CONNECTOR_EV_*
+ * @param[in] arg           Argument given to sddc_connector_create_async or sddc_connector_create_pooled
+ */
+typedef void (*sddc_on_connector_t)(sddc_connector_t *connector, int event, void *arg);
+
 /**
  * @brief Set device uniquely id.
  *
@@ -347,6 +552,16 @@ int sddc_set_on_message_ack(sddc_t *sddc, sddc_on_message_ack_t on_message_ack);
  */
 int sddc_set_on_message_lost(sddc_t *sddc, sddc_on_message_lost_t on_message_lost);
 
+/**
+ * @brief Set callback function of on EdgerOS message queue has room again.
+ *
+ * @param[in] sddc              Pointer to SDDC
+ * @param[in] on_message_ready  callback function
+ *
+ * @return Error number
+ */
+int sddc_set_on_message_ready(sddc_t *sddc, sddc_on_message_ready_t on_message_ready);
+
 /**
  * @brief Set callback function of on EdgerOS disconnection.
  *
@@ -430,9 +645,236 @@ int sddc_set_invite_data(sddc_t *sddc, const char *invite_data, size_t len);
  */
 int sddc_set_abort_data(sddc_t *sddc, const char *abort_data, size_t len);
 
+#if SDDC_CFG_STATS_EN > 0
+/**
+ * @brief Get engine and EdgerOS statistics.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[out] stats        Pointer to engine statistics
+ * @param[out] edgeros      Pointer to EdgerOS statistics array, NULL: engine only
+ * @param[in] max           The size of EdgerOS statistics array
+ *
+ * @return Error number
+ */
+int sddc_get_stats(sddc_t *sddc, sddc_stats_t *stats, sddc_edgeros_stats_t *edgeros, uint16_t max);
+#endif
+
+#if SDDC_CFG_TRACE_EN > 0
+/**
+ * @brief Dump the trace records taken since the last dump, and discard them.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[out] buf          Pointer to dump buffer, NULL: discard only
+ * @param[in] size          The size of dump buffer, the newest records are kept if it is short
+ *
+ * @return The length of dump, -1 on error
+ */
+ssize_t sddc_trace_dump(sddc_t *sddc, void *buf, size_t size);
+#endif
+
+#if SDDC_CFG_LZ_EN > 0
+/**
+ * @brief Compress data with the SDDC payload codec.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] data          Pointer to data
+ * @param[in] len           The length of data
+ * @param[out] output       Pointer to output buffer
+ * @param[in] size          The size of output buffer
+ *
+ * @return The length of compressed data, -1 if it does not fit in the output buffer
+ */
+ssize_t sddc_lz_compress(sddc_t *sddc, const void *data, size_t len, void *output, size_t size);
+
+/**
+ * @brief Decompress data of the SDDC payload codec.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] data          Pointer to compressed data
+ * @param[in] len           The length of compressed data
+ * @param[out] output       Pointer to output buffer
+ * @param[in] size          The size of output buffer
+ *
+ * @return The length of decompressed data, -1 if the data is corrupted or does not fit
+ */
+ssize_t sddc_lz_decompress(sddc_t *sddc, const void *data, size_t len, void *output, size_t size);
+#endif
+
+#if SDDC_CFG_CBOR_EN > 0
+/**
+ * @brief Init CBOR encoder.
+ *
+ * @param[out] writer       Pointer to CBOR encoder
+ * @param[in] buf           Pointer to output buffer
+ * @param[in] size          The size of output buffer
+ */
+void sddc_cbor_writer_init(sddc_cbor_writer_t *writer, void *buf, size_t size);
+
+/**
+ * @brief Get the length of CBOR data encoded.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ *
+ * @return The length of CBOR data, -1 if the output buffer overflowed
+ */
+ssize_t sddc_cbor_writer_len(const sddc_cbor_writer_t *writer);
+
+/**
+ * @brief Encode a map header, count key and value pairs follow.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] count         The number of pairs
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_map(sddc_cbor_writer_t *writer, size_t count);
+
+/**
+ * @brief Encode an array header, count items follow.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] count         The number of items
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_array(sddc_cbor_writer_t *writer, size_t count);
+
+/**
+ * @brief Encode a text string.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] str           Pointer to UTF8 string
+ * @param[in] len           The length of string
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_text(sddc_cbor_writer_t *writer, const char *str, size_t len);
+
+/**
+ * @brief Encode an integer.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] value         Integer
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_int(sddc_cbor_writer_t *writer, int64_t value);
+
+/**
+ * @brief Encode a boolean.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] value         Boolean
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_bool(sddc_cbor_writer_t *writer, sddc_bool_t value);
+
+/**
+ * @brief Encode null.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_null(sddc_cbor_writer_t *writer);
+
+/**
+ * @brief Encode a floating point number, as float if it has no loss.
+ *
+ * @param[in] writer        Pointer to CBOR encoder
+ * @param[in] value         Number
+ *
+ * @return Error number
+ */
+int sddc_cbor_put_double(sddc_cbor_writer_t *writer, double value);
+
+/**
+ * @brief Init CBOR decoder, it reads the data in place.
+ *
+ * @param[out] reader       Pointer to CBOR decoder
+ * @param[in] data          Pointer to CBOR data
+ * @param[in] len           The length of CBOR data
+ */
+void sddc_cbor_reader_init(sddc_cbor_reader_t *reader, const void *data, size_t len);
+
+/**
+ * @brief Decode the next item.
+ *
+ * @notice A string is not copied: item->str points into the CBOR data and is not
+ *         NUL terminated. For an array or map, the reader is left on its first item.
+ *
+ * @param[in] reader        Pointer to CBOR decoder
+ * @param[out] item         Pointer to item
+ *
+ * @return Error number, -1 at the end of the data or if it is malformed
+ */
+int sddc_cbor_read(sddc_cbor_reader_t *reader, sddc_cbor_item_t *item);
+
+/**
+ * @brief Skip the next item, with the items of an array or map.
+ *
+ * @param[in] reader        Pointer to CBOR decoder
+ *
+ * @return Error number
+ */
+int sddc_cbor_skip(sddc_cbor_reader_t *reader);
+
+/**
+ * @brief Find a text key in a map.
+ *
+ * @param[in] map           Pointer to CBOR decoder left on the first key by sddc_cbor_read
+ * @param[in] count         The number of pairs of the map
+ * @param[in] key           Key string
+ * @param[out] value        Pointer to the value item
+ * @param[out] inner        Pointer to CBOR decoder left after the value header (NULL: ignore),
+ *                          on its first item for an array or map
+ *
+ * @return Error number, -1 if the key is not found
+ */
+int sddc_cbor_map_find(const sddc_cbor_reader_t *map, size_t count, const char *key,
+                       sddc_cbor_item_t *value, sddc_cbor_reader_t *inner);
+
+/**
+ * @brief Check whether a text item is a string.
+ *
+ * @param[in] item          Pointer to item
+ * @param[in] str           Pointer to string
+ *
+ * @return SDDC_TRUE if the item is the text string
+ */
+sddc_bool_t sddc_cbor_text_is(const sddc_cbor_item_t *item, const char *str);
+
+/**
+ * @brief Convert CBOR data to JSON text, for EdgerOS which do not take CBOR or to log it.
+ *
+ * @param[in] data          Pointer to CBOR data
+ * @param[in] len           The length of CBOR data
+ * @param[out] output       Pointer to output buffer, NUL terminated (NULL: only get the length)
+ * @param[in] size          The size of output buffer
+ *
+ * @return The length of JSON text, -1 if the data is malformed or does not fit the output buffer
+ */
+ssize_t sddc_cbor_to_json(const void *data, size_t len, char *output, size_t size);
+
+/**
+ * @brief Whether the payload given to the running callback is CBOR.
+ *
+ * @notice Only valid in on_invite, on_update, on_message and on_timestamp. EdgerOS sends
+ *         CBOR only to devices which advertise it, else the payload is JSON.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return SDDC_TRUE if the payload is CBOR
+ */
+sddc_bool_t sddc_payload_is_cbor(sddc_t *sddc);
+#endif
+
 /**
  * @brief Destroy SDDC.
  *
+ * @notice Destroy the connectors of SDDC before, they give their cipher contexts back to it
+ *
  * @param[in] sddc          Pointer to SDDC
  *
  * @return Error number
@@ -448,18 +890,78 @@ int sddc_destroy(sddc_t *sddc);
  */
 sddc_t *sddc_create(uint16_t port);
 
+#if SDDC_CFG_SECURITY_EN > 0
+/**
+ * @brief Create SDDC with a crypto backend.
+ *
+ * @param[in] port          UDP port
+ * @param[in] crypto        Crypto backend of SDDC and its connectors, NULL: sddc_crypto_mbedtls
+ *
+ * @return Pointer to SDDC
+ */
+sddc_t *sddc_create_with_crypto(uint16_t port, const sddc_crypto_ops_t *crypto);
+#endif
+
 /**
  * @brief Run SDDC.
  *
+ * @notice Callbacks are called from this task without the SDDC lock held
+ *
  * @param[in] sddc          Pointer to SDDC
  *
  * @return Error number
  */
 int sddc_run(sddc_t *sddc);
 
+/**
+ * @brief Get the SDDC socket, for an application event loop in place of sddc_run.
+ *
+ * @notice The loop waits the socket readable for at most sddc_next_deadline_ms MS,
+ *         then calls sddc_process_readable if it is readable and sddc_process_timers.
+ *         Callbacks are called from the loop task
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Socket
+ */
+int sddc_get_fd(sddc_t *sddc);
+
+/**
+ * @brief Handle all the datagrams pending on the SDDC socket and the queued sends.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Number of datagrams handled, -1 on error
+ */
+int sddc_process_readable(sddc_t *sddc);
+
+/**
+ * @brief Handle expired timers (retransmission, EdgerOS alive, reassembly, REPORT) and the queued sends.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return Error number
+ */
+int sddc_process_timers(sddc_t *sddc);
+
+/**
+ * @brief Get MS until sddc_process_timers has work to do.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ *
+ * @return MS, 0: call sddc_process_timers now
+ */
+uint32_t sddc_next_deadline_ms(sddc_t *sddc);
+
 /**
  * @brief Send message request to a specified EdgerOS which connected.
  *
+ * @notice The message is queued and sent by sddc_run, a reliable message to an unknown
+ *         EdgerOS is reported by on_message_lost. Returns -1 if the send queue is full.
+ *         A message larger than a datagram is sent in fragments, up to
+ *         SDDC_CFG_FRAG_MAX * SDDC_CFG_FRAG_SIZE bytes.
+ *         The payload is compressed for EdgerOS which advertise compression support.
+ *
  * @param[in] sddc          Pointer to SDDC
  * @param[in] uid           Pointer to EdgerOS UID
  * @param[in] payload       Pointer to message payload data
@@ -478,6 +980,9 @@ int sddc_send_message(sddc_t *sddc, const uint8_t *uid,
 /**
  * @brief Broadcast message request to all EdgerOS which connected.
  *
+ * @notice seqno array gets one seq number per EdgerOS connected when called
+ *         A message larger than a datagram is sent in fragments, as sddc_send_message
+ *
  * @param[in] sddc          Pointer to SDDC
  * @param[in] payload       Pointer to message payload data
  * @param[in] payload_len   The length of payload data
@@ -492,6 +997,48 @@ int sddc_broadcast_message(sddc_t *sddc,
                            uint8_t retries, sddc_bool_t urgent,
                            uint16_t *seqno);
 
+#if SDDC_CFG_CBOR_EN > 0
+/**
+ * @brief Send CBOR message request to a specified EdgerOS which connected.
+ *
+ * @notice As sddc_send_message, the message is converted to JSON for EdgerOS which do not take CBOR.
+ *         Both forms must fit SDDC_CFG_FRAG_MAX fragments.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] uid           Pointer to EdgerOS UID
+ * @param[in] payload       Pointer to CBOR message
+ * @param[in] payload_len   The length of CBOR message
+ * @param[in] retries       The count of retry send
+ * @param[in] urgent        Does urgent request
+ * @param[out] seqno        Seq number
+ *
+ * @return Error number
+ */
+int sddc_send_cbor_message(sddc_t *sddc, const uint8_t *uid,
+                           const void *payload, size_t payload_len,
+                           uint8_t retries, sddc_bool_t urgent,
+                           uint16_t *seqno);
+
+/**
+ * @brief Broadcast CBOR message request to all EdgerOS which connected.
+ *
+ * @notice As sddc_broadcast_message, the message is converted to JSON for EdgerOS which do not take CBOR
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] payload       Pointer to CBOR message
+ * @param[in] payload_len   The length of CBOR message
+ * @param[in] retries       The count of retry send
+ * @param[in] urgent        Does urgent request
+ * @param[out] seqno        Seq number array
+ *
+ * @return Error number
+ */
+int sddc_broadcast_cbor_message(sddc_t *sddc,
+                                const void *payload, size_t payload_len,
+                                uint8_t retries, sddc_bool_t urgent,
+                                uint16_t *seqno);
+#endif
+
 /**
  * @brief Send update request to a specified EdgerOS which connected.
  *
@@ -568,6 +1115,8 @@ int sddc_connector_mode(sddc_connector_t *connector);
 /**
  * @brief Put data to SDDC connector.
  *
+ * @notice len is not limited, the data is encrypted and sent in chunks of SDDC_CFG_CONNECTOR_BLOCK_SIZE
+ *
  * @param[in] connector     Pointer to SDDC connector
  * @param[in] data          Pointer to data buffer
  * @param[in] len           The size of data buffer
@@ -577,6 +1126,22 @@ int sddc_connector_mode(sddc_connector_t *connector);
  */
 int sddc_connector_put(sddc_connector_t *connector, const void *data, size_t len, sddc_bool_t finish);
 
+struct iovec;
+
+/**
+ * @brief Put iovecs to SDDC connector.
+ *
+ * @notice Plain iovecs go by sendmsg, encrypted small iovecs share a chunk of ciphertext
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ * @param[in] iov           Pointer to iovec array
+ * @param[in] iovcnt        The number of iovecs
+ * @param[in] finish        Whether to end the transfer
+ *
+ * @return 0 if success, -1 if failure.
+ */
+int sddc_connector_putv(sddc_connector_t *connector, const struct iovec *iov, int iovcnt, sddc_bool_t finish);
+
 /**
  * @brief Get data from SDDC connector.
  *
@@ -588,6 +1153,80 @@ int sddc_connector_put(sddc_connector_t *connector, const void *data, size_t len
  */
 ssize_t sddc_connector_get(sddc_connector_t *connector, void **data, sddc_bool_t *finish);
 
+/**
+ * @brief Create a non-blocking SDDC connector in put mode.
+ *
+ * @notice The connect completes in the background, on_event gets SDDC_CONNECTOR_EV_CONNECTED
+ *         or SDDC_CONNECTOR_EV_ERROR from sddc_connector_process
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] uid           Pointer to EdgerOS UID
+ * @param[in] port          EdgerOS TCP server port
+ * @param[in] token         Pointer to token string
+ * @param[in] on_event      Event callback
+ * @param[in] arg           Event callback argument
+ *
+ * @return Pointer to SDDC connector.
+ */
+sddc_connector_t *sddc_connector_create_async(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token,
+                                              sddc_on_connector_t on_event, void *arg);
+
+/**
+ * @brief Write data to a non-blocking SDDC connector.
+ *
+ * @notice A write shorter than len is continued on SDDC_CONNECTOR_EV_WRITABLE,
+ *         finish applies when all of len is taken
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ * @param[in] data          Pointer to data buffer
+ * @param[in] len           The size of data buffer
+ * @param[in] finish        Whether to end the transfer
+ *
+ * @return The size of data taken (0 if the socket is full), -1 if failure.
+ */
+ssize_t sddc_connector_write(sddc_connector_t *connector, const void *data, size_t len, sddc_bool_t finish);
+
+/**
+ * @brief Whether a non-blocking SDDC connector waits its fd writable.
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ *
+ * @return SDDC_TRUE: call sddc_connector_process when the fd is writable
+ */
+sddc_bool_t sddc_connector_want_write(sddc_connector_t *connector);
+
+/**
+ * @brief Progress a non-blocking SDDC connector when its fd is writable.
+ *
+ * @notice Completes the connect, sends the data left by short writes and calls the event callback
+ *
+ * @param[in] connector     Pointer to SDDC connector
+ *
+ * @return Error number
+ */
+int sddc_connector_process(sddc_connector_t *connector);
+
+/**
+ * @brief Create a pooled SDDC connector in put mode.
+ *
+ * @notice Takes the idle connection to the same EdgerOS port and token if the pool keeps one.
+ *         The output is framed (4 byte big endian length, an empty frame ends the transfer),
+ *         so the EdgerOS server must read framed transfers. finish ends the transfer without
+ *         closing and sddc_connector_destroy keeps the connection in the pool, with TCP
+ *         keepalive, until it is idle for SDDC_CFG_CONNECTOR_IDLE.
+ *
+ * @param[in] sddc          Pointer to SDDC
+ * @param[in] uid           Pointer to EdgerOS UID
+ * @param[in] port          EdgerOS TCP server port
+ * @param[in] token         Pointer to token string
+ * @param[in] on_event      Event callback, NULL: blocking connector
+ * @param[in] arg           Event callback argument
+ *
+ * @return Pointer to SDDC connector.
+ */
+sddc_connector_t *sddc_connector_create_pooled(sddc_t *sddc, const uint8_t *uid, uint16_t port, const char *token,
+                                               sddc_on_connector_t on_event, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,26 +13,174 @@
 #ifndef SDDC_CONFIG_H
 #define SDDC_CONFIG_H
 
+#ifndef SDDC_CFG_PORT
 #define SDDC_CFG_PORT                   680U
+#endif
+#ifndef SDDC_CFG_RECV_BUF_SIZE
 #define SDDC_CFG_RECV_BUF_SIZE          1460U
+#endif
+#ifndef SDDC_CFG_SEND_BUF_SIZE
 #define SDDC_CFG_SEND_BUF_SIZE          1460U
+#endif
 
+#ifndef SDDC_CFG_NET_IMPL
 #define SDDC_CFG_NET_IMPL               "ms_esp_at_net"
+#endif
 
+#ifndef SDDC_CFG_MQUEUE_SIZE
 #define SDDC_CFG_MQUEUE_SIZE            6U
+#endif
+#ifndef SDDC_CFG_SEND_WINDOW
+#define SDDC_CFG_SEND_WINDOW            4U    /* Requests in flight per EdgerOS */
+#endif
+#ifndef SDDC_CFG_SEND_RING_SIZE
+#define SDDC_CFG_SEND_RING_SIZE         4U    /* Sends queued by application tasks, power of 2 */
+#endif
+#ifndef SDDC_CFG_REPLAY_WINDOW
+#define SDDC_CFG_REPLAY_WINDOW          64U   /* MESSAGE seq numbers, multiple of 32 */
+#endif
+#ifndef SDDC_CFG_REPLY_CACHE_SIZE
+#define SDDC_CFG_REPLY_CACHE_SIZE       4U    /* Acks kept per EdgerOS for retransmitted requests */
+#endif
+#ifndef SDDC_CFG_FRAG_MAX
+#define SDDC_CFG_FRAG_MAX               4U    /* Fragments per MESSAGE, 2 ~ 16 and <= MQUEUE_SIZE, 0: disabled */
+#endif
+#ifndef SDDC_CFG_FRAG_SIZE
+#define SDDC_CFG_FRAG_SIZE              1024U /* MESSAGE bytes per fragment, same on EdgerOS */
+#endif
+#ifndef SDDC_CFG_REASM_NUM
+#define SDDC_CFG_REASM_NUM              2U    /* Fragmented MESSAGE received at the same time, buffers allocated by sddc_create */
+#endif
+#ifndef SDDC_CFG_REASM_TIMEOUT
+#define SDDC_CFG_REASM_TIMEOUT          5000U /* MS */
+#endif
+#ifndef SDDC_CFG_LZ_EN
+#define SDDC_CFG_LZ_EN                  1U    /* Compress payloads for EdgerOS which take it */
+#endif
+#ifndef SDDC_CFG_LZ_MIN
+#define SDDC_CFG_LZ_MIN                 64U   /* Smallest payload compressed (bytes) */
+#endif
+#ifndef SDDC_CFG_CBOR_EN
+#define SDDC_CFG_CBOR_EN                1U    /* CBOR codec and CBOR messages for EdgerOS which take it */
+#endif
+#ifndef SDDC_CFG_DISCOVER_SLOTS
+#define SDDC_CFG_DISCOVER_SLOTS         4U    /* DISCOVER sources rate limited at the same time, 0: disabled */
+#endif
+#ifndef SDDC_CFG_DISCOVER_RATE
+#define SDDC_CFG_DISCOVER_RATE          1000U /* MS per REPORT token of a source */
+#endif
+#ifndef SDDC_CFG_DISCOVER_BURST
+#define SDDC_CFG_DISCOVER_BURST         2U    /* REPORT tokens of a source */
+#endif
+#ifndef SDDC_CFG_DISCOVER_JITTER
+#define SDDC_CFG_DISCOVER_JITTER        200U  /* MS, max random REPORT delay */
+#endif
+#ifndef SDDC_CFG_BATCH_IO_EN
+#define SDDC_CFG_BATCH_IO_EN            0U    /* recvmmsg/sendmmsg, Linux only */
+#endif
+#ifndef SDDC_CFG_BATCH_SIZE
+#define SDDC_CFG_BATCH_SIZE             16U   /* Datagrams per syscall */
+#endif
+#ifndef SDDC_CFG_RETRIES_INTERVAL
 #define SDDC_CFG_RETRIES_INTERVAL       500U  /* MS */
+#endif
+#ifndef SDDC_CFG_RTO_MIN
+#define SDDC_CFG_RTO_MIN                100U  /* MS */
+#endif
+#ifndef SDDC_CFG_RTO_MAX
+#define SDDC_CFG_RTO_MAX                4000U /* MS */
+#endif
+#ifndef SDDC_CFG_EDGEROS_ALIVE
 #define SDDC_CFG_EDGEROS_ALIVE          24U   /* RETRIES_INTERVAL */
+#endif
+#ifndef SDDC_CFG_CONNECTOR_TIMEOUT
 #define SDDC_CFG_CONNECTOR_TIMEOUT      5000U /* MS */
+#endif
+#ifndef SDDC_CFG_CONNECTOR_BLOCK_SIZE
+#define SDDC_CFG_CONNECTOR_BLOCK_SIZE   4096U /* Bytes encrypted and sent at once by a connector */
+#endif
+#ifndef SDDC_CFG_CONNECTOR_POOL_SIZE
+#define SDDC_CFG_CONNECTOR_POOL_SIZE    2U    /* Idle pooled connectors kept, 0: close after the transfer */
+#endif
+#ifndef SDDC_CFG_CONNECTOR_IDLE
+#define SDDC_CFG_CONNECTOR_IDLE         30000U /* MS */
+#endif
+#ifndef SDDC_CFG_CONNECTOR_KEEPALIVE
+#define SDDC_CFG_CONNECTOR_KEEPALIVE    10U   /* S, TCP keepalive idle and interval of pooled connectors */
+#endif
 
+#ifndef SDDC_CFG_DBG_EN
 #define SDDC_CFG_DBG_EN                 1U
+#endif
+#ifndef SDDC_CFG_WARN_EN
 #define SDDC_CFG_WARN_EN                1U
+#endif
+#ifndef SDDC_CFG_ERR_EN
 #define SDDC_CFG_ERR_EN                 1U
+#endif
+#ifndef SDDC_CFG_CRIT_EN
 #define SDDC_CFG_CRIT_EN                1U
+#endif
+#ifndef SDDC_CFG_INFO_EN
 #define SDDC_CFG_INFO_EN                1U
+#endif
 
+#ifndef SDDC_CFG_SECURITY_EN
 #define SDDC_CFG_SECURITY_EN            1U
+#endif
+#ifndef SDDC_CFG_GCM_EN
+#define SDDC_CFG_GCM_EN                 1U    /* AES-GCM with per-packet nonce for EdgerOS which take it */
+#endif
+#ifndef SDDC_CFG_GCM_TAG_LEN
+#define SDDC_CFG_GCM_TAG_LEN            8U    /* Authentication tag (bytes), 4 - 12 */
+#endif
+#ifndef SDDC_CFG_KEY_CACHE_SIZE
+#define SDDC_CFG_KEY_CACHE_SIZE         4U    /* Tokens whose keys and cipher contexts are kept, 0: derive each time */
+#endif
 
+#ifndef SDDC_CFG_STATS_EN
+#define SDDC_CFG_STATS_EN               0U    /* Packet, retransmit, RTT, lock and callback counters (sddc_get_stats) */
+#endif
+#ifndef SDDC_CFG_TRACE_EN
+#define SDDC_CFG_TRACE_EN               0U    /* Receive pipeline trace points (sddc_trace_dump) */
+#endif
+#ifndef SDDC_CFG_TRACE_SIZE
+#define SDDC_CFG_TRACE_SIZE             1024U /* Trace records kept, power of 2 */
+#endif
+
+#ifndef SDDC_CFG_MULTI_EDGEROS_JOIN_EN
 #define SDDC_CFG_MULTI_EDGEROS_JOIN_EN  0U
+#endif
+
+#ifndef SDDC_CFG_EDGEROS_MAX
+#define SDDC_CFG_EDGEROS_MAX            4U
+#endif
+#ifndef SDDC_CFG_EDGEROS_HASH_SIZE
+#define SDDC_CFG_EDGEROS_HASH_SIZE      8U    /* Power of 2, > EDGEROS_MAX */
+#endif
+#ifndef SDDC_CFG_EDGEROS_ADDR_INDEX_EN
+#define SDDC_CFG_EDGEROS_ADDR_INDEX_EN  0U
+#endif
+
+#ifndef SDDC_CFG_MPOOL_NUM
+#if SDDC_CFG_MULTI_EDGEROS_JOIN_EN > 0
+#define SDDC_CFG_MPOOL_NUM              (SDDC_CFG_MQUEUE_SIZE * SDDC_CFG_EDGEROS_MAX) /* Small and medium class */
+#else
+#define SDDC_CFG_MPOOL_NUM              SDDC_CFG_MQUEUE_SIZE
+#endif
+#endif
+#ifndef SDDC_CFG_MPOOL_SMALL_SIZE
+#define SDDC_CFG_MPOOL_SMALL_SIZE       128U  /* Packet bytes */
+#endif
+#ifndef SDDC_CFG_MPOOL_MEDIUM_SIZE
+#define SDDC_CFG_MPOOL_MEDIUM_SIZE      512U  /* Packet bytes */
+#endif
+#ifndef SDDC_CFG_MPOOL_LARGE_NUM
+#define SDDC_CFG_MPOOL_LARGE_NUM        SDDC_CFG_MQUEUE_SIZE /* Full size messages and fragments */
+#endif
+#ifndef SDDC_CFG_MPOOL_HEAP_EN
+#define SDDC_CFG_MPOOL_HEAP_EN          0U    /* Fall back to heap when the class is exhausted */
+#endif
 
 /* Define __FREERTOS__ if use FreeRTOS */
 #define __FREERTOS__
@@ -35,17 +35,49 @@ static const char *TAG = "sddc_example";
 
 #define GPIO_INPUT_IO_SMARTCOFNIG     12 
 
-#define ESP_KEY_TASK_STACK_SIZE       4096
-#define ESP_KEY_TASK_PRIO             25
+#define ESP_KEY_POLL_MS               50
+
+#define ESP_SMART_CONFIG_TASK_STACK_SIZE  4096
+#define ESP_SMART_CONFIG_TASK_PRIO        5
 
 #define ESP_SDDC_TASK_STACK_SIZE      4096
 #define ESP_SDDC_TASK_PRIO            10
 
+#if SDDC_CFG_CBOR_EN > 0
+/*
+ * Check and print CBOR data
+ */
+static sddc_bool_t esp_cbor_print(const char *tag, const char *data, size_t len)
+{
+    sddc_cbor_reader_t reader;
+    char str[256];
+
+    sddc_cbor_reader_init(&reader, data, len);
+    sddc_return_value_if_fail(sddc_cbor_skip(&reader) == 0, SDDC_FALSE);
+
+    if (sddc_cbor_to_json(data, len, str, sizeof(str)) >= 0) {
+        sddc_printf("%s: %s\n", tag, str);
+    }
+
+    return SDDC_TRUE;
+}
+#endif
+
 /*
  * Handle MESSAGE
  */
 static sddc_bool_t esp_on_message(sddc_t *sddc, const uint8_t *uid, const char *message, size_t len)
 {
+#if SDDC_CFG_CBOR_EN > 0
+    if (sddc_payload_is_cbor(sddc)) {
+        /*
+         * Parse here, see sddc_cbor_read
+         */
+        esp_cbor_print("esp_on_message", message, len);
+        return SDDC_TRUE;
+    }
+#endif
+
     cJSON *root = cJSON_Parse(message);
     sddc_return_value_if_fail(root, SDDC_TRUE);
 
@@ -91,9 +123,16 @@ static void esp_on_edgeros_lost(sddc_t *sddc, const uint8_t *uid)
  */
 static sddc_bool_t esp_on_update(sddc_t *sddc, const uint8_t *uid, const char *udpate_data, size_t len)
 {
-    cJSON *root = cJSON_Parse(udpate_data);
+    cJSON *root;
     char *str;
 
+#if SDDC_CFG_CBOR_EN > 0
+    if (sddc_payload_is_cbor(sddc)) {
+        return esp_cbor_print("esp_on_update", udpate_data, len);
+    }
+#endif
+
+    root = cJSON_Parse(udpate_data);
     sddc_return_value_if_fail(root, SDDC_FALSE);
 
     /*
@@ -121,9 +160,16 @@ error:
  */
 static sddc_bool_t esp_on_invite(sddc_t *sddc, const uint8_t *uid, const char *invite_data, size_t len)
 {
-    cJSON *root = cJSON_Parse(invite_data);
+    cJSON *root;
     char *str;
 
+#if SDDC_CFG_CBOR_EN > 0
+    if (sddc_payload_is_cbor(sddc)) {
+        return esp_cbor_print("esp_on_invite", invite_data, len);
+    }
+#endif
+
+    root = cJSON_Parse(invite_data);
     sddc_return_value_if_fail(root, SDDC_FALSE);
 
     /*
@@ -244,32 +290,46 @@ static char *esp_invite_data_create(void)
     return str;
 }
 
+static volatile sddc_bool_t smart_config_running;
+
 /*
- * key task
+ * SmartConfig task, example_smart_config() waits until ESPTouch is done
  */
-static void esp_key_task(void *arg)
+static void esp_smart_config_task(void *arg)
 {
-    sddc_t *sddc = arg;
-    int i = 0;
+    example_smart_config();
 
-    (void)sddc;
+    smart_config_running = SDDC_FALSE;
 
-    while (1) {
-        vTaskDelay(50 / portTICK_RATE_MS);
+    vTaskDelete(NULL);
+}
+
+/*
+ * Poll key every ESP_KEY_POLL_MS, SmartConfig runs in its own task to keep the SDDC loop going
+ */
+static void esp_key_poll(sddc_t *sddc)
+{
+    static int i = 0;
+
+    (void)sddc;
 
-        if (!gpio_get_level(GPIO_INPUT_IO_SMARTCOFNIG)) {
-            i++;
-            if (i > (3 * 20)) {
-                i = 0;
+    if (!gpio_get_level(GPIO_INPUT_IO_SMARTCOFNIG)) {
+        i++;
+        if (i > (3 * 1000 / ESP_KEY_POLL_MS)) {
+            i = 0;
+            if (!smart_config_running) {
                 sddc_printf("Start SmartConfig....\n");
-                example_smart_config();
+                smart_config_running = SDDC_TRUE;
+                if (xTaskCreate(esp_smart_config_task, "smart_config", ESP_SMART_CONFIG_TASK_STACK_SIZE,
+                                NULL, ESP_SMART_CONFIG_TASK_PRIO, NULL) != pdPASS) {
+                    sddc_printf("Failed to start SmartConfig!\n");
+                    smart_config_running = SDDC_FALSE;
+                }
             }
-        } else {
-            i = 0;
         }
+    } else {
+        i = 0;
     }
-
-    vTaskDelete(NULL);
 }
 
 /*
@@ -282,6 +342,8 @@ static void esp_sddc_task(void *arg)
     uint8_t mac[6];
     char ip[sizeof("255.255.255.255")];
     tcpip_adapter_ip_info_t ip_info = { 0 };
+    TickType_t key_time;
+    int fd;
 
     /*
      * Set call backs
@@ -333,14 +395,31 @@ static void esp_sddc_task(void *arg)
     sddc_printf("IP addr: %s\n", ip);
 
     /*
-     * SDDC run
+     * SDDC and key share this task
      */
+    sddc_printf("SDDC running...\n");
+
+    fd = sddc_get_fd(sddc);
+    key_time = xTaskGetTickCount();
+
     while (1) {
-        sddc_printf("SDDC running...\n");
+        uint32_t timeout = MIN(sddc_next_deadline_ms(sddc), ESP_KEY_POLL_MS);
+        struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+        fd_set rfds;
+
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
 
-        sddc_run(sddc);
+        if (select(fd + 1, &rfds, NULL, NULL, &tv) > 0) {
+            sddc_process_readable(sddc);
+        }
 
-        sddc_printf("SDDC quit!\n");
+        sddc_process_timers(sddc);
+
+        if ((xTaskGetTickCount() - key_time) >= (ESP_KEY_POLL_MS / portTICK_RATE_MS)) {
+            key_time = xTaskGetTickCount();
+            esp_key_poll(sddc);
+        }
     }
 
     /*
@@ -389,5 +468,4 @@ void app_main(void)
     sddc_t *sddc = sddc_create(SDDC_CFG_PORT);
 
     xTaskCreate(esp_sddc_task, "sddc_task", ESP_SDDC_TASK_STACK_SIZE, sddc, ESP_SDDC_TASK_PRIO, NULL);
-    xTaskCreate(esp_key_task, "key_task", ESP_KEY_TASK_STACK_SIZE, sddc, ESP_KEY_TASK_PRIO, NULL);
 }
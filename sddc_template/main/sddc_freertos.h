@@ -17,6 +17,10 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#define SDDC_HAVE_SENDMSG   1   /* lwip_sendmsg builds the UDP pbuf from the iovecs */
 
 #define sddc_printf     printf
 
@@ -28,6 +32,45 @@ static inline void sddc_sleep(int sec)
     vTaskDelay(sec * configTICK_RATE_HZ);
 }
 
+static inline uint32_t sddc_time_ms(void)
+{
+    return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+static inline uint32_t sddc_time_us(void)
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+static inline uint32_t sddc_trace_clock(void)
+{
+#ifdef __XTENSA__
+    uint32_t ccount;
+
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(ccount));  /* Cycle counter of this core */
+
+    return ccount;
+#else
+    return (uint32_t)esp_timer_get_time();
+#endif
+}
+
+static inline uint32_t sddc_trace_clock_khz(void)
+{
+#ifdef __XTENSA__
+    return CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ * 1000U;
+#else
+    return 1000U;
+#endif
+}
+
+#define SDDC_RANDOM_ENTROPY     1   /* Hardware RNG, Wi-Fi is on */
+
+static inline uint32_t sddc_random(void)
+{
+    return esp_random();    /* Hardware RNG */
+}
+
 typedef SemaphoreHandle_t   sddc_mutex_t;
 
 static inline int sddc_mutex_create(sddc_mutex_t *mutex)
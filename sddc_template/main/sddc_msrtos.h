@@ -14,6 +14,7 @@
 #define SDDC_MSRTOS_H
 
 #include <ms_rtos.h>
+#include <stdlib.h>
 
 #define sddc_printf     ms_printf
 
@@ -22,6 +23,33 @@
 
 #define sddc_sleep      ms_thread_sleep_s
 
+static inline uint32_t sddc_time_ms(void)
+{
+    return (uint32_t)ms_time_get_ms();
+}
+
+static inline uint32_t sddc_time_us(void)
+{
+    return (uint32_t)ms_time_get_ms() * 1000U;   /* Tick resolution */
+}
+
+static inline uint32_t sddc_trace_clock(void)
+{
+    return (uint32_t)ms_time_get_ms();
+}
+
+static inline uint32_t sddc_trace_clock_khz(void)
+{
+    return 1U;      /* Tick resolution */
+}
+
+#define SDDC_RANDOM_ENTROPY     0   /* rand() is not seeded: no AES-GCM, its nonces would repeat after a reboot */
+
+static inline uint32_t sddc_random(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ (uint32_t)ms_time_get_ms();
+}
+
 typedef ms_handle_t     sddc_mutex_t;
 
 static inline int sddc_mutex_create(sddc_mutex_t *mutex)
@@ -16,6 +16,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#define SDDC_HAVE_SENDMSG   1   /* Scatter-gather send on the socket */
 
 #define sddc_printf     printf
 
@@ -24,6 +28,60 @@
 
 #define sddc_sleep      sleep
 
+static inline uint32_t sddc_time_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)(ts.tv_sec * 1000U + ts.tv_nsec / 1000000U);
+}
+
+static inline uint32_t sddc_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)(ts.tv_sec * 1000000U + ts.tv_nsec / 1000U);
+}
+
+static inline uint32_t sddc_trace_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)(ts.tv_sec * 1000000000U + ts.tv_nsec);
+}
+
+static inline uint32_t sddc_trace_clock_khz(void)
+{
+    return 1000000U;    /* Nanoseconds */
+}
+
+#define SDDC_RANDOM_ENTROPY     1   /* /dev/urandom */
+
+static inline uint32_t sddc_random(void)
+{
+    struct timespec ts;
+    uint32_t value;
+    FILE *fp = fopen("/dev/urandom", "rb");
+
+    if (fp != NULL) {
+        size_t n = fread(&value, sizeof(value), 1, fp);
+
+        fclose(fp);
+        if (n == 1) {
+            return value;
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint32_t)(ts.tv_sec ^ (ts.tv_nsec << 12));
+}
+
 typedef pthread_mutex_t sddc_mutex_t;
 
 static inline int sddc_mutex_create(sddc_mutex_t *mutex)